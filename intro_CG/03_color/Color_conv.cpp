@@ -0,0 +1,811 @@
+#include "Color_conv.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define COLOR_CONV_X86
+#include <immintrin.h>
+#endif
+
+using namespace PPM_lib;
+
+using pixel_t = RGB_Image::value_type;
+using gray_t = GS_Image::value_type;
+
+// kernels: one column of the image (n pixels) into the channels and back
+using To3_fn = void (*)(const pixel_t*, gray_t*, gray_t*, gray_t*,
+        const std::size_t);
+using From3_fn = void (*)(const gray_t*, const gray_t*, const gray_t*,
+        pixel_t*, const std::size_t);
+using To4_fn = void (*)(const pixel_t*, gray_t*, gray_t*, gray_t*, gray_t*,
+        const std::size_t);
+using From4_fn = void (*)(const gray_t*, const gray_t*, const gray_t*,
+        const gray_t*, pixel_t*, const std::size_t);
+
+/*
+ * ------------------ Conversion path selection ------------------
+ */
+static Conv_path current_path {best_conv_path()};
+
+const char *PPM_lib::conv_path_name(const Conv_path p) {
+    switch (p) {
+        case Conv_path::scalar: return "scalar";
+        case Conv_path::sse2: return "sse2";
+        case Conv_path::avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool PPM_lib::conv_path_supported(const Conv_path p) {
+    switch (p) {
+        case Conv_path::scalar:
+            return true;
+#ifdef COLOR_CONV_X86
+        case Conv_path::sse2:
+            __builtin_cpu_init(); // may be called before the constructors
+            return __builtin_cpu_supports("sse2");
+        case Conv_path::avx2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#else
+        default:
+            return false;
+#endif
+    }
+    return false;
+}
+
+Conv_path PPM_lib::best_conv_path() {
+    for (const auto p: {Conv_path::avx2, Conv_path::sse2})
+        if (conv_path_supported(p))
+            return p;
+    return Conv_path::scalar;
+}
+
+Conv_path PPM_lib::conv_path() {
+    return current_path;
+}
+
+// unsupported paths fall back to the scalar kernels
+void PPM_lib::set_conv_path(const Conv_path p) {
+    current_path = conv_path_supported(p) ? p : Conv_path::scalar;
+}
+
+/*
+ * ------------------ Scalar kernels (the reference) ------------------
+ */
+// YCbCr weights: 15 fraction bits forward (each row sums to 1 or 0, so that
+// white stays white and gray has no chroma), 14 backward
+static constexpr int y_r {9798}, y_g {19235}, y_b {3735};
+static constexpr int cb_r {-5529}, cb_g {-10855}, cb_b {16384};
+static constexpr int cr_r {16384}, cr_g {-13720}, cr_b {-2664};
+static constexpr int fwd_round {1 << 14}, chroma_off {128 << 15};
+static constexpr int r_cr {22970}, g_cb {-5638}, g_cr {-11700}, b_cb {29032};
+static constexpr int inv_round {1 << 13};
+// hue: a sixth of the circle in 256 / 6 steps
+static constexpr float hue_scale {256.0f / 6};
+static constexpr float hue_step {6.0f / 256};
+
+static inline int clamp8(const int v) {
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline pixel_t rgb_pixel(const int r, const int g, const int b) {
+    return pixel_t(r) << 16 | pixel_t(g) << 8 | pixel_t(b);
+}
+
+static void rgb2ycbcr_scalar(const pixel_t *p, gray_t *Y, gray_t *Cb,
+        gray_t *Cr, const std::size_t n) {
+    for (std::size_t i {0}; i < n; ++i) {
+        const int r = p[i] >> 16 & 0xFF, g = p[i] >> 8 & 0xFF, b = p[i] & 0xFF;
+        Y[i] = clamp8((y_r * r + y_g * g + y_b * b + fwd_round) >> 15);
+        Cb[i] = clamp8((cb_r * r + cb_g * g + cb_b * b + chroma_off +
+                    fwd_round) >> 15);
+        Cr[i] = clamp8((cr_r * r + cr_g * g + cr_b * b + chroma_off +
+                    fwd_round) >> 15);
+    }
+}
+
+static void ycbcr2rgb_scalar(const gray_t *Y, const gray_t *Cb,
+        const gray_t *Cr, pixel_t *p, const std::size_t n) {
+    for (std::size_t i {0}; i < n; ++i) {
+        const int y {(Y[i] << 14) + inv_round};
+        const int cb {Cb[i] - 128}, cr {Cr[i] - 128};
+        p[i] = rgb_pixel(clamp8((y + r_cr * cr) >> 14),
+                clamp8((y + g_cb * cb + g_cr * cr) >> 14),
+                clamp8((y + b_cb * cb) >> 14));
+    }
+}
+
+static void rgb2hsv_scalar(const pixel_t *p, gray_t *H, gray_t *S, gray_t *V,
+        const std::size_t n) {
+    for (std::size_t i {0}; i < n; ++i) {
+        const int r = p[i] >> 16 & 0xFF, g = p[i] >> 8 & 0xFF, b = p[i] & 0xFF;
+        const int c_max {std::max({r, g, b})};
+        const int delta {c_max - std::min({r, g, b})};
+        int num {r - g}, base {4}; // between magenta and cyan
+        if (r == c_max) {
+            num = g - b; // between yellow and magenta
+            base = 0;
+        } else if (g == c_max) {
+            num = b - r; // between cyan and yellow
+            base = 2;
+        }
+        const float h6 {float(base) + float(num) / float(std::max(delta, 1))};
+        H[i] = int(h6 * hue_scale + 256.5f) & 0xFF;
+        S[i] = int(float(delta) * 255.0f / float(std::max(c_max, 1)) + 0.5f);
+        V[i] = c_max;
+    }
+}
+
+static void hsv2rgb_scalar(const gray_t *H, const gray_t *S, const gray_t *V,
+        pixel_t *p, const std::size_t n) {
+    for (std::size_t i {0}; i < n; ++i) {
+        const float h6 {float(H[i]) * hue_step};
+        const int sextant {int(h6)};
+        const float frac {h6 - float(sextant)};
+        const float s {float(S[i]) / 255.0f}, v {float(V[i])};
+        const float c1 {v * (1 - s)};
+        const float c2 {v * (1 - s * frac)};
+        const float c3 {v * (1 - s * (1 - frac))};
+        float r {v}, g {c1}, b {c2};
+        switch (sextant) {
+            case 0: r = v; g = c3; b = c1; break;
+            case 1: r = c2; g = v; b = c1; break;
+            case 2: r = c1; g = v; b = c3; break;
+            case 3: r = c1; g = c2; b = v; break;
+            case 4: r = c3; g = c1; b = v; break;
+            default: break;
+        }
+        p[i] = rgb_pixel(int(r + 0.5f), int(g + 0.5f), int(b + 0.5f));
+    }
+}
+
+static void rgb2cmyk_scalar(const pixel_t *p, gray_t *C, gray_t *M, gray_t *Y,
+        gray_t *K, const std::size_t n) {
+    for (std::size_t i {0}; i < n; ++i) {
+        const int r = p[i] >> 16 & 0xFF, g = p[i] >> 8 & 0xFF, b = p[i] & 0xFF;
+        const int c_max {std::max({r, g, b})}; // 1 - k
+        const float k {float(std::max(c_max, 1))};
+        C[i] = int(float(c_max - r) * 255.0f / k + 0.5f);
+        M[i] = int(float(c_max - g) * 255.0f / k + 0.5f);
+        Y[i] = int(float(c_max - b) * 255.0f / k + 0.5f);
+        K[i] = 255 - c_max;
+    }
+}
+
+// (255 - c) * (255 - k) / 255 rounded, the division done exactly by shifts
+// (valid up to 65535)
+static inline int cmyk_channel(const int c, const int k) {
+    const int x {(255 - c) * (255 - k) + 127};
+    return (x + 1 + (x >> 8)) >> 8;
+}
+
+static void cmyk2rgb_scalar(const gray_t *C, const gray_t *M, const gray_t *Y,
+        const gray_t *K, pixel_t *p, const std::size_t n) {
+    for (std::size_t i {0}; i < n; ++i)
+        p[i] = rgb_pixel(cmyk_channel(C[i], K[i]), cmyk_channel(M[i], K[i]),
+                cmyk_channel(Y[i], K[i]));
+}
+
+/*
+ * ------------------ SSE2 / AVX2 kernels ------------------
+ *      the values are kept in 32-bit lanes; the madd pairs hold two 16-bit
+ *      values (or weights) in a lane: the low one and the high one
+ */
+#ifdef COLOR_CONV_X86
+static inline int pair16(const int lo, const int hi) {
+    return int(uint32_t(uint16_t(lo)) | uint32_t(uint16_t(hi)) << 16);
+}
+
+// the bytes 0..3 in the 32-bit lanes
+__attribute__((target("sse2")))
+static inline __m128i widen4_sse2(const __m128i v) {
+    const __m128i z {_mm_setzero_si128()};
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, z), z);
+}
+
+__attribute__((target("sse2")))
+static inline __m128i load4_sse2(const gray_t *a) {
+    int v;
+    std::memcpy(&v, a, 4);
+    return widen4_sse2(_mm_cvtsi32_si128(v));
+}
+
+// the lanes saturated to 0..255
+__attribute__((target("sse2")))
+static inline void store4_sse2(gray_t *a, const __m128i v) {
+    const __m128i w {_mm_packs_epi32(v, v)};
+    const int b {_mm_cvtsi128_si32(_mm_packus_epi16(w, w))};
+    std::memcpy(a, &b, 4);
+}
+
+// the pixels of the r, g, b lanes saturated to 0..255
+__attribute__((target("sse2")))
+static inline __m128i pack_rgb_sse2(const __m128i r, const __m128i g,
+        const __m128i b) {
+    // r0..r3 g0..g3 b0..b3 b0..b3
+    const __m128i v {_mm_packus_epi16(_mm_packs_epi32(r, g),
+            _mm_packs_epi32(b, b))};
+    return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(widen4_sse2(v), 16),
+                _mm_slli_epi32(widen4_sse2(_mm_srli_si128(v, 4)), 8)),
+            widen4_sse2(_mm_srli_si128(v, 8)));
+}
+
+__attribute__((target("sse2")))
+static inline __m128 select_sse2(const __m128 m, const __m128 a,
+        const __m128 b) {
+    return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b));
+}
+
+__attribute__((target("sse2")))
+static void rgb2ycbcr_sse2(const pixel_t *p, gray_t *Y, gray_t *Cb, gray_t *Cr,
+        const std::size_t n) {
+    const __m128i rb8 {_mm_set1_epi32(0x00FF00FF)}, ff {_mm_set1_epi32(0xFF)};
+    const __m128i wy {_mm_set1_epi32(pair16(y_b, y_r))};
+    const __m128i wcb {_mm_set1_epi32(pair16(cb_b, cb_r))};
+    const __m128i wcr {_mm_set1_epi32(pair16(cr_b, cr_r))};
+    const __m128i gy {_mm_set1_epi32(pair16(y_g, 0))};
+    const __m128i gcb {_mm_set1_epi32(pair16(cb_g, 0))};
+    const __m128i gcr {_mm_set1_epi32(pair16(cr_g, 0))};
+    const __m128i off_y {_mm_set1_epi32(fwd_round)};
+    const __m128i off_c {_mm_set1_epi32(chroma_off + fwd_round)};
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v {_mm_loadu_si128((const __m128i*)(p + i))};
+        const __m128i rb {_mm_and_si128(v, rb8)}; // b, r
+        const __m128i g {_mm_and_si128(_mm_srli_epi32(v, 8), ff)}; // g, 0
+        store4_sse2(Y + i, _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(
+                            _mm_madd_epi16(rb, wy), _mm_madd_epi16(g, gy)),
+                        off_y), 15));
+        store4_sse2(Cb + i, _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(
+                            _mm_madd_epi16(rb, wcb), _mm_madd_epi16(g, gcb)),
+                        off_c), 15));
+        store4_sse2(Cr + i, _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(
+                            _mm_madd_epi16(rb, wcr), _mm_madd_epi16(g, gcr)),
+                        off_c), 15));
+    }
+    rgb2ycbcr_scalar(p + i, Y + i, Cb + i, Cr + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void ycbcr2rgb_sse2(const gray_t *Y, const gray_t *Cb, const gray_t *Cr,
+        pixel_t *p, const std::size_t n) {
+    const __m128i z {_mm_setzero_si128()}, c128 {_mm_set1_epi16(128)};
+    const __m128i wr {_mm_set1_epi32(pair16(0, r_cr))};
+    const __m128i wg {_mm_set1_epi32(pair16(g_cb, g_cr))};
+    const __m128i wb {_mm_set1_epi32(pair16(b_cb, 0))};
+    const __m128i rnd {_mm_set1_epi32(inv_round)};
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4) {
+        int cb, cr;
+        std::memcpy(&cb, Cb + i, 4);
+        std::memcpy(&cr, Cr + i, 4);
+        // cb - 128, cr - 128 pairs
+        const __m128i c {_mm_unpacklo_epi16(
+                _mm_sub_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(cb), z),
+                    c128),
+                _mm_sub_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(cr), z),
+                    c128))};
+        const __m128i y {_mm_add_epi32(_mm_slli_epi32(load4_sse2(Y + i), 14),
+                rnd)};
+        _mm_storeu_si128((__m128i*)(p + i), pack_rgb_sse2(
+                    _mm_srai_epi32(_mm_add_epi32(y, _mm_madd_epi16(c, wr)), 14),
+                    _mm_srai_epi32(_mm_add_epi32(y, _mm_madd_epi16(c, wg)), 14),
+                    _mm_srai_epi32(_mm_add_epi32(y, _mm_madd_epi16(c, wb)),
+                        14)));
+    }
+    ycbcr2rgb_scalar(Y + i, Cb + i, Cr + i, p + i, n - i);
+}
+
+// the components are below 256: the 16-bit max / min of the low halves work
+// for the 32-bit lanes
+__attribute__((target("sse2")))
+static void rgb2hsv_sse2(const pixel_t *p, gray_t *H, gray_t *S, gray_t *V,
+        const std::size_t n) {
+    const __m128i ff {_mm_set1_epi32(0xFF)}, one {_mm_set1_epi32(1)};
+    const __m128i two {_mm_set1_epi32(2)}, four {_mm_set1_epi32(4)};
+    const __m128 scale {_mm_set1_ps(hue_scale)}, wrap {_mm_set1_ps(256.5f)};
+    const __m128 f255 {_mm_set1_ps(255.0f)}, half {_mm_set1_ps(0.5f)};
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v {_mm_loadu_si128((const __m128i*)(p + i))};
+        const __m128i r {_mm_and_si128(_mm_srli_epi32(v, 16), ff)};
+        const __m128i g {_mm_and_si128(_mm_srli_epi32(v, 8), ff)};
+        const __m128i b {_mm_and_si128(v, ff)};
+        const __m128i c_max {_mm_max_epi16(_mm_max_epi16(r, g), b)};
+        const __m128i delta {_mm_sub_epi32(c_max,
+                _mm_min_epi16(_mm_min_epi16(r, g), b))};
+        const __m128i mr {_mm_cmpeq_epi32(r, c_max)};
+        const __m128i mg {_mm_andnot_si128(mr, _mm_cmpeq_epi32(g, c_max))};
+        const __m128i mb {_mm_andnot_si128(_mm_or_si128(mr, mg),
+                _mm_cmpeq_epi32(r, r))};
+        const __m128i num {_mm_or_si128(_mm_or_si128(
+                    _mm_and_si128(mr, _mm_sub_epi32(g, b)),
+                    _mm_and_si128(mg, _mm_sub_epi32(b, r))),
+                _mm_and_si128(mb, _mm_sub_epi32(r, g)))};
+        const __m128i base {_mm_or_si128(_mm_and_si128(mg, two),
+                _mm_and_si128(mb, four))};
+        const __m128 h6 {_mm_add_ps(_mm_cvtepi32_ps(base),
+                _mm_div_ps(_mm_cvtepi32_ps(num),
+                    _mm_cvtepi32_ps(_mm_max_epi16(delta, one))))};
+        store4_sse2(H + i, _mm_and_si128(_mm_cvttps_epi32(_mm_add_ps(
+                            _mm_mul_ps(h6, scale), wrap)), ff));
+        store4_sse2(S + i, _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(
+                            _mm_mul_ps(_mm_cvtepi32_ps(delta), f255),
+                            _mm_cvtepi32_ps(_mm_max_epi16(c_max, one))),
+                        half)));
+        store4_sse2(V + i, c_max);
+    }
+    rgb2hsv_scalar(p + i, H + i, S + i, V + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void hsv2rgb_sse2(const gray_t *H, const gray_t *S, const gray_t *V,
+        pixel_t *p, const std::size_t n) {
+    const __m128 step {_mm_set1_ps(hue_step)}, f255 {_mm_set1_ps(255.0f)};
+    const __m128 one {_mm_set1_ps(1.0f)}, half {_mm_set1_ps(0.5f)};
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4) {
+        const __m128 h6 {_mm_mul_ps(_mm_cvtepi32_ps(load4_sse2(H + i)), step)};
+        const __m128i sextant {_mm_cvttps_epi32(h6)};
+        const __m128 frac {_mm_sub_ps(h6, _mm_cvtepi32_ps(sextant))};
+        const __m128 s {_mm_div_ps(_mm_cvtepi32_ps(load4_sse2(S + i)), f255)};
+        const __m128 v {_mm_cvtepi32_ps(load4_sse2(V + i))};
+        const __m128 c1 {_mm_mul_ps(v, _mm_sub_ps(one, s))};
+        const __m128 c2 {_mm_mul_ps(v, _mm_sub_ps(one, _mm_mul_ps(s, frac)))};
+        const __m128 c3 {_mm_mul_ps(v, _mm_sub_ps(one, _mm_mul_ps(s,
+                            _mm_sub_ps(one, frac))))};
+        __m128 m[6];
+        for (int k {0}; k < 6; ++k)
+            m[k] = _mm_castsi128_ps(_mm_cmpeq_epi32(sextant,
+                        _mm_set1_epi32(k)));
+        const __m128 r {select_sse2(_mm_or_ps(m[0], m[5]), v,
+                select_sse2(m[1], c2, select_sse2(m[4], c3, c1)))};
+        const __m128 g {select_sse2(_mm_or_ps(m[1], m[2]), v,
+                select_sse2(m[0], c3, select_sse2(m[3], c2, c1)))};
+        const __m128 b {select_sse2(_mm_or_ps(m[3], m[4]), v,
+                select_sse2(m[2], c3, select_sse2(m[5], c2, c1)))};
+        _mm_storeu_si128((__m128i*)(p + i), pack_rgb_sse2(
+                    _mm_cvttps_epi32(_mm_add_ps(r, half)),
+                    _mm_cvttps_epi32(_mm_add_ps(g, half)),
+                    _mm_cvttps_epi32(_mm_add_ps(b, half))));
+    }
+    hsv2rgb_scalar(H + i, S + i, V + i, p + i, n - i);
+}
+
+// (c_max - c) * 255 / k rounded
+__attribute__((target("sse2")))
+static inline __m128i cmy_sse2(const __m128i c_max, const __m128i c,
+        const __m128 k) {
+    return _mm_cvttps_epi32(_mm_add_ps(_mm_div_ps(_mm_mul_ps(_mm_cvtepi32_ps(
+                            _mm_sub_epi32(c_max, c)), _mm_set1_ps(255.0f)), k),
+                _mm_set1_ps(0.5f)));
+}
+
+__attribute__((target("sse2")))
+static void rgb2cmyk_sse2(const pixel_t *p, gray_t *C, gray_t *M, gray_t *Y,
+        gray_t *K, const std::size_t n) {
+    const __m128i ff {_mm_set1_epi32(0xFF)}, one {_mm_set1_epi32(1)};
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4) {
+        const __m128i v {_mm_loadu_si128((const __m128i*)(p + i))};
+        const __m128i r {_mm_and_si128(_mm_srli_epi32(v, 16), ff)};
+        const __m128i g {_mm_and_si128(_mm_srli_epi32(v, 8), ff)};
+        const __m128i b {_mm_and_si128(v, ff)};
+        const __m128i c_max {_mm_max_epi16(_mm_max_epi16(r, g), b)};
+        const __m128 k {_mm_cvtepi32_ps(_mm_max_epi16(c_max, one))};
+        store4_sse2(C + i, cmy_sse2(c_max, r, k));
+        store4_sse2(M + i, cmy_sse2(c_max, g, k));
+        store4_sse2(Y + i, cmy_sse2(c_max, b, k));
+        store4_sse2(K + i, _mm_sub_epi32(ff, c_max));
+    }
+    rgb2cmyk_scalar(p + i, C + i, M + i, Y + i, K + i, n - i);
+}
+
+// cmyk_channel() of the lanes of c and k1 = 255 - k: the products of the
+// 8-bit values fit the low 16-bit halves (unsigned), the high halves are 0
+__attribute__((target("sse2")))
+static inline __m128i rgb_channel_sse2(const __m128i c, const __m128i k1) {
+    // x + 1 with x = (255 - c) * (255 - k) + 127
+    const __m128i x {_mm_add_epi32(_mm_mullo_epi16(_mm_sub_epi32(
+                    _mm_set1_epi32(0xFF), c), k1), _mm_set1_epi32(128))};
+    return _mm_srli_epi32(_mm_add_epi32(x, _mm_srli_epi32(_mm_sub_epi32(x,
+                        _mm_set1_epi32(1)), 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static void cmyk2rgb_sse2(const gray_t *C, const gray_t *M, const gray_t *Y,
+        const gray_t *K, pixel_t *p, const std::size_t n) {
+    const __m128i ff {_mm_set1_epi32(0xFF)};
+    std::size_t i {0};
+    for (; i + 4 <= n; i += 4) {
+        const __m128i k {_mm_sub_epi32(ff, load4_sse2(K + i))};
+        _mm_storeu_si128((__m128i*)(p + i), pack_rgb_sse2(
+                    rgb_channel_sse2(load4_sse2(C + i), k),
+                    rgb_channel_sse2(load4_sse2(M + i), k),
+                    rgb_channel_sse2(load4_sse2(Y + i), k)));
+    }
+    cmyk2rgb_scalar(C + i, M + i, Y + i, K + i, p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i load8_avx2(const gray_t *a) {
+    return _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)a));
+}
+
+// the lanes saturated to 0..255
+__attribute__((target("avx2")))
+static inline void store8_avx2(gray_t *a, const __m256i v) {
+    const __m256i w {_mm256_packs_epi32(v, v)};
+    // the bytes of the lanes 0..3 in the 128-bit half 0, 4..7 in the half 1
+    const __m256i b {_mm256_packus_epi16(w, w)};
+    _mm_storel_epi64((__m128i*)a, _mm256_castsi256_si128(
+                _mm256_permutevar8x32_epi32(b,
+                    _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0))));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i clamp8_avx2(const __m256i v) {
+    return _mm256_max_epi32(_mm256_min_epi32(v, _mm256_set1_epi32(0xFF)),
+            _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2")))
+static inline __m256i pack_rgb_avx2(const __m256i r, const __m256i g,
+        const __m256i b) {
+    return _mm256_or_si256(_mm256_or_si256(
+                _mm256_slli_epi32(clamp8_avx2(r), 16),
+                _mm256_slli_epi32(clamp8_avx2(g), 8)), clamp8_avx2(b));
+}
+
+__attribute__((target("avx2")))
+static void rgb2ycbcr_avx2(const pixel_t *p, gray_t *Y, gray_t *Cb, gray_t *Cr,
+        const std::size_t n) {
+    const __m256i rb8 {_mm256_set1_epi32(0x00FF00FF)};
+    const __m256i ff {_mm256_set1_epi32(0xFF)};
+    const __m256i wy {_mm256_set1_epi32(pair16(y_b, y_r))};
+    const __m256i wcb {_mm256_set1_epi32(pair16(cb_b, cb_r))};
+    const __m256i wcr {_mm256_set1_epi32(pair16(cr_b, cr_r))};
+    const __m256i gy {_mm256_set1_epi32(pair16(y_g, 0))};
+    const __m256i gcb {_mm256_set1_epi32(pair16(cb_g, 0))};
+    const __m256i gcr {_mm256_set1_epi32(pair16(cr_g, 0))};
+    const __m256i off_y {_mm256_set1_epi32(fwd_round)};
+    const __m256i off_c {_mm256_set1_epi32(chroma_off + fwd_round)};
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v {_mm256_loadu_si256((const __m256i*)(p + i))};
+        const __m256i rb {_mm256_and_si256(v, rb8)};
+        const __m256i g {_mm256_and_si256(_mm256_srli_epi32(v, 8), ff)};
+        store8_avx2(Y + i, _mm256_srai_epi32(_mm256_add_epi32(
+                        _mm256_add_epi32(_mm256_madd_epi16(rb, wy),
+                            _mm256_madd_epi16(g, gy)), off_y), 15));
+        store8_avx2(Cb + i, _mm256_srai_epi32(_mm256_add_epi32(
+                        _mm256_add_epi32(_mm256_madd_epi16(rb, wcb),
+                            _mm256_madd_epi16(g, gcb)), off_c), 15));
+        store8_avx2(Cr + i, _mm256_srai_epi32(_mm256_add_epi32(
+                        _mm256_add_epi32(_mm256_madd_epi16(rb, wcr),
+                            _mm256_madd_epi16(g, gcr)), off_c), 15));
+    }
+    rgb2ycbcr_scalar(p + i, Y + i, Cb + i, Cr + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void ycbcr2rgb_avx2(const gray_t *Y, const gray_t *Cb, const gray_t *Cr,
+        pixel_t *p, const std::size_t n) {
+    const __m128i c128 {_mm_set1_epi16(128)};
+    const __m256i wr {_mm256_set1_epi32(pair16(0, r_cr))};
+    const __m256i wg {_mm256_set1_epi32(pair16(g_cb, g_cr))};
+    const __m256i wb {_mm256_set1_epi32(pair16(b_cb, 0))};
+    const __m256i rnd {_mm256_set1_epi32(inv_round)};
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8) {
+        const __m128i cb {_mm_sub_epi16(_mm_cvtepu8_epi16(
+                    _mm_loadl_epi64((const __m128i*)(Cb + i))), c128)};
+        const __m128i cr {_mm_sub_epi16(_mm_cvtepu8_epi16(
+                    _mm_loadl_epi64((const __m128i*)(Cr + i))), c128)};
+        // cb - 128, cr - 128 pairs of the pixels 0..3 and 4..7
+        const __m256i c {_mm256_inserti128_si256(_mm256_castsi128_si256(
+                    _mm_unpacklo_epi16(cb, cr)), _mm_unpackhi_epi16(cb, cr),
+                1)};
+        const __m256i y {_mm256_add_epi32(_mm256_slli_epi32(load8_avx2(Y + i),
+                    14), rnd)};
+        _mm256_storeu_si256((__m256i*)(p + i), pack_rgb_avx2(
+                    _mm256_srai_epi32(_mm256_add_epi32(y,
+                            _mm256_madd_epi16(c, wr)), 14),
+                    _mm256_srai_epi32(_mm256_add_epi32(y,
+                            _mm256_madd_epi16(c, wg)), 14),
+                    _mm256_srai_epi32(_mm256_add_epi32(y,
+                            _mm256_madd_epi16(c, wb)), 14)));
+    }
+    ycbcr2rgb_scalar(Y + i, Cb + i, Cr + i, p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void rgb2hsv_avx2(const pixel_t *p, gray_t *H, gray_t *S, gray_t *V,
+        const std::size_t n) {
+    const __m256i ff {_mm256_set1_epi32(0xFF)}, one {_mm256_set1_epi32(1)};
+    const __m256i two {_mm256_set1_epi32(2)}, four {_mm256_set1_epi32(4)};
+    const __m256 scale {_mm256_set1_ps(hue_scale)};
+    const __m256 wrap {_mm256_set1_ps(256.5f)};
+    const __m256 f255 {_mm256_set1_ps(255.0f)}, half {_mm256_set1_ps(0.5f)};
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v {_mm256_loadu_si256((const __m256i*)(p + i))};
+        const __m256i r {_mm256_and_si256(_mm256_srli_epi32(v, 16), ff)};
+        const __m256i g {_mm256_and_si256(_mm256_srli_epi32(v, 8), ff)};
+        const __m256i b {_mm256_and_si256(v, ff)};
+        const __m256i c_max {_mm256_max_epi32(_mm256_max_epi32(r, g), b)};
+        const __m256i delta {_mm256_sub_epi32(c_max,
+                _mm256_min_epi32(_mm256_min_epi32(r, g), b))};
+        const __m256i mr {_mm256_cmpeq_epi32(r, c_max)};
+        const __m256i mg {_mm256_andnot_si256(mr,
+                _mm256_cmpeq_epi32(g, c_max))};
+        const __m256i mb {_mm256_andnot_si256(_mm256_or_si256(mr, mg),
+                _mm256_cmpeq_epi32(r, r))};
+        const __m256i num {_mm256_or_si256(_mm256_or_si256(
+                    _mm256_and_si256(mr, _mm256_sub_epi32(g, b)),
+                    _mm256_and_si256(mg, _mm256_sub_epi32(b, r))),
+                _mm256_and_si256(mb, _mm256_sub_epi32(r, g)))};
+        const __m256i base {_mm256_or_si256(_mm256_and_si256(mg, two),
+                _mm256_and_si256(mb, four))};
+        const __m256 h6 {_mm256_add_ps(_mm256_cvtepi32_ps(base),
+                _mm256_div_ps(_mm256_cvtepi32_ps(num),
+                    _mm256_cvtepi32_ps(_mm256_max_epi32(delta, one))))};
+        store8_avx2(H + i, _mm256_and_si256(_mm256_cvttps_epi32(
+                        _mm256_add_ps(_mm256_mul_ps(h6, scale), wrap)), ff));
+        store8_avx2(S + i, _mm256_cvttps_epi32(_mm256_add_ps(_mm256_div_ps(
+                            _mm256_mul_ps(_mm256_cvtepi32_ps(delta), f255),
+                            _mm256_cvtepi32_ps(_mm256_max_epi32(c_max, one))),
+                        half)));
+        store8_avx2(V + i, c_max);
+    }
+    rgb2hsv_scalar(p + i, H + i, S + i, V + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void hsv2rgb_avx2(const gray_t *H, const gray_t *S, const gray_t *V,
+        pixel_t *p, const std::size_t n) {
+    const __m256 step {_mm256_set1_ps(hue_step)};
+    const __m256 f255 {_mm256_set1_ps(255.0f)};
+    const __m256 one {_mm256_set1_ps(1.0f)}, half {_mm256_set1_ps(0.5f)};
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8) {
+        const __m256 h6 {_mm256_mul_ps(_mm256_cvtepi32_ps(load8_avx2(H + i)),
+                step)};
+        const __m256i sextant {_mm256_cvttps_epi32(h6)};
+        const __m256 frac {_mm256_sub_ps(h6, _mm256_cvtepi32_ps(sextant))};
+        const __m256 s {_mm256_div_ps(_mm256_cvtepi32_ps(load8_avx2(S + i)),
+                f255)};
+        const __m256 v {_mm256_cvtepi32_ps(load8_avx2(V + i))};
+        const __m256 c1 {_mm256_mul_ps(v, _mm256_sub_ps(one, s))};
+        const __m256 c2 {_mm256_mul_ps(v, _mm256_sub_ps(one,
+                    _mm256_mul_ps(s, frac)))};
+        const __m256 c3 {_mm256_mul_ps(v, _mm256_sub_ps(one,
+                    _mm256_mul_ps(s, _mm256_sub_ps(one, frac))))};
+        __m256 m[6];
+        for (int k {0}; k < 6; ++k)
+            m[k] = _mm256_castsi256_ps(_mm256_cmpeq_epi32(sextant,
+                        _mm256_set1_epi32(k)));
+        // blendv(b, a, m): a where m is set
+        const __m256 r {_mm256_blendv_ps(_mm256_blendv_ps(
+                    _mm256_blendv_ps(c1, c3, m[4]), c2, m[1]), v,
+                _mm256_or_ps(m[0], m[5]))};
+        const __m256 g {_mm256_blendv_ps(_mm256_blendv_ps(
+                    _mm256_blendv_ps(c1, c2, m[3]), c3, m[0]), v,
+                _mm256_or_ps(m[1], m[2]))};
+        const __m256 b {_mm256_blendv_ps(_mm256_blendv_ps(
+                    _mm256_blendv_ps(c1, c2, m[5]), c3, m[2]), v,
+                _mm256_or_ps(m[3], m[4]))};
+        _mm256_storeu_si256((__m256i*)(p + i), pack_rgb_avx2(
+                    _mm256_cvttps_epi32(_mm256_add_ps(r, half)),
+                    _mm256_cvttps_epi32(_mm256_add_ps(g, half)),
+                    _mm256_cvttps_epi32(_mm256_add_ps(b, half))));
+    }
+    hsv2rgb_scalar(H + i, S + i, V + i, p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i cmy_avx2(const __m256i c_max, const __m256i c,
+        const __m256 k) {
+    return _mm256_cvttps_epi32(_mm256_add_ps(_mm256_div_ps(_mm256_mul_ps(
+                        _mm256_cvtepi32_ps(_mm256_sub_epi32(c_max, c)),
+                        _mm256_set1_ps(255.0f)), k), _mm256_set1_ps(0.5f)));
+}
+
+__attribute__((target("avx2")))
+static void rgb2cmyk_avx2(const pixel_t *p, gray_t *C, gray_t *M, gray_t *Y,
+        gray_t *K, const std::size_t n) {
+    const __m256i ff {_mm256_set1_epi32(0xFF)}, one {_mm256_set1_epi32(1)};
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8) {
+        const __m256i v {_mm256_loadu_si256((const __m256i*)(p + i))};
+        const __m256i r {_mm256_and_si256(_mm256_srli_epi32(v, 16), ff)};
+        const __m256i g {_mm256_and_si256(_mm256_srli_epi32(v, 8), ff)};
+        const __m256i b {_mm256_and_si256(v, ff)};
+        const __m256i c_max {_mm256_max_epi32(_mm256_max_epi32(r, g), b)};
+        const __m256 k {_mm256_cvtepi32_ps(_mm256_max_epi32(c_max, one))};
+        store8_avx2(C + i, cmy_avx2(c_max, r, k));
+        store8_avx2(M + i, cmy_avx2(c_max, g, k));
+        store8_avx2(Y + i, cmy_avx2(c_max, b, k));
+        store8_avx2(K + i, _mm256_sub_epi32(ff, c_max));
+    }
+    rgb2cmyk_scalar(p + i, C + i, M + i, Y + i, K + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i rgb_channel_avx2(const __m256i c, const __m256i k1) {
+    const __m256i x {_mm256_add_epi32(_mm256_mullo_epi16(_mm256_sub_epi32(
+                    _mm256_set1_epi32(0xFF), c), k1), _mm256_set1_epi32(128))};
+    return _mm256_srli_epi32(_mm256_add_epi32(x, _mm256_srli_epi32(
+                    _mm256_sub_epi32(x, _mm256_set1_epi32(1)), 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void cmyk2rgb_avx2(const gray_t *C, const gray_t *M, const gray_t *Y,
+        const gray_t *K, pixel_t *p, const std::size_t n) {
+    const __m256i ff {_mm256_set1_epi32(0xFF)};
+    std::size_t i {0};
+    for (; i + 8 <= n; i += 8) {
+        const __m256i k {_mm256_sub_epi32(ff, load8_avx2(K + i))};
+        _mm256_storeu_si256((__m256i*)(p + i), pack_rgb_avx2(
+                    rgb_channel_avx2(load8_avx2(C + i), k),
+                    rgb_channel_avx2(load8_avx2(M + i), k),
+                    rgb_channel_avx2(load8_avx2(Y + i), k)));
+    }
+    cmyk2rgb_scalar(C + i, M + i, Y + i, K + i, p + i, n - i);
+}
+#endif
+
+/*
+ * ------------------ Kernel selection ------------------
+ */
+static To3_fn ycbcr_kernel() {
+    switch (current_path) {
+#ifdef COLOR_CONV_X86
+        case Conv_path::sse2: return rgb2ycbcr_sse2;
+        case Conv_path::avx2: return rgb2ycbcr_avx2;
+#endif
+        default: return rgb2ycbcr_scalar;
+    }
+}
+
+static From3_fn ycbcr_inv_kernel() {
+    switch (current_path) {
+#ifdef COLOR_CONV_X86
+        case Conv_path::sse2: return ycbcr2rgb_sse2;
+        case Conv_path::avx2: return ycbcr2rgb_avx2;
+#endif
+        default: return ycbcr2rgb_scalar;
+    }
+}
+
+static To3_fn hsv_kernel() {
+    switch (current_path) {
+#ifdef COLOR_CONV_X86
+        case Conv_path::sse2: return rgb2hsv_sse2;
+        case Conv_path::avx2: return rgb2hsv_avx2;
+#endif
+        default: return rgb2hsv_scalar;
+    }
+}
+
+static From3_fn hsv_inv_kernel() {
+    switch (current_path) {
+#ifdef COLOR_CONV_X86
+        case Conv_path::sse2: return hsv2rgb_sse2;
+        case Conv_path::avx2: return hsv2rgb_avx2;
+#endif
+        default: return hsv2rgb_scalar;
+    }
+}
+
+static To4_fn cmyk_kernel() {
+    switch (current_path) {
+#ifdef COLOR_CONV_X86
+        case Conv_path::sse2: return rgb2cmyk_sse2;
+        case Conv_path::avx2: return rgb2cmyk_avx2;
+#endif
+        default: return rgb2cmyk_scalar;
+    }
+}
+
+static From4_fn cmyk_inv_kernel() {
+    switch (current_path) {
+#ifdef COLOR_CONV_X86
+        case Conv_path::sse2: return cmyk2rgb_sse2;
+        case Conv_path::avx2: return cmyk2rgb_avx2;
+#endif
+        default: return cmyk2rgb_scalar;
+    }
+}
+
+/*
+ * ------------------ Bulk conversions ------------------
+ */
+// reallocate the output only if it has a different size
+static void fit(GS_Image &I, const std::size_t w, const std::size_t h) {
+    if (I.width() != w || I.height() != h)
+        I = GS_Image{w, h};
+}
+
+static void fit(RGB_Image &I, const std::size_t w, const std::size_t h) {
+    if (I.width() != w || I.height() != h)
+        I = RGB_Image{w, h};
+}
+
+static void check_size(const GS_Image &I, const std::size_t w,
+        const std::size_t h) {
+    if (I.width() != w || I.height() != h)
+        throw std::runtime_error("channel images have different sizes");
+}
+
+void PPM_lib::rgb2ycbcr(const RGB_Image &I, GS_Image &Y, GS_Image &Cb,
+        GS_Image &Cr) {
+    const auto w = I.width(), h = I.height();
+    fit(Y, w, h);
+    fit(Cb, w, h);
+    fit(Cr, w, h);
+    const To3_fn f {ycbcr_kernel()};
+    for (std::size_t x {0}; x < w; ++x)
+        f(I[x].data(), Y[x].data(), Cb[x].data(), Cr[x].data(), h);
+}
+
+void PPM_lib::ycbcr2rgb(const GS_Image &Y, const GS_Image &Cb,
+        const GS_Image &Cr, RGB_Image &I) {
+    const auto w = Y.width(), h = Y.height();
+    check_size(Cb, w, h);
+    check_size(Cr, w, h);
+    fit(I, w, h);
+    const From3_fn f {ycbcr_inv_kernel()};
+    for (std::size_t x {0}; x < w; ++x)
+        f(Y[x].data(), Cb[x].data(), Cr[x].data(), I[x].data(), h);
+}
+
+void PPM_lib::rgb2hsv(const RGB_Image &I, GS_Image &H, GS_Image &S,
+        GS_Image &V) {
+    const auto w = I.width(), h = I.height();
+    fit(H, w, h);
+    fit(S, w, h);
+    fit(V, w, h);
+    const To3_fn f {hsv_kernel()};
+    for (std::size_t x {0}; x < w; ++x)
+        f(I[x].data(), H[x].data(), S[x].data(), V[x].data(), h);
+}
+
+void PPM_lib::hsv2rgb(const GS_Image &H, const GS_Image &S, const GS_Image &V,
+        RGB_Image &I) {
+    const auto w = H.width(), h = H.height();
+    check_size(S, w, h);
+    check_size(V, w, h);
+    fit(I, w, h);
+    const From3_fn f {hsv_inv_kernel()};
+    for (std::size_t x {0}; x < w; ++x)
+        f(H[x].data(), S[x].data(), V[x].data(), I[x].data(), h);
+}
+
+void PPM_lib::rgb2cmyk(const RGB_Image &I, GS_Image &C, GS_Image &M,
+        GS_Image &Y, GS_Image &K) {
+    const auto w = I.width(), h = I.height();
+    fit(C, w, h);
+    fit(M, w, h);
+    fit(Y, w, h);
+    fit(K, w, h);
+    const To4_fn f {cmyk_kernel()};
+    for (std::size_t x {0}; x < w; ++x)
+        f(I[x].data(), C[x].data(), M[x].data(), Y[x].data(), K[x].data(), h);
+}
+
+void PPM_lib::cmyk2rgb(const GS_Image &C, const GS_Image &M,
+        const GS_Image &Y, const GS_Image &K, RGB_Image &I) {
+    const auto w = C.width(), h = C.height();
+    check_size(M, w, h);
+    check_size(Y, w, h);
+    check_size(K, w, h);
+    fit(I, w, h);
+    const From4_fn f {cmyk_inv_kernel()};
+    for (std::size_t x {0}; x < w; ++x)
+        f(C[x].data(), M[x].data(), Y[x].data(), K[x].data(), I[x].data(), h);
+}
+
@@ -0,0 +1,57 @@
+/*
+ * Bulk color conversions between an RGB_Image and its planar channels:
+ *      every channel is a GS_Image (one byte per pixel), the whole image is
+ *      converted in one pass over its columns (the rows of the storage, which
+ *      are contiguous), without a std::array per pixel
+ *          YCbCr: JPEG (full range), fixed-point: 15 fraction bits forward,
+ *          14 backward, rounded to the nearest
+ *          HSV: H covers the whole circle in 256 steps (0..255 for 0..360
+ *          degrees), S is scaled to 0..255, V is the largest component
+ *          CMYK: the components scaled to 0..255
+ *      The conversions are done by one of the kernels:
+ *          scalar: plain loops, the reference (always available)
+ *          sse2:   4 pixels per instruction
+ *          avx2:   8 pixels per instruction (if the cpu supports it)
+ *      All the kernels return the same values (the float ones of HSV and
+ *      CMYK do the same operations in the same order). The kernel is
+ *      selectable at runtime with set_conv_path()
+ *
+ *      The output images are allocated only when their size differs from the
+ *      size of the input, so converting a batch of images of the same size
+ *      reuses them; the input channels of the same size are required
+ *
+ * Examples:
+ *      RGB_Image I {"../imgs/baboon.ppm"};
+ *      GS_Image Y {I.width(), I.height()}, Cb {Y}, Cr {Y};
+ *      rgb2ycbcr(I, Y, Cb, Cr);
+ *      ycbcr2rgb(Y, Cb, Cr, I);
+ *      set_conv_path(Conv_path::scalar); // the reference kernels
+ */
+
+#ifndef COLOR_CONV_H
+#define COLOR_CONV_H
+
+#include "PPM_lib.h"
+
+namespace PPM_lib {
+
+enum class Conv_path { scalar, sse2, avx2 };
+
+const char *conv_path_name(const Conv_path);
+bool conv_path_supported(const Conv_path);
+Conv_path best_conv_path();
+Conv_path conv_path();
+void set_conv_path(const Conv_path);
+
+void rgb2ycbcr(const RGB_Image&, GS_Image&, GS_Image&, GS_Image&);
+void ycbcr2rgb(const GS_Image&, const GS_Image&, const GS_Image&, RGB_Image&);
+void rgb2hsv(const RGB_Image&, GS_Image&, GS_Image&, GS_Image&);
+void hsv2rgb(const GS_Image&, const GS_Image&, const GS_Image&, RGB_Image&);
+void rgb2cmyk(const RGB_Image&, GS_Image&, GS_Image&, GS_Image&, GS_Image&);
+void cmyk2rgb(const GS_Image&, const GS_Image&, const GS_Image&,
+        const GS_Image&, RGB_Image&);
+
+} // end namespace PPM_lib
+
+#endif
+
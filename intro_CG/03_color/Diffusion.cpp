@@ -0,0 +1,170 @@
+#include "Diffusion.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+using namespace PPM_lib;
+
+/*
+ * ------------------ Kernels ------------------
+ */
+// reach: the largest |along|, depth: the largest across, sum: of the weights
+struct Kernel_shape {
+    int reach;
+    int depth;
+    int sum;
+};
+
+static Kernel_shape check_kernel(const Diffusion_kernel &k) {
+    if (k.divisor < 1 || k.size < 1 || k.size > 12)
+        throw std::runtime_error("wrong diffusion kernel");
+    Kernel_shape s {0, 0, 0};
+    for (int i {0}; i < k.size; ++i) {
+        const Diffusion_weight &d {k.w[i]};
+        if (d.along < -2 || d.along > 2 || d.across < 0 || d.across > 2 ||
+                (d.across == 0 && d.along <= 0) || d.weight < 0)
+            throw std::runtime_error("wrong weight of the diffusion kernel");
+        s.reach = std::max(s.reach, std::abs(d.along));
+        s.depth = std::max(s.depth, d.across);
+        s.sum += d.weight;
+    }
+    // the error sums of a cell (at most 128 * sum) have to fit in int16
+    if (s.sum > 255)
+        throw std::runtime_error("too large weights of the diffusion kernel");
+    return s;
+}
+
+/*
+ * ------------------ Diffusion ------------------
+ *      the lines of the image (w columns of h pixels); the ring of the error
+ *      rows has pad cells on both sides of a line, so the weights falling off
+ *      the image need no tests (the pad cells are cleared when a line is
+ *      done). progress[x]: the number of the pixels of the line x done (a
+ *      line reversed goes from the end), published every 32 pixels
+ */
+template <class Gray>
+static void diffuse_lines(Gray &I, const Diffusion_kernel &k,
+        const bool serpentine, const int bits, const int threads) {
+    if (bits < 1 || bits > 8)
+        throw std::runtime_error("diffusion to 1..8 bits only");
+    const Kernel_shape s {check_kernel(k)};
+    const int w = I.width(), h = I.height();
+    const int lag {2 * s.reach + 1};
+    // a serpentine line waits for the whole previous one: no wavefront
+    const int nt = serpentine ? 1 : std::min<int>(w, threads > 0 ? threads :
+            std::max(1u, std::thread::hardware_concurrency()));
+
+    // the error sum acc becomes the correction acc / divisor rounded half away
+    // from zero, the value v the nearest of the levels
+    const int amax {128 * s.sum};
+    std::vector<int> corr(2 * amax + 1);
+    for (int a {-amax}; a <= amax; ++a)
+        corr[a + amax] = a >= 0 ? (2 * a + k.divisor) / (2 * k.divisor) :
+            -((-2 * a + k.divisor) / (2 * k.divisor));
+    const int levels {(1 << bits) - 1};
+    int quant[256];
+    for (int v {0}; v < 256; ++v) {
+        const int l {(v * levels + 127) / 255};
+        quant[v] = (2 * l * 255 + levels) / (2 * levels);
+    }
+
+    const int rows {nt + s.depth}, pad {s.reach}, len {h + 2 * pad};
+    std::vector<int16_t> err(rows * len, 0);
+    std::unique_ptr<std::atomic<int>[]> progress {new std::atomic<int>[w]};
+    for (int x {0}; x < w; ++x)
+        progress[x].store(0, std::memory_order_relaxed);
+    auto reversed = [&](const int x) { return serpentine && (x & 1); };
+
+    auto line = [&](const int x) {
+        const int dir {reversed(x) ? -1 : 1};
+        int16_t *row[3];
+        for (int a {0}; a <= s.depth; ++a)
+            row[a] = &err[(x + a) % rows * len + pad];
+        // the errors for the next pixels of the line are carried in next1 and
+        // next2, the cells of the next lines are relative to the pixel
+        int along[3] {0, 0, 0}, n {0};
+        int16_t *cell[12];
+        int weight[12];
+        for (int j {0}; j < k.size; ++j)
+            if (k.w[j].across == 0)
+                along[k.w[j].along] += k.w[j].weight;
+            else {
+                cell[n] = row[k.w[j].across] + dir * k.w[j].along;
+                weight[n++] = k.w[j].weight;
+            }
+        int next1 {0}, next2 {0};
+        int done {x == 0 ? h : 0}; // of the previous line, as last seen
+        for (int i {0}; i < h; ++i) {
+            const int y {dir > 0 ? i : h - 1 - i};
+            if (done < h) {
+                // the previous line has to be done over y - 2 reach .. y +
+                // 2 reach: none of its pixels left adds to the errors used
+                // here, none of the cells it writes is written here
+                const int need {reversed(x - 1) ?
+                    h - std::max(0, y - lag + 1) : std::min(h, y + lag)};
+                while (done < need) {
+                    done = progress[x - 1].load(std::memory_order_acquire);
+                    if (done < need)
+                        std::this_thread::yield();
+                }
+            }
+            const int acc {row[0][y] + next1};
+            row[0][y] = 0;
+            const int v {std::min(255, std::max(0,
+                        int(I[x][y]) + corr[acc + amax]))};
+            const int q {quant[v]};
+            I[x][y] = q;
+            const int e {v - q};
+            next1 = next2 + e * along[1];
+            next2 = e * along[2];
+            if (e)
+                for (int j {0}; j < n; ++j)
+                    cell[j][y] += e * weight[j];
+            if ((i & 31) == 31)
+                progress[x].store(i + 1, std::memory_order_release);
+        }
+        std::fill_n(row[0] - pad, pad, 0);
+        std::fill_n(row[0] + h, pad, 0);
+        progress[x].store(h, std::memory_order_release);
+    };
+
+    // the lines dealt in turn: the thread of the line x waits for the one of
+    // the line x - 1 only
+    auto run = [&](const int first) {
+        for (int x {first}; x < w; x += nt)
+            line(x);
+    };
+    if (nt <= 1) {
+        run(0);
+        return;
+    }
+    std::vector<std::thread> pool;
+    for (int t {0}; t < nt; ++t)
+        pool.emplace_back(run, t);
+    for (auto &t: pool)
+        t.join();
+}
+
+void PPM_lib::diffuse(GS_Image &I, const Diffusion_kernel &k,
+        const bool serpentine, const int bits, const int threads) {
+    diffuse_lines(I, k, serpentine, bits, threads);
+}
+
+void PPM_lib::diffuse(Channel_view &V, const Diffusion_kernel &k,
+        const bool serpentine, const int bits, const int threads) {
+    diffuse_lines(V, k, serpentine, bits, threads);
+}
+
+// the channels one after another, each in place
+void PPM_lib::diffuse(RGB_Image &I, const Diffusion_kernel &k,
+        const bool serpentine, const int bits, const int threads) {
+    for (const auto c: {RGB_channel::red, RGB_channel::green,
+            RGB_channel::blue}) {
+        Channel_view V {I.channel(c)};
+        diffuse(V, k, serpentine, bits, threads);
+    }
+}
@@ -0,0 +1,84 @@
+/*
+ * Error diffusion engine:
+ *      the image is scanned line by line (the contiguous columns of the
+ *      storage, as the old error_diffusion() did); the error of every pixel
+ *      is spread by the weights of a Diffusion_kernel to the pixels ahead on
+ *      its line and to the next (up to 2) lines. The kernels:
+ *          floyd_steinberg, jarvis, stucki, atkinson (which spreads 6 / 8 of
+ *          the error only)
+ *      serpentine: the odd lines are scanned backwards (the kernel mirrored)
+ *
+ *      The value with the error added is clamped to 0..255 before it is
+ *      quantized to the 2^bits levels, so an error never exceeds half a
+ *      level (128). The errors of the lines not done yet are kept in a ring
+ *      of int16 rows as the sums of error * weight (the division by the
+ *      kernel divisor is done once per pixel): 3 rows (the line itself and
+ *      the next two) when serial, one more per thread.
+ *
+ *      Wavefront: the lines are dealt to the threads in turn and every line
+ *      trails the previous one by 2 * reach + 1 pixels (reach: how far the
+ *      kernel spreads along a line), so two lines never touch the same error
+ *      cells. The sums of integers do not depend on the order of the
+ *      additions: every thread count gives the same image. The lines of a
+ *      serpentine scan run in the opposite directions, so a line can start
+ *      only when the previous one is done: serpentine is serial, whatever
+ *      the number of threads
+ *
+ * Examples:
+ *      diffuse(I); // Floyd-Steinberg, 1 bit, all the hardware threads
+ *      diffuse(I, jarvis, true); // serpentine
+ *      diffuse(I, stucki, false, 2, 8); // 4 levels per channel, 8 threads
+ */
+
+#ifndef DIFFUSION_H
+#define DIFFUSION_H
+
+#include "PPM_lib.h"
+
+namespace PPM_lib {
+
+// a weight of a kernel: for the pixel `along` pixels ahead on its line and
+// `across` lines further
+struct Diffusion_weight {
+    int along;
+    int across;
+    int weight;
+};
+
+// up to 12 weights, |along| <= 2, across 0..2 (along > 0 for across = 0)
+struct Diffusion_kernel {
+    const char *name;
+    int divisor;
+    int size;
+    Diffusion_weight w[12];
+};
+
+constexpr Diffusion_kernel floyd_steinberg {"floyd_steinberg", 16, 4, {
+    {1, 0, 7}, {-1, 1, 3}, {0, 1, 5}, {1, 1, 1}}};
+
+constexpr Diffusion_kernel jarvis {"jarvis", 48, 12, {
+    {1, 0, 7}, {2, 0, 5},
+    {-2, 1, 3}, {-1, 1, 5}, {0, 1, 7}, {1, 1, 5}, {2, 1, 3},
+    {-2, 2, 1}, {-1, 2, 3}, {0, 2, 5}, {1, 2, 3}, {2, 2, 1}}};
+
+constexpr Diffusion_kernel stucki {"stucki", 42, 12, {
+    {1, 0, 8}, {2, 0, 4},
+    {-2, 1, 2}, {-1, 1, 4}, {0, 1, 8}, {1, 1, 4}, {2, 1, 2},
+    {-2, 2, 1}, {-1, 2, 2}, {0, 2, 4}, {1, 2, 2}, {2, 2, 1}}};
+
+constexpr Diffusion_kernel atkinson {"atkinson", 8, 6, {
+    {1, 0, 1}, {2, 0, 1}, {-1, 1, 1}, {0, 1, 1}, {1, 1, 1}, {0, 2, 1}}};
+
+// image (an RGB one channel by channel), kernel, serpentine scan, bits per
+// channel (1..8), number of threads (0: one per hardware thread)
+void diffuse(GS_Image&, const Diffusion_kernel& = floyd_steinberg,
+        const bool = false, const int = 1, const int = 0);
+void diffuse(Channel_view&, const Diffusion_kernel& = floyd_steinberg,
+        const bool = false, const int = 1, const int = 0);
+void diffuse(RGB_Image&, const Diffusion_kernel& = floyd_steinberg,
+        const bool = false, const int = 1, const int = 0);
+
+} // end namespace PPM_lib
+
+#endif
+
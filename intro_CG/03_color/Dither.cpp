@@ -0,0 +1,243 @@
+#include "Dither.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define DITHER_X86
+#include <immintrin.h>
+#endif
+
+using namespace PPM_lib;
+
+/*
+ * ------------------ Threshold maps ------------------
+ */
+Threshold_map::Threshold_map(const size_type w, const size_type h,
+        const std::vector<int> &ranks): w_{w}, h_{h}, t_(w * h) {
+    const size_type n {w * h};
+    if (n == 0 || ranks.size() != n)
+        throw std::runtime_error("wrong size of the threshold tile");
+    for (size_type k {0}; k < n; ++k) {
+        if (ranks[k] < 0 || size_type(ranks[k]) >= n)
+            throw std::runtime_error("wrong rank in the threshold tile");
+        t_[k] = (2 * uint64_t(ranks[k]) + 1) * 255 / (2 * n);
+    }
+}
+
+Threshold_map Threshold_map::bayer(const int n) {
+    if (n < 1 || n > 256 || (n & (n - 1)))
+        throw std::runtime_error("Bayer matrix size is not a power of two");
+    std::vector<int> r(n * n);
+    for (int i {0}; i < n; ++i)
+        for (int j {0}; j < n; ++j)
+            r[i * n + j] = bayer_value(n, i, j);
+    return {size_type(n), size_type(n), r};
+}
+
+// the pixels ranked by their gray values (the equal ones in the storage order)
+Threshold_map Threshold_map::from_tile(const GS_Image &T) {
+    const size_type w {T.width()}, h {T.height()};
+    std::vector<int> idx(w * h);
+    std::iota(idx.begin(), idx.end(), 0);
+    std::stable_sort(idx.begin(), idx.end(), [&](const int a, const int b) {
+        return T[a / h][a % h] < T[b / h][b % h];
+    });
+    std::vector<int> r(w * h);
+    for (size_type k {0}; k < idx.size(); ++k)
+        r[idx[k]] = k;
+    return {w, h, r};
+}
+
+Threshold_map Threshold_map::load(const std::string &fn) {
+    return from_tile(GS_Image{fn});
+}
+
+GS_Image Threshold_map::tile() const {
+    GS_Image T {w_, h_};
+    for (size_type i {0}; i < w_; ++i)
+        for (size_type j {0}; j < h_; ++j)
+            T[i][j] = threshold(i, j);
+    return T;
+}
+
+Threshold_map Threshold_map::shifted(const size_type di,
+        const size_type dj) const {
+    Threshold_map M {*this};
+    for (size_type i {0}; i < w_; ++i)
+        for (size_type j {0}; j < h_; ++j)
+            M.t_[i * h_ + j] = t_[(i + di) % w_ * h_ + (j + dj) % h_];
+    return M;
+}
+
+/*
+ * ------------------ Kernels ------------------
+ *      a line of n bytes dithered in place with the thresholds t: levels is
+ *      L - 1, scale = 255 * 128 / (L - 1) rounded, so that the level l is
+ *      written as (l * scale + 64) >> 7 (l * 255 / (L - 1) rounded). The
+ *      division by 255 is exact with shifts for the values below 65535
+ */
+using Line_fn = void (*)(unsigned char*, const unsigned char*,
+        const std::size_t, const int, const int);
+
+static Conv_path current_path {best_conv_path()};
+
+Conv_path PPM_lib::dither_path() {
+    return current_path;
+}
+
+// unsupported paths fall back to the scalar kernel
+void PPM_lib::set_dither_path(const Conv_path p) {
+    current_path = conv_path_supported(p) ? p : Conv_path::scalar;
+}
+
+static void dither_scalar(unsigned char *p, const unsigned char *t,
+        const std::size_t n, const int levels, const int scale) {
+    for (std::size_t i {0}; i < n; ++i) {
+        const int x {p[i] * levels + t[i]};
+        const int l {(x + 1 + (x >> 8)) >> 8};
+        p[i] = (l * scale + 64) >> 7;
+    }
+}
+
+#ifdef DITHER_X86
+// 8 values of the 16-bit lanes
+__attribute__((target("sse2")))
+static inline __m128i levels_sse2(const __m128i v, const __m128i t,
+        const __m128i levels, const __m128i scale) {
+    const __m128i x {_mm_add_epi16(_mm_mullo_epi16(v, levels), t)};
+    const __m128i l {_mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(x,
+                    _mm_set1_epi16(1)), _mm_srli_epi16(x, 8)), 8)};
+    return _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(l, scale),
+                _mm_set1_epi16(64)), 7);
+}
+
+// 1 bit: v + t >= 255, the saturated sum is 255 (which is the output)
+__attribute__((target("sse2")))
+static void dither_sse2(unsigned char *p, const unsigned char *t,
+        const std::size_t n, const int levels, const int scale) {
+    const __m128i z {_mm_setzero_si128()}, ff {_mm_set1_epi8(-1)};
+    const __m128i lv {_mm_set1_epi16(levels)}, sc {_mm_set1_epi16(scale)};
+    std::size_t i {0};
+    for (; i + 16 <= n; i += 16) {
+        const __m128i v {_mm_loadu_si128((const __m128i*)(p + i))};
+        const __m128i th {_mm_loadu_si128((const __m128i*)(t + i))};
+        __m128i out;
+        if (levels == 1)
+            out = _mm_cmpeq_epi8(_mm_adds_epu8(v, th), ff);
+        else
+            out = _mm_packus_epi16(
+                    levels_sse2(_mm_unpacklo_epi8(v, z),
+                        _mm_unpacklo_epi8(th, z), lv, sc),
+                    levels_sse2(_mm_unpackhi_epi8(v, z),
+                        _mm_unpackhi_epi8(th, z), lv, sc));
+        _mm_storeu_si128((__m128i*)(p + i), out);
+    }
+    dither_scalar(p + i, t + i, n - i, levels, scale);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i levels_avx2(const __m256i v, const __m256i t,
+        const __m256i levels, const __m256i scale) {
+    const __m256i x {_mm256_add_epi16(_mm256_mullo_epi16(v, levels), t)};
+    const __m256i l {_mm256_srli_epi16(_mm256_add_epi16(_mm256_add_epi16(x,
+                    _mm256_set1_epi16(1)), _mm256_srli_epi16(x, 8)), 8)};
+    return _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(l, scale),
+                _mm256_set1_epi16(64)), 7);
+}
+
+// the unpacks and the pack work in the 128-bit halves: the order is kept
+__attribute__((target("avx2")))
+static void dither_avx2(unsigned char *p, const unsigned char *t,
+        const std::size_t n, const int levels, const int scale) {
+    const __m256i z {_mm256_setzero_si256()}, ff {_mm256_set1_epi8(-1)};
+    const __m256i lv {_mm256_set1_epi16(levels)};
+    const __m256i sc {_mm256_set1_epi16(scale)};
+    std::size_t i {0};
+    for (; i + 32 <= n; i += 32) {
+        const __m256i v {_mm256_loadu_si256((const __m256i*)(p + i))};
+        const __m256i th {_mm256_loadu_si256((const __m256i*)(t + i))};
+        __m256i out;
+        if (levels == 1)
+            out = _mm256_cmpeq_epi8(_mm256_adds_epu8(v, th), ff);
+        else
+            out = _mm256_packus_epi16(
+                    levels_avx2(_mm256_unpacklo_epi8(v, z),
+                        _mm256_unpacklo_epi8(th, z), lv, sc),
+                    levels_avx2(_mm256_unpackhi_epi8(v, z),
+                        _mm256_unpackhi_epi8(th, z), lv, sc));
+        _mm256_storeu_si256((__m256i*)(p + i), out);
+    }
+    dither_scalar(p + i, t + i, n - i, levels, scale);
+}
+#endif
+
+static Line_fn dither_kernel() {
+    switch (current_path) {
+#ifdef DITHER_X86
+        case Conv_path::sse2: return dither_sse2;
+        case Conv_path::avx2: return dither_avx2;
+#endif
+        default: return dither_scalar;
+    }
+}
+
+/*
+ * ------------------ Dithering ------------------
+ */
+// the lines of the image of w columns of n bytes (bpp bytes per pixel):
+// the thresholds of the column i of the tile repeated down a chunk of whole
+// tile periods (every threshold bpp times, at least 256 bytes so the vector
+// kernels run on long spans), a line dithered chunk by chunk, the lines split
+// into equal ranges of the threads
+template <class Img>
+static void dither_lines(Img &I, const Threshold_map &T, const int bpp,
+        const int bits, const int threads) {
+    if (bits < 1 || bits > 8)
+        throw std::runtime_error("dithering to 1..8 bits only");
+    const std::size_t w {I.width()}, h {I.height()}, n {h * bpp};
+    const std::size_t tw {T.width()}, th {T.height()}, period {th * bpp};
+    const std::size_t chunk {period * std::max<std::size_t>(1, 256 / period)};
+    std::vector<unsigned char> lines(std::min(w, tw) * chunk);
+    for (std::size_t i {0}; i < std::min(w, tw); ++i)
+        for (std::size_t y {0}; y < chunk / bpp; ++y)
+            std::fill_n(&lines[i * chunk + y * bpp], bpp,
+                    T.threshold(i, y % th));
+
+    const int levels {(1 << bits) - 1};
+    const int scale {(255 * 256 / levels + 1) / 2};
+    const Line_fn f {dither_kernel()};
+    auto run = [&](const std::size_t x0, const std::size_t x1) {
+        for (std::size_t x {x0}; x < x1; ++x) {
+            auto p = reinterpret_cast<unsigned char*>(I[x].data());
+            const unsigned char *t {&lines[(x % tw) * chunk]};
+            for (std::size_t i {0}; i < n; i += chunk)
+                f(p + i, t, std::min(chunk, n - i), levels, scale);
+        }
+    };
+    const std::size_t nt {std::min(w, std::size_t(threads > 0 ? threads :
+                std::max(1u, std::thread::hardware_concurrency())))};
+    if (nt <= 1) {
+        run(0, w);
+        return;
+    }
+    std::vector<std::thread> pool;
+    for (std::size_t k {0}; k < nt; ++k)
+        pool.emplace_back(run, w * k / nt, w * (k + 1) / nt);
+    for (auto &t: pool)
+        t.join();
+}
+
+void PPM_lib::dither(GS_Image &I, const Threshold_map &T, const int bits,
+        const int threads) {
+    dither_lines(I, T, 1, bits, threads);
+}
+
+// the fourth byte of the rgb values is 0 and stays 0 (thresholds are below
+// 255)
+void PPM_lib::dither(RGB_Image &I, const Threshold_map &T, const int bits,
+        const int threads) {
+    dither_lines(I, T, sizeof(RGB_Color::value_type), bits, threads);
+}
+
@@ -0,0 +1,140 @@
+/*
+ * Ordered dithering engine:
+ *      Class Threshold_map: a tile of thresholds repeated over the image. The
+ *      entries of the tile are ranked (0 .. n - 1 for the n entries) and the
+ *      rank r becomes the threshold (2 * r + 1) * 255 / (2 * n), so any tile
+ *      gives uniformly spread thresholds:
+ *          bayer<N>(): the Bayer matrix generated at compile time (Bayer<N>),
+ *          N is a power of two
+ *          bayer(n): the same matrix of a size known at runtime
+ *          from_tile() / load(): a threshold tile given as an image (blue
+ *          noise), its gray values are ranked
+ *      The entry (i, j) of the tile is used for the pixels (x, y) with
+ *      x % width() == i and y % height() == j
+ *
+ *      dither(): the value v (0..255) of a pixel with the threshold t becomes
+ *      the level (v * (L - 1) + t) / 255 of the L = 2^bits levels, written
+ *      back scaled to 0..255 (bits = 1: 0 or 255). An RGB image is dithered
+ *      in all its channels at once, with the same threshold. The image is
+ *      processed along its contiguous lines (the columns of the storage) by
+ *      one of the kernels of Color_conv.h:
+ *          scalar: plain loops, the reference (always available)
+ *          sse2:   16 bytes per instruction
+ *          avx2:   32 bytes per instruction (if the cpu supports it)
+ *      bits = 1 is a single saturating add and compare per byte. The lines
+ *      are split between the threads (0: one per hardware thread); all the
+ *      kernels and thread counts give the same image. The kernel is
+ *      selectable at runtime with set_dither_path()
+ *
+ * Examples:
+ *      dither(I, Threshold_map::bayer<8>()); // 1 bit per channel
+ *      dither(I, Threshold_map::load("blue_noise.pgm"), 2); // 4 levels
+ *      dither(I, Threshold_map::bayer(16), 1, 4); // 4 threads
+ */
+
+#ifndef DITHER_H
+#define DITHER_H
+
+#include "PPM_lib.h"
+#include "Color_conv.h"
+#include <string>
+
+namespace PPM_lib {
+
+// the entry (i, j) of the Bayer matrix of size n (a power of two): the
+// matrix of size 2n is built of the blocks 4M + M2(bi, bj), where
+// M2 = {{0, 2}, {3, 1}}
+constexpr int bayer2(const int i, const int j) {
+    return i == 0 ? (j == 0 ? 0 : 2) : (j == 0 ? 3 : 1);
+}
+
+constexpr int bayer_value(const int n, const int i, const int j) {
+    return n == 1 ? 0 : 4 * bayer_value(n >> 1, i % (n >> 1), j % (n >> 1)) +
+        bayer2(i / (n >> 1), j / (n >> 1));
+}
+
+// the Bayer matrix of size N generated at compile time: Bayer<N>::value(i, j)
+template <int N>
+struct Bayer_table {
+    int v[N * N];
+};
+
+template <int N>
+constexpr Bayer_table<N> make_bayer() {
+    Bayer_table<N> t {};
+    for (int i {0}; i < N; ++i)
+        for (int j {0}; j < N; ++j)
+            t.v[i * N + j] = bayer_value(N, i, j);
+    return t;
+}
+
+template <int N>
+struct Bayer {
+    static_assert(N > 0 && (N & (N - 1)) == 0, "N is a power of two");
+    static_assert(N <= 256, "N is 256 at most");
+    static constexpr int size {N};
+    static constexpr Bayer_table<N> table {make_bayer<N>()};
+    static constexpr int value(const int i, const int j) {
+        return table.v[i * N + j];
+    }
+};
+
+template <int N>
+constexpr Bayer_table<N> Bayer<N>::table;
+
+/*
+ * Definition of class Threshold_map
+ */
+class Threshold_map {
+public:
+    using value_type = unsigned char;
+    using size_type = std::size_t;
+
+    // the tile of ranks 0 .. w * h - 1 (w columns of h values)
+    Threshold_map(const size_type, const size_type, const std::vector<int>&);
+    Threshold_map(const Threshold_map&) = default;
+    Threshold_map& operator=(const Threshold_map&) = default;
+
+    ~Threshold_map() = default;
+
+    template <int N>
+    static Threshold_map bayer() {
+        std::vector<int> r(N * N);
+        for (int i {0}; i < N; ++i)
+            for (int j {0}; j < N; ++j)
+                r[i * N + j] = Bayer<N>::value(i, j);
+        return {N, N, r};
+    }
+    static Threshold_map bayer(const int);
+    static Threshold_map from_tile(const GS_Image&);
+    static Threshold_map load(const std::string&);
+
+    size_type width() const { return w_; }
+    size_type height() const { return h_; }
+    value_type threshold(const int i, const int j) const {
+        return t_[i * h_ + j];
+    }
+
+    // the tile as an image: the thresholds, which load() reads back
+    GS_Image tile() const;
+    // the tile moved by (di, dj): its entry (i + di, j + dj) is used at
+    // (i, j), e.g. for a part of an image starting at the row dj
+    Threshold_map shifted(const size_type, const size_type) const;
+
+private:
+    size_type w_;
+    size_type h_;
+    std::vector<value_type> t_; // column by column, as the images
+};
+
+Conv_path dither_path();
+void set_dither_path(const Conv_path);
+
+// image, thresholds, bits per channel (1..8), number of threads
+void dither(GS_Image&, const Threshold_map&, const int = 1, const int = 0);
+void dither(RGB_Image&, const Threshold_map&, const int = 1, const int = 0);
+
+} // end namespace PPM_lib
+
+#endif
+
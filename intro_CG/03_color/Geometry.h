@@ -25,6 +25,7 @@
 #include "PPM_lib.h"
 #include "Vec.h"
 #include <algorithm>
+#include <cmath>
 
 #include <stdexcept>
 #include <iostream>
@@ -5,7 +5,7 @@
 using namespace PPM_lib;
 
 // helper function: skip commment lines in the header of the ppm image
-void skip_comment(std::istream &is) {
+void PPM_lib::skip_comment(std::istream &is) {
     char c;
     is >> c;
     while (c == '#') { // skipping comment lines
@@ -46,7 +46,7 @@ RGB_Image::RGB_Image(const std::string &fn): bgcolor_{0}, I_{} {
     using gray_type = RGB_Color::gray_type;
     for (int y {0}; y < h; ++y)
         for (int x {0}; x < w; ++x) {
-            const int idx {(y * h + x) * 3};
+            const int idx {(y * w + x) * 3};
             I_[x][y] = gray_type(v[idx]) << 16 | gray_type(v[idx + 1]) << 8 |
                 gray_type(v[idx + 2]);
         }
@@ -144,7 +144,7 @@ GS_Image::GS_Image(const std::string &fn): bgcolor_{}, I_{} {
         delete [] v;
     for (int y {0}; y < h; ++y)
         for (int x {0}; x < w; ++x)
-            I_[x][y] = v[y * h + x];
+            I_[x][y] = v[y * w + x];
     delete [] v;
 }
 
@@ -157,6 +157,17 @@ GS_Image::GS_Image(const RGB_Image& I):
                 I_[x][y] = rgb2gray(I[x][y]);
     }
 
+// copy a channel of an RGB image
+GS_Image::GS_Image(const Const_channel_view &V): GS_Image(V.width(),
+        V.height()) {
+    const auto h = height();
+    for (size_type x {0}; x < width(); ++x) {
+        const Const_channel_view::column c {V[x]};
+        for (size_type y {0}; y < h; ++y)
+            I_[x][y] = c[y];
+    }
+}
+
 GS_Image::GS_Image(const GS_Image &o): bgcolor_{o.bgcolor_}, I_{o.I_} { }
 
 GS_Image& GS_Image::operator=(const GS_Image &o) {
@@ -168,30 +179,15 @@ GS_Image& GS_Image::operator=(const GS_Image &o) {
 }
 
 const GS_Image RGB_Image::red() const {
-    const auto w = width(), h = height();
-    GS_Image R {w, h};
-    for (size_t x = 0; x < w; ++x)
-        for (size_t y = 0; y < h; ++y)
-            R[x][y] = color(x, y).red();
-    return R;
+    return GS_Image{channel(RGB_channel::red)};
 }
 
 const GS_Image RGB_Image::green() const {
-    const auto w = width(), h = height();
-    GS_Image R {w, h};
-    for (size_t x = 0; x < w; ++x)
-        for (size_t y = 0; y < h; ++y)
-            R[x][y] = color(x, y).green();
-    return R;
+    return GS_Image{channel(RGB_channel::green)};
 }
 
 const GS_Image RGB_Image::blue() const {
-    const auto w = width(), h = height();
-    GS_Image R {w, h};
-    for (size_t x = 0; x < w; ++x)
-        for (size_t y = 0; y < h; ++y)
-            R[x][y] = color(x, y).blue();
-    return R;
+    return GS_Image{channel(RGB_channel::blue)};
 }
 
 // change the background color
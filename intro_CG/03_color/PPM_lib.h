@@ -31,6 +31,9 @@ constexpr unsigned int gray2rgb(const unsigned char r, const unsigned char g,
     return r << 16 | g << 8 | b;
 }
 
+// skip the comment lines in the header of a ppm file
+void skip_comment(std::istream&);
+
 /*
  * Definition of class RGB_Color
  */
@@ -119,6 +122,14 @@ inline GS_Color& GS_Color::operator=(const GS_Color &o) {
 }
 
 class GS_Image; // forward declaration
+template <class, class> class Basic_channel_view;
+class RGB_Image;
+using Channel_view = Basic_channel_view<RGB_Image, unsigned char>;
+using Const_channel_view = Basic_channel_view<const RGB_Image,
+      const unsigned char>;
+
+// color channels: the shift of their bits in the rgb value
+enum class RGB_channel { red = 16, green = 8, blue = 0 };
 
 /*
  * Definition of class RGB_Image
@@ -156,6 +167,9 @@ public:
     const GS_Image red() const;
     const GS_Image green() const;
     const GS_Image blue() const;
+    // the channels in place (no copies): see Basic_channel_view
+    Channel_view channel(const RGB_channel);
+    Const_channel_view channel(const RGB_channel) const;
 
     void set_bgcolor(const RGB_Color&);
     void set_color(const int, const int, const RGB_Color& = 0xFFFFFF);
@@ -182,6 +196,7 @@ public:
     GS_Image(const size_type, const size_type, const GS_Color& = {});
     GS_Image(const std::string&);
     GS_Image(const RGB_Image&);
+    GS_Image(const Const_channel_view&);
     GS_Image(const GS_Image&);
     GS_Image &operator=(const GS_Image&);
 
@@ -210,6 +225,95 @@ private:
     mat I_;
 };
 
+/*
+ * Definition of class Basic_channel_view:
+ *      a non-owning view of one channel of an RGB_Image: the channel is a byte
+ *      lane of the rgb values, so every column of the view is a span over the
+ *      column of the image with the stride of the rgb value. The view is used
+ *      like a GS_Image (width(), height(), [x][y], color(), set_color()) by
+ *      the grayscale algorithms, which then process a channel in place,
+ *      without splitting the image into GS_Images and merging them back.
+ *      The view is valid as long as the image is not resized
+ */
+// a column of the channel: n bytes, one in every rgb value
+template <class Byte>
+class Channel_column {
+public:
+    using size_type = std::size_t;
+    static constexpr int stride {sizeof(RGB_Color::value_type)};
+
+    Channel_column(Byte *p, const size_type n): p_{p}, n_{n} { }
+    Channel_column(const Channel_column&) = default;
+    Channel_column& operator=(const Channel_column&) = default;
+
+    ~Channel_column() = default;
+
+    Byte& operator[](const int i) const { return p_[i * stride]; }
+    size_type size() const { return n_; }
+
+private:
+    Byte *p_;
+    size_type n_;
+};
+
+template <class Img, class Byte>
+class Basic_channel_view {
+public:
+    using value_type = GS_Color::value_type;
+    using size_type = std::size_t;
+    using column = Channel_column<Byte>;
+
+    Basic_channel_view(Img&, const RGB_channel);
+    Basic_channel_view(const Basic_channel_view&) = default;
+    Basic_channel_view& operator=(const Basic_channel_view&) = default;
+
+    ~Basic_channel_view() = default;
+
+    column operator[](const int x) const {
+        return {reinterpret_cast<Byte*>((*I_)[x].data()) + offset_, height()};
+    }
+
+    size_type width() const { return I_->width(); }
+    size_type height() const { return I_->height(); }
+    const GS_Color color(const int x, const int y) const {
+        return {(*this)[x][y]};
+    }
+
+    void set_color(const int, const int, const GS_Color& = 255) const;
+
+private:
+    Img *I_;
+    int offset_; // of the channel byte in the rgb value
+};
+
+/*
+ * Implementation of class Basic_channel_view
+ */
+template <class Img, class Byte>
+Basic_channel_view<Img, Byte>::Basic_channel_view(Img &I,
+        const RGB_channel c): I_{&I}, offset_{int(c) >> 3} {
+    static_assert(sizeof(RGB_Color::value_type) == 4, "32-bit rgb values");
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    offset_ = 3 - offset_;
+#endif
+}
+
+// set color to the individual pixel (of a writable view)
+template <class Img, class Byte>
+void Basic_channel_view<Img, Byte>::set_color(const int x, const int y,
+        const GS_Color &gc) const {
+    if (x >= 0 && x < int(width()) && y >= 0 && y < int(height()))
+        (*this)[x][y] = gc.color();
+}
+
+inline Channel_view RGB_Image::channel(const RGB_channel c) {
+    return {*this, c};
+}
+
+inline Const_channel_view RGB_Image::channel(const RGB_channel c) const {
+    return {*this, c};
+}
+
 } // end namespace PPM_lib
 
 #endif
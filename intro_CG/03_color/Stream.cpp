@@ -0,0 +1,408 @@
+#include "Stream.h"
+#include "Color_conv.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+using namespace PPM_lib;
+
+/*
+ * ------------------ Reading and writing rows ------------------
+ */
+// the rows of a P6 or P5 file in their order; the last `keep` rows read are
+// kept, so that the overlapping bands read them again from memory
+class PPM_reader {
+public:
+    using size_type = std::size_t;
+
+    PPM_reader(const std::string&, const size_type);
+
+    size_type width() const { return w_; }
+    size_type height() const { return h_; }
+
+    // the rows y .. y + n - 1 of the picture into the rows 0 .. n - 1 of I
+    void read(RGB_Image&, const size_type, const size_type);
+
+private:
+    std::ifstream ifs_;
+    size_type w_;
+    size_type h_;
+    size_type bpp_; // bytes per pixel: 3 (P6) or 1 (P5)
+    size_type keep_;
+    size_type next_; // the row of the file read next
+    std::vector<unsigned char> rows_; // keep rows (one at least), a ring
+};
+
+PPM_reader::PPM_reader(const std::string &fn, const size_type keep):
+    ifs_{fn, std::ios_base::binary}, w_{0}, h_{0}, bpp_{0},
+    keep_{std::max<size_type>(keep, 1)}, next_{0}, rows_{} {
+    using namespace std;
+    if (!ifs_)
+        throw runtime_error("cannot open file " + fn);
+    ifs_.exceptions(ifs_.exceptions() | ios_base::badbit);
+    string header;
+    ifs_ >> header;
+    if (header != "P6" && header != "P5")
+        throw runtime_error("wrong input file format");
+    bpp_ = header == "P6" ? 3 : 1;
+    skip_comment(ifs_);
+    int w, h, temp;
+    ifs_ >> w >> h >> temp;
+    if (!ifs_ || w < 1 || h < 1 || temp != 255)
+        throw runtime_error("cannot read input file");
+    ifs_.get(); // the single white space after the header
+    w_ = w;
+    h_ = h;
+    rows_.resize(keep_ * w_ * bpp_);
+}
+
+void PPM_reader::read(RGB_Image &I, const size_type y, const size_type n) {
+    const size_type len {w_ * bpp_};
+    for (size_type r {0}; r < n; ++r) {
+        unsigned char *p {&rows_[(y + r) % keep_ * len]};
+        if (y + r >= next_) {
+            if (y + r != next_)
+                throw std::runtime_error("rows of the file skipped");
+            ifs_.read(reinterpret_cast<char*>(p), len);
+            if (!ifs_)
+                throw std::runtime_error("cannot read input file");
+            ++next_;
+        } else if (next_ - (y + r) > keep_) {
+            throw std::runtime_error("rows of the file read again");
+        }
+        if (bpp_ == 3)
+            for (size_type x {0}; x < w_; ++x, p += 3)
+                I[x][r] = gray2rgb(p[0], p[1], p[2]);
+        else
+            for (size_type x {0}; x < w_; ++x, ++p)
+                I[x][r] = gray2rgb(*p, *p, *p);
+    }
+}
+
+// a gray pixel (r = g = b) is written to a P5 file as it is, the others
+// converted by rgb2gray()
+class PPM_writer {
+public:
+    using size_type = std::size_t;
+
+    PPM_writer(const std::string&, const size_type, const size_type,
+            const Format);
+
+    // the rows y .. y + n - 1 of I
+    void write(const RGB_Image&, const size_type, const size_type);
+
+private:
+    std::ofstream ofs_;
+    size_type bpp_;
+    std::vector<unsigned char> row_;
+};
+
+PPM_writer::PPM_writer(const std::string &fn, const size_type w,
+        const size_type h, const Format f): ofs_{fn, std::ios_base::binary},
+    bpp_{f == Format::RGB ? 3u : 1u}, row_(w * bpp_) {
+    if (!ofs_)
+        throw std::runtime_error("cannot open file " + fn);
+    ofs_.exceptions(ofs_.exceptions() | std::ios_base::badbit);
+    ofs_ << (bpp_ == 3 ? "P6\n" : "P5\n") << w << ' ' << h << "\n255\n";
+}
+
+void PPM_writer::write(const RGB_Image &I, const size_type y,
+        const size_type n) {
+    const size_type w {I.width()};
+    for (size_type r {y}; r < y + n; ++r) {
+        unsigned char *p {row_.data()};
+        for (size_type x {0}; x < w; ++x) {
+            const RGB_Color c {I[x][r]};
+            if (bpp_ == 3) {
+                *p++ = c.red();
+                *p++ = c.green();
+                *p++ = c.blue();
+            } else {
+                *p++ = c.red() == c.green() && c.green() == c.blue() ?
+                    c.red() : rgb2gray(c.color());
+            }
+        }
+        ofs_.write(reinterpret_cast<const char*>(row_.data()), row_.size());
+    }
+}
+
+/*
+ * ------------------ Stages ------------------
+ */
+// the planes of a worker: allocated again only when the size of the band
+// changes (the first and the last bands), not for every band
+static std::array<GS_Image, 3> &worker_planes(const std::size_t w,
+        const std::size_t h) {
+    static thread_local std::array<GS_Image, 3> P {{{w, h}, {w, h}, {w, h}}};
+    for (auto &c: P)
+        if (c.width() != w || c.height() != h)
+            c = GS_Image{w, h};
+    return P;
+}
+
+// rgb2gray(), the gray of GS_Image(const RGB_Image&) and of the P5 files
+Stage PPM_lib::gray_stage() {
+    return {0, [](Band &B) {
+        for (auto &c: B.image)
+            for (auto &v: c) {
+                const auto g = rgb2gray(v);
+                v = gray2rgb(g, g, g);
+            }
+    }};
+}
+
+Stage PPM_lib::rgb2ycbcr_stage() {
+    return {0, [](Band &B) {
+        const auto w = B.image.width(), h = B.image.height();
+        auto &P = worker_planes(w, h);
+        rgb2ycbcr(B.image, P[0], P[1], P[2]);
+        for (size_t x = 0; x < w; ++x)
+            for (size_t y = 0; y < h; ++y)
+                B.image[x][y] = gray2rgb(P[0][x][y], P[1][x][y], P[2][x][y]);
+    }};
+}
+
+// the three channels split in one pass
+Stage PPM_lib::ycbcr2rgb_stage() {
+    return {0, [](Band &B) {
+        const auto w = B.image.width(), h = B.image.height();
+        auto &P = worker_planes(w, h);
+        for (size_t x = 0; x < w; ++x)
+            for (size_t y = 0; y < h; ++y) {
+                const RGB_Color c {B.image[x][y]};
+                P[0][x][y] = c.red();
+                P[1][x][y] = c.green();
+                P[2][x][y] = c.blue();
+            }
+        ycbcr2rgb(P[0], P[1], P[2], B.image);
+    }};
+}
+
+// the map shifted to the first row of the band; the workers are the
+// threads, the band is dithered by one
+Stage PPM_lib::dither_stage(const Threshold_map &T, const int bits) {
+    if (bits < 1 || bits > 8)
+        throw std::runtime_error("dithering to 1..8 bits only");
+    return {0, [T, bits](Band &B) {
+        dither(B.image, T.shifted(0, B.y % T.height()), bits, 1);
+    }};
+}
+
+// the rows of the band still valid after the stage: every value is computed
+// from the rows of the picture only, the same in any band
+Stage PPM_lib::warp_stage(const Warp_map &m, const int overlap) {
+    if (overlap < 1)
+        throw std::runtime_error("a warp needs an overlap");
+    return {overlap, [m, overlap](Band &B) {
+        const RGB_Image src {B.image};
+        const long w = B.image.width(), ph = B.picture_height;
+        const long y0 = B.y, lo = B.lo, hi = B.hi;
+        const long first {y0 + lo > 0 ? lo + overlap : lo};
+        const long last {y0 + hi < ph ? hi - overlap : hi};
+        for (long x {0}; x < w; ++x)
+            for (long r {first}; r < last; ++r) {
+                const std::array<double, 2> p {m(x, y0 + r)};
+                if (!(p[0] >= 0 && p[0] <= w - 1 && p[1] >= 0 &&
+                            p[1] <= ph - 1)) {
+                    B.image[x][r] = 0;
+                    continue;
+                }
+                const long u0 = std::floor(p[0]), v0 = std::floor(p[1]);
+                const double fu {p[0] - u0}, fv {p[1] - v0};
+                const long u1 {std::min(u0 + 1, w - 1)};
+                const long s0 {v0 - y0}, s1 {std::min(v0 + 1, ph - 1) - y0};
+                if (s0 < lo || s1 >= hi)
+                    throw std::runtime_error("the warp moves the rows "
+                            "farther than its overlap");
+                const RGB_Color a {src[u0][s0]}, b {src[u1][s0]};
+                const RGB_Color c {src[u0][s1]}, d {src[u1][s1]};
+                auto mix = [&](const int ca, const int cb, const int cc,
+                        const int cd) {
+                    return (unsigned char)((ca + (cb - ca) * fu) * (1 - fv) +
+                            (cc + (cd - cc) * fu) * fv + 0.5);
+                };
+                B.image[x][r] = gray2rgb(
+                        mix(a.red(), b.red(), c.red(), d.red()),
+                        mix(a.green(), b.green(), c.green(), d.green()),
+                        mix(a.blue(), b.blue(), c.blue(), d.blue()));
+            }
+    }};
+}
+
+/*
+ * ------------------ Pipeline ------------------
+ */
+// the indices of the bands of the pool passed between the threads; pop()
+// waits for one, false when the queue is closed and empty
+class Band_queue {
+public:
+    Band_queue(): m_{}, cv_{}, q_{}, closed_{false} { }
+
+    void push(const int i) {
+        {
+            std::lock_guard<std::mutex> lock {m_};
+            q_.push_back(i);
+        }
+        cv_.notify_one();
+    }
+
+    bool pop(int &i) {
+        std::unique_lock<std::mutex> lock {m_};
+        cv_.wait(lock, [this] { return closed_ || !q_.empty(); });
+        if (q_.empty())
+            return false;
+        i = q_.front();
+        q_.pop_front();
+        return true;
+    }
+
+    void close() {
+        {
+            std::lock_guard<std::mutex> lock {m_};
+            closed_ = true;
+        }
+        cv_.notify_all();
+    }
+
+private:
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::deque<int> q_;
+    bool closed_;
+};
+
+Pipeline::Pipeline(const size_type rows, const int workers):
+    band_rows_{rows}, workers_{workers}, stages_{} {
+    if (rows < 1 || workers < 1)
+        throw std::runtime_error("a pipeline needs rows and workers");
+}
+
+Pipeline& Pipeline::add(const Stage &s) {
+    if (s.overlap < 0 || !s.run)
+        throw std::runtime_error("wrong stage");
+    stages_.push_back(s);
+    return *this;
+}
+
+int Pipeline::overlap() const {
+    int sum {0};
+    for (const auto &s: stages_)
+        sum += s.overlap;
+    return sum;
+}
+
+// the bands go from the free queue (reader) to the work queue (workers) to
+// the done queue (writer, which puts them back in the order of the picture)
+// and to the free queue again; the first exception stops all the threads
+// and is thrown again here
+void Pipeline::run(const std::string &in, const std::string &out,
+        const Format f) const {
+    const size_type ov = overlap(), n {band_rows_};
+    PPM_reader reader {in, 2 * ov};
+    const size_type w {reader.width()}, h {reader.height()};
+    const size_type bands {(h + n - 1) / n};
+    PPM_writer writer {out, w, h, f};
+
+    std::vector<Band> pool(workers_ + 2, Band{w, std::min(h, n + 2 * ov)});
+    Band_queue free_q, work_q, done_q;
+    for (size_type i {0}; i < pool.size(); ++i)
+        free_q.push(i);
+    std::exception_ptr error;
+    std::mutex error_m;
+    std::atomic<bool> failed {false};
+    auto fail = [&] {
+        {
+            std::lock_guard<std::mutex> lock {error_m};
+            if (!error)
+                error = std::current_exception();
+        }
+        failed = true;
+        for (Band_queue *q: {&free_q, &work_q, &done_q})
+            q->close();
+    };
+
+    std::thread read_t {[&] {
+        try {
+            int i;
+            for (size_type b {0}; b < bands && free_q.pop(i) && !failed; ++b) {
+                Band &B {pool[i]};
+                const size_type y {b * n}, rows {std::min(n, h - y)};
+                const size_type y0 {y > ov ? y - ov : 0};
+                const size_type y1 {std::min(h, y + rows + ov)};
+                if (B.image.height() != y1 - y0)
+                    B.image = RGB_Image{w, y1 - y0};
+                B.y = y0;
+                B.lo = 0;
+                B.hi = y1 - y0;
+                B.top = y - y0;
+                B.rows = rows;
+                B.picture_height = h;
+                B.index = b;
+                reader.read(B.image, y0, y1 - y0);
+                work_q.push(i);
+            }
+            work_q.close();
+        } catch (...) {
+            fail();
+        }
+    }};
+
+    std::atomic<int> working {workers_};
+    auto work = [&] {
+        try {
+            int i;
+            while (work_q.pop(i) && !failed) {
+                Band &B {pool[i]};
+                for (const Stage &s: stages_) {
+                    s.run(B);
+                    if (B.y + B.lo > 0)
+                        B.lo += s.overlap;
+                    if (B.y + B.hi < h)
+                        B.hi -= s.overlap;
+                }
+                done_q.push(i);
+            }
+        } catch (...) {
+            fail();
+        }
+        if (--working == 0)
+            done_q.close();
+    };
+    std::vector<std::thread> work_t;
+    for (int k {0}; k < workers_; ++k)
+        work_t.emplace_back(work);
+
+    size_type next {0};
+    try {
+        std::map<size_type, int> waiting;
+        int i;
+        while (next < bands && done_q.pop(i) && !failed) {
+            waiting[pool[i].index] = i;
+            for (auto p = waiting.begin(); p != waiting.end() &&
+                    p->first == next; p = waiting.erase(p), ++next) {
+                const Band &B {pool[p->second]};
+                writer.write(B.image, B.top, B.rows);
+                free_q.push(p->second);
+            }
+        }
+    } catch (...) {
+        fail();
+    }
+    if (next == bands)
+        free_q.close();
+    read_t.join();
+    for (auto &t: work_t)
+        t.join();
+    if (error)
+        std::rethrow_exception(error);
+    if (next != bands)
+        throw std::runtime_error("the pipeline stopped early");
+}
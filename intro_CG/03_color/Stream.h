@@ -0,0 +1,114 @@
+/*
+ * Streaming pipeline:
+ *      a PPM file (P6, or P5 read as gray rgb values) is read, processed and
+ *      written band by band: a band is a few rows of the image (band_rows)
+ *      held in an RGB_Image of the width of the file, so the whole image is
+ *      never in memory. The stages run on every band in their order:
+ *          gray_stage(): the gray of rgb2gray() in all the channels
+ *          rgb2ycbcr_stage() / ycbcr2rgb_stage(): Y, Cb, Cr in the red,
+ *          green, blue channels and back
+ *          dither_stage(): ordered dithering, the threshold map continues
+ *          over the bands
+ *          warp_stage(): resampling at the positions given by a map, which
+ *          moves the rows by less than the overlap of the stage
+ *          a Stage of its own: the overlap and a function of the band
+ *
+ *      Overlap: a stage reading the rows around a pixel (warp, filters)
+ *      declares how many; the bands are read with the sum of the overlaps of
+ *      the stages as the context above and below, and every stage leaves
+ *      its overlap less of the context valid (Band::lo, Band::hi)
+ *
+ *      Threads: a reader fills the bands, the workers run the stages (a band
+ *      each), the calling thread writes the bands in their order. The bands
+ *      are a pool of workers + 2 buffers, which the reader waits for, so the
+ *      memory is bounded by the pool whatever the size of the file
+ *
+ * Examples:
+ *      Pipeline p {64, 2}; // 64 rows per band, 2 workers
+ *      p.add(gray_stage()).add(dither_stage(Threshold_map::bayer<8>()));
+ *      p.run("scan.ppm", "scan_bw.pgm", Format::GS);
+ */
+
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "PPM_lib.h"
+#include "Dither.h"
+#include <array>
+#include <functional>
+#include <string>
+
+namespace PPM_lib {
+
+/*
+ * Definition of class Band:
+ *      the rows y .. y + image.height() - 1 of the picture; the rows lo .. hi
+ *      - 1 of the image are valid, the rows top .. top + rows - 1 are written
+ *      out (the others are the context of the stages)
+ */
+struct Band {
+    using size_type = std::size_t;
+
+    Band(const size_type w, const size_type h): image{w, h}, y{0}, lo{0},
+        hi{h}, top{0}, rows{0}, picture_height{0}, index{0} { }
+
+    RGB_Image image;
+    size_type y;
+    size_type lo;
+    size_type hi;
+    size_type top;
+    size_type rows;
+    size_type picture_height;
+    size_type index; // of the band in the picture
+};
+
+// overlap: rows of context needed above and below the rows to compute
+struct Stage {
+    int overlap;
+    std::function<void(Band&)> run;
+};
+
+Stage gray_stage();
+Stage rgb2ycbcr_stage();
+Stage ycbcr2rgb_stage();
+// thresholds, bits per channel (1..8)
+Stage dither_stage(const Threshold_map&, const int = 1);
+// the position (x, y) of the picture sampled (bilinear) for the pixel (x, y),
+// the rows moved by less than the overlap (the positions out of the picture
+// are black)
+using Warp_map = std::function<std::array<double, 2>(double, double)>;
+Stage warp_stage(const Warp_map&, const int);
+
+/*
+ * Definition of class Pipeline
+ */
+class Pipeline {
+public:
+    using size_type = std::size_t;
+
+    // rows per band, number of the workers
+    Pipeline(const size_type = 64, const int = 1);
+    Pipeline(const Pipeline&) = default;
+    Pipeline& operator=(const Pipeline&) = default;
+
+    ~Pipeline() = default;
+
+    Pipeline& add(const Stage&);
+
+    size_type band_rows() const { return band_rows_; }
+    int workers() const { return workers_; }
+    int overlap() const; // of all the stages
+
+    // input file, output file (Format::RGB: P6, Format::GS: P5)
+    void run(const std::string&, const std::string&,
+            const Format = Format::RGB) const;
+
+private:
+    size_type band_rows_;
+    int workers_;
+    std::vector<Stage> stages_;
+};
+
+} // end namespace PPM_lib
+
+#endif
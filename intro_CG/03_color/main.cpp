@@ -6,12 +6,18 @@
 
 
 #include "PPM_lib.h"
+#include "Color_conv.h"
+#include "Dither.h"
+#include "Diffusion.h"
+#include "Stream.h"
 #include "Geometry.h"
 #include <iostream>
 #include <array>
 #include <chrono>
 #include <bitset>
 #include <algorithm>
+#include <cmath>
+#include <thread>
 
 // define file (path) separator depending on OS
 #ifdef _WIN32
@@ -35,8 +41,9 @@ void disp_array_int(const C &A) {
     }
 }
 
-// apply ordered dither to a grayscale image
-void ordered_dither(PPM_lib::GS_Image &I) {
+// apply ordered dither to a grayscale image: a GS_Image or a channel view
+template <class Gray>
+void ordered_dither(Gray &I) {
     using namespace PPM_lib;
     using namespace std;
     using gray_t = GS_Image::value_type;
@@ -61,17 +68,18 @@ void ordered_dither(PPM_lib::GS_Image &I) {
     //I[x][y] = (I[x][y] * 5 >> 8) > M2[x % 2][y % 2] ? 255 : 0;
 }
 
+// every channel in place
 void ordered_dither(PPM_lib::RGB_Image &I) {
-    PPM_lib::GS_Image R {I.red()};
-    PPM_lib::GS_Image G {I.green()};
-    PPM_lib::GS_Image B {I.blue()};
-    ordered_dither(R);
-    ordered_dither(G);
-    ordered_dither(B);
-    I = PPM_lib::RGB_Image{R, G, B};
+    using PPM_lib::RGB_channel;
+    for (const auto c: {RGB_channel::red, RGB_channel::green,
+            RGB_channel::blue}) {
+        PPM_lib::Channel_view V {I.channel(c)};
+        ordered_dither(V);
+    }
 }
 
-void error_diffusion(PPM_lib::GS_Image &I) {
+template <class Gray>
+void error_diffusion(Gray &I) {
     const auto h = I.height() - 1;
     for (size_t x {2}; x < I.width() - 2; ++x)
         for (size_t y {0}; y < h; ++y) {
@@ -91,13 +99,50 @@ void error_diffusion(PPM_lib::GS_Image &I) {
 }
 
 void error_diffusion(PPM_lib::RGB_Image &I) {
-    PPM_lib::GS_Image R {I.red()};
-    PPM_lib::GS_Image G {I.green()};
-    PPM_lib::GS_Image B {I.blue()};
-    error_diffusion(R);
-    error_diffusion(G);
-    error_diffusion(B);
-    I = PPM_lib::RGB_Image{R, G, B};
+    using PPM_lib::RGB_channel;
+    for (const auto c: {RGB_channel::red, RGB_channel::green,
+            RGB_channel::blue}) {
+        PPM_lib::Channel_view V {I.channel(c)};
+        error_diffusion(V);
+    }
+}
+
+// the dithering of the channels in place (channel views) against the split
+// into GS_Images and the merge: the same images
+void test_channel_views() {
+    using namespace PPM_lib;
+    const RGB_Image I {"../imgs/building.ppm"};
+    auto split = [](const RGB_Image &J, void (*f)(GS_Image&)) {
+        GS_Image R {J.red()}, G {J.green()}, B {J.blue()};
+        f(R);
+        f(G);
+        f(B);
+        return RGB_Image{R, G, B};
+    };
+    auto same = [](const RGB_Image &A, const RGB_Image &B) {
+        bool eq {true};
+        for (size_t x = 0; x < A.width(); ++x)
+            eq = eq && A[x] == B[x];
+        return eq;
+    };
+    bool ok {true};
+    for (int k {0}; k < 2; ++k) {
+        RGB_Image J {I};
+        k ? error_diffusion(J) : ordered_dither(J);
+        const bool eq {same(J, split(I, k ? error_diffusion<GS_Image> :
+                    ordered_dither<GS_Image>))};
+        std::cout << (k ? "error diffusion" : "ordered dither") <<
+            " in place: " << (eq ? "same image" : "image DIFFERS") << '\n';
+        ok = ok && eq;
+    }
+    // a write through the view changes only its byte of the rgb value
+    RGB_Image J {I};
+    Channel_view G {J.channel(RGB_channel::green)};
+    G.set_color(1, 2, 0xAB);
+    ok = ok && J[1][2] == ((I[1][2] & 0xFF00FF) | 0xAB00) &&
+        G.color(1, 2).color() == 0xAB;
+    std::cout << (ok ? "channel views passed" : "channel views FAILED") <<
+        '\n';
 }
 
 // construct a name for a new file
@@ -107,6 +152,39 @@ std::string create_outname(const std::string &fn, const std::string &ins) {
     return s.insert(0, ins);
 }
 
+// the image of size w x h covered by copies of src (a picture of any size
+// for the tests and the benchmarks)
+template <class Img>
+Img tiled(const Img &src, const size_t w, const size_t h) {
+    Img I {w, h};
+    for (size_t x = 0; x < w; ++x)
+        for (size_t y = 0; y < h; ++y)
+            I[x][y] = src[x % src.width()][y % src.height()];
+    return I;
+}
+
+// mean gray of the image
+double mean(const PPM_lib::GS_Image &I) {
+    double sum {0};
+    for (const auto &c: I)
+        for (const auto v: c)
+            sum += v;
+    return sum / (I.width() * I.height());
+}
+
+#ifdef BENCH
+// Mpixel/s of reps calls of f for the image of size w x h
+template <class F>
+double mpixels(const size_t w, const size_t h, const int reps, F f) {
+    using namespace std::chrono;
+    const auto t0 = steady_clock::now();
+    for (int r {0}; r < reps; ++r)
+        f();
+    const double t {duration<double>(steady_clock::now() - t0).count()};
+    return w * h * double(reps) / t * 1E-6;
+}
+#endif
+
 void test_gray() {
     using namespace PPM_lib;
     // read image
@@ -119,13 +197,84 @@ void test_gray() {
 }
 
 void test_dither() {
+    using namespace PPM_lib;
     //const std::string fn {"../imgs/baboon.ppm"};
     const std::string fn {"../imgs/building.ppm"};
-    //PPM_lib::GS_Image I {fn};
-    PPM_lib::RGB_Image I {fn};
-    ordered_dither(I);
+    //GS_Image I {fn};
+    RGB_Image I {fn};
+    dither(I, Threshold_map::bayer<8>());
     //I.write_to("baboon_dither.ppm");
     I.write_to(create_outname(fn, "dither_"));
+    RGB_Image J {fn};
+    dither(J, Threshold_map::bayer<8>(), 2); // 4 levels per channel
+    J.write_to(create_outname(fn, "dither2_"));
+}
+
+// the dithering engine: the compile-time Bayer matrix is the one of the old
+// ordered_dither(), every kernel and thread count gives the image of the
+// scalar kernel, the mean gray is kept, 8 bits change nothing, a tile written
+// and loaded back gives the same thresholds, an RGB image is dithered as its
+// three channels
+void test_dither_engine() {
+    using namespace PPM_lib;
+    static_assert(Bayer<4>::value(0, 1) == 8 && Bayer<4>::value(0, 2) == 2 &&
+            Bayer<4>::value(3, 3) == 5, "4x4 Bayer matrix");
+    bool ok {true};
+    const Threshold_map B8 {Threshold_map::bayer<8>()};
+    const Threshold_map R8 {Threshold_map::bayer(8)};
+    for (int i {0}; i < 8; ++i)
+        for (int j {0}; j < 8; ++j)
+            ok = ok && B8.threshold(i, j) == R8.threshold(i, j);
+
+    // a horizontal ramp of an odd height: the kernels end with the scalar code
+    constexpr size_t w {1024}, h {67};
+    GS_Image ramp {w, h};
+    for (size_t x = 0; x < w; ++x)
+        for (size_t y = 0; y < h; ++y)
+            ramp[x][y] = x * 255 / (w - 1);
+    const Conv_path old_path {dither_path()};
+    for (const int bits: {1, 2, 3, 8}) {
+        set_dither_path(Conv_path::scalar);
+        GS_Image ref {ramp};
+        dither(ref, B8, bits, 1);
+        const double err {std::abs(mean(ref) - mean(ramp))};
+        bool same {true};
+        for (const auto p: {Conv_path::sse2, Conv_path::avx2}) {
+            if (!conv_path_supported(p))
+                continue;
+            set_dither_path(p);
+            for (const int nt: {1, 3}) {
+                GS_Image I {ramp};
+                dither(I, B8, bits, nt);
+                for (size_t x = 0; x < w; ++x)
+                    same = same && I[x] == ref[x];
+            }
+        }
+        bool identity {true};
+        for (size_t x = 0; bits == 8 && x < w; ++x)
+            identity = identity && ref[x] == ramp[x];
+        std::cout << bits << " bits: mean error " << err << ", " <<
+            (same ? "all kernels same" : "kernels DIFFER") << '\n';
+        ok = ok && same && identity && err < 1;
+    }
+    set_dither_path(old_path);
+
+    const Threshold_map B16 {Threshold_map::bayer(16)};
+    B16.tile().write_to("bayer_16.pgm");
+    const Threshold_map L16 {Threshold_map::load("bayer_16.pgm")};
+    for (int i {0}; i < 16; ++i)
+        for (int j {0}; j < 16; ++j)
+            ok = ok && B16.threshold(i, j) == L16.threshold(i, j);
+
+    RGB_Image I {"../imgs/building.ppm"};
+    GS_Image R {I.red()}, G {I.green()}, Bl {I.blue()};
+    for (GS_Image *c: {&R, &G, &Bl})
+        dither(*c, L16, 2);
+    dither(I, L16, 2);
+    const RGB_Image J {R, G, Bl};
+    for (size_t x = 0; x < I.width(); ++x)
+        ok = ok && I[x] == J[x];
+    std::cout << (ok ? "dithering passed" : "dithering FAILED") << '\n';
 }
 
 void test_error_diffusion() {
@@ -133,22 +282,123 @@ void test_error_diffusion() {
     const std::string fn {"../imgs/building.ppm"};
     //PPM_lib::GS_Image I {fn};
     PPM_lib::RGB_Image I {fn};
-    error_diffusion(I);
+    PPM_lib::diffuse(I);
     I.write_to(create_outname(fn, "err_diff_"));
+    PPM_lib::RGB_Image J {fn};
+    PPM_lib::diffuse(J, PPM_lib::jarvis, true, 2); // serpentine, 4 levels
+    J.write_to(create_outname(fn, "err_diff2_"));
 }
 
-void display_rgb_channels(const std::string &fn) {
-    PPM_lib::RGB_Image I {fn};
-    const auto w = I.width(), h = I.height();
-    PPM_lib::GS_Image IR {w, h};
-    PPM_lib::GS_Image IG {w, h};
-    PPM_lib::GS_Image IB {w, h};
+// the error diffusion engine: every thread count gives the image of one
+// thread (each kernel, serpentine or not), 1 bit gives 0 and 255 only, the
+// mean gray of a ramp is kept (Atkinson loses a quarter of the error), 8 bits
+// change nothing, an RGB image is diffused as its three channels
+void test_diffusion_engine() {
+    using namespace PPM_lib;
+    constexpr size_t w {301}, h {203};
+    GS_Image ramp {w, h};
     for (size_t x = 0; x < w; ++x)
-        for (size_t y = 0; y < h; ++y) {
-            IR[x][y] = I.color(x, y).red();
-            IG[x][y] = I.color(x, y).green();
-            IB[x][y] = I.color(x, y).blue();
+        for (size_t y = 0; y < h; ++y)
+            ramp[x][y] = (x + y) * 255 / (w + h - 2);
+    bool ok {true};
+    for (const Diffusion_kernel *k: {&floyd_steinberg, &jarvis, &stucki,
+            &atkinson})
+        for (const bool serp: {false, true}) {
+            GS_Image ref {ramp};
+            diffuse(ref, *k, serp, 1, 1);
+            bool same {true}, binary {true};
+            for (const int nt: {2, 3, 8}) {
+                GS_Image I {ramp};
+                diffuse(I, *k, serp, 1, nt);
+                for (size_t x = 0; x < w; ++x)
+                    same = same && I[x] == ref[x];
+            }
+            for (const auto &c: ref)
+                for (const auto v: c)
+                    binary = binary && (v == 0 || v == 255);
+            const double err {std::abs(mean(ref) - mean(ramp))};
+            std::cout << k->name << (serp ? " serpentine" : "") <<
+                ": mean error " << err << ", " << (same ?
+                        "all thread counts same" : "thread counts DIFFER") <<
+                '\n';
+            ok = ok && same && binary && err < (k == &atkinson ? 4 : 1);
         }
+    GS_Image I {ramp};
+    diffuse(I, stucki, false, 8, 3);
+    for (size_t x = 0; x < w; ++x)
+        ok = ok && I[x] == ramp[x];
+
+    RGB_Image C {"../imgs/building.ppm"};
+    GS_Image R {C.red()}, G {C.green()}, B {C.blue()};
+    for (GS_Image *c: {&R, &G, &B})
+        diffuse(*c, floyd_steinberg, true, 2, 2);
+    diffuse(C, floyd_steinberg, true, 2, 2);
+    const RGB_Image D {R, G, B};
+    for (size_t x = 0; x < C.width(); ++x)
+        ok = ok && C[x] == D[x];
+    std::cout << (ok ? "error diffusion passed" : "error diffusion FAILED") <<
+        '\n';
+}
+
+// the streaming pipeline: a picture of an odd size (building.ppm tiled) is
+// copied as it is, made gray and dithered band by band into the image of the
+// same operations on the whole picture (the bands start inside the Bayer
+// tile); the warps (reading the rows around) give the same file for any band
+// size and number of workers, a warp moving the rows farther than its
+// overlap throws
+void test_stream() {
+    using namespace PPM_lib;
+    constexpr size_t w {301}, h {203};
+    RGB_Image I {tiled(RGB_Image {"../imgs/building.ppm"}, w, h)};
+    I.write_to("stream_in.ppm");
+    bool ok {true};
+
+    Pipeline {16, 2}.run("stream_in.ppm", "stream_copy.ppm");
+    const RGB_Image C {"stream_copy.ppm"};
+    for (size_t x = 0; x < w; ++x)
+        ok = ok && C[x] == I[x];
+
+    const Threshold_map B8 {Threshold_map::bayer<8>()};
+    GS_Image Y {I};
+    dither(Y, B8, 2);
+    Pipeline p {37, 3};
+    p.add(gray_stage()).add(dither_stage(B8, 2));
+    p.run("stream_in.ppm", "stream_dither.pgm", Format::GS);
+    const GS_Image D {"stream_dither.pgm"};
+    for (size_t x = 0; x < w; ++x)
+        ok = ok && D[x] == Y[x];
+
+    const Warp_map wave {[](const double x, const double y) {
+        return std::array<double, 2> {x + 3 * std::sin(y / 9),
+            y + 2.5 * std::sin(x / 13)};
+    }};
+    Pipeline whole {h, 1}, bands {10, 3};
+    for (Pipeline *q: {&whole, &bands})
+        q->add(warp_stage(wave, 3)).add(rgb2ycbcr_stage()).
+            add(warp_stage(wave, 3)).add(ycbcr2rgb_stage());
+    whole.run("stream_in.ppm", "stream_warp1.ppm");
+    bands.run("stream_in.ppm", "stream_warp2.ppm");
+    const RGB_Image W1 {"stream_warp1.ppm"}, W2 {"stream_warp2.ppm"};
+    for (size_t x = 0; x < w; ++x)
+        ok = ok && W1[x] == W2[x];
+
+    bool thrown {false};
+    try {
+        Pipeline {10, 2}.add(warp_stage(wave, 1)).run("stream_in.ppm",
+                "stream_warp3.ppm");
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    ok = ok && thrown;
+    std::cout << (ok ? "streaming passed" : "streaming FAILED") << '\n';
+}
+
+void display_rgb_channels(const std::string &fn) {
+    using PPM_lib::RGB_channel;
+    const PPM_lib::RGB_Image I {fn};
+    PPM_lib::GS_Image IR {I.channel(RGB_channel::red)};
+    PPM_lib::GS_Image IG {I.channel(RGB_channel::green)};
+    PPM_lib::GS_Image IB {I.channel(RGB_channel::blue)};
     IR.write_to(create_outname(fn, "red_"));
     IG.write_to(create_outname(fn, "green_"));
     IB.write_to(create_outname(fn, "blue_"));
@@ -181,41 +431,17 @@ constexpr std::array<unsigned char, 3> cmyk2rgb(const std::array<double, 4> &a){
 }
 
 void display_cmyk_channels(const std::string &fn) {
-    PPM_lib::RGB_Image I {fn};
+    using namespace PPM_lib;
+    RGB_Image I {fn};
     const auto w = I.width(), h = I.height();
-    PPM_lib::GS_Image IC {w, h};
-    PPM_lib::GS_Image IM {w, h};
-    PPM_lib::GS_Image IY {w, h};
-    PPM_lib::GS_Image IK {w, h};
-    PPM_lib::GS_Image IR {w, h};
-    PPM_lib::GS_Image IG {w, h};
-    PPM_lib::GS_Image IB {w, h};
-    for (size_t x = 0; x < w; ++x)
-        for (size_t y = 0; y < h; ++y) {
-            const std::array<double, 4> cmyk = rgb2cmyk(I.color(x, y).red(),
-                    I.color(x, y).green(), I.color(x, y).blue());
-            //const double r = I.color(x, y).red() / 255.0;
-            //const double g = I.color(x, y).green() / 255.0;
-            //const double b = I.color(x, y).blue() / 255.0;
-            //const double k = std::max({r, g, b}); // 1 - k
-            //IC[x][y] = k > 0 ? (1 - r / k) * 255 : 0;
-            //IM[x][y] = k > 0 ? (1 - g / k) * 255 : 0;
-            //IY[x][y] = k > 0 ? (1 - b / k) * 255 : 0;
-            //IK[x][y] = (1 - k) * 255;
-            IC[x][y] = cmyk[0] * 255;
-            IM[x][y] = cmyk[1] * 255;
-            IY[x][y] = cmyk[2] * 255;
-            IK[x][y] = cmyk[3] * 255;
-            const std::array<unsigned char, 3> rgb = cmyk2rgb(cmyk);
-            IR[x][y] = rgb[0];
-            IG[x][y] = rgb[1];
-            IB[x][y] = rgb[2];
-        }
+    GS_Image IC {w, h}, IM {w, h}, IY {w, h}, IK {w, h};
+    rgb2cmyk(I, IC, IM, IY, IK);
     IC.write_to(create_outname(fn, "cyan_"));
     IM.write_to(create_outname(fn, "magenta_"));
     IY.write_to(create_outname(fn, "yellow_"));
     IK.write_to(create_outname(fn, "black_"));
-    PPM_lib::RGB_Image{IR, IG, IB}.write_to(create_outname(fn, "rgb_"));
+    cmyk2rgb(IC, IM, IY, IK, I);
+    I.write_to(create_outname(fn, "rgb_"));
 }
 
 std::array<double, 3> rgb2hsv(const unsigned char r, const unsigned char g,
@@ -307,62 +533,274 @@ constexpr std::array<unsigned char, 3> ycbcr2rgb(const
 }
 
 void display_hsv_channels(const std::string &fn) {
-    PPM_lib::RGB_Image I {fn};
+    using namespace PPM_lib;
+    RGB_Image I {fn};
     const auto w = I.width(), h = I.height();
-    PPM_lib::GS_Image H {w, h};
-    PPM_lib::GS_Image S {w, h};
-    PPM_lib::GS_Image V {w, h};
-    PPM_lib::GS_Image IR {w, h};
-    PPM_lib::GS_Image IG {w, h};
-    PPM_lib::GS_Image IB {w, h};
-    for (size_t x = 0; x < w; ++x)
-        for (size_t y = 0; y < h; ++y) {
-            const std::array<double, 3> hsv = rgb2hsv(I.color(x, y).red(),
-                    I.color(x, y).green(), I.color(x, y).blue());
-            H[x][y] = hsv[0] / 360.0 * 255;
-            S[x][y] = hsv[1] * 255;
-            V[x][y] = hsv[2];
-
-            const std::array<unsigned char, 3> rgb = hsv2rgb(hsv);
-            IR[x][y] = rgb[0];
-            IG[x][y] = rgb[1];
-            IB[x][y] = rgb[2];
-        }
+    GS_Image H {w, h}, S {w, h}, V {w, h};
+    rgb2hsv(I, H, S, V);
     H.write_to(create_outname(fn, "hue_"));
     S.write_to(create_outname(fn, "sat_"));
     V.write_to(create_outname(fn, "val_"));
-    PPM_lib::RGB_Image{IR, IG, IB}.write_to(create_outname(fn, "rgb_"));
+    hsv2rgb(H, S, V, I);
+    I.write_to(create_outname(fn, "rgb_"));
 }
 
 void display_ycbcr_channels(const std::string &fn) {
-    PPM_lib::RGB_Image I {fn};
+    using namespace PPM_lib;
+    RGB_Image I {fn};
     const auto w = I.width(), h = I.height();
-    PPM_lib::GS_Image Y {w, h};
-    PPM_lib::GS_Image Cb {w, h};
-    PPM_lib::GS_Image Cr {w, h};
-    PPM_lib::GS_Image IR {w, h};
-    PPM_lib::GS_Image IG {w, h};
-    PPM_lib::GS_Image IB {w, h};
-    for (size_t x = 0; x < w; ++x)
-        for (size_t y = 0; y < h; ++y) {
-            const std::array<unsigned char, 3> ycbcr =
-                rgb2ycbcr(I.color(x, y).red(), I.color(x, y).green(),
-                        I.color(x, y).blue());
-            Y[x][y] = ycbcr[0];
-            Cb[x][y] = ycbcr[1];
-            Cr[x][y] = ycbcr[2];
-
-            const std::array<unsigned char, 3> rgb = ycbcr2rgb(ycbcr);
-            IR[x][y] = rgb[0];
-            IG[x][y] = rgb[1];
-            IB[x][y] = rgb[2];
-        }
+    GS_Image Y {w, h}, Cb {w, h}, Cr {w, h};
+    rgb2ycbcr(I, Y, Cb, Cr);
     Y.write_to(create_outname(fn, "y_"));
     Cb.write_to(create_outname(fn, "cb_"));
     Cr.write_to(create_outname(fn, "cr_"));
-    PPM_lib::RGB_Image{IR, IG, IB}.write_to(create_outname(fn, "rgb_"));
+    ycbcr2rgb(Y, Cb, Cr, I);
+    I.write_to(create_outname(fn, "rgb_"));
+}
+
+// largest and mean difference of the color components of two images
+std::array<double, 2> color_error(const PPM_lib::RGB_Image &A,
+        const PPM_lib::RGB_Image &B) {
+    int max_err {0};
+    double sum {0};
+    for (size_t x = 0; x < A.width(); ++x)
+        for (size_t y = 0; y < A.height(); ++y)
+            for (const int s: {16, 8, 0}) {
+                const int e {std::abs(int(A[x][y] >> s & 0xFF) -
+                        int(B[x][y] >> s & 0xFF))};
+                max_err = std::max(max_err, e);
+                sum += e;
+            }
+    return {double(max_err), sum / (A.width() * A.height() * 3)};
 }
 
+// the bulk conversions of every kernel: the channels and the images converted
+// back are the same as those of the scalar kernels, the round trip error is
+// within the limit; YCbCr is also compared to the per-pixel rgb2ycbcr()
+void test_color_conv() {
+    using namespace PPM_lib;
+    const RGB_Image src {"../imgs/baboon.ppm"};
+    // an odd height: the kernels finish every column by the scalar code
+    const auto w = src.width(), h = src.height() - 3;
+    RGB_Image I {w, h};
+    for (size_t x = 0; x < w; ++x)
+        std::copy(src[x].begin(), src[x].begin() + h, I[x].begin());
+    const Conv_path old_path {conv_path()};
+    struct Result {
+        std::vector<GS_Image> ch;
+        RGB_Image back;
+    };
+    auto run = [&](const Conv_path p, const int space) -> Result {
+        set_conv_path(p);
+        Result r {std::vector<GS_Image>(4, GS_Image{w, h}), RGB_Image{w, h}};
+        std::vector<GS_Image> &c = r.ch;
+        switch (space) {
+            case 0:
+                rgb2ycbcr(I, c[0], c[1], c[2]);
+                ycbcr2rgb(c[0], c[1], c[2], r.back);
+                break;
+            case 1:
+                rgb2hsv(I, c[0], c[1], c[2]);
+                hsv2rgb(c[0], c[1], c[2], r.back);
+                break;
+            default:
+                rgb2cmyk(I, c[0], c[1], c[2], c[3]);
+                cmyk2rgb(c[0], c[1], c[2], c[3], r.back);
+        }
+        return r;
+    };
+    static constexpr const char *names[] {"ycbcr", "hsv", "cmyk"};
+    static constexpr int limits[] {3, 4, 1}; // largest round trip error
+    bool ok {true};
+    for (int space {0}; space < 3; ++space) {
+        const Result ref {run(Conv_path::scalar, space)};
+        const std::array<double, 2> err {color_error(I, ref.back)};
+        std::cout << names[space] << " round trip: max error " << err[0] <<
+            ", mean " << err[1] << '\n';
+        ok = ok && err[0] <= limits[space];
+        for (const auto p: {Conv_path::sse2, Conv_path::avx2}) {
+            if (!conv_path_supported(p))
+                continue;
+            const Result r {run(p, space)};
+            bool same {color_error(ref.back, r.back)[0] == 0};
+            for (int k {0}; k < 4; ++k)
+                for (size_t x = 0; x < w; ++x)
+                    same = same && r.ch[k][x] == ref.ch[k][x];
+            std::cout << "    " << conv_path_name(p) << ": " <<
+                (same ? "same as scalar" : "DIFFERS from scalar") << '\n';
+            ok = ok && same;
+        }
+    }
+    // the fixed-point YCbCr rounds, the per-pixel one truncates
+    const Result ycc {run(Conv_path::scalar, 0)};
+    int max_err {0};
+    for (size_t x = 0; x < w; ++x)
+        for (size_t y = 0; y < h; ++y) {
+            const RGB_Color c {I.color(x, y)};
+            const std::array<unsigned char, 3> a {rgb2ycbcr(c.red(),
+                    c.green(), c.blue())};
+            for (int k {0}; k < 3; ++k)
+                max_err = std::max(max_err, std::abs(int(a[k]) -
+                            int(ycc.ch[k][x][y])));
+        }
+    std::cout << "ycbcr against rgb2ycbcr(): max difference " << max_err <<
+        '\n';
+    ok = ok && max_err <= 1;
+    set_conv_path(old_path);
+    std::cout << (ok ? "color conversions passed" :
+            "color conversions FAILED") << '\n';
+}
+
+#ifdef BENCH
+// throughput of the conversions of baboon.ppm (forward and back): the
+// per-pixel functions with std::array and I.color() against the bulk
+// conversions of every kernel
+void bench_color_conv(const int reps = 50) {
+    using namespace PPM_lib;
+    RGB_Image I {"../imgs/baboon.ppm"};
+    const auto w = I.width(), h = I.height();
+    std::vector<GS_Image> c(4, GS_Image{w, h});
+    RGB_Image back {w, h};
+    auto report = [](const char *name, const char *path, const double mps) {
+        std::cout << name << ' ' << path << ": " << mps << " Mpixel/s\n";
+    };
+
+    report("ycbcr", "per pixel", mpixels(w, h, reps, [&] {
+        for (size_t x = 0; x < w; ++x)
+            for (size_t y = 0; y < h; ++y) {
+                const std::array<unsigned char, 3> a {rgb2ycbcr(
+                        I.color(x, y).red(), I.color(x, y).green(),
+                        I.color(x, y).blue())};
+                c[0][x][y] = a[0]; c[1][x][y] = a[1]; c[2][x][y] = a[2];
+                const std::array<unsigned char, 3> b {ycbcr2rgb(a)};
+                back[x][y] = gray2rgb(b[0], b[1], b[2]);
+            }
+    }));
+    report("hsv", "per pixel", mpixels(w, h, reps, [&] {
+        for (size_t x = 0; x < w; ++x)
+            for (size_t y = 0; y < h; ++y) {
+                const std::array<double, 3> a {rgb2hsv(I.color(x, y).red(),
+                        I.color(x, y).green(), I.color(x, y).blue())};
+                c[0][x][y] = a[0] / 360 * 255; c[1][x][y] = a[1] * 255;
+                c[2][x][y] = a[2];
+                const std::array<unsigned char, 3> b {hsv2rgb(a)};
+                back[x][y] = gray2rgb(b[0], b[1], b[2]);
+            }
+    }));
+    report("cmyk", "per pixel", mpixels(w, h, reps, [&] {
+        for (size_t x = 0; x < w; ++x)
+            for (size_t y = 0; y < h; ++y) {
+                const std::array<double, 4> a {rgb2cmyk(I.color(x, y).red(),
+                        I.color(x, y).green(), I.color(x, y).blue())};
+                for (int k {0}; k < 4; ++k)
+                    c[k][x][y] = a[k] * 255;
+                const std::array<unsigned char, 3> b {cmyk2rgb(a)};
+                back[x][y] = gray2rgb(b[0], b[1], b[2]);
+            }
+    }));
+    const Conv_path old_path {conv_path()};
+    for (const auto p: {Conv_path::scalar, Conv_path::sse2, Conv_path::avx2}) {
+        if (!conv_path_supported(p))
+            continue;
+        set_conv_path(p);
+        report("ycbcr", conv_path_name(p), mpixels(w, h, reps, [&] {
+            rgb2ycbcr(I, c[0], c[1], c[2]);
+            ycbcr2rgb(c[0], c[1], c[2], back);
+        }));
+        report("hsv", conv_path_name(p), mpixels(w, h, reps, [&] {
+            rgb2hsv(I, c[0], c[1], c[2]);
+            hsv2rgb(c[0], c[1], c[2], back);
+        }));
+        report("cmyk", conv_path_name(p), mpixels(w, h, reps, [&] {
+            rgb2cmyk(I, c[0], c[1], c[2], c[3]);
+            cmyk2rgb(c[0], c[1], c[2], c[3], back);
+        }));
+    }
+    set_conv_path(old_path);
+}
+
+// 1-bit ordered dithering of a 4096 x 4096 gray image (building.ppm tiled):
+// the old ordered_dither() against the engine with every kernel, one thread
+// and all of them
+void bench_dither(const int reps = 10) {
+    using namespace PPM_lib;
+    constexpr size_t w {4096}, h {4096};
+    const GS_Image I {tiled(GS_Image {"../imgs/building.ppm"}, w, h)};
+    GS_Image J {I};
+    std::cout << "dither per pixel: " << mpixels(w, h, reps, [&] {
+        J = I;
+        ordered_dither(J);
+    }) << " Mpixel/s\n";
+    const Threshold_map T {Threshold_map::bayer<4>()};
+    const Conv_path old_path {dither_path()};
+    for (const auto p: {Conv_path::scalar, Conv_path::sse2, Conv_path::avx2}) {
+        if (!conv_path_supported(p))
+            continue;
+        set_dither_path(p);
+        for (const int nt: {1, 0}) {
+            std::cout << "dither " << conv_path_name(p) << ", " <<
+                (nt ? "1 thread" : "all threads") << ": " <<
+                mpixels(w, h, reps, [&] {
+                    J = I;
+                    dither(J, T, 1, nt);
+                }) << " Mpixel/s\n";
+        }
+    }
+    set_dither_path(old_path);
+}
+
+// 1-bit error diffusion of a 7168 x 7168 gray image (building.ppm tiled):
+// the old error_diffusion() against the engine, one thread and all of them
+void bench_diffusion(const int reps = 1) {
+    using namespace PPM_lib;
+    constexpr size_t w {7168}, h {7168};
+    const GS_Image I {tiled(GS_Image {"../imgs/building.ppm"}, w, h)};
+    GS_Image J {I};
+    std::cout << "error diffusion per pixel: " << mpixels(w, h, reps, [&] {
+        J = I;
+        error_diffusion(J);
+    }) << " Mpixel/s\n";
+    for (const Diffusion_kernel *k: {&floyd_steinberg, &jarvis})
+        for (const int nt: {1, 0}) {
+            std::cout << "diffuse " << k->name << ", " <<
+                (nt ? "1 thread" : "all threads") << ": " <<
+                mpixels(w, h, reps, [&] {
+                    J = I;
+                    diffuse(J, *k, false, 1, nt);
+                }) << " Mpixel/s\n";
+        }
+}
+
+// gray and 1-bit Bayer dithering of a 4096 x 4096 file (building.ppm tiled):
+// the whole picture loaded, processed and written against the pipeline (64
+// rows per band) with one worker and one per hardware thread
+void bench_stream() {
+    using namespace PPM_lib;
+    constexpr size_t w {4096}, h {4096};
+    tiled(RGB_Image {"../imgs/building.ppm"}, w, h).write_to(
+            "stream_bench.ppm");
+    const Threshold_map T {Threshold_map::bayer<8>()};
+    const double whole {mpixels(w, h, 1, [&] {
+        GS_Image Y {RGB_Image {"stream_bench.ppm"}};
+        dither(Y, T, 1, 1);
+        Y.write_to("stream_bench.pgm");
+    })};
+    std::cout << "stream whole picture: " << whole << " Mpixel/s\n";
+    std::vector<int> workers {1};
+    if (std::thread::hardware_concurrency() > 1)
+        workers.push_back(std::thread::hardware_concurrency());
+    for (const int nw: workers) {
+        Pipeline p {64, nw};
+        p.add(gray_stage()).add(dither_stage(T));
+        std::cout << "stream " << nw << " workers (" << (nw + 2) * 64 * w *
+            sizeof(RGB_Color::value_type) / 1024 << " KB of bands): " <<
+            mpixels(w, h, 1, [&] {
+                p.run("stream_bench.ppm", "stream_bench.pgm", Format::GS);
+            }) << " Mpixel/s\n";
+    }
+}
+#endif
+
 void test_rgb_channels() {
     //display_rgb_channels("../imgs/building.ppm");
     display_rgb_channels("../imgs/baboon.ppm");
@@ -459,15 +897,27 @@ void test_palette() {
 
 int main() {
 
+#ifdef BENCH
+    bench_color_conv();
+    bench_dither();
+    bench_diffusion();
+    bench_stream();
+#else
     //test_gray();
     //test_dither();
+    //test_dither_engine();
     //test_error_diffusion();
+    //test_diffusion_engine();
+    //test_stream();
+    //test_channel_views();
     //test_rgb_channels();
     //test_cmyk_channels();
     //test_hsv_channels();
     test_ycbcr_channels();
+    //test_color_conv();
     //test_colors();
     //test_palette();
+#endif
 
     return 0;
 }
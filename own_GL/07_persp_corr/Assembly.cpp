@@ -0,0 +1,164 @@
+#include "Assembly.h"
+
+using Vec3d = Vec<3, double>;
+using Vec4d = Vec<4, double>;
+
+// smallest w kept in front of the eye
+static constexpr double near_w {1E-5};
+
+// vertex of the polygon being clipped: screen coordinates and barycentric
+// coordinates in the source triangle
+struct Clip_vert {
+    Vec4d p {};
+    Vec3d b {};
+};
+
+// signed distance of the point to one of the clipping planes (inside >= 0):
+// 0: near plane, 1 - 4: left, right, bottom and top guard band borders
+static double plane_dist(const int k, const Vec4d &p, const double gx0,
+        const double gx1, const double gy0, const double gy1) {
+    switch (k) {
+        case 0: return p[3] - near_w;
+        case 1: return p[0] - gx0 * p[3];
+        case 2: return gx1 * p[3] - p[0];
+        case 3: return p[1] - gy0 * p[3];
+        default: return gy1 * p[3] - p[1];
+    }
+}
+
+Primitive_assembly::Primitive_assembly(const int w, const int h,
+        const Cull_mode c, const int guard): w_{w}, h_{h}, cull_{c},
+    guard_{double(guard)}, stats_{0, 0, 0, 0, 0} {
+}
+
+bool Primitive_assembly::culled(const Mat<3, 4, double> &pts) const {
+    if (cull_ == Cull_mode::none)
+        return false;
+    const double x0 {pts[0][0] / pts[0][3]}, y0 {pts[0][1] / pts[0][3]};
+    const double area {(pts[1][0] / pts[1][3] - x0) *
+        (pts[2][1] / pts[2][3] - y0) - (pts[2][0] / pts[2][3] - x0) *
+        (pts[1][1] / pts[1][3] - y0)};
+    return cull_ == Cull_mode::back ? area < 0 : area > 0;
+}
+
+// the rasterizer truncates the coordinates: x / w <= -1 or x / w >= width
+// cannot cover any pixel of the image (w > 0)
+bool Primitive_assembly::outside(const Mat<3, 4, double> &pts) const {
+    bool left {true}, right {true}, bottom {true}, top {true};
+    for (int i {0}; i < 3; ++i) {
+        const double x {pts[i][0]}, y {pts[i][1]}, w {pts[i][3]};
+        left = left && x <= -w;
+        right = right && x >= w_ * w;
+        bottom = bottom && y <= -w;
+        top = top && y >= h_ * w;
+    }
+    return left || right || bottom || top;
+}
+
+int Primitive_assembly::assemble(const Mat<3, 4, double> &pts, Clip_tri *out,
+        bool &clipped) {
+    ++stats_.triangles;
+    clipped = false;
+    const double gx0 {-guard_}, gx1 {w_ + guard_}, gy0 {-guard_},
+          gy1 {h_ + guard_};
+
+    // planes crossed by the triangle, trivial rejection against the near one
+    int planes {0};
+    for (int k {0}; k < 5; ++k) {
+        int nout {0};
+        for (int i {0}; i < 3; ++i)
+            nout += plane_dist(k, pts[i], gx0, gx1, gy0, gy1) < 0;
+        if (k == 0 && nout == 3) {
+            ++stats_.frustum_culled;
+            return 0;
+        }
+        if (nout)
+            planes |= 1 << k;
+    }
+
+    if (!(planes & 1) && outside(pts)) {
+        ++stats_.frustum_culled;
+        return 0;
+    }
+    if (!planes) {
+        if (culled(pts)) {
+            ++stats_.back_culled;
+            return 0;
+        }
+        out[0].pts = pts;
+        out[0].bar = Mat<3, 3, double>{eye<3>()};
+        ++stats_.emitted;
+        return 1;
+    }
+
+    // Sutherland-Hodgman: the polygon is clipped by the crossed planes
+    Clip_vert poly[2][9];
+    int n {3};
+    for (int i {0}; i < 3; ++i) {
+        poly[0][i].p = pts[i];
+        poly[0][i].b = Vec3d{0, 0, 0};
+        poly[0][i].b[i] = 1;
+    }
+    int cur {0};
+    for (int k {0}; k < 5 && n; ++k) {
+        if (!(planes & (1 << k)))
+            continue;
+        const Clip_vert *src {poly[cur]};
+        Clip_vert *dst {poly[cur ^ 1]};
+        int m {0};
+        for (int i {0}; i < n; ++i) {
+            const Clip_vert &a = src[i], &b = src[(i + 1) % n];
+            const double da {plane_dist(k, a.p, gx0, gx1, gy0, gy1)};
+            const double db {plane_dist(k, b.p, gx0, gx1, gy0, gy1)};
+            if (da >= 0)
+                dst[m++] = a;
+            if ((da >= 0) != (db >= 0)) {
+                const double t {da / (da - db)};
+                dst[m].p = a.p + (b.p - a.p) * t;
+                dst[m].b = a.b + (b.b - a.b) * t;
+                ++m;
+            }
+        }
+        n = m;
+        cur ^= 1;
+    }
+    ++stats_.clipped;
+    clipped = true;
+
+    // the clipping interpolates in homogeneous space (P = sum b_i P_i), the
+    // rasterizer and the shaders in the screen: the projection of P is
+    // sum l_i p_i with l_i = b_i w_i / sum b_j w_j (the sum is the w of P)
+    for (int i {0}; i < n; ++i) {
+        Vec3d &b = poly[cur][i].b;
+        double sw {0};
+        for (int j {0}; j < 3; ++j) {
+            b[j] *= pts[j][3];
+            sw += b[j];
+        }
+        b /= sw;
+    }
+
+    // fan of triangles
+    int ntris {0};
+    for (int i {1}; i + 1 < n; ++i) {
+        Clip_tri &t = out[ntris];
+        const Clip_vert *v[3] {&poly[cur][0], &poly[cur][i],
+            &poly[cur][i + 1]};
+        for (int j {0}; j < 3; ++j) {
+            t.pts[j] = v[j]->p;
+            t.bar[j] = v[j]->b;
+        }
+        if (outside(t.pts)) {
+            ++stats_.frustum_culled;
+            continue;
+        }
+        if (culled(t.pts)) {
+            ++stats_.back_culled;
+            continue;
+        }
+        ++ntris;
+    }
+    stats_.emitted += ntris;
+    return ntris;
+}
+
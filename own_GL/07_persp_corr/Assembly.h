@@ -0,0 +1,113 @@
+/*
+ * Class Primitive_assembly:
+ *      the stage between the vertex shaders and the rasterizer. The vertices
+ *      are homogeneous screen coordinates (Viewport * Proj * ModelView * v),
+ *      the pixel is (x / w, y / w). For every triangle:
+ *          - frustum: the triangle is rejected if all the vertices are behind
+ *            the eye (w < near) or all lie on the outer side of the same image
+ *            border (no pixel of the image can be covered)
+ *          - clipping: a triangle crossing the near plane (w = near) or
+ *            sticking out of the guard band (the image extended by a margin,
+ *            which keeps the integer edge functions from overflowing) is
+ *            clipped in homogeneous coordinates (Sutherland-Hodgman) and the
+ *            resulting polygon is split into a fan of triangles. Triangles
+ *            inside the guard band are not clipped: the rasterizer clamps the
+ *            bounding box to the image anyway
+ *          - back-face culling by the sign of the screen area (counter-clock
+ *            wise triangles are the front ones)
+ *      Every output triangle carries the barycentric coordinates of its
+ *      vertices in the source triangle, so the varyings of a clipped triangle
+ *      are interpolated from the source ones (Clipped_shader). They are the
+ *      screen space coordinates the rasterizer gives, not the homogeneous
+ *      ones of the clipping: a clipped part shades its pixels as the whole
+ *      triangle would
+ *      Counters are kept per frame (reset_stats()); an instance is used by a
+ *      single thread
+ *
+ * Examples:
+ *      Primitive_assembly pa {w, h}; // back faces culled
+ *      pa.reset_stats();
+ *      draw_triangle(pts, shader, img, tex, zbuf, pa); // per face
+ *      render_tiled(m, shader, ..., pool, 64, &pa); // or for the whole model
+ *      pa.stats().back_culled;
+ */
+
+#ifndef ASSEMBLY_H
+#define ASSEMBLY_H
+
+#include "Vec.h"
+#include "Mat.h"
+#include "PPM_Image.h"
+#include <cstdint>
+
+enum class Cull_mode { none, back, front };
+
+// counters of a Primitive_assembly
+struct Assembly_stats {
+    uint64_t triangles;      // triangles submitted
+    uint64_t back_culled;    // culled by the facing
+    uint64_t frustum_culled; // outside of the frustum
+    uint64_t clipped;        // triangles clipped
+    uint64_t emitted;        // triangles sent to the rasterizer
+};
+
+// output triangle: screen coordinates and, row by row, the barycentric
+// coordinates of its vertices in the source triangle
+struct Clip_tri {
+    Mat<3, 4, double> pts {};
+    Mat<3, 3, double> bar {};
+};
+
+class Primitive_assembly {
+public:
+    // a convex polygon clipped by 5 planes has at most 8 vertices
+    static constexpr int max_tris {6};
+
+    // image size, facing to cull, guard band margin (pixels)
+    Primitive_assembly(const int, const int, const Cull_mode = Cull_mode::back,
+            const int = 4096);
+
+    Cull_mode cull_mode() const { return cull_; }
+    void set_cull_mode(const Cull_mode c) { cull_ = c; }
+
+    // the output triangles of the source one (0 to max_tris); clipped is set
+    // if they are parts of it, otherwise the only output is the source one
+    int assemble(const Mat<3, 4, double>&, Clip_tri*, bool&);
+
+    const Assembly_stats& stats() const { return stats_; }
+    void reset_stats() { stats_ = Assembly_stats{0, 0, 0, 0, 0}; }
+
+private:
+    // the triangle is culled by its facing
+    bool culled(const Mat<3, 4, double>&) const;
+    // all the vertices are outside of the image on the same side
+    bool outside(const Mat<3, 4, double>&) const;
+
+    int w_;
+    int h_;
+    Cull_mode cull_;
+    double guard_;
+    Assembly_stats stats_;
+};
+
+// fragment shader of a clipped triangle: the barycentric coordinates are
+// mapped to the source triangle, whose varyings the shader holds
+template <class Shader>
+class Clipped_shader {
+public:
+    Clipped_shader(Shader &s, const Mat<3, 3, double> &bar): s_(s),
+        bar_t_{bar.transpose()} {
+    }
+
+    bool fragment(const PPM_Image &tex, const Vec<3, double> &bc,
+            PPM_Color &C) {
+        return s_.fragment(tex, bar_t_ * bc, C);
+    }
+
+private:
+    Shader &s_;
+    Mat<3, 3, double> bar_t_; // source coordinates = bar_t_ * bc
+};
+
+#endif
+
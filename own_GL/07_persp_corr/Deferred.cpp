@@ -0,0 +1,12 @@
+#include "Deferred.h"
+
+G_buffer::G_buffer(const int w, const int h): w_{w}, h_{h}, face_(w * h, -1),
+    lam1_(w * h, 0), lam2_(w * h, 0), area_{}, fragments_{0}, pixels_{0} {
+}
+
+void G_buffer::clear() {
+    std::fill(face_.begin(), face_.end(), -1);
+    fragments_ = 0;
+    pixels_ = 0;
+}
+
@@ -0,0 +1,201 @@
+/*
+ * Deferred shading:
+ *      the forward triangle_shader runs the fragment shader every time a
+ *      fragment passes the depth test, so an overdrawn pixel is shaded (and
+ *      textured) several times. The deferred mode splits the work:
+ *          pass 1 (geometry): the triangles are rasterized tile by tile (in
+ *          parallel, in the submission order within a tile) into the depth
+ *          buffer and a G-buffer which keeps, for every pixel, the index of
+ *          the triangle last written there and its unnormalized barycentric
+ *          coordinates (lam1, lam2: exact integers, 12 bytes per pixel with
+ *          the face index)
+ *          pass 2 (shading): the fragment shader of the stored triangle runs
+ *          exactly once per visible pixel, rows in parallel
+ *      The barycentric coordinates are rebuilt from the integers the same way
+ *      the forward path computes them, so the image is bit-identical to the
+ *      forward one (for shaders which never discard fragments: the depth is
+ *      written in pass 1, before fragment() is called)
+ *      Counters: fragments which passed the depth test (fragment shader calls
+ *      of the forward path) and visible pixels (calls of the deferred one)
+ *
+ * Examples:
+ *      G_buffer gbuf {w, h};
+ *      render_deferred(mesh, Tex_shader{}, Viewport, Proj, ModelView, L_dir,
+ *          img, tex, zbuf, gbuf, pool);
+ *      gbuf.stats().overdraw();
+ */
+
+#ifndef DEFERRED_H
+#define DEFERRED_H
+
+#include "Tiles.h"
+#include <atomic>
+
+struct Deferred_stats {
+    uint64_t fragments; // fragments which passed the depth test
+    uint64_t pixels;    // pixels shaded
+
+    double overdraw() const { return pixels ? double(fragments) / pixels : 0; }
+};
+
+class G_buffer {
+public:
+    G_buffer(const int, const int);
+    G_buffer(const G_buffer&) = delete;
+    G_buffer& operator=(const G_buffer&) = delete;
+
+    ~G_buffer() = default;
+
+    int width() const { return w_; }
+    int height() const { return h_; }
+    // triangle index of the pixel, -1 if none
+    int face(const int x, const int y) const { return face_[x + y * w_]; }
+
+    void clear();
+
+    // pass 1 of a frame (the G-buffer and the counters are cleared first):
+    // rasterize the triangles (screen coordinates) into the depth buffer
+    // (std::vector<int> or Depth_buffer) and the G-buffer
+    template <class Zbuf>
+    void rasterize(const std::vector<Mat<3, 4, double>>&, Zbuf&,
+            Thread_pool&, const int = 64);
+    // pass 2: run the fragment shader of the stored triangle (shaders[face])
+    // once for every visible pixel
+    template <class Shader>
+    void shade(const std::vector<Shader>&, PPM_Image&, const PPM_Image&,
+            Thread_pool&);
+
+    Deferred_stats stats() const { return {fragments_.load(), pixels_.load()}; }
+
+private:
+    template <class Depth>
+    void rasterize_tile(const std::vector<Mat<3, 4, double>>&, const int,
+            const Raster_rect&, Depth&);
+
+    int w_;
+    int h_;
+    aligned_vector<int32_t> face_;
+    aligned_vector<int32_t> lam1_;
+    aligned_vector<int32_t> lam2_;
+    std::vector<int> area_; // double area of every triangle
+    std::atomic<uint64_t> fragments_;
+    std::atomic<uint64_t> pixels_;
+};
+
+template <class Zbuf>
+void G_buffer::rasterize(const std::vector<Mat<3, 4, double>> &pts,
+        Zbuf &zbuf, Thread_pool &pool, const int tile) {
+    clear();
+    // binning: the same as in render_tiled
+    const size_t n {pts.size()};
+    area_.assign(n, 0);
+    Tile_grid grid {w_, h_, (std::max(tile, 1) + 7) & ~7};
+    for (size_t i {0}; i < n; ++i) {
+        Mat<3, 2, double> pts2;
+        for (int j = 0; j < 3; ++j)
+            pts2[j] = pts[i][j] / pts[i][j][3];
+        area_[i] = Edge_tri{pts2[0], pts2[1], pts2[2]}.area();
+        grid.bin(i, bounding_box(pts2, w_, h_));
+    }
+
+    auto &&depth = depth_ref(zbuf, w_);
+    pool.run(grid.num_tiles(), [&](const size_t t) {
+        const Raster_rect r {grid.rect(t)};
+        for (const int i: grid.triangles(t))
+            rasterize_tile(pts, i, r, depth);
+    });
+}
+
+// the depth test of triangle_shader, storing the triangle instead of shading
+template <class Depth>
+void G_buffer::rasterize_tile(const std::vector<Mat<3, 4, double>> &tris,
+        const int itri, const Raster_rect &clip, Depth &zbuf) {
+    const Mat<3, 4, double> &pts = tris[itri];
+    Mat<3, 2, double> pts2;
+    for (int i = 0; i < 3; ++i)
+        pts2[i] = pts[i] / pts[i][3];
+    const Raster_rect bb {bounding_box(pts2, w_, h_)};
+    const Raster_rect r {std::max(bb.x0, clip.x0), std::max(bb.y0, clip.y0),
+        std::min(bb.x1, clip.x1), std::min(bb.y1, clip.y1)};
+
+    Tri_cull<Depth> cull {pts, zbuf, r};
+    if (cull.occluded())
+        return;
+
+    uint64_t tested {0}, passed {0};
+    int *z {zbuf.data()};
+    int32_t *face {face_.data()}, *l1 {lam1_.data()}, *l2 {lam2_.data()};
+    const int w {w_};
+    const Edge_tri tri {pts2[0], pts2[1], pts2[2]};
+    // the depths of the forward path
+    const Edge_depth depth {pts, double(tri.area())};
+    for_each_covered_culled(tri, r,
+            [&](const int x, const int y, const int lam1, const int lam2) {
+        const int frag_dep {zbuf.quantize(depth(lam1, lam2))};
+        const int idx {x + y * w};
+        ++tested;
+        if (z[idx] < frag_dep) {
+            zbuf.write(idx, frag_dep);
+            face[idx] = itri;
+            l1[idx] = lam1;
+            l2[idx] = lam2;
+            ++passed;
+        }
+    }, cull.skip());
+    zbuf.count(tested, passed, 0, cull.rejected());
+    fragments_.fetch_add(passed, std::memory_order_relaxed);
+}
+
+template <class Shader>
+void G_buffer::shade(const std::vector<Shader> &shaders, PPM_Image &I,
+        const PPM_Image &tex, Thread_pool &pool) {
+    using Vec3d = Vec<3, double>;
+    if (shaders.empty())
+        return;
+    const int img_h {h_ - 1};
+    pool.run(h_, [&](const size_t y) {
+        // neighbouring pixels mostly belong to the same triangle: its shader
+        // (varyings) is copied once per run of pixels
+        Shader shader {shaders[0]};
+        int cur {-1};
+        uint64_t npix {0};
+        PPM_Color C;
+        uint *row {I.row(img_h - y)};
+        for (int x {0}; x < w_; ++x) {
+            const int idx {x + int(y) * w_};
+            const int f {face_[idx]};
+            if (f < 0)
+                continue;
+            if (f != cur) {
+                shader = shaders[f];
+                cur = f;
+            }
+            const double area = area_[f];
+            const int lam1 {lam1_[idx]}, lam2 {lam2_[idx]};
+            if (!shader.fragment(tex, Vec3d{1 - (lam1 + lam2) / area,
+                        lam2 / area, lam1 / area}, C))
+                row[x] = C.color();
+            ++npix;
+        }
+        pixels_.fetch_add(npix, std::memory_order_relaxed);
+    });
+}
+
+// vertex stage, geometry pass and shading pass of the whole model (the
+// geometry is either a Model or a compiled Mesh)
+template <class Shader, class Geom, class Zbuf>
+void render_deferred(const Geom &m, const Shader &proto,
+        const Mat<4, 4, double> &Viewport, const Mat<4, 4, double> &Proj,
+        const Mat<4, 4, double> &ModelView, const Vec<3, double> &L_dir,
+        PPM_Image &I, const PPM_Image &tex, Zbuf &zbuf, G_buffer &gbuf,
+        Thread_pool &pool) {
+    const size_t nfaces {m.num_faces()};
+    std::vector<Mat<3, 4, double>> pts(nfaces);
+    std::vector<Shader> shaders(nfaces, proto);
+    vertex_stage(m, shaders, pts, Viewport, Proj, ModelView, L_dir, pool);
+    gbuf.rasterize(pts, zbuf, pool);
+    gbuf.shade(shaders, I, tex, pool);
+}
+
+#endif
+
@@ -0,0 +1,73 @@
+#include "Depth_buffer.h"
+
+Depth_buffer::Depth_buffer(const int w, const int h, const int nbits,
+        const int range): w_{w}, h_{h},
+    bits_{std::max(8, std::min(24, nbits))}, max_{(1 << bits_) - 1},
+    scale_{double(max_) / range}, nbx_{(w + block - 1) / block},
+    nby_{(h + block - 1) / block}, z_(w * h, 0), bmin_(nbx_ * nby_, 0),
+    bmax_(nbx_ * nby_, 0), stale_(nbx_ * nby_, 0), tested_{0}, shaded_{0},
+    tri_rejected_{0}, blk_rejected_{0} {
+}
+
+void Depth_buffer::clear() {
+    std::fill(z_.begin(), z_.end(), 0);
+    std::fill(bmin_.begin(), bmin_.end(), 0);
+    std::fill(bmax_.begin(), bmax_.end(), 0);
+    std::fill(stale_.begin(), stale_.end(), 0);
+    reset_stats();
+}
+
+int Depth_buffer::block_min(const int b) {
+    if (!stale_[b])
+        return bmin_[b];
+    const int x0 {b % nbx_ * block}, y0 {b / nbx_ * block};
+    const int x1 {std::min(x0 + block, w_)}, y1 {std::min(y0 + block, h_)};
+    int m {max_};
+    for (int y {y0}; y < y1; ++y)
+        for (int x {x0}; x < x1; ++x)
+            m = std::min(m, z_[x + y * w_]);
+    stale_[b] = 0;
+    return bmin_[b] = m;
+}
+
+bool Depth_buffer::occluded(const Raster_rect &r, const int d) {
+    if (r.empty())
+        return false;
+    for (int by {r.y0 / block}; by <= r.y1 / block; ++by)
+        for (int bx {r.x0 / block}; bx <= r.x1 / block; ++bx)
+            if (d > block_min(bx + by * nbx_))
+                return false;
+    return true;
+}
+
+void Depth_buffer::count(const uint64_t tested, const uint64_t shaded,
+        const uint64_t tri_rejected, const uint64_t blk_rejected) {
+    tested_.fetch_add(tested, std::memory_order_relaxed);
+    shaded_.fetch_add(shaded, std::memory_order_relaxed);
+    tri_rejected_.fetch_add(tri_rejected, std::memory_order_relaxed);
+    blk_rejected_.fetch_add(blk_rejected, std::memory_order_relaxed);
+}
+
+Depth_stats Depth_buffer::stats() const {
+    // only the blocks ever written to (maximum above zero) have to be scanned
+    uint64_t visible {0};
+    for (int b {0}; b < nbx_ * nby_; ++b) {
+        if (!bmax_[b])
+            continue;
+        const int x0 {b % nbx_ * block}, y0 {b / nbx_ * block};
+        const int x1 {std::min(x0 + block, w_)}, y1 {std::min(y0 + block, h_)};
+        for (int y {y0}; y < y1; ++y)
+            for (int x {x0}; x < x1; ++x)
+                visible += z_[x + y * w_] > 0;
+    }
+    return {tested_.load(), shaded_.load(), tri_rejected_.load(),
+        blk_rejected_.load(), visible};
+}
+
+void Depth_buffer::reset_stats() {
+    tested_ = 0;
+    shaded_ = 0;
+    tri_rejected_ = 0;
+    blk_rejected_ = 0;
+}
+
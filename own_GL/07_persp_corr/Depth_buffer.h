@@ -0,0 +1,152 @@
+/*
+ * Depth buffers of triangle_shader (a fragment passes if its depth is greater
+ * than the stored one, the buffer starts with zeros):
+ *
+ * Zbuf_ref:
+ *      the plain std::vector<int> z-buffer (depth 0..255, one int per pixel)
+ *      as it has always been: no coarse rejection, no counters
+ *
+ * Class Depth_buffer:
+ *      hierarchical z-buffer. The depth is quantized to 8 bits (the same
+ *      values as the plain z-buffer) or to more bits (up to 24) for scenes
+ *      where 256 levels alias. Besides the per-pixel depth it keeps the
+ *      minimum and the maximum depth of every 8x8 block (the blocks of the
+ *      edge rasterizer), updated on write:
+ *          - a triangle whose largest depth is not greater than the block
+ *            minimum cannot pass the depth test anywhere in the block, so the
+ *            block is skipped before the coverage and the barycentrics are
+ *            computed (early block rejection)
+ *          - if this holds for all the blocks of the triangle bounding box
+ *            (clipped to the tile), the triangle is rejected as a whole
+ *      The depth values only grow, so a block minimum may be stale (too
+ *      small) and is recomputed lazily: a stale value rejects less, never
+ *      wrongly. The blocks are owned by the tile which contains them (the
+ *      tiles of render_tiled are multiples of 8 pixels), so the tiles are
+ *      shaded concurrently without locks
+ *      Counters: fragments tested and shaded, triangles and blocks rejected;
+ *      the overdraw is shaded fragments per visible pixel
+ *
+ * Examples:
+ *      Depth_buffer zbuf {w, h}; // 8-bit depth, 0..255 like std::vector<int>
+ *      Depth_buffer zbuf24 {w, h, 24}; // 24-bit depth for the same Viewport
+ *      triangle_shader(pts, shader, img, tex, zbuf); // or render_tiled(...)
+ *      zbuf.stats().overdraw();
+ */
+
+#ifndef DEPTH_BUFFER_H
+#define DEPTH_BUFFER_H
+
+#include "Edge_raster.h"
+#include <vector>
+#include <atomic>
+#include <algorithm>
+
+// counters of a Depth_buffer
+struct Depth_stats {
+    uint64_t tested;       // fragments which reached the depth test
+    uint64_t shaded;       // fragments which passed it
+    uint64_t tri_rejected; // triangles rejected as a whole
+    uint64_t blk_rejected; // 8x8 blocks rejected
+    uint64_t visible;      // pixels covered in the end
+
+    // number of times a visible pixel has been shaded
+    double overdraw() const { return visible ? double(shaded) / visible : 0; }
+};
+
+class Zbuf_ref {
+public:
+    Zbuf_ref(std::vector<int> &z, const int w): z_{z.data()}, w_{w} { }
+
+    static constexpr bool hierarchical {false};
+
+    int quantize(const double d) const {
+        return std::max(0, std::min(255, int(d + 0.5)));
+    }
+    int* data() const { return z_; }
+    int width() const { return w_; }
+
+    bool occluded(const Raster_rect&, const int) { return false; }
+    bool block_occluded(const int, const int, const int) { return false; }
+    void write(const int idx, const int d) { z_[idx] = d; }
+    void count(const uint64_t, const uint64_t, const uint64_t,
+            const uint64_t) { }
+
+private:
+    int *z_;
+    int w_;
+};
+
+class Depth_buffer {
+public:
+    static constexpr bool hierarchical {true};
+    static constexpr int block {8};
+
+    // image size, depth bits (8..24) and the depth range of the Viewport
+    Depth_buffer(const int, const int, const int = 8, const int = 255);
+    Depth_buffer(const Depth_buffer&) = delete;
+    Depth_buffer& operator=(const Depth_buffer&) = delete;
+
+    ~Depth_buffer() = default;
+
+    int width() const { return w_; }
+    int height() const { return h_; }
+    int bits() const { return bits_; }
+    int max_depth() const { return max_; }
+
+    // quantized depth of the fragment (z / w in the Viewport depth range)
+    int quantize(const double d) const {
+        return std::max(0, std::min(max_, int(d * scale_ + 0.5)));
+    }
+
+    int* data() { return z_.data(); }
+    const int* data() const { return z_.data(); }
+    int operator[](const size_t i) const { return z_[i]; }
+    // the depth rescaled to 0..255 (the plain z-buffer values)
+    int depth8(const size_t i) const { return z_[i] >> (bits_ - 8); }
+
+    void clear();
+
+    // nothing at depth <= d may pass the test in the rectangle (the
+    // rectangle has to lie inside the image)
+    bool occluded(const Raster_rect&, const int);
+    // the same for the 8x8 block with the corner at (bx, by)
+    bool block_occluded(const int bx, const int by, const int d) {
+        return d <= block_min(bx / block + by / block * nbx_);
+    }
+    // store the depth of the pixel which passed the test
+    void write(const int idx, const int d) {
+        const int b {idx % w_ / block + idx / w_ / block * nbx_};
+        if (z_[idx] == bmin_[b])
+            stale_[b] = 1;
+        z_[idx] = d;
+        bmax_[b] = std::max(bmax_[b], d);
+    }
+    // add to the counters (once per triangle)
+    void count(const uint64_t, const uint64_t, const uint64_t, const uint64_t);
+
+    // the counters (visible pixels are counted here) and their reset
+    Depth_stats stats() const;
+    void reset_stats();
+
+private:
+    int block_min(const int);
+
+    int w_;
+    int h_;
+    int bits_;
+    int max_;
+    double scale_;
+    int nbx_;
+    int nby_;
+    std::vector<int> z_;
+    std::vector<int> bmin_;
+    std::vector<int> bmax_;
+    std::vector<unsigned char> stale_;
+    std::atomic<uint64_t> tested_;
+    std::atomic<uint64_t> shaded_;
+    std::atomic<uint64_t> tri_rejected_;
+    std::atomic<uint64_t> blk_rejected_;
+};
+
+#endif
+
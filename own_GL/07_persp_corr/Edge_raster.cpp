@@ -0,0 +1,253 @@
+#include "Edge_raster.h"
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define EDGE_RASTER_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * ------------------ Raster path selection ------------------
+ */
+static Raster_path current_path {best_raster_path()};
+
+const char *raster_path_name(const Raster_path p) {
+    switch (p) {
+        case Raster_path::baryc: return "baryc";
+        case Raster_path::scalar: return "scalar";
+        case Raster_path::sse2: return "sse2";
+        case Raster_path::avx2: return "avx2";
+    }
+    return "unknown";
+}
+
+bool raster_path_supported(const Raster_path p) {
+    switch (p) {
+        case Raster_path::baryc:
+        case Raster_path::scalar:
+            return true;
+#ifdef EDGE_RASTER_X86
+        case Raster_path::sse2:
+            __builtin_cpu_init(); // may be called before the constructors
+            return __builtin_cpu_supports("sse2");
+        case Raster_path::avx2:
+            __builtin_cpu_init();
+            return __builtin_cpu_supports("avx2");
+#else
+        default:
+            return false;
+#endif
+    }
+    return false;
+}
+
+Raster_path best_raster_path() {
+    for (const auto p: {Raster_path::avx2, Raster_path::sse2})
+        if (raster_path_supported(p))
+            return p;
+    return Raster_path::scalar;
+}
+
+Raster_path raster_path() {
+    return current_path;
+}
+
+// unsupported paths fall back to the scalar kernel
+void set_raster_path(const Raster_path p) {
+    current_path = raster_path_supported(p) ? p : Raster_path::scalar;
+}
+
+/*
+ * ------------------ Edge_tri implementation ------------------
+ */
+// the edges are the ones of baryc(): lam1 and lam2 give the barycentric
+// coordinates of the 3rd and 2nd vertices, area - lam1 - lam2 of the 1st one;
+// multiplying them by the sign of the area makes the inner side non-negative
+Edge_tri::Edge_tri(const Vec<2, int> &p1, const Vec<2, int> &p2,
+        const Vec<2, int> &p3): a_(), b_(), c_(), bias_(), ox_{0}, oy_{0},
+    area_{0}, sign_{1} {
+    setup(p1, p2, p3, 0);
+}
+
+Edge_tri::Edge_tri(const Vec<2, int> &p1, const Vec<2, int> &p2,
+        const Vec<2, int> &p3, const int bits): a_(), b_(), c_(), bias_(),
+    ox_{0}, oy_{0}, area_{0}, sign_{1} {
+    // |edge| <= 2 * (extent + 8 pixels of the blocks)^2 * 2^(2 * bits) has
+    // to fit in 31 bits
+    int b {bits};
+    const int ext {std::max({std::abs(p2.x() - p1.x()),
+            std::abs(p3.x() - p1.x()), std::abs(p3.x() - p2.x()),
+            std::abs(p2.y() - p1.y()), std::abs(p3.y() - p1.y()),
+            std::abs(p3.y() - p2.y())})};
+    while (b > 0 && (ext >> bits) + 8 >= 1 << (15 - b))
+        --b;
+    const int drop {bits - b}, half {drop ? 1 << (drop - 1) : 0};
+    auto reduce = [&](const Vec<2, int> &p) {
+        return Vec<2, int>{(p.x() + half) >> drop, (p.y() + half) >> drop};
+    };
+    setup(reduce(p1), reduce(p2), reduce(p3), b);
+    if (!b)
+        return;
+    // top edge: horizontal, inside below it (the y axis points up); left
+    // edge: inside to the right of it
+    for (int k {0}; k < 3; ++k)
+        if (!(a_[k] > 0 || (a_[k] == 0 && b_[k] < 0))) {
+            --c_[k];
+            bias_[k] = 1;
+        }
+}
+
+// edge functions of the sample points: the pixel corners (x, y) for whole
+// pixels, the centers (x + 1/2, y + 1/2) for fixed point, relative to the
+// pixel of p1
+void Edge_tri::setup(const Vec<2, int> &p1, const Vec<2, int> &p2,
+        const Vec<2, int> &p3, const int bits) {
+    const int x1 {p1.x()}, dx31 {p3.x() - x1}, dx21 {p2.x() - x1};
+    const int y1 {p1.y()}, dy31 {p3.y() - y1}, dy21 {p2.y() - y1};
+    area_ = dx31 * dy21 - dx21 * dy31;
+    sign_ = area_ < 0 ? -1 : 1;
+    // the sample of the origin pixel relative to p1 (x1, y1 for whole pixels)
+    const int unit {1 << bits};
+    int sx {-x1}, sy {-y1};
+    if (bits) {
+        ox_ = x1 >> bits;
+        oy_ = y1 >> bits;
+        sx = ox_ * unit + unit / 2 - x1;
+        sy = oy_ * unit + unit / 2 - y1;
+    }
+    // lam1 = dx21 * (y1 - y) - dy21 * (x1 - x)
+    a_[1] = sign_ * dy21 * unit;
+    b_[1] = -sign_ * dx21 * unit;
+    c_[1] = sign_ * (dy21 * sx - dx21 * sy);
+    // lam2 = dy31 * (x1 - x) - dx31 * (y1 - y)
+    a_[2] = -sign_ * dy31 * unit;
+    b_[2] = sign_ * dx31 * unit;
+    c_[2] = sign_ * (dx31 * sy - dy31 * sx);
+    // |area| - lam1 - lam2 (in 64 bits: only the result is bounded)
+    a_[0] = -a_[1] - a_[2];
+    b_[0] = -b_[1] - b_[2];
+    c_[0] = int(int64_t{std::abs(area_)} - c_[1] - c_[2]);
+}
+
+uint64_t rect_mask(const int x0, const int y0, const Raster_rect &r) {
+    uint64_t cols {0}, mask {0};
+    for (int i {std::max(r.x0 - x0, 0)}; i < std::min(r.x1 - x0 + 1, 8); ++i)
+        cols |= 1u << i;
+    for (int j {std::max(r.y0 - y0, 0)}; j < std::min(r.y1 - y0 + 1, 8); ++j)
+        mask |= cols << (j * 8);
+    return mask;
+}
+
+/*
+ * ------------------ Coverage kernels ------------------
+ */
+// trivial reject/accept of the whole block by the corners: returns true if the
+// block is decided and sets the mask accordingly
+static inline bool block_trivial(const Edge_tri &t, const int x0, const int y0,
+        int *e, uint64_t &mask) {
+    bool inside {true};
+    for (int k {0}; k < 3; ++k) {
+        const int a {t.a()[k]}, b {t.b()[k]};
+        e[k] = t.edge(k, x0, y0);
+        // the largest and smallest values of the edge over the block corners
+        const int emax {e[k] + 7 * (std::max(a, 0) + std::max(b, 0))};
+        const int emin {e[k] + 7 * (std::min(a, 0) + std::min(b, 0))};
+        if (emax < 0) {
+            mask = 0;
+            return true;
+        }
+        inside = inside && emin >= 0;
+    }
+    mask = ~uint64_t{0};
+    return inside;
+}
+
+static uint64_t coverage_scalar(const Edge_tri &t, const int x0, const int y0) {
+    int e[3];
+    uint64_t mask;
+    if (block_trivial(t, x0, y0, e, mask))
+        return mask;
+    const int *a {t.a()}, *b {t.b()};
+    mask = 0;
+    for (int j {0}; j < 8; ++j) {
+        int e0 {e[0]}, e1 {e[1]}, e2 {e[2]};
+        for (int i {0}; i < 8; ++i) {
+            if ((e0 | e1 | e2) >= 0) // all the signs are positive
+                mask |= uint64_t{1} << (j * 8 + i);
+            e0 += a[0]; e1 += a[1]; e2 += a[2];
+        }
+        e[0] += b[0]; e[1] += b[1]; e[2] += b[2];
+    }
+    return mask;
+}
+
+#ifdef EDGE_RASTER_X86
+__attribute__((target("sse2")))
+static uint64_t coverage_sse2(const Edge_tri &t, const int x0, const int y0) {
+    int e[3];
+    uint64_t mask;
+    if (block_trivial(t, x0, y0, e, mask))
+        return mask;
+    const int *a {t.a()}, *b {t.b()};
+    __m128i lo[3], hi[3], dy[3];
+    for (int k {0}; k < 3; ++k) {
+        const __m128i step {_mm_set1_epi32(a[k])};
+        // e + i * a for the columns 0..3 and 4..7
+        const __m128i ia {_mm_set_epi32(3 * a[k], 2 * a[k], a[k], 0)};
+        lo[k] = _mm_add_epi32(_mm_set1_epi32(e[k]), ia);
+        hi[k] = _mm_add_epi32(lo[k], _mm_slli_epi32(step, 2));
+        dy[k] = _mm_set1_epi32(b[k]);
+    }
+    mask = 0;
+    for (int j {0}; j < 8; ++j) {
+        const __m128i l {_mm_or_si128(_mm_or_si128(lo[0], lo[1]), lo[2])};
+        const __m128i h {_mm_or_si128(_mm_or_si128(hi[0], hi[1]), hi[2])};
+        // the sign bits of the lanes are set for the pixels outside
+        const int bits {_mm_movemask_ps(_mm_castsi128_ps(l)) |
+            _mm_movemask_ps(_mm_castsi128_ps(h)) << 4};
+        mask |= uint64_t(~bits & 0xFF) << (j * 8);
+        for (int k {0}; k < 3; ++k) {
+            lo[k] = _mm_add_epi32(lo[k], dy[k]);
+            hi[k] = _mm_add_epi32(hi[k], dy[k]);
+        }
+    }
+    return mask;
+}
+
+__attribute__((target("avx2")))
+static uint64_t coverage_avx2(const Edge_tri &t, const int x0, const int y0) {
+    int e[3];
+    uint64_t mask;
+    if (block_trivial(t, x0, y0, e, mask))
+        return mask;
+    const int *a {t.a()}, *b {t.b()};
+    const __m256i lanes {_mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0)};
+    __m256i row[3], dy[3];
+    for (int k {0}; k < 3; ++k) {
+        row[k] = _mm256_add_epi32(_mm256_set1_epi32(e[k]),
+                _mm256_mullo_epi32(lanes, _mm256_set1_epi32(a[k])));
+        dy[k] = _mm256_set1_epi32(b[k]);
+    }
+    mask = 0;
+    for (int j {0}; j < 8; ++j) {
+        const __m256i v {_mm256_or_si256(_mm256_or_si256(row[0], row[1]),
+                row[2])};
+        const int bits {_mm256_movemask_ps(_mm256_castsi256_ps(v))};
+        mask |= uint64_t(~bits & 0xFF) << (j * 8);
+        for (int k {0}; k < 3; ++k)
+            row[k] = _mm256_add_epi32(row[k], dy[k]);
+    }
+    return mask;
+}
+#endif
+
+Coverage_fn coverage_kernel(const Raster_path p) {
+    switch (p) {
+#ifdef EDGE_RASTER_X86
+        case Raster_path::sse2: return coverage_sse2;
+        case Raster_path::avx2: return coverage_avx2;
+#endif
+        default: return coverage_scalar;
+    }
+}
+
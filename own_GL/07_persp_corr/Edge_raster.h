@@ -0,0 +1,137 @@
+/*
+ * Edge-function rasterization:
+ *      a pixel p lies inside the triangle if it is on the inner side of all
+ *      three edges. Each edge equation E(x, y) = c + a * x + b * y is linear,
+ *      so it is stepped incrementally (adding a or b) instead of computing
+ *      the barycentric coordinates of every pixel of the bounding box.
+ *      The vertices are integer (the same truncated screen coordinates as
+ *      baryc() uses), so the edge values are exact integers and the pixels
+ *      covered are exactly those accepted by baryc().
+ *
+ *      The bounding box is walked in 8x8 pixel blocks: a block that lies
+ *      completely outside of one of the edges is rejected by testing a single
+ *      corner, a block that is completely inside is accepted as a whole, other
+ *      blocks get a 64-bit coverage mask (bit = row * 8 + column) computed by
+ *      one of the kernels:
+ *          scalar: plain loops (always available)
+ *          sse2:   4 pixels per instruction
+ *          avx2:   8 pixels per instruction (if the cpu supports it)
+ *      The kernel (or the old per-pixel baryc() path) is selectable at runtime
+ *      with set_raster_path()
+ *
+ *      Sub-pixel triangles (Precision.h): the vertices are fixed-point
+ *      numbers (28.4: 4 fraction bits) and the pixels are sampled at their
+ *      centers. The edge values stay integers of the same form, so the same
+ *      kernels and loops cover them; they are relative to the pixel of the
+ *      first vertex (keeping them in 32 bits up to 2040 pixels of triangle
+ *      extent, larger triangles lose fraction bits). A pixel exactly on an
+ *      edge is covered only if it is a top or a left edge of the triangle:
+ *      the edges which are not have their values lowered by 1, and the
+ *      barycentric coordinates add it back
+ */
+
+#ifndef EDGE_RASTER_H
+#define EDGE_RASTER_H
+
+#include "Vec.h"
+#include <cstdint>
+
+enum class Raster_path { baryc, scalar, sse2, avx2 };
+
+const char *raster_path_name(const Raster_path);
+bool raster_path_supported(const Raster_path);
+// the fastest path supported by the cpu: default one
+Raster_path best_raster_path();
+Raster_path raster_path();
+void set_raster_path(const Raster_path);
+
+// rectangle of raster pixels (inclusive bounds, y axis pointing up)
+struct Raster_rect {
+    int x0, y0, x1, y1;
+    bool empty() const { return x0 > x1 || y0 > y1; }
+};
+
+class Edge_tri {
+public:
+    // whole pixels
+    Edge_tri(const Vec<2, int>&, const Vec<2, int>&, const Vec<2, int>&);
+    // fixed-point vertices with the given fraction bits
+    Edge_tri(const Vec<2, int>&, const Vec<2, int>&, const Vec<2, int>&,
+            const int);
+
+    // the triangle has zero area: no pixels are covered
+    bool degenerate() const { return area_ == 0; }
+    // signed double area: denominator of the barycentric coordinates (in
+    // units of the fixed-point fraction squared)
+    int area() const { return area_; }
+
+    // edge value at pixel (x, y): non-negative for the inner side
+    int edge(const int k, const int x, const int y) const {
+        return c_[k] + a_[k] * (x - ox_) + b_[k] * (y - oy_);
+    }
+    // unnormalized barycentric coordinates (the values baryc() divides)
+    int lam1(const int x, const int y) const {
+        return sign_ * (edge(1, x, y) + bias_[1]);
+    }
+    int lam2(const int x, const int y) const {
+        return sign_ * (edge(2, x, y) + bias_[2]);
+    }
+
+    const int *a() const { return a_; }
+    const int *b() const { return b_; }
+    const int *c() const { return c_; }
+
+private:
+    void setup(const Vec<2, int>&, const Vec<2, int>&, const Vec<2, int>&,
+            const int);
+
+    int a_[3];    // steps along x
+    int b_[3];    // steps along y
+    int c_[3];    // values at the origin pixel
+    int bias_[3]; // 1 for the edges which are not top-left ones
+    int ox_;      // origin: (0, 0) or the pixel of the first vertex
+    int oy_;
+    int area_;
+    int sign_;
+};
+
+// coverage mask of the 8x8 block with the corner at (x0, y0)
+using Coverage_fn = uint64_t (*)(const Edge_tri&, const int, const int);
+Coverage_fn coverage_kernel(const Raster_path = raster_path());
+
+// bits of the 8x8 block with the corner at (x0, y0) inside the rectangle
+uint64_t rect_mask(const int, const int, const Raster_rect&);
+
+// call f(x, y, lam1, lam2) for every pixel of the rectangle covered by the
+// triangle, skipping the 8x8 blocks with the corner at (bx, by) for which
+// skip(bx, by) is true (e.g. hidden by the hierarchical z-buffer): the
+// rectangle must lie inside the image (non-negative corners)
+template <class F, class S>
+void for_each_covered_culled(const Edge_tri &t, const Raster_rect &r, F f,
+        S skip, const Coverage_fn cover = coverage_kernel()) {
+    if (t.degenerate() || r.empty())
+        return;
+    for (int by = r.y0 & ~7; by <= r.y1; by += 8)
+        for (int bx = r.x0 & ~7; bx <= r.x1; bx += 8) {
+            uint64_t m {cover(t, bx, by)};
+            if (!m || skip(bx, by))
+                continue;
+            for (m &= rect_mask(bx, by, r); m; m &= m - 1) {
+                const int bit {__builtin_ctzll(m)};
+                const int x {bx + (bit & 7)}, y {by + (bit >> 3)};
+                f(x, y, t.lam1(x, y), t.lam2(x, y));
+            }
+        }
+}
+
+// the same for all the blocks
+template <class F>
+void for_each_covered(const Edge_tri &t, const Raster_rect &r, F f,
+        const Coverage_fn cover = coverage_kernel()) {
+    for_each_covered_culled(t, r, f, [](const int, const int) {
+        return false;
+    }, cover);
+}
+
+#endif
+
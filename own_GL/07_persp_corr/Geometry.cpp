@@ -33,7 +33,9 @@ Point_array::Point_array(const std::initializer_list<Point> &pil): pa_{} {
 Point_array::Point_array(const Point_array &o): pa_{o.pa_} { }
 
 Point_array& Point_array::operator=(const Point_array &o) {
-    if (this != &o) pa_ = o.pa_; return *this;
+    if (this != &o)
+        pa_ = o.pa_;
+    return *this;
 }
 
 Point_array::Point_array(Point_array &&o): pa_{std::move(o.pa_)} { }
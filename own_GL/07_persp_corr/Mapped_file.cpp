@@ -0,0 +1,75 @@
+#include "Mapped_file.h"
+#include <stdexcept>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+Mapped_file::Mapped_file(const std::string &fn): data_{nullptr}, size_{0} {
+    const int fd {open(fn.c_str(), O_RDONLY)};
+    if (fd < 0)
+        throw std::runtime_error("cannot open file " + fn);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw std::runtime_error("cannot stat file " + fn);
+    }
+    size_ = st.st_size;
+    if (size_ > 0) {
+        void *p {mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0)};
+        if (p == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("cannot map file " + fn);
+        }
+        // the file is read front to back
+        madvise(p, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(p);
+    }
+    close(fd); // the mapping stays valid after closing the descriptor
+}
+
+Mapped_file::~Mapped_file() {
+    if (data_)
+        munmap(const_cast<char*>(data_), size_);
+}
+
+bool file_stat(const std::string &fn, File_stat &fs) {
+    struct stat st;
+    if (stat(fn.c_str(), &st) < 0)
+        return false;
+    fs.size = st.st_size;
+    fs.mtime = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    return true;
+}
+
+void write_file(const std::string &fn, const char *head, const size_t nhead,
+        const char *body, const size_t nbody) {
+    const int fd {open(fn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644)};
+    if (fd < 0)
+        throw std::runtime_error("cannot open file " + fn);
+    iovec iov[2] {{const_cast<char*>(head), nhead},
+        {const_cast<char*>(body), nbody}};
+    int i {0};
+    while (i < 2) {
+        const ssize_t n {writev(fd, iov + i, 2 - i)};
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            throw std::runtime_error("cannot write file " + fn);
+        }
+        // partial write: skip what has been written and try again
+        size_t done = n;
+        for (; i < 2 && done >= iov[i].iov_len; ++i)
+            done -= iov[i].iov_len;
+        if (i < 2) {
+            iov[i].iov_base = static_cast<char*>(iov[i].iov_base) + done;
+            iov[i].iov_len -= done;
+        }
+    }
+    if (close(fd) < 0)
+        throw std::runtime_error("cannot write file " + fn);
+}
+
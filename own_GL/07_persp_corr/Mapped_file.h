@@ -0,0 +1,51 @@
+/*
+ * Class Mapped_file:
+ *      read-only memory mapping of a whole file (POSIX mmap). The contents
+ *      are paged in by the OS on demand, so large files (images, models) can
+ *      be decoded straight from the page cache without copying them into
+ *      intermediate buffers
+ *
+ * Examples:
+ *      Mapped_file f {"file.ppm"}; // throws std::runtime_error on failure
+ *      const char *p = f.data(); // f.size() bytes, valid while f lives
+ *      write_file("file.bin", head, nhead, body, nbody); // single writev
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstdint>
+
+class Mapped_file {
+public:
+    Mapped_file(const std::string&);
+    Mapped_file(const Mapped_file&) = delete;
+    Mapped_file& operator=(const Mapped_file&) = delete;
+
+    ~Mapped_file();
+
+    const char *data() const { return data_; }
+    const char *begin() const { return data_; }
+    const char *end() const { return data_ + size_; }
+    size_t size() const { return size_; }
+
+private:
+    const char *data_;
+    size_t size_;
+};
+
+// size and modification time (in nanoseconds) of a file
+struct File_stat {
+    uint64_t size;
+    int64_t mtime;
+};
+// returns false if the file does not exist
+bool file_stat(const std::string&, File_stat&);
+
+// write the buffers (header and body) to a file with a single writev call
+void write_file(const std::string&, const char*, const size_t, const char*,
+        const size_t);
+
+#endif
+
@@ -9,68 +9,73 @@
  *      Num type hints that the type should be numeric
  *      Decided to use fixed size array because the Mat class is going to be
  *      used mainly for small (2x2 - 4x4 elements) matrices
+ *      constexpr like Vec: products, transpose, inverse and the transform
+ *      builders (viewport, lookat, projection) of constant arguments are
+ *      evaluated at compile time
  */
 template <size_t R, size_t C, class Num>
 class Mat {
     Vec<R, Vec<C, Num>> M_;
 public:
     // ctors
-    Mat(const Num& = 0); // fill matrix with a value
-    Mat(const Vec<C, Num>&); // fill each matrix row with a Vec
-    Mat(const std::array<std::array<Num, C>, R>&);
-    Mat(const std::initializer_list<Vec<C, Num>>&);
+    constexpr Mat(const Num& = 0); // fill matrix with a value
+    constexpr Mat(const Vec<C, Num>&); // fill each matrix row with a Vec
+    constexpr Mat(const std::array<std::array<Num, C>, R>&);
+    constexpr Mat(const std::initializer_list<Vec<C, Num>>&);
     template <size_t R2, size_t C2, class Comp>
-    Mat(const Mat<R2, C2, Comp>&); // templated copy ctor: e.g., double to int
+    constexpr Mat(const Mat<R2, C2, Comp>&); // templated copy: double to int
     template <size_t R2, size_t C2, class Comp>
-    Mat& operator=(const Mat<R2, C2, Comp>&);
+    constexpr Mat& operator=(const Mat<R2, C2, Comp>&);
     ~Mat() = default;
 
     // templated compound arithemtic operators
     template <class Comp>
-    Mat& operator+=(const Comp&);
+    constexpr Mat& operator+=(const Comp&);
     template <class Comp>
-    Mat& operator+=(const Vec<R, Comp>&);
+    constexpr Mat& operator+=(const Vec<R, Comp>&);
     template <class Comp>
-    Mat& operator+=(const Mat<R, C, Comp>&);
+    constexpr Mat& operator+=(const Mat<R, C, Comp>&);
     template <class Comp>
-    Mat& operator-=(const Comp&);
+    constexpr Mat& operator-=(const Comp&);
     template <class Comp>
-    Mat& operator-=(const Vec<R, Comp>&);
+    constexpr Mat& operator-=(const Vec<R, Comp>&);
     template <class Comp>
-    Mat& operator-=(const Mat<R, C, Comp>&);
+    constexpr Mat& operator-=(const Mat<R, C, Comp>&);
     template <class Comp>
-    Mat& operator*=(const Comp&);
+    constexpr Mat& operator*=(const Comp&);
     template <class Comp>
-    Mat& operator/=(const Comp&);
+    constexpr Mat& operator/=(const Comp&);
 
     // iterators: using in loops (for (auto m: M))
     using iterator = typename Vec<R, Vec<C, Num>>::iterator;
     using const_iterator = typename Vec<R, Vec<C, Num>>::const_iterator;
-    iterator begin() { return M_.begin(); }
-    const_iterator begin() const { return M_.begin(); }
-    const_iterator cbegin() const { return M_.cbegin(); }
-    iterator end() { return M_.end(); }
-    const_iterator end() const { return M_.end(); }
-    const_iterator cend() const { return M_.cend(); }
+    constexpr iterator begin() { return M_.begin(); }
+    constexpr const_iterator begin() const { return M_.begin(); }
+    constexpr const_iterator cbegin() const { return M_.cbegin(); }
+    constexpr iterator end() { return M_.end(); }
+    constexpr const_iterator end() const { return M_.end(); }
+    constexpr const_iterator cend() const { return M_.cend(); }
 
     // index and range-check index operators
-    Vec<C, Num>& operator[](const size_t i) { return M_[i]; }
-    const Vec<C, Num>& operator[](const size_t i) const { return M_[i]; }
-    Vec<C, Num>& at(const size_t i) { return M_.at(i); }
-    const Vec<C, Num>& at(const size_t i) const { return M_.at(i); }
-    Vec<C, Num>& row(const size_t i) { return M_.at(i); }
-    const Vec<C, Num>& row(const size_t i) const { return M_.at(i); }
-    Vec<R, Num> col(const size_t);
-    const Vec<R, Num> col(const size_t) const;
+    constexpr Vec<C, Num>& operator[](const size_t i) { return M_[i]; }
+    constexpr const Vec<C, Num>& operator[](const size_t i) const {
+        return M_[i];
+    }
+    constexpr Vec<C, Num>& at(const size_t i) { return M_.at(i); }
+    constexpr const Vec<C, Num>& at(const size_t i) const { return M_.at(i); }
+    constexpr Vec<C, Num>& row(const size_t i) { return M_.at(i); }
+    constexpr const Vec<C, Num>& row(const size_t i) const { return M_.at(i); }
+    constexpr Vec<R, Num> col(const size_t);
+    constexpr const Vec<R, Num> col(const size_t) const;
 
     template <class Comp>
-    void fill_col(const size_t, const Vec<R, Comp>&);
+    constexpr void fill_col(const size_t, const Vec<R, Comp>&);
 
-    const Mat<C, R, Num> transpose() const;
+    constexpr const Mat<C, R, Num> transpose() const;
 
     // size methods
-    constexpr size_t nrows() { return R; }
-    constexpr size_t ncols() { return C; }
+    constexpr size_t nrows() const { return R; }
+    constexpr size_t ncols() const { return C; }
     constexpr Vec<2, size_t> size() const {return std::array<size_t, 2>{R, C};}
 };
 
@@ -78,54 +83,61 @@ public:
  * ------------------ Mat ctors and operators ------------------
  */
 template <size_t R, size_t C, class Num>
-Mat<R, C, Num>::Mat(const Num& val): M_() { for (auto &m: M_) m = val; }
+constexpr Mat<R, C, Num>::Mat(const Num& val): M_() {
+    for (auto &m: M_) m = val;
+}
 
 template <size_t R, size_t C, class Num>
-Mat<R, C, Num>::Mat(const Vec<C, Num>& v): M_{} { for (auto &m: M_) m = v; }
+constexpr Mat<R, C, Num>::Mat(const Vec<C, Num>& v): M_{} {
+    for (auto &m: M_) m = v;
+}
 
 template <size_t R, size_t C, class Num>
-Mat<R, C, Num>::Mat(const std::array<std::array<Num, C>, R> &M): M_() {
+constexpr Mat<R, C, Num>::Mat(const std::array<std::array<Num, C>, R> &M):
+    M_() {
     for (size_t i {R}; i--; M_[i] = M[i]) { }
 }
 
 template <size_t R, size_t C, class Num>
-Mat<R, C, Num>::Mat(const std::initializer_list<Vec<C, Num>> &IL): M_() {
+constexpr Mat<R, C, Num>::Mat(const std::initializer_list<Vec<C, Num>> &IL):
+    M_() {
     auto iter = std::begin(IL);
     for (size_t i {0}; i < std::min(R, IL.size()); ++i, ++iter) M_[i] = *iter;
 }
 
 template <size_t R, size_t C, class Num>
 template <size_t R2, size_t C2, class Comp>
-Mat<R, C, Num>::Mat(const Mat<R2, C2, Comp> &o): M_() {
+constexpr Mat<R, C, Num>::Mat(const Mat<R2, C2, Comp> &o): M_() {
     for (auto i = std::min(R, R2); i--;)
         for (auto j = std::min(C, C2); j--; M_[i][j] = o[i][j]) { }
 }
 
 template <size_t R, size_t C, class Num>
 template <size_t R2, size_t C2, class Comp>
-Mat<R, C, Num>& Mat<R, C, Num>::operator=(const Mat<R2, C2, Comp> &o) {
-    if (this != &o)
+constexpr Mat<R, C, Num>&
+Mat<R, C, Num>::operator=(const Mat<R2, C2, Comp> &o) {
+    if (static_cast<const void*>(this) != &o)
         for (auto i = std::min(R, R2); i--;)
             for (auto j = std::min(C, C2); j--; M_[i][j] = o[i][j]) { }
     return *this;
 }
 
 template <size_t R, size_t C, class Num>
-inline Vec<R, Num> Mat<R, C, Num>::col(const size_t j) {
+constexpr Vec<R, Num> Mat<R, C, Num>::col(const size_t j) {
     Vec<R, Num> v;
     for (auto i = R; i--; v[i] = M_[i][j]) { }
     return v;
 }
 
 template <size_t R, size_t C, class Num>
-inline const Vec<R, Num> Mat<R, C, Num>::col(const size_t j) const {
+constexpr const Vec<R, Num> Mat<R, C, Num>::col(const size_t j) const {
     Vec<R, Num> v;
     for (auto i = R; i--; v[i] = M_[i][j]) { }
     return v;
 }
 
 template <size_t R, size_t C, class Num> template <class Comp>
-void Mat<R, C, Num>::fill_col(const size_t j, const Vec<R, Comp> &v) {
+constexpr void Mat<R, C, Num>::fill_col(const size_t j, const Vec<R, Comp> &v) {
     for (auto i = R; i--; M_[i][j] = v[i]) { }
 }
 
@@ -144,7 +156,7 @@ std::ostream& operator<<(std::ostream &os, const Mat<R, C, Num> &M) {
 }
 
 template <size_t R1, size_t C1, class Num, size_t R2, size_t C2, class Comp>
-inline bool operator==(const Mat<R1,C1,Num> &M1, const Mat<R2,C2,Comp> &M2) {
+constexpr bool operator==(const Mat<R1,C1,Num> &M1, const Mat<R2,C2,Comp> &M2) {
     if (R1 != R2 || C1 != C2) return false;
     for (size_t i {0}; i < R1; ++i)
         if (M1[i] != M2[i]) return false;
@@ -152,12 +164,12 @@ inline bool operator==(const Mat<R1,C1,Num> &M1, const Mat<R2,C2,Comp> &M2) {
 }
 
 template <size_t R1, size_t C1, class Num, size_t R2, size_t C2, class Comp>
-inline bool operator!=(const Mat<R1,C1,Num> &M1, const Mat<R2,C2,Comp> &M2) {
+constexpr bool operator!=(const Mat<R1,C1,Num> &M1, const Mat<R2,C2,Comp> &M2) {
     return !(M1 == M2);
 }
 
 template <size_t R, size_t C, class Num>
-const Mat<C, R, Num> Mat<R, C, Num>::transpose() const {
+constexpr const Mat<C, R, Num> Mat<R, C, Num>::transpose() const {
     Mat<C, R, Num> M;
     for (auto i = C; i--; M[i] = this->col(i)) { }
     return M;
@@ -168,14 +180,14 @@ const Mat<C, R, Num> Mat<R, C, Num>::transpose() const {
  */
 // add a value to a matrix
 template <size_t R, size_t C, class Num> template <class Comp>
-inline Mat<R, C, Num>& Mat<R, C, Num>::operator+=(const Comp &rhs) {
+constexpr Mat<R, C, Num>& Mat<R, C, Num>::operator+=(const Comp &rhs) {
     for (auto &m: M_) m += rhs;
     return *this;
 }
 
 // add a column vector to each colum of a matrix (element-wise)
 template <size_t R, size_t C, class Num> template <class Comp>
-inline Mat<R, C, Num>& Mat<R, C, Num>::operator+=(const Vec<R, Comp> &rhs) {
+constexpr Mat<R, C, Num>& Mat<R, C, Num>::operator+=(const Vec<R, Comp> &rhs) {
     for (auto j = C; j--;)
         for (auto i = R; i--; M_[i][j] += rhs[i]) { }
     return *this;
@@ -183,21 +195,22 @@ inline Mat<R, C, Num>& Mat<R, C, Num>::operator+=(const Vec<R, Comp> &rhs) {
 
 // add a matrix to a matrix
 template <size_t R, size_t C, class Num> template <class Comp>
-inline Mat<R, C, Num>& Mat<R, C, Num>::operator+=(const Mat<R, C, Comp> &rhs) {
+constexpr Mat<R, C, Num>&
+Mat<R, C, Num>::operator+=(const Mat<R, C, Comp> &rhs) {
     for (auto i = R; i--; M_[i] += rhs[i]) { }
     return *this;
 }
 
 // subtract a value from a matrix
 template <size_t R, size_t C, class Num> template <class Comp>
-inline Mat<R, C, Num>& Mat<R, C, Num>::operator-=(const Comp &rhs) {
+constexpr Mat<R, C, Num>& Mat<R, C, Num>::operator-=(const Comp &rhs) {
     for (auto &m: M_) m -= rhs;
     return *this;
 }
 
 // subtract a column from each colum of a matrix (element-wise)
 template <size_t R, size_t C, class Num> template <class Comp>
-inline Mat<R, C, Num>& Mat<R, C, Num>::operator-=(const Vec<R, Comp> &rhs) {
+constexpr Mat<R, C, Num>& Mat<R, C, Num>::operator-=(const Vec<R, Comp> &rhs) {
     for (auto j = C; j--;)
         for (auto i = R; i--; M_[i][j] -= rhs[i]) { }
     return *this;
@@ -205,21 +218,22 @@ inline Mat<R, C, Num>& Mat<R, C, Num>::operator-=(const Vec<R, Comp> &rhs) {
 
 // subtract a matrix from a matrix
 template <size_t R, size_t C, class Num> template <class Comp>
-inline Mat<R, C, Num>& Mat<R, C, Num>::operator-=(const Mat<R, C, Comp> &rhs) {
+constexpr Mat<R, C, Num>&
+Mat<R, C, Num>::operator-=(const Mat<R, C, Comp> &rhs) {
     for (auto i = R; i--; M_[i] -= rhs[i]) { }
     return *this;
 }
 
 // multiply a matrix by a value
 template <size_t R, size_t C, class Num> template <class Comp>
-inline Mat<R, C, Num>& Mat<R, C, Num>::operator*=(const Comp &rhs) {
+constexpr Mat<R, C, Num>& Mat<R, C, Num>::operator*=(const Comp &rhs) {
     for (auto &m: M_) m *= rhs;
     return *this;
 }
 
 // divide a matrix by a value
 template <size_t R, size_t C, class Num> template <class Comp>
-inline Mat<R, C, Num>& Mat<R, C, Num>::operator/=(const Comp &rhs) {
+constexpr Mat<R, C, Num>& Mat<R, C, Num>::operator/=(const Comp &rhs) {
     for (auto &m: M_) m /= rhs;
     return *this;
 }
@@ -229,82 +243,82 @@ inline Mat<R, C, Num>& Mat<R, C, Num>::operator/=(const Comp &rhs) {
  */
 // add a value to a matrix
 template <size_t R, size_t C, class Num, class Comp>
-inline Mat<R, C, class std::common_type<Num, Comp>::type>
+constexpr Mat<R, C, typename std::common_type<Num, Comp>::type>
 operator+(const Mat<R, C, Num> &lhs, const Comp &rhs) {
-    Mat<R, C, class std::common_type<Num, Comp>::type> M {lhs};
+    Mat<R, C, typename std::common_type<Num, Comp>::type> M {lhs};
     return M += rhs;
 }
 
 // add a column vector to each colum of a matrix (element-wise)
 template <size_t R, size_t C, class Num, class Comp>
-inline Mat<R, C, class std::common_type<Num, Comp>::type>
+constexpr Mat<R, C, typename std::common_type<Num, Comp>::type>
 operator+(const Mat<R, C, Num> &lhs, const Vec<R, Comp> &rhs) {
-    Mat<R, C, class std::common_type<Num, Comp>::type> M {lhs};
+    Mat<R, C, typename std::common_type<Num, Comp>::type> M {lhs};
     return M += rhs;
 }
 
 // add a matrix to a matrix
 template <size_t R, size_t C, class Num, class Comp>
-inline Mat<R, C, class std::common_type<Num, Comp>::type>
+constexpr Mat<R, C, typename std::common_type<Num, Comp>::type>
 operator+(const Mat<R, C, Num> &lhs, const Mat<R, C, Comp> &rhs) {
-    Mat<R, C, class std::common_type<Num, Comp>::type> M {lhs};
+    Mat<R, C, typename std::common_type<Num, Comp>::type> M {lhs};
     return M += rhs;
 }
 
 // subtract a value from a matrix
 template <size_t R, size_t C, class Num, class Comp>
-inline Mat<R, C, class std::common_type<Num, Comp>::type>
+constexpr Mat<R, C, typename std::common_type<Num, Comp>::type>
 operator-(const Mat<R, C, Num> &lhs, const Comp &rhs) {
-    Mat<R, C, class std::common_type<Num, Comp>::type> M {lhs};
+    Mat<R, C, typename std::common_type<Num, Comp>::type> M {lhs};
     return M -= rhs;
 }
 
 // subtract a column vector from each colum of a matrix (element-wise)
 template <size_t R, size_t C, class Num, class Comp>
-inline Mat<R, C, class std::common_type<Num, Comp>::type>
+constexpr Mat<R, C, typename std::common_type<Num, Comp>::type>
 operator-(const Mat<R, C, Num> &lhs, const Vec<R, Comp> &rhs) {
-    Mat<R, C, class std::common_type<Num, Comp>::type> M {lhs};
+    Mat<R, C, typename std::common_type<Num, Comp>::type> M {lhs};
     return M -= rhs;
 }
 
 // subtract a matrix from a matrix
 template <size_t R, size_t C, class Num, class Comp>
-inline Mat<R, C, class std::common_type<Num, Comp>::type>
+constexpr Mat<R, C, typename std::common_type<Num, Comp>::type>
 operator-(const Mat<R, C, Num> &lhs, const Mat<R, C, Comp> &rhs) {
-    Mat<R, C, class std::common_type<Num, Comp>::type> M {lhs};
+    Mat<R, C, typename std::common_type<Num, Comp>::type> M {lhs};
     return M -= rhs;
 }
 
 // multiply a matrix by a value
 template <size_t R, size_t C, class Num, class Comp>
-inline Mat<R, C, class std::common_type<Num, Comp>::type>
+constexpr Mat<R, C, typename std::common_type<Num, Comp>::type>
 operator*(const Mat<R, C, Num> &lhs, const Comp &rhs) {
-    Mat<R, C, class std::common_type<Num, Comp>::type> M {lhs};
+    Mat<R, C, typename std::common_type<Num, Comp>::type> M {lhs};
     return M *= rhs;
 }
 
 // divide a matrix by a value
 template <size_t R, size_t C, class Num, class Comp>
-inline Mat<R, C, class std::common_type<Num, Comp>::type>
+constexpr Mat<R, C, typename std::common_type<Num, Comp>::type>
 operator/(const Mat<R, C, Num> &lhs, const Comp &rhs) {
-    Mat<R, C, class std::common_type<Num, Comp>::type> M {lhs};
+    Mat<R, C, typename std::common_type<Num, Comp>::type> M {lhs};
     return M /= rhs;
 }
 
 // multiply matrix by a vector: output is a vector
 template <size_t R, size_t C, class Num, class Comp>
-inline Vec<R, class std::common_type<Num, Comp>::type>
+constexpr Vec<R, typename std::common_type<Num, Comp>::type>
 operator*(const Mat<R, C, Num> &lhs, const Vec<C, Comp> &rhs) {
-    Vec<R, class std::common_type<Num, Comp>::type> v;
+    Vec<R, typename std::common_type<Num, Comp>::type> v;
     for (auto i = R; i--; v[i] = lhs[i] * rhs) { }
     return v;
 }
 
 // multiply matrix by a matrix
 template <size_t R, size_t RC, size_t C, class Num, class Comp>
-inline Mat<R, C, class std::common_type<Num, Comp>::type>
+constexpr Mat<R, C, typename std::common_type<Num, Comp>::type>
 operator*(const Mat<R, RC, Num> &lhs, const Mat<RC, C, Comp> &rhs) {
-    Mat<R, C, class std::common_type<Num, Comp>::type> M;
+    Mat<R, C, typename std::common_type<Num, Comp>::type> M;
     for (auto i = R; i--;)
         for (auto j = C; j--; M[i][j] = lhs[i] * rhs.col(j)) { }
     return M;
@@ -315,7 +329,7 @@ operator*(const Mat<R, RC, Num> &lhs, const Mat<RC, C, Comp> &rhs) {
  */
 // get matrix minor
 template <size_t R, size_t C, class Num>
-inline Mat<R - 1, C - 1, Num> mat_minor(const Mat<R, C, Num> &M,
+constexpr Mat<R - 1, C - 1, Num> mat_minor(const Mat<R, C, Num> &M,
         const size_t row_idx, const size_t col_idx) {
     Mat<R - 1, C - 1, Num> ret;
     for (size_t i {0}; i < R - 1; ++i)
@@ -326,32 +340,68 @@ inline Mat<R - 1, C - 1, Num> mat_minor(const Mat<R, C, Num> &M,
 
 // calculate matrix determinant: version for 3x3 matrix
 template <class Num>
-inline Num det3(const Mat<3, 3, Num> &M) {
+constexpr Num det3(const Mat<3, 3, Num> &M) {
     return M[0][0] * M[1][1] * M[2][2] + M[0][1] * M[1][2] * M[2][0] +
         M[0][2] * M[1][0] * M[2][1] - M[0][2] * M[1][1] * M[2][0] -
         M[0][1] * M[1][0] * M[2][2] - M[0][0] * M[1][2] * M[2][1];
 }
 
-// inverse transpose matrix
 template <size_t N, class Num>
-inline Mat<N, N, Num> invert_transpose(const Mat<N, N, Num> &M) {
+constexpr Num cofactor(const Mat<N, N, Num>&, const size_t, const size_t);
+
+// determinant: 1x1 and 3x3 directly, larger ones expanded along the first
+// row (2x2 into 1x1 minors)
+template <class Num>
+constexpr Num det(const Mat<1, 1, Num> &M) {
+    return M[0][0];
+}
+
+template <class Num>
+constexpr Num det(const Mat<3, 3, Num> &M) {
+    return det3(M);
+}
+
+template <size_t N, class Num>
+constexpr Num det(const Mat<N, N, Num> &M) {
+    Num d = 0;
+    for (auto j = N; j--; d += M[0][j] * cofactor(M, 0, j)) { }
+    return d;
+}
+
+// cofactor: signed determinant of the minor
+template <size_t N, class Num>
+constexpr Num cofactor(const Mat<N, N, Num> &M, const size_t i,
+        const size_t j) {
+    return det(mat_minor(M, i, j)) * ((i + j) & 1 ? -1 : 1);
+}
+
+// inverse transpose matrix: the cofactors divided by the determinant (the
+// first row of M times its cofactors)
+template <size_t N, class Num>
+constexpr Mat<N, N, Num> invert_transpose(const Mat<N, N, Num> &M) {
     Mat<N, N, double> ret;
     for (size_t i {0}; i < N; ++i)
         for (size_t j {0}; j < N; ++j)
-            ret[i][j] = det3(mat_minor(M, i, j)) * ((i + j) & 1 ? -1 : 1);
+            ret[i][j] = cofactor(M, i, j);
     return ret / double(ret[0] * M[0]);
 }
 
+// inverse matrix
+template <size_t N, class Num>
+constexpr Mat<N, N, Num> inverse(const Mat<N, N, Num> &M) {
+    return invert_transpose(M).transpose();
+}
+
 // identity matrix
 template <size_t N>
-inline Mat<N, N, int> eye() {
+constexpr Mat<N, N, int> eye() {
     Mat<N, N, int> M (0);
     for (auto i = N; i--; M[i][i] = 1) { }
     return M;
 }
 
 // viewport matrix
-inline Mat<4, 4, double> viewport(const int xx, const int yy,
+constexpr Mat<4, 4, double> viewport(const int xx, const int yy,
         const int w, const int h, const int d) {
     Mat<4, 4, double> m {eye<4>()};
     const double half_w {w / 2.0}, half_h {h / 2.0}, half_d {d / 2.0};
@@ -361,7 +411,7 @@ inline Mat<4, 4, double> viewport(const int xx, const int yy,
 }
 
 // lookat matrix
-inline Mat<4, 4, double> lookat(const Vec<3, double> &Eye,
+constexpr Mat<4, 4, double> lookat(const Vec<3, double> &Eye,
         const Vec<3, double> &Cen, const Vec<3, double> &Up) {
     const Vec<3, double> z {(Eye - Cen).normalize()};
     const Vec<3, double> x {(Up ^ z).normalize()};
@@ -375,12 +425,170 @@ inline Mat<4, 4, double> lookat(const Vec<3, double> &Eye,
 }
 
 // projection matrix
-inline Mat<4, 4, double> projection(const double coeff) {
+constexpr Mat<4, 4, double> projection(const double coeff) {
     Mat<4, 4, double> Proj {eye<4>()};
     Proj[3][2] = coeff;
     return Proj;
 }
 
+/*
+ * ------------------ SIMD kernels ------------------
+ * Non-template overloads of the matrix products for the 4-column float and
+ * double matrices (see the Vec kernels). Every element is summed in the
+ * order of the generic loops, (((0 + a3 * b3) + a2 * b2) + a1 * b1) +
+ * a0 * b0, but four (or two) elements at a time: the matrix-vector product
+ * works on the columns (transposed rows), the matrix product adds the rows
+ * of the right matrix scaled by the elements of a left row, so no col()
+ * temporaries are built
+ */
+#ifdef VEC_SIMD
+namespace simd {
+
+// rows i and j of a 4-column double matrix times v: (row_i * v, row_j * v)
+inline __m128d rows_dot(const Vec<4, double> &ri, const Vec<4, double> &rj,
+        const Vec<4, double> &v) {
+    const __m128d i01 {_mm_load_pd(&ri[0])}, i23 {_mm_load_pd(&ri[2])};
+    const __m128d j01 {_mm_load_pd(&rj[0])}, j23 {_mm_load_pd(&rj[2])};
+    __m128d acc {_mm_setzero_pd()};
+    acc = _mm_add_pd(acc, _mm_mul_pd(_mm_unpackhi_pd(i23, j23),
+                _mm_set1_pd(v[3])));
+    acc = _mm_add_pd(acc, _mm_mul_pd(_mm_unpacklo_pd(i23, j23),
+                _mm_set1_pd(v[2])));
+    acc = _mm_add_pd(acc, _mm_mul_pd(_mm_unpackhi_pd(i01, j01),
+                _mm_set1_pd(v[1])));
+    return _mm_add_pd(acc, _mm_mul_pd(_mm_unpacklo_pd(i01, j01),
+                _mm_set1_pd(v[0])));
+}
+
+// row of the product of a left row and a 4x4 double matrix
+inline void row_mul(const Vec<4, double> &l, const Mat<4, 4, double> &rhs,
+        double *out) {
+#ifdef __AVX__
+    __m256d acc {_mm256_setzero_pd()};
+    for (int k {3}; k >= 0; --k)
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(_mm256_set1_pd(l[k]),
+                    _mm256_loadu_pd(&rhs[k][0])));
+    _mm256_storeu_pd(out, acc);
+#else
+    __m128d lo {_mm_setzero_pd()}, hi {_mm_setzero_pd()};
+    for (int k {3}; k >= 0; --k) {
+        const __m128d a {_mm_set1_pd(l[k])};
+        lo = _mm_add_pd(lo, _mm_mul_pd(a, _mm_load_pd(&rhs[k][0])));
+        hi = _mm_add_pd(hi, _mm_mul_pd(a, _mm_load_pd(&rhs[k][2])));
+    }
+    _mm_store_pd(out, lo);
+    _mm_store_pd(out + 2, hi);
+#endif
+}
+
+inline Vec<4, double> mul(const Mat<4, 4, double> &lhs,
+        const Vec<4, double> &rhs) {
+    Vec<4, double> v;
+#ifdef __AVX__
+    // transpose the rows into columns: c[k] = (m0k, m1k, m2k, m3k)
+    const __m256d r0 {_mm256_loadu_pd(&lhs[0][0])};
+    const __m256d r1 {_mm256_loadu_pd(&lhs[1][0])};
+    const __m256d r2 {_mm256_loadu_pd(&lhs[2][0])};
+    const __m256d r3 {_mm256_loadu_pd(&lhs[3][0])};
+    const __m256d t0 {_mm256_unpacklo_pd(r0, r1)};
+    const __m256d t1 {_mm256_unpackhi_pd(r0, r1)};
+    const __m256d t2 {_mm256_unpacklo_pd(r2, r3)};
+    const __m256d t3 {_mm256_unpackhi_pd(r2, r3)};
+    const __m256d c[4] {_mm256_permute2f128_pd(t0, t2, 0x20),
+        _mm256_permute2f128_pd(t1, t3, 0x20),
+        _mm256_permute2f128_pd(t0, t2, 0x31),
+        _mm256_permute2f128_pd(t1, t3, 0x31)};
+    __m256d acc {_mm256_setzero_pd()};
+    for (int k {3}; k >= 0; --k)
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(c[k], _mm256_set1_pd(rhs[k])));
+    _mm256_storeu_pd(&v[0], acc);
+#else
+    _mm_store_pd(&v[0], rows_dot(lhs[0], lhs[1], rhs));
+    _mm_store_pd(&v[2], rows_dot(lhs[2], lhs[3], rhs));
+#endif
+    return v;
+}
+
+// three homogeneous points (rows) times a vector
+inline Vec<3, double> mul(const Mat<3, 4, double> &lhs,
+        const Vec<4, double> &rhs) {
+    Vec<3, double> v;
+    _mm_storeu_pd(&v[0], rows_dot(lhs[0], lhs[1], rhs));
+    v[2] = _mm_cvtsd_f64(rows_dot(lhs[2], lhs[2], rhs));
+    return v;
+}
+
+inline Mat<4, 4, double> mul(const Mat<4, 4, double> &lhs,
+        const Mat<4, 4, double> &rhs) {
+    Mat<4, 4, double> M;
+    for (int i {0}; i < 4; ++i)
+        row_mul(lhs[i], rhs, &M[i][0]);
+    return M;
+}
+
+inline Vec<4, float> mul(const Mat<4, 4, float> &lhs,
+        const Vec<4, float> &rhs) {
+    __m128 c0 {_mm_load_ps(&lhs[0][0])}, c1 {_mm_load_ps(&lhs[1][0])};
+    __m128 c2 {_mm_load_ps(&lhs[2][0])}, c3 {_mm_load_ps(&lhs[3][0])};
+    _MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+    __m128 acc {_mm_setzero_ps()};
+    acc = _mm_add_ps(acc, _mm_mul_ps(c3, _mm_set1_ps(rhs[3])));
+    acc = _mm_add_ps(acc, _mm_mul_ps(c2, _mm_set1_ps(rhs[2])));
+    acc = _mm_add_ps(acc, _mm_mul_ps(c1, _mm_set1_ps(rhs[1])));
+    acc = _mm_add_ps(acc, _mm_mul_ps(c0, _mm_set1_ps(rhs[0])));
+    Vec<4, float> v;
+    _mm_store_ps(&v[0], acc);
+    return v;
+}
+
+inline Mat<4, 4, float> mul(const Mat<4, 4, float> &lhs,
+        const Mat<4, 4, float> &rhs) {
+    const __m128 r[4] {_mm_load_ps(&rhs[0][0]), _mm_load_ps(&rhs[1][0]),
+        _mm_load_ps(&rhs[2][0]), _mm_load_ps(&rhs[3][0])};
+    Mat<4, 4, float> M;
+    for (int i {0}; i < 4; ++i) {
+        __m128 acc {_mm_setzero_ps()};
+        for (int k {3}; k >= 0; --k)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(lhs[i][k]), r[k]));
+        _mm_store_ps(&M[i][0], acc);
+    }
+    return M;
+}
+
+} // namespace simd
+
+// the products of the kernels, the generic templates in constant expressions
+constexpr Vec<4, double> operator*(const Mat<4, 4, double> &lhs,
+        const Vec<4, double> &rhs) {
+    return constant_evaluated() ? operator*<4, 4, double, double>(lhs, rhs) :
+        simd::mul(lhs, rhs);
+}
+
+constexpr Vec<3, double> operator*(const Mat<3, 4, double> &lhs,
+        const Vec<4, double> &rhs) {
+    return constant_evaluated() ? operator*<3, 4, double, double>(lhs, rhs) :
+        simd::mul(lhs, rhs);
+}
+
+constexpr Mat<4, 4, double> operator*(const Mat<4, 4, double> &lhs,
+        const Mat<4, 4, double> &rhs) {
+    return constant_evaluated() ?
+        operator*<4, 4, 4, double, double>(lhs, rhs) : simd::mul(lhs, rhs);
+}
+
+constexpr Vec<4, float> operator*(const Mat<4, 4, float> &lhs,
+        const Vec<4, float> &rhs) {
+    return constant_evaluated() ? operator*<4, 4, float, float>(lhs, rhs) :
+        simd::mul(lhs, rhs);
+}
+
+constexpr Mat<4, 4, float> operator*(const Mat<4, 4, float> &lhs,
+        const Mat<4, 4, float> &rhs) {
+    return constant_evaluated() ? operator*<4, 4, 4, float, float>(lhs, rhs) :
+        simd::mul(lhs, rhs);
+}
+#endif
+
 
 #endif
 
@@ -0,0 +1,92 @@
+/*
+ * Small memory helpers for the flat pixel/vertex buffers:
+ *      Aligned_allocator: allocator for std::vector returning memory aligned
+ *      to a cache line (64 bytes by default), so that rows of pixels and
+ *      arrays of vertex components start at a cache line and can be loaded
+ *      with aligned SIMD instructions
+ *      Span: non-owning view of a contiguous range of values (pointer and
+ *      size), used to pass rows/arrays around without copying them
+ *
+ * Examples:
+ *      aligned_vector<unsigned int> v(1024); // v.data() % 64 == 0
+ *      Span<unsigned int> s {v.data(), 16}; // view of the first 16 values
+ *      for (auto &a: s) a = 0;
+ */
+
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <cstdlib>
+#include <new>
+#include <vector>
+#include <type_traits>
+
+static constexpr size_t cache_line {64};
+
+template <class T, size_t Align = cache_line>
+class Aligned_allocator {
+public:
+    using value_type = T;
+    template <class U>
+    struct rebind { using other = Aligned_allocator<U, Align>; };
+
+    Aligned_allocator() = default;
+    template <class U>
+    Aligned_allocator(const Aligned_allocator<U, Align>&) { }
+
+    T* allocate(const size_t n) {
+        void *p {nullptr};
+        if (posix_memalign(&p, Align, n * sizeof(T)))
+            throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T *p, const size_t) { free(p); }
+};
+
+template <class T, class U, size_t Align>
+inline bool operator==(const Aligned_allocator<T, Align>&,
+        const Aligned_allocator<U, Align>&) {
+    return true;
+}
+
+template <class T, class U, size_t Align>
+inline bool operator!=(const Aligned_allocator<T, Align>&,
+        const Aligned_allocator<U, Align>&) {
+    return false;
+}
+
+template <class T>
+using aligned_vector = std::vector<T, Aligned_allocator<T>>;
+
+template <class T>
+class Span {
+public:
+    Span(): p_{nullptr}, n_{0} { }
+    Span(T *p, const size_t n): p_{p}, n_{n} { }
+    template <class Alloc>
+    Span(std::vector<typename std::remove_const<T>::type, Alloc> &v):
+        p_{v.data()}, n_{v.size()} { }
+    template <class Alloc>
+    Span(const std::vector<typename std::remove_const<T>::type, Alloc> &v):
+        p_{v.data()}, n_{v.size()} { }
+    Span(const Span&) = default;
+    Span& operator=(const Span&) = default;
+
+    T* begin() const { return p_; }
+    T* end() const { return p_ + n_; }
+    T* data() const { return p_; }
+    size_t size() const { return n_; }
+    bool empty() const { return n_ == 0; }
+    T& operator[](const size_t i) const { return p_[i]; }
+
+    Span subspan(const size_t pos, const size_t n) const {
+        return {p_ + pos, n};
+    }
+
+private:
+    T *p_;
+    size_t n_;
+};
+
+#endif
+
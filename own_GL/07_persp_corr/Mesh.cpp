@@ -0,0 +1,255 @@
+#include "Mesh.h"
+#include "Mapped_file.h"
+#include "Thread_pool.h"
+#include "Profile.h"
+#include <unordered_map>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+
+// key for de-duplication: (vertex / texvertex / normal) triple
+struct Triple_hash {
+    size_t operator()(const Vec<3, int> &t) const {
+        return (size_t(t[0]) * 73856093) ^ (size_t(t[1]) * 19349663) ^
+            (size_t(t[2]) * 83492791);
+    }
+};
+
+struct Triple_equal {
+    bool operator()(const Vec<3, int> &a, const Vec<3, int> &b) const {
+        return a[0] == b[0] && a[1] == b[1] && a[2] == b[2];
+    }
+};
+
+/*
+ * ------------------ cache file format ------------------
+ */
+static constexpr char mesh_magic[8] {'O', 'W', 'N', 'G', 'L', 'M', 'S', 'H'};
+static constexpr uint32_t mesh_version {1};
+static constexpr int num_arrays {9}; // x, y, z, nx, ny, nz, u, v, indices
+
+struct Mesh_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t src_size;
+    int64_t src_mtime;
+    uint64_t src_hash;
+    uint64_t num_vertices;
+    uint64_t num_indices;
+    uint64_t offset[num_arrays]; // from the start of the block
+    uint64_t block_size;
+    char pad[56];
+};
+static_assert(sizeof(Mesh_header) % cache_line == 0,
+        "the arrays following the header must start at a cache line");
+
+// offsets of the arrays within a block, each one starting at a cache line;
+// returns the size of the block
+static uint64_t block_layout(const uint64_t nverts, const uint64_t nidx,
+        uint64_t *off) {
+    auto align = [](const uint64_t n) {
+        return (n + cache_line - 1) & ~uint64_t(cache_line - 1);
+    };
+    uint64_t pos {0};
+    for (int i {0}; i < num_arrays - 1; ++i) {
+        off[i] = pos;
+        pos = align(pos + nverts * sizeof(float));
+    }
+    off[num_arrays - 1] = pos;
+    return align(pos + nidx * sizeof(uint32_t));
+}
+
+// 64-bit hash of the contents of the source file (word at a time, the file
+// is hashed at memory speed)
+static uint64_t hash_bytes(const char *p, const size_t n) {
+    uint64_t h {0x9e3779b97f4a7c15ULL ^ n};
+    size_t i {0};
+    for (; i + 8 <= n; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdULL;
+        h ^= h >> 32;
+    }
+    for (; i < n; ++i)
+        h = (h ^ uint8_t(p[i])) * 0x100000001b3ULL;
+    return h;
+}
+
+static uint64_t hash_file(const std::string &fn) {
+    const Mapped_file f {fn};
+    return hash_bytes(f.data(), f.size());
+}
+
+// header of the cache file if it is complete and consistent
+static const Mesh_header* valid_header(const Mapped_file &f) {
+    if (f.size() < sizeof(Mesh_header))
+        return nullptr;
+    const Mesh_header *hdr {reinterpret_cast<const Mesh_header*>(f.data())};
+    if (memcmp(hdr->magic, mesh_magic, sizeof(mesh_magic)) ||
+            hdr->version != mesh_version ||
+            hdr->header_size != sizeof(Mesh_header) ||
+            hdr->num_indices % 3 || hdr->num_vertices > UINT32_MAX)
+        return nullptr;
+    uint64_t off[num_arrays];
+    if (block_layout(hdr->num_vertices, hdr->num_indices, off) !=
+            hdr->block_size || f.size() != sizeof(Mesh_header) +
+            hdr->block_size ||
+            memcmp(off, hdr->offset, sizeof(off)))
+        return nullptr;
+    return hdr;
+}
+
+/*
+ * ------------------ Mesh implementation ------------------
+ */
+Mesh::Mesh(): storage_{}, block_{}, mapped_{false}, x_{}, y_{}, z_{}, nx_{},
+    ny_{}, nz_{}, u_{}, v_{}, idx_{} {
+}
+
+Mesh::Mesh(const Model &m): Mesh() {
+    const size_t nfaces {m.num_faces()};
+    std::unordered_map<Vec<3, int>, uint32_t, Triple_hash, Triple_equal> ids;
+    ids.reserve(m.num_vertices() * 2);
+    // the arrays are gathered first and then packed into a single block
+    std::vector<float> a[num_arrays - 1];
+    std::vector<uint32_t> idx;
+    idx.reserve(nfaces * 3);
+    for (size_t i {0}; i < nfaces; ++i)
+        for (int j {0}; j < 3; ++j) {
+            const Vec<3, int> &t = m.facet(i)[j];
+            const auto ins = ids.emplace(t, uint32_t(a[0].size()));
+            idx.push_back(ins.first->second);
+            if (!ins.second) // the triple is known already
+                continue;
+            const Vec3d p {m.vertex(t[0])};
+            a[0].push_back(p[0]);
+            a[1].push_back(p[1]);
+            a[2].push_back(p[2]);
+            // the normal is normalized here once and for all
+            Vec3d n {0, 0, 0};
+            if (t[2] >= 0 && size_t(t[2]) < m.num_normals())
+                n = m.normal(t[2]).normalize();
+            a[3].push_back(n[0]);
+            a[4].push_back(n[1]);
+            a[5].push_back(n[2]);
+            Vec3d uv {0, 0, 0};
+            if (t[1] >= 0 && size_t(t[1]) < m.num_texvertices())
+                uv = m.texvertex(t[1]);
+            a[6].push_back(uv[0]);
+            a[7].push_back(uv[1]);
+        }
+
+    const uint64_t nverts {a[0].size()};
+    uint64_t off[num_arrays];
+    const uint64_t size {block_layout(nverts, idx.size(), off)};
+    const auto buf = std::make_shared<aligned_vector<char>>(size, 0);
+    for (int i {0}; i < num_arrays - 1; ++i)
+        if (nverts)
+            memcpy(buf->data() + off[i], a[i].data(), nverts * sizeof(float));
+    if (!idx.empty())
+        memcpy(buf->data() + off[num_arrays - 1], idx.data(),
+                idx.size() * sizeof(uint32_t));
+    attach(buf, buf->data(), nverts, idx.size(), false);
+}
+
+void Mesh::attach(std::shared_ptr<const void> storage, const char *block,
+        const uint64_t nverts, const uint64_t nidx, const bool mapped) {
+    uint64_t off[num_arrays];
+    const uint64_t size {block_layout(nverts, nidx, off)};
+    auto floats = [&](const int i) {
+        return Span<const float> {reinterpret_cast<const float*>(block +
+                off[i]), nverts};
+    };
+    storage_ = std::move(storage);
+    block_ = {block, size};
+    mapped_ = mapped;
+    x_ = floats(0);
+    y_ = floats(1);
+    z_ = floats(2);
+    nx_ = floats(3);
+    ny_ = floats(4);
+    nz_ = floats(5);
+    u_ = floats(6);
+    v_ = floats(7);
+    idx_ = {reinterpret_cast<const uint32_t*>(block + off[num_arrays - 1]),
+        nidx};
+}
+
+// the cache is written to a temporary file which is then renamed, so a
+// concurrent run never maps a half written cache
+void Mesh::save(const std::string &fn, const uint64_t src_size,
+        const int64_t src_mtime, const uint64_t src_hash) const {
+    Mesh_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, mesh_magic, sizeof(mesh_magic));
+    hdr.version = mesh_version;
+    hdr.header_size = sizeof(Mesh_header);
+    hdr.src_size = src_size;
+    hdr.src_mtime = src_mtime;
+    hdr.src_hash = src_hash;
+    hdr.num_vertices = num_vertices();
+    hdr.num_indices = idx_.size();
+    hdr.block_size = block_layout(hdr.num_vertices, hdr.num_indices,
+            hdr.offset);
+    const std::string tmp {fn + ".tmp"};
+    write_file(tmp, reinterpret_cast<const char*>(&hdr), sizeof(hdr),
+            block_.data(), block_.size());
+    if (std::rename(tmp.c_str(), fn.c_str())) {
+        std::remove(tmp.c_str());
+        throw std::runtime_error("cannot write file " + fn);
+    }
+}
+
+Mesh Mesh::load(const std::string &fn) {
+    return load(fn, nullptr);
+}
+
+Mesh Mesh::load(const std::string &fn, Thread_pool &pool) {
+    return load(fn, &pool);
+}
+
+Mesh Mesh::load(const std::string &fn, Thread_pool *pool) {
+    PROF_SCOPE("mesh_load");
+    File_stat src;
+    if (!file_stat(fn, src))
+        throw std::runtime_error("cannot open file " + fn);
+    const std::string cfn {cache_name(fn)};
+    uint64_t hash {0};
+    bool hashed {false};
+    File_stat cst;
+    if (file_stat(cfn, cst)) {
+        const auto f = std::make_shared<Mapped_file>(cfn);
+        const Mesh_header *hdr {valid_header(*f)};
+        if (hdr && hdr->src_size == src.size) {
+            if (hdr->src_mtime != src.mtime) {
+                hash = hash_file(fn);
+                hashed = true;
+            }
+            if (!hashed || hash == hdr->src_hash) {
+                Mesh mesh;
+                mesh.attach(f, f->data() + sizeof(Mesh_header),
+                        hdr->num_vertices, hdr->num_indices, true);
+                // touched but unchanged: the cache takes the new time, so
+                // the next runs do not hash the source again
+                if (hashed)
+                    try {
+                        mesh.save(cfn, src.size, src.mtime, hash);
+                    } catch (const std::runtime_error&) {
+                    }
+                return mesh;
+            }
+        }
+    }
+
+    // missing or stale cache: parse the source and rebuild it
+    const Mesh mesh {pool ? Model{fn, *pool} : Model{fn}};
+    if (!hashed)
+        hash = hash_file(fn);
+    try {
+        mesh.save(cfn, src.size, src.mtime, hash);
+    } catch (const std::runtime_error&) {
+        // a read-only directory only costs the parsing on the next run
+    }
+    return mesh;
+}
@@ -0,0 +1,131 @@
+/*
+ * Class Mesh:
+ *      compiled (render-ready) version of a Model
+ *      Model keeps the separate lists of vertices, texture vertices and
+ *      normals, and every face corner refers to a (v / vt / vn) triple, so each
+ *      access is a double indirection and the normal is normalized on every
+ *      call. Mesh de-duplicates the triples into a single indexed vertex
+ *      stream:
+ *          - structure of arrays: x, y, z, normal x, y, z and u, v are
+ *            separate 64-byte aligned float arrays, so a stage that needs
+ *            only the positions streams only through them
+ *          - normals are normalized once when the mesh is built
+ *          - faces are three indices into the vertex stream (index buffer)
+ *      The per-face accessors have the same signatures as the Model ones, so
+ *      the shaders work with both
+ *      All the arrays live in one block of memory which is shared between the
+ *      copies of a Mesh and is either allocated or a mapping of a cache file.
+ *
+ * Compiled mesh cache (Mesh::load): the block is written next to the OBJ file
+ * (model.obj.mesh) the first time the model is loaded, and later runs map the
+ * cache file and use the arrays in place (no parsing, no copying). File layout:
+ *      Mesh_header (192 bytes): magic, format version, size, modification
+ *      time and content hash of the source file, counts and array offsets
+ *      x, y, z, nx, ny, nz, u, v: float[num_vertices] each
+ *      indices: uint32_t[num_faces * 3]
+ * every array starts at a multiple of 64 bytes. The cache is rebuilt when the
+ * version or the source size differs, or when the modification time differs
+ * and the content hash does too (a touched but unchanged file keeps its cache,
+ * which is written again with the new modification time)
+ *
+ * Examples:
+ *      const Mesh mesh {Model{"model.obj"}};
+ *      const Mesh cached {Mesh::load("model.obj")}; // via model.obj.mesh
+ *      for (auto x: mesh.x()) ...; // stream through the x coordinates
+ *      mesh.vertex(iface, ivert); // the same as Model::vertex(iface, ivert)
+ */
+
+#ifndef MESH_H
+#define MESH_H
+
+#include "Model.h"
+#include "Memory.h"
+#include <cstdint>
+#include <memory>
+
+class Thread_pool; // forward declaration
+
+class Mesh {
+public:
+    using Vec3d = Vec<3, double>;
+
+    Mesh();
+    explicit Mesh(const Model&);
+
+    ~Mesh() = default;
+
+    // compile the OBJ file through the cache file (parsing, with the pool if
+    // given, only when the cache is missing or stale)
+    static Mesh load(const std::string&);
+    static Mesh load(const std::string&, Thread_pool&);
+    static std::string cache_name(const std::string &fn) {
+        return fn + ".mesh";
+    }
+
+    // true if the arrays are a mapping of a cache file
+    bool mapped() const { return mapped_; }
+
+    size_t num_vertices() const { return x_.size(); }
+    size_t num_faces() const { return idx_.size() / 3; }
+
+    // index of the vertex at the corner ivert of the face iface
+    uint32_t index(const int iface, const int ivert) const {
+        return idx_[iface * 3 + ivert];
+    }
+
+    // single vertex access
+    const Vec3d vertex(const uint32_t i) const { return {x_[i], y_[i], z_[i]}; }
+    const Vec3d normal(const uint32_t i) const {
+        return {nx_[i], ny_[i], nz_[i]};
+    }
+    const Vec3d texvertex(const uint32_t i) const { return {u_[i], v_[i], 0}; }
+
+    // face corner access: the same as in Model (the normal is unit already)
+    const Vec3d vertex(const int iface, const int ivert) const {
+        return vertex(index(iface, ivert));
+    }
+    const Vec3d normal(const int iface, const int ivert) const {
+        return normal(index(iface, ivert));
+    }
+    const Vec3d texvertex(const int iface, const int ivert) const {
+        return texvertex(index(iface, ivert));
+    }
+
+    // streams
+    Span<const float> x() const { return x_; }
+    Span<const float> y() const { return y_; }
+    Span<const float> z() const { return z_; }
+    Span<const float> nx() const { return nx_; }
+    Span<const float> ny() const { return ny_; }
+    Span<const float> nz() const { return nz_; }
+    Span<const float> u() const { return u_; }
+    Span<const float> v() const { return v_; }
+    Span<const uint32_t> indices() const { return idx_; }
+
+    // memory taken by the arrays in bytes
+    size_t memory() const { return block_.size(); }
+
+private:
+    static Mesh load(const std::string&, Thread_pool*);
+    // point the arrays into the block (laid out by block_layout)
+    void attach(std::shared_ptr<const void>, const char*, const uint64_t,
+            const uint64_t, const bool);
+    void save(const std::string&, const uint64_t, const int64_t,
+            const uint64_t) const;
+
+    std::shared_ptr<const void> storage_; // owns the block
+    Span<const char> block_;
+    bool mapped_;
+    Span<const float> x_;
+    Span<const float> y_;
+    Span<const float> z_;
+    Span<const float> nx_;
+    Span<const float> ny_;
+    Span<const float> nz_;
+    Span<const float> u_;
+    Span<const float> v_;
+    Span<const uint32_t> idx_;
+};
+
+#endif
+
@@ -1,4 +1,11 @@
 #include "Model.h"
+#include "Mapped_file.h"
+#include "Thread_pool.h"
+#include "Profile.h"
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <stdexcept>
 
 using Vec3i = Vec<3, int>;
 using Vec3d = Vec<3, double>;
@@ -23,13 +30,250 @@ std::istream& operator>>(std::istream &is, Facet &f) {
     return is;
 }
 
+/*
+ * ------------------ OBJ parsing ------------------
+ */
+// part of the file parsed independently of the others
+struct Obj_chunk {
+    std::vector<Vec3d> verts {};
+    std::vector<Vec3d> norms {};
+    std::vector<Vec3d> texverts {};
+    std::vector<Facet> faces {};
+    // negative (relative) indices are resolved against the chunk: the chunk
+    // offsets are added when merging. Face number and position (corner * 3 +
+    // component) of such indices
+    std::vector<std::pair<uint32_t, uint8_t>> rel {};
+};
+
+static inline bool is_blank(const char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline void skip_blanks(const char *&p, const char *end) {
+    while (p < end && is_blank(*p)) ++p;
+}
+
+static inline bool is_digit(const char c) {
+    return c >= '0' && c <= '9';
+}
+
+// parse a decimal integer: returns false if there is no number at p
+static bool parse_int(const char *&p, const char *end, int &val) {
+    const char *q {p};
+    const bool neg {q < end && *q == '-'};
+    if (q < end && (*q == '-' || *q == '+')) ++q;
+    if (q == end || !is_digit(*q))
+        return false;
+    int v {0};
+    for (; q < end && is_digit(*q); ++q)
+        v = v * 10 + (*q - '0');
+    val = neg ? -v : v;
+    p = q;
+    return true;
+}
+
+// parse a decimal floating point number (in the spirit of from_chars: no
+// locale, no allocation, no null terminator needed); up to 19 significant
+// digits are kept and the usual fast path (mantissa < 2^53, |exponent| <= 22)
+// is exact, i.e. gives the same value as strtod()
+static bool parse_double(const char *&p, const char *end, double &val) {
+    static constexpr double pow10[] {1E0, 1E1, 1E2, 1E3, 1E4, 1E5, 1E6, 1E7,
+        1E8, 1E9, 1E10, 1E11, 1E12, 1E13, 1E14, 1E15, 1E16, 1E17, 1E18, 1E19,
+        1E20, 1E21, 1E22};
+    skip_blanks(p, end);
+    const char *q {p};
+    const bool neg {q < end && *q == '-'};
+    if (q < end && (*q == '-' || *q == '+')) ++q;
+    uint64_t mant {0};
+    int exp10 {0}, ndig {0};
+    bool any {false};
+    for (; q < end && is_digit(*q); ++q, any = true) {
+        if (ndig < 19) {
+            mant = mant * 10 + (*q - '0');
+            ndig += mant > 0;
+        } else {
+            ++exp10;
+        }
+    }
+    if (q < end && *q == '.')
+        for (++q; q < end && is_digit(*q); ++q, any = true)
+            if (ndig < 19) {
+                mant = mant * 10 + (*q - '0');
+                ndig += mant > 0;
+                --exp10;
+            }
+    if (!any)
+        return false;
+    if (q < end && (*q == 'e' || *q == 'E')) {
+        const char *r {q + 1};
+        int e {0};
+        if (parse_int(r, end, e)) {
+            exp10 += std::max(-9999, std::min(e, 9999));
+            q = r;
+        }
+    }
+    double v = mant;
+    if (mant < uint64_t{1} << 53 && exp10 >= -22 && exp10 <= 22)
+        v = exp10 < 0 ? v / pow10[-exp10] : v * pow10[exp10];
+    else
+        v *= std::pow(10.0, exp10);
+    val = neg ? -v : v;
+    p = q;
+    return true;
+}
+
+// read up to three values (missing ones are zeros)
+static Vec3d parse_vec3(const char *p, const char *end) {
+    Vec3d v {0, 0, 0};
+    for (int i {0}; i < 3 && parse_double(p, end, v[i]); ++i) { }
+    return v;
+}
+
+// face corner: v, v/vt, v//vn or v/vt/vn; converts the indices to zero based
+// ones and marks the relative indices in rel (bit per component)
+static bool parse_corner(const char *&p, const char *end, const Obj_chunk &c,
+        Vec3i &idx, int &rel) {
+    skip_blanks(p, end);
+    const int count[3] {int(c.verts.size()), int(c.texverts.size()),
+        int(c.norms.size())};
+    int raw[3] {0, 0, 0};
+    if (!parse_int(p, end, raw[0]))
+        return false;
+    if (p < end && *p == '/') {
+        ++p;
+        if (p < end && *p != '/')
+            parse_int(p, end, raw[1]);
+        if (p < end && *p == '/') {
+            ++p;
+            parse_int(p, end, raw[2]);
+        }
+    }
+    rel = 0;
+    for (int k {0}; k < 3; ++k) {
+        if (raw[k] > 0) {
+            idx[k] = raw[k] - 1;
+        } else if (raw[k] < 0) { // relative to the end of the list
+            idx[k] = count[k] + raw[k];
+            rel |= 1 << k;
+        } else {
+            idx[k] = -1; // missing
+        }
+    }
+    return true;
+}
+
+static void parse_chunk(const char *p, const char *end, Obj_chunk &c) {
+    std::vector<std::pair<Vec3i, int>> corners;
+    while (p < end) {
+        skip_blanks(p, end);
+        const char *eol {static_cast<const char*>(memchr(p, '\n', end - p))};
+        if (!eol)
+            eol = end;
+        if (eol - p > 1 && p[0] == 'v' && is_blank(p[1])) {
+            c.verts.push_back(parse_vec3(p + 1, eol));
+        } else if (eol - p > 2 && p[0] == 'v' && is_blank(p[2])) {
+            if (p[1] == 'n')
+                c.norms.push_back(parse_vec3(p + 2, eol));
+            else if (p[1] == 't')
+                c.texverts.push_back(parse_vec3(p + 2, eol));
+        } else if (eol - p > 1 && p[0] == 'f' && is_blank(p[1])) {
+            corners.clear();
+            Vec3i idx;
+            int rel;
+            for (const char *q {p + 1}; parse_corner(q, eol, c, idx, rel);)
+                corners.emplace_back(idx, rel);
+            // polygons are split into a fan of triangles
+            for (size_t i {1}; i + 1 < corners.size(); ++i) {
+                const size_t tri[3] {0, i, i + 1};
+                for (int j {0}; j < 3; ++j)
+                    for (int k {0}; k < 3; ++k)
+                        if (corners[tri[j]].second >> k & 1)
+                            c.rel.emplace_back(c.faces.size(), j * 3 + k);
+                c.faces.emplace_back(corners[0].first, corners[i].first,
+                        corners[i + 1].first);
+            }
+        }
+        p = eol + 1;
+    }
+}
+
 /*
  * ------------------ Model implementation ------------------
  */
-Model::Model(const std::string &fn): verts_{}, norms_{}, texverts_{}, faces_{} {
-    std::ifstream ifs {fn};
-    if (!ifs)
-        throw std::runtime_error("cannot open file " + fn);
+Model::Model(const std::string &fn): verts_{}, norms_{}, texverts_{},
+    faces_{} {
+    load(fn, nullptr);
+}
+
+Model::Model(const std::string &fn, Thread_pool &pool): verts_{}, norms_{},
+    texverts_{}, faces_{} {
+    load(fn, &pool);
+}
+
+void Model::load(const std::string &fn, Thread_pool *pool) {
+    PROF_SCOPE("obj_load");
+    const Mapped_file f {fn};
+    // split the file into chunks at the line ends
+    size_t nchunks {1};
+    if (pool)
+        nchunks = std::max(size_t{1}, std::min(f.size() >> 16,
+                    pool->num_threads() * 8));
+    std::vector<const char*> bounds {f.begin()};
+    for (size_t k {1}; k < nchunks; ++k) {
+        const char *q {std::max(f.begin() + f.size() * k / nchunks,
+                bounds.back())};
+        q = static_cast<const char*>(memchr(q, '\n', f.end() - q));
+        bounds.push_back(q ? q + 1 : f.end());
+    }
+    bounds.push_back(f.end());
+
+    std::vector<Obj_chunk> chunks(nchunks);
+    auto parse = [&](const size_t k) {
+        parse_chunk(bounds[k], bounds[k + 1], chunks[k]);
+    };
+    if (pool)
+        pool->run(nchunks, parse);
+    else
+        parse(0);
+
+    // merge the chunks in the file order
+    std::vector<std::array<size_t, 4>> off(nchunks + 1, {{0, 0, 0, 0}});
+    for (size_t k {0}; k < nchunks; ++k)
+        off[k + 1] = {{off[k][0] + chunks[k].verts.size(),
+            off[k][1] + chunks[k].texverts.size(),
+            off[k][2] + chunks[k].norms.size(),
+            off[k][3] + chunks[k].faces.size()}};
+    verts_.resize(off[nchunks][0]);
+    texverts_.resize(off[nchunks][1]);
+    norms_.resize(off[nchunks][2]);
+    faces_.resize(off[nchunks][3]);
+    auto merge = [&](const size_t k) {
+        const Obj_chunk &c = chunks[k];
+        std::copy(c.verts.begin(), c.verts.end(), verts_.begin() + off[k][0]);
+        std::copy(c.texverts.begin(), c.texverts.end(),
+                texverts_.begin() + off[k][1]);
+        std::copy(c.norms.begin(), c.norms.end(), norms_.begin() + off[k][2]);
+        std::copy(c.faces.begin(), c.faces.end(), faces_.begin() + off[k][3]);
+        for (const auto &r: c.rel)
+            faces_[off[k][3] + r.first][r.second / 3][r.second % 3] +=
+                off[k][r.second % 3];
+        // the vertex of every corner is required (the texture vertices and
+        // the normals are checked by their users)
+        for (size_t i {off[k][3]}; i < off[k + 1][3]; ++i)
+            for (int j {0}; j < 3; ++j)
+                if (faces_[i][j][0] < 0 ||
+                        size_t(faces_[i][j][0]) >= verts_.size())
+                    throw std::runtime_error("wrong vertex index in file " +
+                            fn);
+    };
+    if (pool)
+        pool->run(nchunks, merge);
+    else
+        merge(0);
+}
+
+// old stream based reader
+Model::Model(std::istream &ifs): verts_{}, norms_{}, texverts_{}, faces_{} {
     ifs.exceptions(ifs.exceptions() | std::ios_base::badbit);
 
     for (std::string s; ifs >> s;) {
@@ -63,13 +307,19 @@ const Vec3d Model::vertex(const int iface, const int ivert) const {
     return verts_[faces_[iface][ivert][0]];
 }
 
+// missing texture vertices and normals (index -1) are zero vectors
 const Vec3d Model::texvertex(const int iface, const int ivert) const {
     const int idx {faces_[iface][ivert][1]};
+    if (idx < 0)
+        return Vec3d{0, 0, 0};
     return Vec3d{texverts_[idx][0], texverts_[idx][1], texverts_[idx][2]};
 }
 
 const Vec3d Model::normal(const int iface, const int ivert) const {
-    return (norms_[faces_[iface][ivert][2]]).normalize();
+    const int idx {faces_[iface][ivert][2]};
+    if (idx < 0)
+        return Vec3d{0, 0, 0};
+    return (norms_[idx]).normalize();
 }
 
 const Vec3i Model::face(const int idx) const {
@@ -47,19 +47,38 @@ private:
 /*
  * ------------------ Model ------------------
  */
+class Thread_pool; // forward declaration
+
+/*
+ * Reading OBJ files: the file is memory mapped, split into newline aligned
+ * chunks which are parsed (optionally in parallel with a Thread_pool) by a
+ * hand-written number parser, and the chunks are merged in the file order.
+ * Supported face formats: v, v/vt, v//vn, v/vt/vn with positive or negative
+ * (relative) indices; quads and other polygons are split into triangles.
+ * Missing texture vertex or normal indices are stored as -1; a face with a
+ * vertex index out of the list (missing, not defined in the file or relative
+ * past its start) throws.
+ * Model(std::istream&) is the old stream based reader (v/vt/vn triangles)
+ */
 class Model {
 public:
     using Vec3i = Vec<3, int>;
     using Vec3d = Vec<3, double>;
     Model(const std::string&);
+    Model(const std::string&, Thread_pool&);
+    Model(std::istream&);
 
     ~Model() = default;
 
     const Vec3d vertex(const int i) const { return verts_[i]; }
     const Vec3d vertex(const int, const int) const;
+    const Vec3d texvertex(const int i) const { return texverts_[i]; }
     const Vec3d texvertex(const int, const int) const;
+    const Vec3d normal(const int i) const { return norms_[i]; }
     const Vec3d normal(const int, const int) const;
     const Vec3i face(const int) const;
+    // the (vertex / texvertex / normal) index triples of a face
+    const Facet& facet(const int i) const { return faces_[i]; }
 
     size_t num_vertices() const { return verts_.size(); }
     size_t num_faces() const { return faces_.size(); }
@@ -71,6 +90,8 @@ private:
     std::vector<Vec3d> norms_;
     std::vector<Vec3d> texverts_; // texture vertices
     std::vector<Facet> faces_;
+
+    void load(const std::string&, Thread_pool*);
 };
 
 /*
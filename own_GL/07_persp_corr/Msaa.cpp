@@ -0,0 +1,88 @@
+#include "Msaa.h"
+
+// sample positions (1/16 pixel, relative to the center) of the D3D standard
+// patterns: 1x, 2x, 4x (rotated grid) and 8x
+static const int patterns[4][8][2] {
+    {{0, 0}},
+    {{4, 4}, {-4, -4}},
+    {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}},
+    {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}}
+};
+
+Msaa_buffer::Msaa_buffer(const int w, const int h, const int n,
+        const int nbits, const int range, const PPM_Color &bg): w_{w}, h_{h},
+    n_{n <= 1 ? 1 : n <= 2 ? 2 : n <= 4 ? 4 : 8},
+    max_{(1 << std::max(8, std::min(24, nbits))) - 1},
+    scale_{double(max_) / range}, bgcolor_{bg.color()},
+    full_{(1u << n_) - 1}, used_{0}, z_(size_t(w) * h * n_, 0),
+    color_(size_t(w) * h, bgcolor_), slot_(size_t(w) * h, uniform),
+    samples_{}, free_{} {
+}
+
+Vec<2, int> Msaa_buffer::offset(const int s) const {
+    const int *o {patterns[__builtin_ctz(n_)][s]};
+    return {o[0], o[1]};
+}
+
+void Msaa_buffer::clear() {
+    std::fill(z_.begin(), z_.end(), 0);
+    std::fill(color_.begin(), color_.end(), bgcolor_);
+    std::fill(slot_.begin(), slot_.end(), uniform);
+    samples_.clear();
+    free_.clear();
+    used_ = 0;
+}
+
+// the slow path: a pixel on an edge
+void Msaa_buffer::write_samples(const size_t p, const uint mask,
+        const uint c) {
+    if (slot_[p] == uniform) {
+        // expand: every sample gets the color of the pixel
+        if (!free_.empty()) {
+            slot_[p] = free_.back();
+            free_.pop_back();
+        } else {
+            slot_[p] = uint32_t(used_++);
+            samples_.resize(used_ * n_);
+        }
+        std::fill_n(&samples_[size_t(slot_[p]) * n_], n_, color_[p]);
+    }
+    if (mask == full_) { // covered again: back to one color
+        free_.push_back(slot_[p]);
+        slot_[p] = uniform;
+        color_[p] = c;
+        return;
+    }
+    uint *s {&samples_[size_t(slot_[p]) * n_]};
+    for (uint k {mask}; k; k &= k - 1)
+        s[__builtin_ctz(k)] = c;
+}
+
+void Msaa_buffer::resolve(PPM_Image &img) const {
+    for (int y {0}; y < h_; ++y) {
+        uint *dst {img.row(h_ - 1 - y)};
+        for (int x {0}; x < w_; ++x) {
+            const size_t p {size_t(y) * w_ + x};
+            if (slot_[p] == uniform) {
+                dst[x] = color_[p];
+                continue;
+            }
+            const uint *s {&samples_[size_t(slot_[p]) * n_]};
+            uint r {0}, g {0}, b {0};
+            for (int i {0}; i < n_; ++i) {
+                r += s[i] >> 16 & 0xff;
+                g += s[i] >> 8 & 0xff;
+                b += s[i] & 0xff;
+            }
+            const uint half = n_ / 2;
+            dst[x] = (r + half) / n_ << 16 | (g + half) / n_ << 8 |
+                (b + half) / n_;
+        }
+    }
+}
+
+size_t Msaa_buffer::memory() const {
+    return z_.size() * sizeof(int) + color_.size() * sizeof(uint) +
+        slot_.size() * sizeof(uint32_t) + samples_.capacity() * sizeof(uint) +
+        free_.capacity() * sizeof(uint32_t);
+}
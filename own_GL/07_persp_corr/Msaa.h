@@ -0,0 +1,176 @@
+/*
+ * Multi-sample anti-aliasing:
+ *      every pixel has 2, 4 or 8 samples (the standard rotated patterns, in
+ *      1/16 of a pixel around the center; 1 is the center alone). Coverage
+ *      and depth are evaluated per sample, by the sub-pixel edge rasterizer
+ *      (28.4 fixed point, top-left fill rule: Precision.h), but the fragment
+ *      shader runs once per pixel and triangle: at the pixel center if the
+ *      triangle covers all the samples, at its first covered sample
+ *      otherwise (so the attributes are not extrapolated outside of it). Its
+ *      color goes to the samples which passed the depth test
+ *
+ * Class Msaa_buffer: per-sample depth, compressed color
+ *      depth: one value per sample (the quantization of Depth_buffer: 8 bits
+ *      by default, the values of the plain z-buffer)
+ *      color: one value per pixel while all its samples have the same color
+ *      (the fast path: every pixel inside a triangle, and the background).
+ *      A pixel on an edge gets a slot of per-sample colors (allocated on
+ *      demand from a shared array, recycled when a fragment covers the whole
+ *      pixel again), so the color memory grows with the edges, not with the
+ *      number of samples
+ *      resolve(): the box filter of the samples into a PPM_Image
+ *      The buffer is not shared between threads (the slots are allocated
+ *      from one array)
+ *
+ * Examples:
+ *      Msaa_buffer ms {w, h, 4}; // 4x MSAA, 8-bit depth
+ *      triangle_shader_msaa(pts, shader, tex, ms); // instead of
+ *          triangle_shader(pts, shader, img, tex, zbuf)
+ *      ms.resolve(img);
+ *      ms.expanded(); // pixels which store per-sample colors
+ */
+
+#ifndef MSAA_H
+#define MSAA_H
+
+#include "Shader.h"
+#include <vector>
+
+class Msaa_buffer {
+public:
+    // slot of a pixel whose samples have one color
+    static constexpr uint32_t uniform {~uint32_t{0}};
+
+    // image size, samples (1, 2, 4, 8), depth bits (8..24) and the depth
+    // range of the Viewport
+    Msaa_buffer(const int, const int, const int, const int = 8,
+            const int = 255, const PPM_Color& = PPM_Color{0});
+
+    int width() const { return w_; }
+    int height() const { return h_; }
+    int samples() const { return n_; }
+    // position of the sample relative to the pixel center (1/16 pixel)
+    Vec<2, int> offset(const int) const;
+
+    int quantize(const double d) const {
+        return std::max(0, std::min(max_, int(d * scale_ + 0.5)));
+    }
+    // the depths of the samples of pixel (x, y)
+    int* depth(const int x, const int y) {
+        return &z_[(size_t(y) * w_ + x) * n_];
+    }
+
+    // store the color in the samples of the mask
+    void write(const int x, const int y, const uint mask, const uint c) {
+        const size_t p {size_t(y) * w_ + x};
+        if (slot_[p] == uniform && (mask == full_ || color_[p] == c)) {
+            color_[p] = c;
+            return;
+        }
+        write_samples(p, mask, c);
+    }
+
+    void clear();
+    // average of the samples, the y axis flipped like triangle_shader does
+    void resolve(PPM_Image&) const;
+
+    // pixels with per-sample colors, and the bytes of the buffer
+    size_t expanded() const { return used_ - free_.size(); }
+    size_t memory() const;
+
+private:
+    int w_;
+    int h_;
+    int n_;
+    int max_;
+    double scale_;
+    uint bgcolor_;
+    uint full_;   // mask of all the samples
+    size_t used_; // slots allocated
+    std::vector<int> z_;
+    std::vector<uint> color_;
+    std::vector<uint32_t> slot_;
+    std::vector<uint> samples_;
+    std::vector<uint32_t> free_;
+
+    void write_samples(const size_t, const uint, const uint);
+};
+
+// draw the triangle into the MSAA buffer (the whole image)
+template <class Shader>
+typename std::enable_if<is_shader<Shader>::value>::type
+triangle_shader_msaa(const Mat<3, 4, double> &pts, Shader &shader,
+        const PPM_Image &tex, Msaa_buffer &ms) {
+    using Vec3d = Vec<3, double>;
+    constexpr int bits {Prec_fixed::sub_bits};
+    const int n {ms.samples()};
+    Mat<3, 2, double> pts2;
+    Vec<2, int> v[3];
+    for (int i = 0; i < 3; ++i) {
+        pts2[i] = pts[i] / pts[i][3];
+        v[i] = {snap(pts2[i][0], bits), snap(pts2[i][1], bits)};
+    }
+    // the pixel centers, and every sample: the triangle moved by minus the
+    // offset of the sample, sampled at the centers
+    const Edge_tri center {v[0], v[1], v[2], bits};
+    if (center.degenerate())
+        return;
+    static thread_local std::vector<Edge_tri> tris;
+    tris.clear();
+    for (int s {0}; s < n; ++s) {
+        const Vec<2, int> o {ms.offset(s)};
+        tris.emplace_back(v[0] - o, v[1] - o, v[2] - o, bits);
+    }
+    // a sample is at most half a pixel away from the center
+    const Raster_rect bb {bounding_box(pts2, ms.width(), ms.height())};
+    const Raster_rect r {std::max(bb.x0 - 1, 0), std::max(bb.y0 - 1, 0),
+        std::min(bb.x1 + 1, ms.width() - 1),
+        std::min(bb.y1 + 1, ms.height() - 1)};
+    if (r.empty())
+        return;
+
+    const Coverage_fn cover {coverage_kernel()};
+    const double area = center.area();
+    auto bar = [&](const Edge_tri &t, const int x, const int y) {
+        const int lam1 {t.lam1(x, y)}, lam2 {t.lam2(x, y)};
+        return Vec3d{1 - (lam1 + lam2) / area, lam2 / area, lam1 / area};
+    };
+    uint64_t m[8];
+    for (int by = r.y0 & ~7; by <= r.y1; by += 8)
+        for (int bx = r.x0 & ~7; bx <= r.x1; bx += 8) {
+            const uint64_t inside {rect_mask(bx, by, r)};
+            uint64_t any {0};
+            for (int s {0}; s < n; ++s)
+                any |= m[s] = cover(tris[s], bx, by) & inside;
+            for (; any; any &= any - 1) {
+                const int bit {__builtin_ctzll(any)};
+                const int x {bx + (bit & 7)}, y {by + (bit >> 3)};
+                uint mask {0};
+                for (int s {0}; s < n; ++s)
+                    mask |= uint(m[s] >> bit & 1) << s;
+                // depth test of the covered samples
+                int *z {ms.depth(x, y)}, dep[8];
+                uint pass {0};
+                for (uint k {mask}; k; k &= k - 1) {
+                    const int s {__builtin_ctz(k)};
+                    const Vec3d bc {bar(tris[s], x, y)};
+                    dep[s] = ms.quantize((pts.col(2) * bc) /
+                            (pts.col(3) * bc));
+                    if (z[s] < dep[s])
+                        pass |= 1u << s;
+                }
+                if (!pass)
+                    continue;
+                const Vec3d bc {mask == (1u << n) - 1 ? bar(center, x, y) :
+                    bar(tris[__builtin_ctz(mask)], x, y)};
+                PPM_Color C;
+                if (shader.fragment(tex, bc, C))
+                    continue;
+                for (uint k {pass}; k; k &= k - 1)
+                    z[__builtin_ctz(k)] = dep[__builtin_ctz(k)];
+                ms.write(x, y, pass, C.color());
+            }
+        }
+}
+
+#endif
@@ -1,7 +1,11 @@
 #include "PPM_Image.h"
 #include <iostream>
+#include "Mapped_file.h"
+#include "Profile.h"
 #include <stdexcept>
-#include <memory>
+#include <string>
+#include <algorithm>
+#include <cctype>
 
 /*
  * --------------------- PPM_Color implementation ---------------------
@@ -59,104 +63,170 @@ bool PPM_Color::is_valid_hex(const std::string &s) {
 /*
  * --------------------- PPM_Image implementation ---------------------
  */
-PPM_Image::PPM_Image(): bgcolor_{0}, vals_{} {
+PPM_Image::PPM_Image(): bgcolor_{0}, w_{0}, h_{0}, stride_{0}, vals_{} {
 }
 
 PPM_Image::PPM_Image(const int w, const int h, const PPM_Color& c):
-    bgcolor_{c.color()},
-    vals_{std::vector<std::vector<uint>>(w, std::vector<uint>(h, bgcolor_))} {
+    bgcolor_{c.color()}, w_{0}, h_{0}, stride_{0}, vals_{} {
         if (w <= 0 || h <= 0)
             std::cerr << "warning: negative dimensions, empty image created\n";
+        else
+            resize(w, h, bgcolor_);
     }
 
-PPM_Image::PPM_Image(const PPM_Image &o): bgcolor_{o.bgcolor_}, vals_{o.vals_} {
+PPM_Image::PPM_Image(const PPM_Image &o): bgcolor_{o.bgcolor_}, w_{o.w_},
+    h_{o.h_}, stride_{o.stride_}, vals_{o.vals_} {
 }
 
-// reading PPM_Image from a file
-PPM_Image::PPM_Image(const std::string &fn): bgcolor_{0}, vals_{} {
-    std::ifstream ifs {fn, std::ios_base::binary};
-    if (!ifs)
-        throw std::runtime_error("cannot open file " + fn);
-    ifs.exceptions(ifs.exceptions() | std::ios_base::badbit);
-    std::string header;
-    ifs >> header;
-    if (header != "P6")
+// reading PPM_Image from a file: the file is memory mapped and the raster is
+// decoded straight into the pixel buffer; P6 (rgb), P5 (gray) and P3 (ascii
+// rgb) formats with 8 or 16 bit samples are supported
+PPM_Image::PPM_Image(const std::string &fn): bgcolor_{0}, w_{0}, h_{0},
+    stride_{0}, vals_{} {
+    const Mapped_file f {fn};
+    const char *p {f.begin()}, *end {f.end()};
+    if (f.size() < 2 || p[0] != 'P' || (p[1] != '3' && p[1] != '5' &&
+                p[1] != '6'))
         throw std::runtime_error("cannot read input file");
-    skip_comment(ifs);
-    int w, h, temp;
-    ifs >> w >> h >> temp;
-    skip_comment(ifs);
-    const int num_values {w * h * 3};
-    vals_ = std::vector<std::vector<uint>>(w, std::vector<uint>(h));
-    char *v = new char[num_values];
-    //std::unique_ptr<char> v {new char[num_values]}; // maybe later...
-    ifs.read(v, num_values);
-    if (!ifs) delete [] v;
-    for (int j {0}; j < h; ++j)
+    const char fmt {p[1]};
+    p += 2;
+    const int w {header_value(p, end)}, h {header_value(p, end)};
+    const int maxval {header_value(p, end)};
+    if (w <= 0 || h <= 0 || maxval <= 0 || maxval > 0xFFFF)
+        throw std::runtime_error("wrong header of file " + fn);
+    resize(w, h, 0);
+    // scale a sample to the 0..255 range; a sample above the maximum value
+    // would spill into the next channel
+    auto scale = [maxval, &fn](const uint s) -> uint {
+        if (s > uint(maxval))
+            throw std::runtime_error("wrong value in file " + fn);
+        return maxval == 255 ? s : (s * 255 + (maxval >> 1)) / maxval;
+    };
+    if (fmt == '3') {
+        for (int j {0}; j < h; ++j) {
+            uint *r {row(j)};
+            for (int i {0}; i < w; ++i) {
+                const uint cr = scale(header_value(p, end));
+                const uint cg = scale(header_value(p, end));
+                r[i] = cr << 16 | cg << 8 | scale(header_value(p, end));
+            }
+        }
+        return;
+    }
+    ++p; // single whitespace character after the header
+    const int bps {maxval > 255 ? 2 : 1}; // bytes per sample
+    const int spp {fmt == '6' ? 3 : 1}; // samples per pixel
+    const size_t row_bytes {size_t(w) * bps * spp};
+    if (p > end || size_t(end - p) < row_bytes * h)
+        throw std::runtime_error("unexpected end of file " + fn);
+    auto src = reinterpret_cast<const uchar*>(p);
+    for (int j {0}; j < h; ++j, src += row_bytes) {
+        uint *r {row(j)};
+        const uchar *s {src};
+        if (bps == 1 && maxval == 255 && spp == 3) { // the common case
+            for (int i {0}; i < w; ++i, s += 3)
+                r[i] = uint(s[0]) << 16 | uint(s[1]) << 8 | s[2];
+            continue;
+        }
         for (int i {0}; i < w; ++i) {
-            const int idx {(j * h + i) * 3};
-            vals_[i][j] = static_cast<uchar>(v[idx]) << 16 |
-                static_cast<uchar>(v[idx + 1]) << 8 |
-                static_cast<uchar>(v[idx + 2]);
+            uint c[3];
+            for (int k {0}; k < spp; ++k, s += bps)
+                c[k] = scale(bps == 1 ? s[0] : uint(s[0]) << 8 | s[1]);
+            r[i] = spp == 3 ? c[0] << 16 | c[1] << 8 | c[2] :
+                c[0] << 16 | c[0] << 8 | c[0];
         }
-    delete [] v;
+    }
 }
 
 PPM_Image &PPM_Image::operator=(const PPM_Image &o) {
     if (this != &o) {
         bgcolor_ = o.bgcolor_;
+        w_ = o.w_;
+        h_ = o.h_;
+        stride_ = o.stride_;
         vals_ = o.vals_;
     }
     return *this;
 }
 
-std::vector<uint> &PPM_Image::operator[](const int i) {
-    return vals_[i];
-}
-
-const std::vector<uint> &PPM_Image::operator[](const int i) const {
-    return vals_[i];
+// helper function: rows are padded to a multiple of the cache line size
+void PPM_Image::resize(const int w, const int h, const uint c) {
+    constexpr int vals_per_line {cache_line / sizeof(uint)};
+    w_ = w;
+    h_ = h;
+    stride_ = (w + vals_per_line - 1) / vals_per_line * vals_per_line;
+    vals_.assign(size_t(stride_) * h, c);
 }
 
 const PPM_Color PPM_Image::color(const int x, const int y) const {
-    const uint c {vals_[x][y]};
+    const uint c {row(y)[x]};
     return PPM_Color {red(c), green(c), blue(c)};
 }
 
 void PPM_Image::set_bgcolor(const PPM_Color &c) {
     uint old_bgcolor_ {bgcolor_};
     bgcolor_ = c.color();
-    for (auto &x: vals_)
-        for (auto &y: x)
-            if (y == old_bgcolor_)
-                y = bgcolor_;
+    for (int y {0}; y < h_; ++y)
+        for (auto &x: row_span(y))
+            if (x == old_bgcolor_)
+                x = bgcolor_;
 }
 
 void PPM_Image::set_color(const int x, const int y, const PPM_Color &c) {
     if (x >= 0 && x < width() && y >= 0 && y < height())
-        vals_[x][y] = c.color();
+        row(y)[x] = c.color();
 }
 
-void PPM_Image::write_to(const std::string &fn) {
-    std::ofstream ofs {fn, std::ios_base::binary};
-    ofs.exceptions(ofs.exceptions() | std::ios_base::badbit);
-    ofs << "P6\n" << width() << ' ' << height() << "\n255\n"; // header
-    const int w {width()}, h {height()};
-    for (int y {0}; y < h; ++y)
-        for (int x {0}; x < w; ++x) {
-            const uint c = vals_[x][y];
-            ofs << red(c) << green(c) << blue(c);
+void PPM_Image::clear() {
+    std::fill(vals_.begin(), vals_.end(), bgcolor_);
+}
+
+std::string PPM_Image::header() const {
+    return "P6\n" + std::to_string(width()) + ' ' + std::to_string(height()) +
+        "\n255\n";
+}
+
+// 3 bytes per pixel, rows without the padding
+void PPM_Image::encode(std::vector<char> &buf) const {
+    PROF_SCOPE("encode");
+    buf.resize(size_t(width()) * height() * 3);
+    char *dst {buf.data()};
+    for (int y {0}; y < h_; ++y)
+        for (const uint c: row_span(y)) {
+            *dst++ = red(c);
+            *dst++ = green(c);
+            *dst++ = blue(c);
         }
+}
+
+// the pixels are converted into one byte buffer (reused between the calls)
+// which is written together with the header by a single system call
+void PPM_Image::write_to(const std::string &fn) {
+    PROF_SCOPE("write_to");
+    const std::string head {header()};
+    static thread_local std::vector<char> buf;
+    encode(buf);
+    write_file(fn, head.data(), head.size(), buf.data(), buf.size());
     std::cout << "The result is saved to file: " << fn << '\n';
 }
 
-// helper function: skip commment lines in the header of ppm image
-void PPM_Image::skip_comment(std::istream &is) {
-    char c; is >> c;
-    while (c == '#') { // skipping comment lines
-        is.ignore(256, '\n');
-        is >> c;
+// helper function: read a decimal value of the header skipping whitespaces and
+// commment lines; the values above 2^24 (a width, height or maximum value no
+// image has) are rejected before they overflow
+int PPM_Image::header_value(const char *&p, const char *end) {
+    constexpr int max_value {1 << 24};
+    auto space = [](const char c) { return isspace((unsigned char)c); };
+    auto digit = [](const char c) { return isdigit((unsigned char)c); };
+    for (; p < end && (space(*p) || *p == '#'); ++p)
+        if (*p == '#') // skipping comment lines
+            while (p < end && *p != '\n') ++p;
+    if (p == end || !digit(*p))
+        throw std::runtime_error("cannot read input file");
+    int val {0};
+    for (; p < end && digit(*p); ++p) {
+        if (val > (max_value - (*p - '0')) / 10)
+            throw std::runtime_error("wrong value in the header");
+        val = val * 10 + (*p - '0');
     }
-    is.unget();
+    return val;
 }
-
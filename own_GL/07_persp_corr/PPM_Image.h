@@ -23,17 +23,25 @@
  *          be convenient
  *      PPM_Image I4 {"some_ppm_file.ppm"}; // image from a .ppm image file
  *          (replacement of old read_ppm_image("file.ppm") function)
+ *          (P6, P5 and P3 files are memory mapped and decoded directly)
  *      I2.write_to("output.ppm"); // save image to a file
  *      I[24][79] = 0XFF00FF; // can assign unsigned int value
+ *      I.row(79)[24] = 0XFF00FF; // the same via the pointer to the row
+ *      for (auto &c: I.row_span(79)) c = 0; // span of the whole row
  *      bgcolor() and color(int x, int y) return background color and
  *      color value at (x, y) coordinates respectively
  *      set_bgcolor(PPM_Color &c) // change background color
  *      set_bgcolor(Color_name::green).
+ *      clear() // every pixel back to the background color (reusing the
+ *          image as a framebuffer)
+ *      encode(buf) // the P6 raster (header() is its header): write_to()
+ *          without the file, e.g. to write it on another thread
  */
 
 #ifndef _PPM_IMAGE_H_
 #define _PPM_IMAGE_H_
 
+#include "Memory.h"
 #include <fstream>
 #include <vector>
 
@@ -71,6 +79,26 @@ private:
     bool is_valid_hex(const std::string&);
 };
 
+/*
+ * Pixels are stored in one contiguous, 64-byte aligned, row-major buffer:
+ * pixel (x, y) lives at y * stride() + x and every row starts at a cache line.
+ * I[x][y] is kept for compatibility: I[x] returns a lightweight proxy of the
+ * column x, loops over the pixels should prefer row(y) / row_span(y)
+ */
+template <class T>
+class Column_ref {
+public:
+    Column_ref(T *p, const int stride): p_{p}, stride_{stride} { }
+    Column_ref(const Column_ref&) = default;
+    Column_ref& operator=(const Column_ref&) = default;
+
+    T& operator[](const int y) const { return p_[y * stride_]; }
+
+private:
+    T *p_;
+    int stride_;
+};
+
 class PPM_Image {
 public:
     PPM_Image();
@@ -82,23 +110,44 @@ public:
 
     ~PPM_Image() = default;
 
-    std::vector<uint> &operator[](const int);
-    const std::vector<uint> &operator[](const int) const;
-
-    int width() const { return vals_.size(); }
-    int height() const { return vals_[0].size(); }
+    Column_ref<uint> operator[](const int x) { return {&vals_[x], stride_}; }
+    Column_ref<const uint> operator[](const int x) const {
+        return {&vals_[x], stride_};
+    }
+
+    uint *row(const int y) { return &vals_[y * stride_]; }
+    const uint *row(const int y) const { return &vals_[y * stride_]; }
+    Span<uint> row_span(const int y) { return {row(y), size_t(w_)}; }
+    Span<const uint> row_span(const int y) const {
+        return {row(y), size_t(w_)};
+    }
+    // the whole buffer including the padding at the end of the rows
+    Span<uint> pixels() { return vals_; }
+    Span<const uint> pixels() const { return vals_; }
+
+    int width() const { return w_; }
+    int height() const { return h_; }
+    int stride() const { return stride_; }
     uint bgcolor() const { return bgcolor_; }
     const PPM_Color color(const int, const int) const;
 
     void set_bgcolor(const PPM_Color&);
     void set_color(const int, const int, const PPM_Color& = PPM_Color{255});
+    void clear();
+    std::string header() const;
+    void encode(std::vector<char>&) const;
     void write_to(const std::string&);
 
 private:
     uint bgcolor_;
-    std::vector<std::vector<uint>> vals_;
-    // helper function: skip commment lines in the header of ppm image
-    void skip_comment(std::istream&);
+    int w_;
+    int h_;
+    int stride_; // number of values per row: width padded to the cache line
+    aligned_vector<uint> vals_;
+    // helper function: read a value from the header of ppm image
+    static int header_value(const char*&, const char*);
+    // helper function: allocate the pixel buffer for the given size
+    void resize(const int, const int, const uint);
     // helper functions: extract channel values from uint values of the color
     uchar red(const uint c) const { return c >> 16 & 0xff; }
     uchar green(const uint c) const { return c >> 8 & 0xff; }
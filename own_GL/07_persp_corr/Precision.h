@@ -0,0 +1,57 @@
+/*
+ * Precision policies of the forward pipeline:
+ *      real: type of the vertex positions the shaders return, of the
+ *      barycentric coordinates, of the depth interpolation and of the
+ *      varyings (IShader_p<P>, Gouraud_shader_p<P>, Tex_shader_p<P>)
+ *      sub_bits: fraction bits of the vertex positions the rasterizer works
+ *      with. 0: whole pixels, the positions are truncated and the pixels are
+ *      sampled at their (integer) corners, which is what baryc() does; every
+ *      pixel on an edge belongs to the triangle. 4: 28.4 fixed point, the
+ *      positions are rounded to 1/16 of a pixel, the pixels are sampled at
+ *      their centers, and a pixel on an edge shared by two triangles belongs
+ *      to only one of them (top-left fill rule)
+ *
+ *      Prec_double: the reference (the pipeline as it was)
+ *      Prec_float: the same rasterization, with floats
+ *      Prec_fixed: sub-pixel rasterization, with floats
+ *
+ * Examples:
+ *      Tex_shader_p<Prec_fixed> shader; // Tex_shader is the Prec_double one
+ *      Mat<3, 4, float> pts;
+ *      for (int j {0}; j < 3; ++j)
+ *          pts[j] = shader.vertex(m, Viewport, Proj, ModelView, L_dir, i, j);
+ *      triangle_shader(pts, shader, img, tex, zbuf);
+ */
+
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <cmath>
+
+struct Prec_double {
+    using real = double;
+    static constexpr int sub_bits {0};
+    static constexpr const char *name {"double"};
+};
+
+struct Prec_float {
+    using real = float;
+    static constexpr int sub_bits {0};
+    static constexpr const char *name {"float"};
+};
+
+struct Prec_fixed {
+    using real = float;
+    static constexpr int sub_bits {4};
+    static constexpr const char *name {"28.4 fixed"};
+};
+
+// screen coordinate in fixed point with the given fraction bits (rounded to
+// nearest)
+template <class Real>
+inline int snap(const Real x, const int bits) {
+    return int(std::lrint(x * (1 << bits)));
+}
+
+#endif
+
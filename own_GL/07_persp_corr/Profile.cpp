@@ -0,0 +1,218 @@
+#include "Profile.h"
+
+#ifdef PROFILE
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr size_t ncounters {size_t(Prof_counter::count)};
+// events kept per thread (the later ones are only counted)
+constexpr size_t max_events {size_t{1} << 20};
+
+const char *counter_names[ncounters] {"tris_submitted", "tris_culled",
+    "tris_rasterized", "frags_tested", "frags_passed", "frags_shaded",
+    "tex_fetches"};
+
+struct Stage {
+    const char *name;
+    uint64_t calls;
+    int64_t total;
+};
+
+struct Event {
+    const char *name;
+    int64_t begin;
+    int64_t end;
+};
+
+// record of a thread: written by the thread only, read by the dumps (the
+// counters are atomic, so that they can be read at any time)
+struct Thread_rec {
+    int tid;
+    std::atomic<uint64_t> counters[ncounters];
+    std::vector<Stage> stages;
+    std::vector<Event> events;
+    uint64_t dropped;
+
+    explicit Thread_rec(const int t): tid{t}, counters{}, stages{}, events{},
+        dropped{0} { }
+};
+
+struct Registry {
+    std::mutex m {};
+    std::vector<std::unique_ptr<Thread_rec>> threads {};
+    std::chrono::steady_clock::time_point epoch {
+        std::chrono::steady_clock::now()};
+};
+
+Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+Thread_rec& self() {
+    thread_local Thread_rec *rec {nullptr};
+    if (!rec) {
+        Registry &r = registry();
+        std::lock_guard<std::mutex> lk {r.m};
+        r.threads.emplace_back(new Thread_rec{int(r.threads.size())});
+        rec = r.threads.back().get();
+    }
+    return *rec;
+}
+
+// the stages of all the threads summed by name
+std::vector<Stage> stages() {
+    std::vector<Stage> res;
+    for (const auto &t: registry().threads)
+        for (const Stage &s: t->stages) {
+            auto it = std::find_if(res.begin(), res.end(),
+                    [&](const Stage &o) { return !strcmp(o.name, s.name); });
+            if (it == res.end())
+                res.push_back(s);
+            else {
+                it->calls += s.calls;
+                it->total += s.total;
+            }
+        }
+    return res;
+}
+
+uint64_t counter(const size_t c) {
+    uint64_t n {0};
+    for (const auto &t: registry().threads)
+        n += t->counters[c].load(std::memory_order_relaxed);
+    return n;
+}
+
+std::ofstream open_dump(const std::string &fn) {
+    std::ofstream ofs {fn};
+    if (!ofs)
+        throw std::runtime_error("cannot open file " + fn);
+    return ofs;
+}
+
+} // namespace
+
+int64_t prof_now() {
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now() -
+            registry().epoch).count();
+}
+
+// only the thread itself writes its counters: a relaxed load and store
+// instead of a locked add
+void prof_count(const Prof_counter c, const uint64_t n) {
+    std::atomic<uint64_t> &a = self().counters[size_t(c)];
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void prof_record(const char *name, const int64_t begin, const int64_t end,
+        const bool event) {
+    Thread_rec &t = self();
+    // a thread has a handful of stages: pointer comparison of the literals
+    auto it = std::find_if(t.stages.begin(), t.stages.end(),
+            [&](const Stage &s) { return s.name == name; });
+    if (it == t.stages.end())
+        t.stages.push_back(Stage{name, 1, end - begin});
+    else {
+        ++it->calls;
+        it->total += end - begin;
+    }
+    if (!event)
+        return;
+    if (t.events.size() < max_events)
+        t.events.push_back(Event{name, begin, end});
+    else
+        ++t.dropped;
+}
+
+void prof_reset() {
+    Registry &r = registry();
+    std::lock_guard<std::mutex> lk {r.m};
+    for (const auto &t: r.threads) {
+        for (auto &c: t->counters)
+            c.store(0, std::memory_order_relaxed);
+        t->stages.clear();
+        t->events.clear();
+        t->dropped = 0;
+    }
+    r.epoch = std::chrono::steady_clock::now();
+}
+
+void prof_print() {
+    std::lock_guard<std::mutex> lk {registry().m};
+    for (const Stage &s: stages())
+        std::cout << "  " << s.name << ": " << s.calls << " calls, " <<
+            s.total * 1E-6 << " ms\n";
+    for (size_t c {0}; c < ncounters; ++c)
+        std::cout << "  " << counter_names[c] << ": " << counter(c) << '\n';
+}
+
+void prof_write_json(const std::string &fn) {
+    std::lock_guard<std::mutex> lk {registry().m};
+    std::ofstream ofs {open_dump(fn)};
+    ofs << "{\n  \"threads\": " << registry().threads.size() <<
+        ",\n  \"stages\": [";
+    const char *sep {"\n"};
+    for (const Stage &s: stages()) {
+        ofs << sep << "    {\"name\": \"" << s.name << "\", \"calls\": " <<
+            s.calls << ", \"total_ms\": " << s.total * 1E-6 <<
+            ", \"mean_us\": " << s.total * 1E-3 / s.calls << '}';
+        sep = ",\n";
+    }
+    ofs << "\n  ],\n  \"counters\": {";
+    sep = "\n";
+    for (size_t c {0}; c < ncounters; ++c) {
+        ofs << sep << "    \"" << counter_names[c] << "\": " << counter(c);
+        sep = ",\n";
+    }
+    ofs << "\n  }\n}\n";
+}
+
+void prof_write_csv(const std::string &fn) {
+    std::lock_guard<std::mutex> lk {registry().m};
+    std::ofstream ofs {open_dump(fn)};
+    ofs << "kind,name,calls,total_ms,value\n";
+    for (const Stage &s: stages())
+        ofs << "stage," << s.name << ',' << s.calls << ',' << s.total * 1E-6 <<
+            ",\n";
+    for (size_t c {0}; c < ncounters; ++c)
+        ofs << "counter," << counter_names[c] << ",,," << counter(c) << '\n';
+}
+
+// complete events ("ph": "X") in microseconds, a thread name per track
+void prof_write_trace(const std::string &fn) {
+    std::lock_guard<std::mutex> lk {registry().m};
+    std::ofstream ofs {open_dump(fn)};
+    ofs << std::fixed << std::setprecision(3);
+    ofs << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char *sep {"\n"};
+    for (const auto &t: registry().threads) {
+        ofs << sep << "{\"name\": \"thread_name\", \"ph\": \"M\", " <<
+            "\"pid\": 1, \"tid\": " << t->tid << ", \"args\": {\"name\": \"" <<
+            (t->tid ? "thread " + std::to_string(t->tid) : "main") << "\"}}";
+        sep = ",\n";
+        for (const Event &e: t->events)
+            ofs << sep << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", " <<
+                "\"pid\": 1, \"tid\": " << t->tid << ", \"ts\": " <<
+                e.begin * 1E-3 << ", \"dur\": " << (e.end - e.begin) * 1E-3 <<
+                '}';
+        if (t->dropped)
+            std::cerr << "warning: " << t->dropped << " events of thread " <<
+                t->tid << " dropped\n";
+    }
+    ofs << "\n]}\n";
+}
+
+#endif
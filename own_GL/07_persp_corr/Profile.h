@@ -0,0 +1,101 @@
+/*
+ * Instrumentation of the pipeline, compiled in only with -DPROFILE (make
+ * profile): otherwise the macros expand to nothing and the dump functions
+ * are empty, so the instrumented code is the code without it.
+ *
+ *      PROF_SCOPE("name"): times the enclosing block (stage) and records it
+ *      as an event of the frame timeline
+ *      PROF_TIMER("name"): times the block without the event (for the
+ *      blocks run too often to be drawn: one triangle)
+ *      PROF_COUNT(counter, n): adds n to one of the Prof_counter counters
+ *
+ *      Every thread accumulates into its own record (registered on the first
+ *      use and kept after the thread exits), the records are summed by the
+ *      dumps: stages (calls, total and mean time) and counters as JSON or
+ *      CSV, the events in the Chrome trace-event format (chrome://tracing,
+ *      Perfetto), one track per thread. The stage names have to be string
+ *      literals. Dumps and reset are meant for an idle pipeline (between
+ *      frames)
+ *
+ *      Counters: triangles submitted to the primitive assembly (or to
+ *      render_tiled without one) and culled there, triangles rasterized (one
+ *      per tile the triangle is drawn into), fragments depth tested, passed
+ *      (fragment shader called) and shaded (written), texture fetches
+ *
+ * Examples:
+ *      void stage() {
+ *          PROF_SCOPE("vertex");
+ *          ...
+ *          PROF_COUNT(frags_tested, n);
+ *      }
+ *      prof_reset();
+ *      render a frame
+ *      prof_write_json("profile.json");
+ *      prof_write_trace("trace.json");
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <string>
+
+enum class Prof_counter {
+    tris_submitted, tris_culled, tris_rasterized, frags_tested,
+    frags_passed, frags_shaded, tex_fetches, count
+};
+
+#ifdef PROFILE
+
+#include <chrono>
+
+// nanoseconds since the start of the profile (the last prof_reset())
+int64_t prof_now();
+void prof_count(const Prof_counter, const uint64_t);
+void prof_record(const char*, const int64_t, const int64_t, const bool);
+
+class Prof_scope {
+public:
+    Prof_scope(const char *name, const bool event): name_{name},
+        event_{event}, begin_{prof_now()} { }
+    Prof_scope(const Prof_scope&) = delete;
+    Prof_scope& operator=(const Prof_scope&) = delete;
+
+    ~Prof_scope() { prof_record(name_, begin_, prof_now(), event_); }
+
+private:
+    const char *name_;
+    bool event_;
+    int64_t begin_;
+};
+
+#define PROF_CAT_(a, b) a##b
+#define PROF_CAT(a, b) PROF_CAT_(a, b)
+#define PROF_SCOPE(name) \
+    const Prof_scope PROF_CAT(prof_scope_, __LINE__) {name, true}
+#define PROF_TIMER(name) \
+    const Prof_scope PROF_CAT(prof_scope_, __LINE__) {name, false}
+#define PROF_COUNT(counter, n) prof_count(Prof_counter::counter, n)
+
+void prof_reset();
+void prof_print();
+void prof_write_json(const std::string&);
+void prof_write_csv(const std::string&);
+void prof_write_trace(const std::string&);
+
+#else
+
+// the count is not evaluated (sizeof), only kept from the unused warnings
+#define PROF_SCOPE(name) do { } while (0)
+#define PROF_TIMER(name) do { } while (0)
+#define PROF_COUNT(counter, n) do { (void)sizeof(n); } while (0)
+
+inline void prof_reset() { }
+inline void prof_print() { }
+inline void prof_write_json(const std::string&) { }
+inline void prof_write_csv(const std::string&) { }
+inline void prof_write_trace(const std::string&) { }
+
+#endif
+
+#endif
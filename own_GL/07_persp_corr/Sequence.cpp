@@ -0,0 +1,183 @@
+#include "Sequence.h"
+#include "Mapped_file.h"
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+std::vector<Camera> orbit(const Vec<3, double> &center, const double radius,
+        const double height, const int n, const Vec<3, double> &up) {
+    std::vector<Camera> path;
+    for (int i {0}; i < n; ++i) {
+        const double a {2 * M_PI * i / n};
+        path.push_back(Camera{center + Vec<3, double>{radius * std::sin(a),
+                height, radius * std::cos(a)}, center, up});
+    }
+    return path;
+}
+
+// eye, center and up (9 numbers) per line, empty lines and # comments are
+// skipped
+std::vector<Camera> read_camera_path(const std::string &fn) {
+    std::ifstream ifs {fn};
+    if (!ifs)
+        throw std::runtime_error("cannot open file " + fn);
+    std::vector<Camera> path;
+    std::string line;
+    for (int i {1}; std::getline(ifs, line); ++i) {
+        const size_t b {line.find_first_not_of(" \t\r")};
+        if (b == std::string::npos || line[b] == '#')
+            continue;
+        std::istringstream iss {line};
+        Camera c {};
+        if (!(iss >> c.eye >> c.center >> c.up))
+            throw std::runtime_error("cannot read camera at line " +
+                    std::to_string(i) + " of " + fn);
+        path.push_back(c);
+    }
+    return path;
+}
+
+std::ostream& operator<<(std::ostream &os, const Sequence_stats &st) {
+    os << st.frames << " frames in " << st.seconds << " s: " << st.fps() <<
+        " fps\n";
+    const std::pair<const char*, const Stage_time*> stages[] {
+        {"wait", &st.wait}, {"render", &st.render}, {"encode", &st.encode},
+        {"write", &st.write}};
+    for (const auto &s: stages)
+        os << "  " << s.first << ": mean " << s.second->mean() * 1E3 <<
+            " ms, max " << s.second->max * 1E3 << " ms\n";
+    return os;
+}
+
+std::string frame_name(const std::string &prefix, const size_t i) {
+    char num[24];
+    snprintf(num, sizeof(num), "%04zu", i);
+    return prefix + num + ".ppm";
+}
+
+/*
+ * ------------------ Frame_pool ------------------
+ */
+Frame_pool::Frame_pool(const int w, const int h, const size_t n): frames_{},
+    free_{}, m_{}, cv_{} {
+    for (size_t i {0}; i < n; ++i) {
+        frames_.emplace_back(new Frame{w, h});
+        free_.push_back(frames_.back().get());
+    }
+}
+
+Frame_pool::Frame& Frame_pool::acquire() {
+    std::unique_lock<std::mutex> lk {m_};
+    cv_.wait(lk, [this] { return !free_.empty(); });
+    Frame *f {free_.back()};
+    free_.pop_back();
+    return *f;
+}
+
+void Frame_pool::release(Frame &f) {
+    {
+        std::lock_guard<std::mutex> lk {m_};
+        free_.push_back(&f);
+    }
+    cv_.notify_one();
+}
+
+/*
+ * ------------------ Frame_writer ------------------
+ */
+Frame_writer::Frame_writer(Frame_pool &pool, const std::string &prefix):
+    pool_(pool), prefix_{prefix}, jobs_{}, m_{}, work_cv_{}, done_cv_{},
+    busy_{false}, stop_{false}, error_{}, encode_{}, write_{},
+    thread_{&Frame_writer::work, this} {
+}
+
+Frame_writer::~Frame_writer() {
+    {
+        std::lock_guard<std::mutex> lk {m_};
+        stop_ = true;
+    }
+    work_cv_.notify_one();
+    thread_.join();
+}
+
+void Frame_writer::push(Frame_pool::Frame &f, const size_t i) {
+    {
+        std::lock_guard<std::mutex> lk {m_};
+        rethrow();
+        jobs_.push_back(Job{&f, i});
+    }
+    work_cv_.notify_one();
+}
+
+void Frame_writer::finish() {
+    std::unique_lock<std::mutex> lk {m_};
+    done_cv_.wait(lk, [this] { return jobs_.empty() && !busy_; });
+    rethrow();
+}
+
+// the first error of the thread (once): called with the lock held
+void Frame_writer::rethrow() {
+    if (error_) {
+        std::exception_ptr e {error_};
+        error_ = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+// the frames are taken in order; the framebuffer goes back to the pool as
+// soon as it is encoded. After an error the frames are only released
+void Frame_writer::work() {
+    using namespace std::chrono;
+    std::vector<char> buf;
+    bool failed {false};
+    for (;;) {
+        std::unique_lock<std::mutex> lk {m_};
+        work_cv_.wait(lk, [this] { return stop_ || !jobs_.empty(); });
+        if (jobs_.empty())
+            return;
+        const Job job {jobs_.front()};
+        jobs_.pop_front();
+        busy_ = true;
+        lk.unlock();
+
+        double te {0}, tw {0};
+        std::exception_ptr err {};
+        if (failed) {
+            pool_.release(*job.frame);
+        } else {
+            bool released {false};
+            try {
+                const auto t0 = steady_clock::now();
+                const std::string head {job.frame->img.header()};
+                job.frame->img.encode(buf);
+                pool_.release(*job.frame);
+                released = true;
+                const auto t1 = steady_clock::now();
+                PROF_SCOPE("write_file");
+                if (!prefix_.empty())
+                    write_file(frame_name(prefix_, job.index), head.data(),
+                            head.size(), buf.data(), buf.size());
+                te = duration<double>(t1 - t0).count();
+                tw = duration<double>(steady_clock::now() - t1).count();
+            } catch (...) {
+                if (!released)
+                    pool_.release(*job.frame);
+                failed = true;
+                err = std::current_exception();
+            }
+        }
+
+        lk.lock();
+        if (err)
+            error_ = err;
+        if (!failed) {
+            encode_.add(te);
+            write_.add(tw);
+        }
+        busy_ = false;
+        if (jobs_.empty())
+            done_cv_.notify_all();
+    }
+}
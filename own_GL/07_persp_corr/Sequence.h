@@ -0,0 +1,192 @@
+/*
+ * Rendering of frame sequences (turntables, camera paths):
+ *      Camera: Eye / Center / Up of a frame; a path is a vector of them,
+ *      built by orbit() (the eye circles around the center) or read from a
+ *      text file (read_camera_path(), 9 numbers per line, # comments)
+ *
+ *      Class Frame_pool: a fixed set of framebuffers (image and hierarchical
+ *      depth buffer), allocated once and reused: acquire() blocks until a
+ *      frame is free, release() gives it back
+ *
+ *      Class Frame_writer: background I/O thread. A pushed frame is encoded
+ *      (PPM_Image::encode), released to the pool right away and then written
+ *      to <prefix>NNNN.ppm, so that frame N is encoded and written while
+ *      frame N + 1 is rendered. An empty prefix encodes without writing. An
+ *      error of the thread is rethrown by push() or finish()
+ *
+ *      render_sequence(): the model and the texture are loaded by the caller
+ *      once, every frame is render_tiled() into a pooled framebuffer and
+ *      handed to the writer. Returns the frames per second and the latency
+ *      of every stage: waiting for a free framebuffer (the writer is behind),
+ *      rendering, encoding, writing
+ *
+ * Examples:
+ *      const Model m {"../obj/african_head.obj"};
+ *      const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+ *      Thread_pool pool {};
+ *      const Sequence_stats st {render_sequence(m, Tex_shader{}, tex,
+ *          orbit({0, 0, 0}, 3, 1, 360), L_dir, 800, 800, "turn_", pool)};
+ *      std::cout << st; // turn_0000.ppm .. turn_0359.ppm
+ */
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include "Tiles.h"
+#include "Depth_buffer.h"
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct Camera {
+    Vec<3, double> eye;
+    Vec<3, double> center;
+    Vec<3, double> up;
+};
+
+// n frames of the eye going around the center (about the y axis) at the
+// given radius and height, starting in front of it (+z)
+std::vector<Camera> orbit(const Vec<3, double>&, const double, const double,
+        const int, const Vec<3, double>& = Vec<3, double>{0, 1, 0});
+std::vector<Camera> read_camera_path(const std::string&);
+
+// latency of a stage over the frames
+struct Stage_time {
+    double total;
+    double max;
+    size_t n;
+
+    void add(const double t) {
+        total += t;
+        max = std::max(max, t);
+        ++n;
+    }
+    double mean() const { return n ? total / n : 0; }
+};
+
+struct Sequence_stats {
+    size_t frames;
+    double seconds; // the whole sequence, until the last frame is written
+    Stage_time wait;
+    Stage_time render;
+    Stage_time encode;
+    Stage_time write;
+
+    double fps() const { return seconds > 0 ? frames / seconds : 0; }
+};
+
+std::ostream& operator<<(std::ostream&, const Sequence_stats&);
+
+class Frame_pool {
+public:
+    struct Frame {
+        Frame(const int w, const int h): img{w, h}, zbuf{w, h} { }
+
+        PPM_Image img;
+        Depth_buffer zbuf;
+    };
+
+    // image size and number of framebuffers
+    Frame_pool(const int, const int, const size_t);
+    Frame_pool(const Frame_pool&) = delete;
+    Frame_pool& operator=(const Frame_pool&) = delete;
+
+    ~Frame_pool() = default;
+
+    size_t size() const { return frames_.size(); }
+
+    Frame& acquire();
+    void release(Frame&);
+
+private:
+    std::vector<std::unique_ptr<Frame>> frames_;
+    std::vector<Frame*> free_;
+    std::mutex m_;
+    std::condition_variable cv_;
+};
+
+class Frame_writer {
+public:
+    Frame_writer(Frame_pool&, const std::string&);
+    Frame_writer(const Frame_writer&) = delete;
+    Frame_writer& operator=(const Frame_writer&) = delete;
+
+    ~Frame_writer();
+
+    // queue the frame with its number in the sequence
+    void push(Frame_pool::Frame&, const size_t);
+    // wait until every queued frame is written
+    void finish();
+
+    const Stage_time& encode_time() const { return encode_; }
+    const Stage_time& write_time() const { return write_; }
+
+private:
+    struct Job {
+        Frame_pool::Frame *frame;
+        size_t index;
+    };
+
+    Frame_pool &pool_;
+    std::string prefix_;
+    std::deque<Job> jobs_;
+    std::mutex m_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    bool busy_;
+    bool stop_;
+    std::exception_ptr error_;
+    Stage_time encode_;
+    Stage_time write_;
+    std::thread thread_; // last: started once the rest is initialized
+
+    void work();
+    void rethrow();
+};
+
+// file name of the frame: prefix and the zero-padded number
+std::string frame_name(const std::string&, const size_t);
+
+template <class Shader, class Geom>
+Sequence_stats render_sequence(const Geom &m, const Shader &proto,
+        const PPM_Image &tex, const std::vector<Camera> &path,
+        const Vec<3, double> &L_dir, const int w, const int h,
+        const std::string &prefix, Thread_pool &pool,
+        const size_t nbuffers = 3) {
+    using namespace std::chrono;
+    const Mat<4, 4, double> Viewport {viewport(w >> 3, h >> 3, (w >> 2) * 3,
+            (h >> 2) * 3, 255)};
+    Sequence_stats st {path.size(), 0, {}, {}, {}, {}};
+    Frame_pool buffers {w, h, std::max(nbuffers, size_t{1})};
+    Frame_writer writer {buffers, prefix};
+    const auto t0 = steady_clock::now();
+    for (size_t i {0}; i < path.size(); ++i) {
+        PROF_SCOPE("frame");
+        const Camera &c = path[i];
+        auto t = steady_clock::now();
+        Frame_pool::Frame &f = buffers.acquire();
+        auto t1 = steady_clock::now();
+        st.wait.add(duration<double>(t1 - t).count());
+        f.img.clear();
+        f.zbuf.clear();
+        render_tiled(m, proto, Viewport,
+                projection(-1.0 / (c.eye - c.center).norm()),
+                lookat(c.eye, c.center, c.up), L_dir, f.img, tex, f.zbuf,
+                pool);
+        t = steady_clock::now();
+        st.render.add(duration<double>(t - t1).count());
+        writer.push(f, i);
+    }
+    writer.finish();
+    st.seconds = duration<double>(steady_clock::now() - t0).count();
+    st.encode = writer.encode_time();
+    st.write = writer.write_time();
+    return st;
+}
+
+#endif
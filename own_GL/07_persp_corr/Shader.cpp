@@ -33,39 +33,38 @@ Vec3d baryc(const Vec2i &p1, const Vec2i &p2, const Vec2i &p3, const Vec2i &p) {
     return {1 - (lam1 + lam2) / z, lam2 / z, lam1 / z};
 }
 
-// draw triangle using own shaders
-void triangle_shader(const Mat<3, 4, double> &pts, IShader &shader,
-        PPM_Image &I, const PPM_Image &tex, std::vector<int> &zbuf) {
-    Mat<3, 2, double> pts2;
-    for (int i = 0; i < 3; ++i)
-        pts2[i] = pts[i] / pts[i][3];
-    const int img_w = I.width() - 1, img_h = I.height() - 1;
+// bounding box of the triangle: the same pixels the rasterizer loops over
+// (a superset of the pixels whose centers the sub-pixel rasterizer samples)
+template <class Real>
+Raster_rect bounding_box(const Mat<3, 2, Real> &pts2, const int w,
+        const int h) {
+    const Real img_w = w - 1, img_h = h - 1;
     auto xmin = std::max(std::min({pts2[0][0], pts2[1][0], pts2[2][0],
-                double(img_w)}), 0.0);
+                img_w}), Real(0));
     auto xmax = std::min(std::max({pts2[0][0], pts2[1][0], pts2[2][0],
-                0.0}), double(img_w));
+                Real(0)}), img_w);
     auto ymin = std::max(std::min({pts2[0][1], pts2[1][1], pts2[2][1],
-                double(img_h)}), 0.0);
+                img_h}), Real(0));
     auto ymax = std::min(std::max({pts2[0][1], pts2[1][1], pts2[2][1],
-                0.0}), double(img_h));
+                Real(0)}), img_h);
+    // all the values are non-negative here: conversion to int is floor()
+    return {int(xmin), int(ymin), int(xmax), int(ymax)};
+}
 
-    for (int x = xmin; x <= xmax; ++x) {
-        for (int y = ymin; y <= ymax; ++y) {
-            const Vec3d bc = baryc(pts2[0], pts2[1], pts2[2], Vec2i{x, y});
-            if (bc.x() < 0 || bc.y() < 0 || bc.z() < 0)
-                continue;
-            const double z {pts.col(2) * bc}, w {pts.col(3) * bc};
-            const int frag_dep {std::max(0, std::min(255, int(z / w + 0.5)))};
-            const int idx {x + y * img_w};
-            if (zbuf[idx] < frag_dep) {
-                PPM_Color C;
-                if (!shader.fragment(tex, bc, C)) {
-                    zbuf[idx] = frag_dep;
-                    I[x][img_h - y] = C.color();
-                }
-            }
-        }
-    }
+template Raster_rect bounding_box(const Mat<3, 2, double>&, const int,
+        const int);
+template Raster_rect bounding_box(const Mat<3, 2, float>&, const int,
+        const int);
 
+// draw triangle using own shaders (virtual route)
+void triangle_shader(const Mat<3, 4, double> &pts, IShader &shader,
+        PPM_Image &I, const PPM_Image &tex, std::vector<int> &zbuf) {
+    triangle_shader<double, IShader>(pts, shader, I, tex, zbuf,
+            Raster_rect{0, 0, I.width() - 1, I.height() - 1});
 }
 
+void triangle_shader(const Mat<3, 4, double> &pts, IShader &shader,
+        PPM_Image &I, const PPM_Image &tex, std::vector<int> &zbuf,
+        const Raster_rect &clip) {
+    triangle_shader<double, IShader>(pts, shader, I, tex, zbuf, clip);
+}
@@ -4,42 +4,108 @@
 #include "Vec.h"
 #include "Mat.h"
 #include "Model.h"
+#include "Mesh.h"
+#include "Vertex_cache.h"
 #include "PPM_Image.h"
+#include "Edge_raster.h"
+#include "Depth_buffer.h"
+#include "Assembly.h"
+#include "Texture.h"
+#include "Precision.h"
+#include "Profile.h"
+#include <type_traits>
+#include <utility>
+#include <limits>
 
-// interface class
-class IShader {
+// interface class: the positions returned by the vertex shader and the
+// barycentric coordinates of the fragment shader are of the real type of the
+// precision policy P (Precision.h); the geometry and the transforms are
+// double
+template <class P>
+class IShader_p {
 public:
+    using precision = P;
+    using real = typename P::real;
     using Mat4d = Mat<4, 4, double>;
 
-    virtual ~IShader() { }
+    virtual ~IShader_p() { }
 
-    virtual Vec<4, double> vertex(const Model&, const Mat4d&, const Mat4d&,
+    virtual Vec<4, real> vertex(const Model&, const Mat4d&, const Mat4d&,
             const Mat4d&, const Vec<3, double>&, const int, const int) = 0;
-    virtual bool fragment(const PPM_Image&, const Vec<3, double>&,
+    // the same for the compiled mesh
+    virtual Vec<4, real> vertex(const Mesh&, const Mat4d&, const Mat4d&,
+            const Mat4d&, const Vec<3, double>&, const int, const int) = 0;
+    // batched vertex stage: the corner is taken from the transformed mesh
+    virtual Vec<4, real> vertex(const Vertex_cache&, const int,
+            const int) = 0;
+    virtual bool fragment(const PPM_Image&, const Vec<3, real>&,
             PPM_Color&) = 0;
 };
 
-// Gouraud shader lcass
-class Gouraud_shader: public IShader {
+using IShader = IShader_p<Prec_double>;
+
+// static shader interface of the templated triangle_shader: any class with
+//      bool fragment(const PPM_Image&, const Vec<3, Real>&, PPM_Color&)
+// (the shaders are final, so the compiler knows the exact fragment() and can
+// inline it into the raster loop)
+template <class S, class Real = double>
+class is_shader {
+    template <class T>
+    static auto check(T *s) -> typename std::is_convertible<decltype(
+            s->fragment(std::declval<const PPM_Image&>(),
+                std::declval<const Vec<3, Real>&>(),
+                std::declval<PPM_Color&>())), bool>::type;
+    template <class>
+    static std::false_type check(...);
+
 public:
+    static constexpr bool value {decltype(check<S>(nullptr))::value};
+};
+
+// precision policy of a shader: its precision type (the IShader_p ones), or
+// the double reference
+template <class S, class = void>
+struct shader_precision {
+    using type = Prec_double;
+};
+
+template <class S>
+struct shader_precision<S, std::void_t<typename S::precision>> {
+    using type = typename S::precision;
+};
+
+// Gouraud shader lcass (Gouraud_shader: the double one)
+template <class P>
+class Gouraud_shader_p final: public IShader_p<P> {
+public:
+    using real = typename P::real;
+    using Mat4d = Mat<4, 4, double>;
     using Vec3d = Vec<3, double>;
     using Vec4d = Vec<4, double>;
+    using Vec3 = Vec<3, real>;
+    using Vec4 = Vec<4, real>;
 
-    Vec4d vertex(const Model &m, const Mat4d &Viewport, const Mat4d &Proj,
+    Vec4 vertex(const Model &m, const Mat4d &Viewport, const Mat4d &Proj,
             const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
             const int ivert) {
-        // get vertex from the model file
-        Vec4d gl_vert = resize<4>(m.vertex(iface, ivert));
-        // transform the vertex to screen coordinates
-        gl_vert = Viewport * Proj * ModelView * gl_vert;
-        // get diffuse lighting intensity
-        var_intensity[ivert] = std::max(0.0, m.normal(iface, ivert) * L_dir);
-        return gl_vert;
+        return vertex_(m, Viewport, Proj, ModelView, L_dir, iface, ivert);
     }
 
-    bool fragment(const PPM_Image&, const Vec3d &bar, PPM_Color &C) {
+    Vec4 vertex(const Mesh &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        return vertex_(m, Viewport, Proj, ModelView, L_dir, iface, ivert);
+    }
+
+    Vec4 vertex(const Vertex_cache &vc, const int iface, const int ivert) {
+        const uint32_t i {vc.mesh().index(iface, ivert)};
+        var_intensity[ivert] = vc.intensity(i);
+        return vc.position(i);
+    }
+
+    bool fragment(const PPM_Image&, const Vec3 &bar, PPM_Color &C) {
         // interpolate intensity for the current pixel
-        double intensity = var_intensity * bar;
+        real intensity = var_intensity * bar;
 
         // playing with limited number of intensity values
         //if (intensity > 0.85)
@@ -61,15 +127,66 @@ public:
     }
 
 private:
-    Vec3d var_intensity {};
+    template <class Geom>
+    Vec4 vertex_(const Geom &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        // get vertex from the model file
+        Vec4d gl_vert = resize<4>(m.vertex(iface, ivert));
+        // transform the vertex to screen coordinates
+        gl_vert = Viewport * Proj * ModelView * gl_vert;
+        // get diffuse lighting intensity
+        var_intensity[ivert] = std::max(0.0, m.normal(iface, ivert) * L_dir);
+        return gl_vert;
+    }
+
+    Vec3 var_intensity {};
 };
 
-// texture shader
-class Tex_shader: public IShader {
+using Gouraud_shader = Gouraud_shader_p<Prec_double>;
+
+// texture shader (Tex_shader: the double one)
+template <class P>
+class Tex_shader_p final: public IShader_p<P> {
 public:
+    using real = typename P::real;
+    using Mat4d = Mat<4, 4, double>;
     using Vec3d = Vec<3, double>;
     using Vec4d = Vec<4, double>;
-    Vec4d vertex(const Model &m, const Mat4d &Viewport, const Mat4d &Proj,
+    using Vec3 = Vec<3, real>;
+    using Vec4 = Vec<4, real>;
+    Vec4 vertex(const Model &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        return vertex_(m, Viewport, Proj, ModelView, L_dir, iface, ivert);
+    }
+
+    Vec4 vertex(const Mesh &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        return vertex_(m, Viewport, Proj, ModelView, L_dir, iface, ivert);
+    }
+
+    Vec4 vertex(const Vertex_cache &vc, const int iface, const int ivert) {
+        const uint32_t i {vc.mesh().index(iface, ivert)};
+        var_uv.fill_col(ivert, Vec<2, real>{vc.mesh().u()[i],
+                vc.mesh().v()[i]});
+        var_intensity[ivert] = vc.intensity(i);
+        return vc.position(i);
+    }
+
+    bool fragment(const PPM_Image &tex, const Vec3 &bar, PPM_Color &C) {
+        PROF_COUNT(tex_fetches, 1);
+        real intensity = var_intensity * bar;
+        auto uv = var_uv * bar;
+        C = tex.color(uv.x() * tex.width(), tex.height() * (1 - uv.y())) *
+            intensity;
+        return false;
+    }
+
+private:
+    template <class Geom>
+    Vec4 vertex_(const Geom &m, const Mat4d &Viewport, const Mat4d &Proj,
             const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
             const int ivert) {
         var_uv.fill_col(ivert, resize<2>(m.texvertex(iface, ivert)));
@@ -79,23 +196,405 @@ public:
         return gl_vert;
     }
 
-    bool fragment(const PPM_Image &tex, const Vec3d &bar, PPM_Color &C) {
-        double intensity = var_intensity * bar;
-        auto uv = var_uv * bar;
-        C = tex.color(uv.x() * tex.width(), tex.height() * (1 - uv.y())) *
-            intensity;
+    Vec3 var_intensity {};
+    // triangle uv coordinates: written by the vertex shader, read by the
+    // fragment shader
+    Mat<2, 3, real> var_uv {};
+};
+
+using Tex_shader = Tex_shader_p<Prec_double>;
+
+// texture shader sampling a mipmapped Texture (the PPM_Image passed to
+// fragment() is not used). The level of detail comes from the uv
+// differences between the pixels of a 2x2 quad; the varyings are
+// interpolated linearly in screen space, so these are the same for every
+// quad of the triangle and are computed once, by the vertex shader of the
+// last corner (the corners are set in order). Without mipmaps (or for a
+// triangle crossing the eye plane) level 0 is sampled
+class Mip_shader final: public IShader {
+public:
+    using Vec3d = Vec<3, double>;
+    using Vec4d = Vec<4, double>;
+
+    Mip_shader(const Texture &tex, const Tex_filter f = Tex_filter::trilinear,
+            const bool mipmaps = true): tex_{&tex}, filter_{f},
+        mipmaps_{mipmaps} {
+    }
+    Mip_shader(const Mip_shader&) = default;
+    Mip_shader& operator=(const Mip_shader&) = default;
+
+    Vec4d vertex(const Model &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        return vertex_(m, Viewport, Proj, ModelView, L_dir, iface, ivert);
+    }
+
+    Vec4d vertex(const Mesh &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        return vertex_(m, Viewport, Proj, ModelView, L_dir, iface, ivert);
+    }
+
+    Vec4d vertex(const Vertex_cache &vc, const int iface, const int ivert) {
+        const uint32_t i {vc.mesh().index(iface, ivert)};
+        var_uv.fill_col(ivert, Vec<2, double>{vc.mesh().u()[i],
+                vc.mesh().v()[i]});
+        var_intensity[ivert] = vc.intensity(i);
+        return set_position(ivert, vc.position(i));
+    }
+
+    bool fragment(const PPM_Image&, const Vec3d &bar, PPM_Color &C) {
+        PROF_COUNT(tex_fetches, 1);
+        const double intensity = var_intensity * bar;
+        const auto uv = var_uv * bar;
+        C = tex_->sample(uv.x(), uv.y(), lod_, filter_) * intensity;
         return false;
     }
 
+    double lod() const { return lod_; }
+
 private:
+    template <class Geom>
+    Vec4d vertex_(const Geom &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        var_uv.fill_col(ivert, resize<2>(m.texvertex(iface, ivert)));
+        var_intensity[ivert] = std::max(0.0, m.normal(iface, ivert) * L_dir);
+        Vec4d gl_vert = resize<4>(m.vertex(iface, ivert));
+        gl_vert = Viewport * Proj * ModelView * gl_vert;
+        return set_position(ivert, gl_vert);
+    }
+
+    // keep the pixel of the corner (truncated, as the rasterizer does); the
+    // last one completes the triangle
+    const Vec4d& set_position(const int ivert, const Vec4d &p) {
+        var_w[ivert] = p[3];
+        if (p[3] > 0)
+            var_xy[ivert] = Vec<2, int>{Vec<2, double>{p[0] / p[3],
+                p[1] / p[3]}};
+        if (ivert == 2)
+            lod_ = mipmaps_ ? triangle_lod() : 0;
+        return p;
+    }
+
+    double triangle_lod() const {
+        if (var_w[0] <= 0 || var_w[1] <= 0 || var_w[2] <= 0)
+            return 0;
+        const double e1x = var_xy[1].x() - var_xy[0].x(),
+              e1y = var_xy[1].y() - var_xy[0].y(),
+              e2x = var_xy[2].x() - var_xy[0].x(),
+              e2y = var_xy[2].y() - var_xy[0].y();
+        const double area {e1x * e2y - e1y * e2x};
+        if (area == 0)
+            return 0;
+        // d(bc)/dx and d(bc)/dy applied to the uv of the corners
+        const double du1 {var_uv[0][1] - var_uv[0][0]},
+              du2 {var_uv[0][2] - var_uv[0][0]},
+              dv1 {var_uv[1][1] - var_uv[1][0]},
+              dv2 {var_uv[1][2] - var_uv[1][0]};
+        return tex_->lod((du1 * e2y - du2 * e1y) / area,
+                (dv1 * e2y - dv2 * e1y) / area,
+                (du2 * e1x - du1 * e2x) / area,
+                (dv2 * e1x - dv1 * e2x) / area);
+    }
+
+    const Texture *tex_;
+    Tex_filter filter_;
+    bool mipmaps_;
+    double lod_ {0};
     Vec3d var_intensity {};
-    // triangle uv coordinates: written by the vertex shader, read by the
-    // fragment shader
     Mat<2, 3, double> var_uv {};
+    Vec3d var_w {};
+    Vec<2, int> var_xy[3] {};
 };
 
+// bounding box of the triangle (screen coordinates) clamped to the image
+// (double and float)
+template <class Real>
+Raster_rect bounding_box(const Mat<3, 2, Real>&, const int, const int);
+// barycentric coordinates of the pixel ({-1, 1, 1} for degenerate triangles)
+Vec<3, double> baryc(const Vec<2, int>&, const Vec<2, int>&,
+        const Vec<2, int>&, const Vec<2, int>&);
+
+// virtual route: IShader (or any shader behind an IShader reference) calls
+// fragment() through the vtable
 void triangle_shader(const Mat<3, 4, double>&, IShader&, PPM_Image&,
         const PPM_Image&, std::vector<int>&);
+// draw only the part of the triangle which lies inside the given rectangle
+void triangle_shader(const Mat<3, 4, double>&, IShader&, PPM_Image&,
+        const PPM_Image&, std::vector<int>&, const Raster_rect&);
+
+// the depth buffer used by the raster loop: the plain z-buffer or the
+// hierarchical one
+inline Zbuf_ref depth_ref(std::vector<int> &zbuf, const int w) {
+    return {zbuf, w};
+}
+inline Depth_buffer& depth_ref(Depth_buffer &zbuf, const int) { return zbuf; }
+
+// hierarchical z-buffer culling of a triangle drawn into the rectangle r
+// (raster_triangle, depth_triangle, G_buffer): zmax bounds the depths of the
+// fragments from above, since z / w of a point of the triangle is a convex
+// combination of the z / w of the vertices (if all w > 0); one level more
+// covers the rounding of the interpolation
+//      occluded(): the rectangle hides the whole triangle (counted as culled)
+//      skip(): the block test of for_each_covered_culled, rejected() counts
+//      the blocks skipped
+template <class Depth>
+class Tri_cull {
+public:
+    template <class Real>
+    Tri_cull(const Mat<3, 4, Real> &pts, Depth &zbuf, const Raster_rect &r):
+        zbuf_(zbuf), zmax_{std::numeric_limits<int>::max()}, rejected_{0},
+        occluded_{false} {
+        if (Depth::hierarchical && pts[0][3] > 0 && pts[1][3] > 0 &&
+                pts[2][3] > 0) {
+            zmax_ = zbuf.quantize(std::max({pts[0][2] / pts[0][3],
+                        pts[1][2] / pts[1][3], pts[2][2] / pts[2][3]})) + 1;
+            occluded_ = zbuf.occluded(r, zmax_);
+            if (occluded_)
+                zbuf.count(0, 0, 1, 0);
+        }
+    }
+    Tri_cull(const Tri_cull&) = delete;
+    Tri_cull& operator=(const Tri_cull&) = delete;
+
+    ~Tri_cull() = default;
+
+    bool occluded() const { return occluded_; }
+    uint64_t rejected() const { return rejected_; }
+
+    auto skip() {
+        return [this](const int bx, const int by) {
+            if (!zbuf_.block_occluded(bx, by, zmax_))
+                return false;
+            ++rejected_;
+            return true;
+        };
+    }
+
+private:
+    Depth &zbuf_;
+    int zmax_;
+    uint64_t rejected_;
+    bool occluded_;
+};
+
+// z / w of the pixel with the edge values lam1, lam2 of a triangle of the
+// given area: the sums in the order of the Vec dot products (pts.col(2) * bc)
+// of raster_triangle, so the depth-only passes store the depths the shading
+// pass computes
+class Edge_depth {
+public:
+    Edge_depth(const Mat<3, 4, double> &pts, const double area):
+        z0_{pts[0][2]}, z1_{pts[1][2]}, z2_{pts[2][2]}, w0_{pts[0][3]},
+        w1_{pts[1][3]}, w2_{pts[2][3]}, area_{area} {
+    }
+
+    double operator()(const int lam1, const int lam2) const {
+        const double b0 {1 - (lam1 + lam2) / area_}, b1 {lam2 / area_},
+              b2 {lam1 / area_};
+        const double pz {0.0 + z2_ * b2 + z1_ * b1 + z0_ * b0};
+        const double pw {0.0 + w2_ * b2 + w1_ * b1 + w0_ * b0};
+        return pz / pw;
+    }
+
+private:
+    double z0_, z1_, z2_;
+    double w0_, w1_, w2_;
+    double area_;
+};
+
+// raster loop of triangle_shader with the precision policy P
+template <class P, class Shader, class Depth>
+void raster_triangle(const Mat<3, 4, typename P::real> &pts, Shader &shader,
+        PPM_Image &I, const PPM_Image &tex, Depth &zbuf,
+        const Raster_rect &clip) {
+    PROF_TIMER("raster");
+    using Real = typename P::real;
+    using Vec3 = Vec<3, Real>;
+    Mat<3, 2, Real> pts2;
+    for (int i = 0; i < 3; ++i)
+        pts2[i] = pts[i] / pts[i][3];
+    const int img_w = I.width(), img_h = I.height() - 1;
+    const Raster_rect bb {bounding_box(pts2, img_w, I.height())};
+    const int xmin {std::max(bb.x0, clip.x0)}, xmax {std::min(bb.x1, clip.x1)};
+    const int ymin {std::max(bb.y0, clip.y0)}, ymax {std::min(bb.y1, clip.y1)};
+    const Raster_rect r {xmin, ymin, xmax, ymax};
+
+    Tri_cull<Depth> cull {pts, zbuf, r};
+    if (cull.occluded())
+        return;
+
+    // depth test and fragment shader of the pixel
+    uint64_t tested {0}, passed {0}, shaded {0};
+    int *z = zbuf.data();
+    auto shade = [&](const int x, const int y, const Vec3 &bc) {
+        const Real pz {pts.col(2) * bc}, pw {pts.col(3) * bc};
+        const int frag_dep {zbuf.quantize(pz / pw)};
+        const int idx {x + y * img_w};
+        ++tested;
+        if (z[idx] < frag_dep) {
+            ++passed;
+            PPM_Color C;
+            if (!shader.fragment(tex, bc, C)) {
+                zbuf.write(idx, frag_dep);
+                I.row(img_h - y)[x] = C.color();
+                ++shaded;
+            }
+        }
+    };
+
+    if (P::sub_bits) {
+        // sub-pixel vertices, pixel centers and the top-left fill rule (the
+        // baryc() path samples whole pixels only)
+        auto fixed = [](const Vec<2, Real> &v) {
+            return Vec<2, int>{snap(v.x(), P::sub_bits),
+                snap(v.y(), P::sub_bits)};
+        };
+        const Edge_tri tri {fixed(pts2[0]), fixed(pts2[1]), fixed(pts2[2]),
+            P::sub_bits};
+        const Real area = tri.area();
+        for_each_covered_culled(tri, r,
+                [&](const int x, const int y, const int lam1, const int lam2) {
+            shade(x, y, {1 - (lam1 + lam2) / area, lam2 / area, lam1 / area});
+        }, cull.skip());
+    } else if (raster_path() != Raster_path::baryc) {
+        // incremental edge functions: the same pixels and the same
+        // barycentric coordinates as baryc() gives
+        const Edge_tri tri {pts2[0], pts2[1], pts2[2]};
+        const Real area = tri.area();
+        for_each_covered_culled(tri, r,
+                [&](const int x, const int y, const int lam1, const int lam2) {
+            shade(x, y, {1 - (lam1 + lam2) / area, lam2 / area, lam1 / area});
+        }, cull.skip());
+    } else {
+        for (int y = ymin; y <= ymax; ++y)
+            for (int x = xmin; x <= xmax; ++x) {
+                const Vec3 bc = baryc(pts2[0], pts2[1], pts2[2],
+                        Vec<2, int>{x, y});
+                if (bc.x() < 0 || bc.y() < 0 || bc.z() < 0)
+                    continue;
+                shade(x, y, bc);
+            }
+    }
+    zbuf.count(tested, shaded, 0, cull.rejected());
+    PROF_COUNT(tris_rasterized, 1);
+    PROF_COUNT(frags_tested, tested);
+    PROF_COUNT(frags_passed, passed);
+    PROF_COUNT(frags_shaded, shaded);
+}
+
+// depth-only raster loop (shadow maps, z-prepass): the depth test and write
+// of raster_triangle without varyings, fragment shader and color, for the
+// image of size w x h
+//      exact: the pixels and the depth values are those of the double edge
+//      path (the sums in the order of the Vec dot products), so a shading
+//      pass with the same positions computes the same depths (z-prepass)
+//      otherwise, for the corners of the same w (orthographic views: shadow
+//      maps), z / w is linear in the screen and is evaluated from the edge
+//      values without divisions; it may round to the neighbouring level
+// The stored depth is lowered by bias levels (not below 0): see z_prepass()
+template <class Depth>
+void depth_triangle(const Mat<3, 4, double> &pts, Depth &zbuf, const int w,
+        const int h, const Raster_rect &clip, const int bias = 0,
+        const bool exact = true) {
+    PROF_TIMER("depth");
+    Mat<3, 2, double> pts2;
+    for (int i = 0; i < 3; ++i)
+        pts2[i] = pts[i] / pts[i][3];
+    const Raster_rect bb {bounding_box(pts2, w, h)};
+    const Raster_rect r {std::max(bb.x0, clip.x0), std::max(bb.y0, clip.y0),
+        std::min(bb.x1, clip.x1), std::min(bb.y1, clip.y1)};
+
+    Tri_cull<Depth> cull {pts, zbuf, r};
+    if (cull.occluded())
+        return;
+
+    uint64_t tested {0}, written {0};
+    int *z {zbuf.data()};
+    const Edge_tri tri {pts2[0], pts2[1], pts2[2]};
+    const double area = tri.area();
+    const double z0 {pts[0][2]}, z1 {pts[1][2]}, z2 {pts[2][2]};
+    const double w0 {pts[0][3]}, w1 {pts[1][3]}, w2 {pts[2][3]};
+    auto test = [&](const int x, const int y, const double d) {
+        const int frag_dep {std::max(zbuf.quantize(d) - bias, 0)};
+        const int idx {x + y * w};
+        ++tested;
+        if (z[idx] < frag_dep) {
+            zbuf.write(idx, frag_dep);
+            ++written;
+        }
+    };
+    if (exact || w0 != w1 || w0 != w2) {
+        const Edge_depth depth {pts, area};
+        for_each_covered_culled(tri, r,
+                [&](const int x, const int y, const int lam1, const int lam2) {
+            test(x, y, depth(lam1, lam2));
+        }, cull.skip());
+    } else if (!tri.degenerate()) {
+        const double d0 {z0 / w0}, d1 {(z1 - z0) / w0 / area},
+              d2 {(z2 - z0) / w0 / area};
+        for_each_covered_culled(tri, r,
+                [&](const int x, const int y, const int lam1, const int lam2) {
+            test(x, y, d0 + lam2 * d1 + lam1 * d2);
+        }, cull.skip());
+    }
+    zbuf.count(tested, written, 0, cull.rejected());
+    PROF_COUNT(frags_tested, tested);
+}
+
+// templated route: chosen by overload resolution for a concrete shader type,
+// the fragment shader is inlined into the raster loop. Only the pixels inside
+// the clip rectangle are read and written, so the triangles can be drawn into
+// disjoint rectangles (tiles) concurrently. The depth buffer is either the
+// plain std::vector<int> or a Depth_buffer. The positions are of the real
+// type of the shader's precision policy (double for the shaders without one)
+template <class Real, class Shader, class Zbuf>
+typename std::enable_if<is_shader<Shader, Real>::value>::type
+triangle_shader(const Mat<3, 4, Real> &pts, Shader &shader, PPM_Image &I,
+        const PPM_Image &tex, Zbuf &zbuf, const Raster_rect &clip) {
+    using P = typename shader_precision<Shader>::type;
+    static_assert(std::is_same<Real, typename P::real>::value,
+            "the positions have to be of the shader's real type");
+    auto &&depth = depth_ref(zbuf, I.width());
+    raster_triangle<P>(pts, shader, I, tex, depth, clip);
+}
+
+template <class Real, class Shader, class Zbuf>
+typename std::enable_if<is_shader<Shader, Real>::value>::type
+triangle_shader(const Mat<3, 4, Real> &pts, Shader &shader, PPM_Image &I,
+        const PPM_Image &tex, Zbuf &zbuf) {
+    triangle_shader(pts, shader, I, tex, zbuf,
+            Raster_rect{0, 0, I.width() - 1, I.height() - 1});
+}
+
+// draw an assembled triangle: the source one through the shader itself, a
+// clipped part through the Clipped_shader mapping
+template <class Shader, class Zbuf>
+void draw_clip_tri(const Clip_tri &t, const bool clipped, Shader &shader,
+        PPM_Image &I, const PPM_Image &tex, Zbuf &zbuf,
+        const Raster_rect &clip) {
+    if (!clipped) {
+        triangle_shader(t.pts, shader, I, tex, zbuf, clip);
+        return;
+    }
+    Clipped_shader<Shader> cs {shader, t.bar};
+    triangle_shader(t.pts, cs, I, tex, zbuf, clip);
+}
+
+// primitive assembly (culling and clipping) followed by the rasterization
+template <class Shader, class Zbuf>
+void draw_triangle(const Mat<3, 4, double> &pts, Shader &shader, PPM_Image &I,
+        const PPM_Image &tex, Zbuf &zbuf, Primitive_assembly &pa) {
+    Clip_tri tris[Primitive_assembly::max_tris];
+    bool clipped;
+    const int n {pa.assemble(pts, tris, clipped)};
+    PROF_COUNT(tris_submitted, 1);
+    PROF_COUNT(tris_culled, n == 0);
+    for (int i {0}; i < n; ++i)
+        draw_clip_tri(tris[i], clipped, shader, I, tex, zbuf,
+                Raster_rect{0, 0, I.width() - 1, I.height() - 1});
+}
 
 #endif
 
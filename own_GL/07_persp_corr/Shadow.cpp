@@ -0,0 +1,43 @@
+#include "Shadow.h"
+#include <cmath>
+
+Shadow_map::Shadow_map(const int size, const int pcf, const double bias,
+        const int bits): size_{std::max(size, 8)}, pcf_{std::max(pcf, 0)},
+    bias_{bias}, depth_{size_, size_, bits}, Viewport_{eye<4>()},
+    ModelView_{eye<4>()}, M_{eye<4>()} {
+}
+
+void Shadow_map::look(const Vec3d &L_dir, const Vec3d &center,
+        const double radius) {
+    // any up vector not parallel to the light
+    const Vec3d up {std::abs(L_dir.normalize().y()) < 0.99 ? Vec3d{0, 1, 0} :
+        Vec3d{1, 0, 0}};
+    // the sphere moved to the origin and scaled to the unit one, which the
+    // viewport maps onto the whole map
+    Mat4d T {eye<4>()}, S {eye<4>()};
+    for (int i {0}; i < 3; ++i) {
+        T[i][3] = -center[i];
+        S[i][i] = 1 / radius;
+    }
+    ModelView_ = S * lookat(L_dir, Vec3d{0, 0, 0}, up) * T;
+    Viewport_ = ::viewport(0, 0, size_, size_, 255);
+    M_ = Viewport_ * projection(0) * ModelView_;
+}
+
+// the greater depth is nearer to the light: the point is lit where the map
+// does not store a greater one. A texel covers a depth range growing with the
+// slope of the surface to the light, tan = sin / cos (up to 10)
+double Shadow_map::lit(const Vec3d &p, const double cos_l) const {
+    const double c {std::max(cos_l, 0.1)};
+    const double b {bias_ * std::max(1.0, std::sqrt(1 - c * c) / c)};
+    const int d {depth_.quantize(p.z() + b)};
+    const int x0 {int(std::floor(p.x() + 0.5))};
+    const int y0 {int(std::floor(p.y() + 0.5))};
+    int n {0}, nlit {0};
+    for (int y {y0 - pcf_}; y <= y0 + pcf_; ++y)
+        for (int x {x0 - pcf_}; x <= x0 + pcf_; ++x, ++n)
+            if (x < 0 || y < 0 || x >= size_ || y >= size_ ||
+                    depth_[x + size_t(y) * size_] <= d)
+                ++nlit;
+    return double(nlit) / n;
+}
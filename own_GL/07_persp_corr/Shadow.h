@@ -0,0 +1,154 @@
+/*
+ * Shadow mapping of the directional light:
+ *      Class Shadow_map: the depth of the scene seen from the light. The
+ *      light looks at the bounding sphere of the scene (center, radius) from
+ *      the direction L_dir (the direction towards the light, as the shaders
+ *      take it) through an orthographic projection, so the sphere fills the
+ *      square map. The pass is the depth-only render_depth (no varyings, no
+ *      fragment shader); the depth is quantized to 16 bits by default
+ *      lit(): percentage-closer filtering, the fraction of the (2 * pcf + 1)^2
+ *      texels around the point which do not hide it. The bias (in the depth
+ *      units of the Viewport, 0..255, scaled by the slope of the surface to
+ *      the light) keeps a surface from shadowing itself through the
+ *      quantization and the texel size; the points outside of the map are
+ *      lit
+ *
+ *      Class Shadow_shader: the texture shader with the diffuse light scaled
+ *      by lit() (down to the dark fraction in the full shadow). The vertex
+ *      shader transforms the vertex into the map as well, and this position
+ *      is interpolated like the other varyings
+ *
+ * Examples:
+ *      Shadow_map sm {1024}; // 3x3 PCF
+ *      sm.render(mesh, L_dir, pool); // once per light or scene change
+ *      render_tiled(mesh, Shadow_shader{sm}, Viewport, Proj, ModelView,
+ *          L_dir, img, tex, zbuf, pool);
+ */
+
+#ifndef SHADOW_H
+#define SHADOW_H
+
+#include "Tiles.h"
+
+class Shadow_map {
+public:
+    using Vec3d = Vec<3, double>;
+    using Mat4d = Mat<4, 4, double>;
+
+    // size of the (square) map in texels, PCF radius in texels, bias and
+    // depth bits (8..24)
+    explicit Shadow_map(const int = 1024, const int = 1, const double = 1.0,
+            const int = 16);
+    Shadow_map(const Shadow_map&) = delete;
+    Shadow_map& operator=(const Shadow_map&) = delete;
+
+    ~Shadow_map() = default;
+
+    int size() const { return size_; }
+    const Depth_buffer& depth() const { return depth_; }
+    // object coordinates to the map: texel x, y and the depth
+    const Mat4d& transform() const { return M_; }
+    // the matrices of the light view
+    const Mat4d& viewport() const { return Viewport_; }
+    const Mat4d& modelview() const { return ModelView_; }
+
+    // set the light view of the sphere (center, radius) lit from L_dir
+    void look(const Vec3d&, const Vec3d& = Vec3d{0, 0, 0}, const double = 1);
+    // the light view and the depth-only pass of the geometry
+    template <class Geom>
+    void render(const Geom &m, const Vec3d &L_dir, Thread_pool &pool,
+            const Vec3d &center = Vec3d{0, 0, 0}, const double radius = 1) {
+        PROF_SCOPE("shadow_map");
+        look(L_dir, center, radius);
+        depth_.clear();
+        render_depth(m, Viewport_, projection(0), ModelView_, depth_, size_,
+                size_, pool, 64, nullptr, 0, false);
+    }
+
+    // fraction of the PCF texels lit at the point of the map, for the
+    // surface at the angle to the light of the given cosine (the bias is
+    // scaled by the slope)
+    double lit(const Vec3d&, const double = 1) const;
+
+private:
+    int size_;
+    int pcf_;
+    double bias_;
+    Depth_buffer depth_;
+    Mat4d Viewport_;
+    Mat4d ModelView_;
+    Mat4d M_;
+};
+
+class Shadow_shader final: public IShader {
+public:
+    using Vec3d = Vec<3, double>;
+    using Vec4d = Vec<4, double>;
+
+    // the map (rendered before the shading pass) and the diffuse light left
+    // in the full shadow
+    explicit Shadow_shader(const Shadow_map &sm, const double dark = 0.3):
+        map_{&sm}, dark_{dark} {
+    }
+    Shadow_shader(const Shadow_shader&) = default;
+    Shadow_shader& operator=(const Shadow_shader&) = default;
+
+    Vec4d vertex(const Model &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        return vertex_(m, Viewport, Proj, ModelView, L_dir, iface, ivert);
+    }
+
+    Vec4d vertex(const Mesh &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        return vertex_(m, Viewport, Proj, ModelView, L_dir, iface, ivert);
+    }
+
+    Vec4d vertex(const Vertex_cache &vc, const int iface, const int ivert) {
+        const uint32_t i {vc.mesh().index(iface, ivert)};
+        var_uv.fill_col(ivert, Vec<2, double>{vc.mesh().u()[i],
+                vc.mesh().v()[i]});
+        var_intensity[ivert] = vc.intensity(i);
+        set_light(ivert, vc.mesh().vertex(i));
+        return vc.position(i);
+    }
+
+    bool fragment(const PPM_Image &tex, const Vec3d &bar, PPM_Color &C) {
+        PROF_COUNT(tex_fetches, 1);
+        const double diffuse {var_intensity * bar};
+        const double intensity {diffuse * (dark_ + (1 - dark_) *
+                map_->lit(var_light * bar, diffuse))};
+        const auto uv = var_uv * bar;
+        C = tex.color(uv.x() * tex.width(), tex.height() * (1 - uv.y())) *
+            intensity;
+        return false;
+    }
+
+private:
+    template <class Geom>
+    Vec4d vertex_(const Geom &m, const Mat4d &Viewport, const Mat4d &Proj,
+            const Mat4d &ModelView, const Vec3d &L_dir, const int iface,
+            const int ivert) {
+        var_uv.fill_col(ivert, resize<2>(m.texvertex(iface, ivert)));
+        var_intensity[ivert] = std::max(0.0, m.normal(iface, ivert) * L_dir);
+        set_light(ivert, m.vertex(iface, ivert));
+        Vec4d gl_vert = resize<4>(m.vertex(iface, ivert));
+        gl_vert = Viewport * Proj * ModelView * gl_vert;
+        return gl_vert;
+    }
+
+    // position of the corner in the map (orthographic: w = 1)
+    void set_light(const int ivert, const Vec3d &v) {
+        var_light.fill_col(ivert, resize<3>(map_->transform() *
+                    resize<4>(v)));
+    }
+
+    const Shadow_map *map_;
+    double dark_;
+    Vec3d var_intensity {};
+    Mat<2, 3, double> var_uv {};
+    Mat<3, 3, double> var_light {};
+};
+
+#endif
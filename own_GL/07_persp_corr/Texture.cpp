@@ -0,0 +1,85 @@
+#include "Texture.h"
+#include <cmath>
+
+// 2x2 box filter of a level (row-major texels); a texel of an odd border
+// averages the last row/column with itself
+static std::vector<uint> half_level(const std::vector<uint> &src, const int w,
+        const int h, const int hw, const int hh) {
+    std::vector<uint> dst(size_t(hw) * hh);
+    for (int y {0}; y < hh; ++y) {
+        const uint *r0 {&src[size_t(std::min(2 * y, h - 1)) * w]};
+        const uint *r1 {&src[size_t(std::min(2 * y + 1, h - 1)) * w]};
+        for (int x {0}; x < hw; ++x) {
+            const int x0 {std::min(2 * x, w - 1)}, x1 {std::min(2 * x + 1,
+                    w - 1)};
+            uint c {0};
+            for (int s {16}; s >= 0; s -= 8) {
+                const uint sum {(r0[x0] >> s & 0xff) + (r0[x1] >> s & 0xff) +
+                    (r1[x0] >> s & 0xff) + (r1[x1] >> s & 0xff)};
+                c |= (sum + 2) >> 2 << s;
+            }
+            dst[size_t(y) * hw + x] = c;
+        }
+    }
+    return dst;
+}
+
+Texture::Texture(const PPM_Image &img): levels_{}, data_{} {
+    int w {std::max(img.width(), 1)}, h {std::max(img.height(), 1)};
+    std::vector<uint> lin(size_t(w) * h, 0);
+    for (int y {0}; y < std::min(h, img.height()); ++y)
+        std::copy(img.row(y), img.row(y) + img.width(), &lin[size_t(y) * w]);
+
+    // level sizes and offsets: every level is a whole number of tiles
+    for (int lw {w}, lh {h}, off {0}; ; lw = std::max(lw / 2, 1),
+            lh = std::max(lh / 2, 1)) {
+        const int tx {(lw + 7) >> tile_bits}, ty {(lh + 7) >> tile_bits};
+        levels_.push_back(Level{lw, lh, tx, size_t(off), double(lw),
+                double(lh)});
+        off += tx * ty << (2 * tile_bits);
+        if (lw == 1 && lh == 1)
+            break;
+    }
+    const Level &last = levels_.back();
+    data_.assign(last.offset + (size_t(1) << (2 * tile_bits)), 0);
+
+    for (size_t l {0}; l < levels_.size(); ++l) {
+        const Level &lv = levels_[l];
+        for (int y {0}; y < lv.h; ++y)
+            for (int x {0}; x < lv.w; ++x)
+                data_[lv.offset + col(lv, x) + row(lv, y)] =
+                    lin[size_t(y) * lv.w + x];
+        if (l + 1 < levels_.size())
+            lin = half_level(lin, lv.w, lv.h, levels_[l + 1].w,
+                    levels_[l + 1].h);
+    }
+}
+
+double Texture::lod(const double dudx, const double dvdx, const double dudy,
+        const double dvdy) const {
+    const double w {double(width())}, h {double(height())};
+    const double rx {dudx * dudx * w * w + dvdx * dvdx * h * h};
+    const double ry {dudy * dudy * w * w + dvdy * dvdy * h * h};
+    const double rho {std::max(rx, ry)};
+    if (!(rho > 1))
+        return 0;
+    return std::min(0.5 * std::log2(rho), double(levels() - 1));
+}
+
+// 4 texels of the level around (u, v)
+uint Texture::bilinear(const int l, const double u, const double v) const {
+    const Level &lv = levels_[l];
+    // texel centers are at the half-integers: (fx, fy) is the position
+    // relative to the center of texel (-1, -1), which keeps it positive and
+    // the truncation a floor (the border texels are repeated beyond it)
+    const double fx {std::max(u * lv.sw + 0.5, 0.0)},
+          fy {std::max(lv.sh * (1 - v) + 0.5, 0.0)};
+    const int ix {int(fx)}, iy {int(fy)};
+    const uint wx {uint((fx - ix) * 256)}, wy {uint((fy - iy) * 256)};
+    const uint *t {&data_[lv.offset]};
+    const size_t x0 {col(lv, ix - 1)}, x1 {col(lv, ix)};
+    const size_t y0 {row(lv, iy - 1)}, y1 {row(lv, iy)};
+    const uint t00 {t[x0 + y0]}, t10 {t[x1 + y0]}, t01 {t[x0 + y1]},
+          t11 {t[x1 + y1]};
+    return lerp_texel(lerp_texel(t00, t10, wx), lerp_texel(t01, t11, wx), wy);
+}
@@ -0,0 +1,138 @@
+/*
+ * Class Texture:
+ *      read-only copy of a PPM_Image prepared for sampling. The image and its
+ *      mip chain (every level a 2x2 box-filtered half of the previous one,
+ *      down to 1x1) are kept in one 64-byte aligned buffer. A level is stored
+ *      in tiles of 8x8 texels (256 bytes: four cache lines), the tiles row by
+ *      row and the texels of a tile in Morton (Z) order, so the texels
+ *      around a sample point (bilinear footprint, neighbouring pixels of a
+ *      minified triangle) mostly share a cache line
+ *      Texel (x, y) of a level is the pixel (x, y) of its image: row 0 is
+ *      v = 1, the same orientation as tex.color(u * w, h * (1 - v))
+ *      Coordinates outside of the level are clamped to its border
+ *      Filters:
+ *          nearest: point sample of the nearest level
+ *          bilinear: 4 texels of the nearest level
+ *          trilinear: bilinear samples of the two levels around the LOD
+ *      LOD is the log2 of the texels per pixel (0: level 0, the image);
+ *      lod() computes it from the uv derivatives along x and y. The nearest
+ *      sample at LOD 0 is the pixel tex.color() would return
+ *
+ * Examples:
+ *      const PPM_Image img {"../obj/african_head_diffuse.ppm"};
+ *      const Texture tex {img};
+ *      tex.levels(); // 11 for a 1024x1024 image
+ *      tex.sample(u, v, 0, Tex_filter::nearest); // == img.color(...)
+ *      const double lod {tex.lod(dudx, dvdx, dudy, dvdy)};
+ *      tex.sample(u, v, lod, Tex_filter::trilinear);
+ */
+
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include "PPM_Image.h"
+#include <algorithm>
+#include <cstdint>
+
+enum class Tex_filter { nearest, bilinear, trilinear };
+
+class Texture {
+public:
+    Texture(const PPM_Image&);
+
+    ~Texture() = default;
+
+    int width() const { return levels_[0].w; }
+    int height() const { return levels_[0].h; }
+    int levels() const { return int(levels_.size()); }
+    int width(const int l) const { return levels_[l].w; }
+    int height(const int l) const { return levels_[l].h; }
+    // bytes of the image and its mip chain
+    size_t memory() const { return data_.size() * sizeof(uint); }
+
+    // texel (0xRRGGBB) of the level, the coordinates are clamped
+    uint texel(const int l, const int x, const int y) const {
+        const Level &lv = levels_[l];
+        return data_[lv.offset + col(lv, x) + row(lv, y)];
+    }
+
+    // level of detail of the derivatives of (u, v) along the screen x and y
+    // (uv units per pixel), clamped to the levels
+    double lod(const double, const double, const double, const double) const;
+
+    PPM_Color sample(const double, const double, const double,
+            const Tex_filter) const;
+
+private:
+    struct Level {
+        int w;
+        int h;
+        int tiles_x;   // tiles per row
+        size_t offset; // first texel in data_
+        double sw;     // the size as doubles, u and v are scaled by it
+        double sh;
+    };
+
+    static constexpr int tile_bits {3}; // 8x8 texels per tile
+
+    // the 3 bits of a coordinate inside the tile spread to the even bits
+    static int spread(const int a) {
+        static constexpr uint8_t s[8] {0, 1, 4, 5, 16, 17, 20, 21};
+        return s[a];
+    }
+    // index of texel (x, y) inside the level: the sum of the part of the
+    // column (clamped) and of the row, so that the 4 texels of a bilinear
+    // sample need 2 + 2 of them
+    static size_t col(const Level &lv, const int x) {
+        const int c {std::min(std::max(x, 0), lv.w - 1)};
+        return size_t(c >> tile_bits << 2 * tile_bits | spread(c & 7));
+    }
+    static size_t row(const Level &lv, const int y) {
+        const int r {std::min(std::max(y, 0), lv.h - 1)};
+        return (size_t(r >> tile_bits) * lv.tiles_x << 2 * tile_bits) |
+            size_t(spread(r & 7) << 1);
+    }
+
+    uint nearest(const int, const double, const double) const;
+    uint bilinear(const int, const double, const double) const;
+
+    std::vector<Level> levels_;
+    aligned_vector<uint> data_;
+};
+
+// the point sampler and the filter selection are inlined into the fragment
+// shaders
+
+inline uint Texture::nearest(const int l, const double u, const double v)
+    const {
+    const Level &lv = levels_[l];
+    return texel(l, int(u * lv.sw), int(lv.sh * (1 - v)));
+}
+
+// blend of two texels with a weight of 0 - 256 for the second one: red and
+// blue and then green are weighted in one multiplication each
+inline uint lerp_texel(const uint a, const uint b, const uint t) {
+    const uint rb {((a & 0xff00ff) * (256 - t) + (b & 0xff00ff) * t) >> 8};
+    const uint g {((a & 0xff00) * (256 - t) + (b & 0xff00) * t) >> 8};
+    return (rb & 0xff00ff) | (g & 0xff00);
+}
+
+inline PPM_Color Texture::sample(const double u, const double v,
+        const double lod, const Tex_filter f) const {
+    const int last {levels() - 1};
+    const double d {lod < 0 ? 0 : lod < last ? lod : last};
+    uint c;
+    if (f == Tex_filter::nearest) {
+        c = nearest(int(d + 0.5), u, v);
+    } else if (f == Tex_filter::bilinear || d >= last) {
+        c = bilinear(f == Tex_filter::bilinear ? int(d + 0.5) : last, u, v);
+    } else {
+        const int l {int(d)};
+        c = lerp_texel(bilinear(l, u, v), bilinear(l + 1, u, v),
+                uint((d - l) * 256));
+    }
+    return PPM_Color{uchar(c >> 16), uchar(c >> 8), uchar(c)};
+}
+
+#endif
+
@@ -0,0 +1,100 @@
+#include "Thread_pool.h"
+
+Thread_pool::Thread_pool(const size_t n): workers_{}, queues_{}, m_{},
+    work_cv_{}, done_cv_{}, task_{nullptr}, generation_{0}, pending_{0},
+    error_{}, stop_{false} {
+    const size_t nthreads {n ? n : std::thread::hardware_concurrency()};
+    if (nthreads < 2) // single thread: run() executes the tasks in place
+        return;
+    for (size_t i {0}; i < nthreads; ++i)
+        queues_.emplace_back(new Queue);
+    for (size_t i {0}; i < nthreads; ++i)
+        workers_.emplace_back(&Thread_pool::work, this, i);
+}
+
+Thread_pool::~Thread_pool() {
+    {
+        std::lock_guard<std::mutex> lk {m_};
+        stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto &t: workers_)
+        t.join();
+}
+
+void Thread_pool::run(const size_t n, const Task &task) {
+    if (workers_.empty()) {
+        for (size_t i {0}; i < n; ++i)
+            task(i);
+        return;
+    }
+    std::unique_lock<std::mutex> lk {m_};
+    task_ = &task;
+    pending_ = n;
+    // hand out contiguous ranges of tasks: neighbouring tiles share data
+    const size_t nq {queues_.size()};
+    for (size_t k {0}; k < nq; ++k) {
+        std::lock_guard<std::mutex> qlk {queues_[k]->m};
+        for (size_t i {k * n / nq}; i < (k + 1) * n / nq; ++i)
+            queues_[k]->q.push_back(i);
+    }
+    ++generation_;
+    work_cv_.notify_all();
+    done_cv_.wait(lk, [this] { return pending_ == 0; });
+    if (error_) {
+        std::exception_ptr e {error_};
+        error_ = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+// take a task from the own queue or steal one from the other queues
+bool Thread_pool::pop(const size_t id, size_t &i) {
+    const size_t nq {queues_.size()};
+    {
+        Queue &own = *queues_[id];
+        std::lock_guard<std::mutex> lk {own.m};
+        if (!own.q.empty()) {
+            i = own.q.front();
+            own.q.pop_front();
+            return true;
+        }
+    }
+    for (size_t k {1}; k < nq; ++k) {
+        Queue &victim = *queues_[(id + k) % nq];
+        std::lock_guard<std::mutex> lk {victim.m};
+        if (!victim.q.empty()) {
+            i = victim.q.back();
+            victim.q.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void Thread_pool::work(const size_t id) {
+    size_t seen {0};
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lk {m_};
+            work_cv_.wait(lk, [&] { return stop_ || generation_ != seen; });
+            if (stop_)
+                return;
+            seen = generation_;
+        }
+        for (size_t i; pop(id, i);) {
+            try {
+                (*task_)(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lk {m_};
+                if (!error_)
+                    error_ = std::current_exception();
+            }
+            if (--pending_ == 0) {
+                std::lock_guard<std::mutex> lk {m_};
+                done_cv_.notify_all();
+            }
+        }
+    }
+}
+
@@ -0,0 +1,72 @@
+/*
+ * Class Thread_pool:
+ *      a small pool of worker threads used to run independent pieces of work
+ *      (screen tiles, chunks of faces) in parallel
+ *      Every worker owns a queue of task indices. A worker takes tasks from
+ *      the front of its own queue and, once it runs dry, steals tasks from the
+ *      back of the other workers' queues (work stealing), so that the threads
+ *      stay busy even when some tasks (tiles) are much heavier than others
+ *      An exception thrown by a task is caught by the worker, the other
+ *      tasks still run and run() throws the first exception again, as it
+ *      does when the tasks run in the caller
+ *
+ * Examples:
+ *      Thread_pool pool {};  // one worker per hardware thread
+ *      Thread_pool pool1 {1}; // no extra threads: tasks run in the caller
+ *      pool.run(n, [&](const size_t i) { do_task(i); }); // blocks until all
+ *          n tasks are done
+ */
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <exception>
+
+class Thread_pool {
+public:
+    using Task = std::function<void(const size_t)>;
+
+    // number of threads: zero means use all hardware threads
+    explicit Thread_pool(const size_t = 0);
+    Thread_pool(const Thread_pool&) = delete;
+    Thread_pool& operator=(const Thread_pool&) = delete;
+
+    ~Thread_pool();
+
+    size_t num_threads() const { return std::max(workers_.size(), size_t{1}); }
+
+    // execute task(i) for i in [0, n) and wait for all of them to finish
+    void run(const size_t, const Task&);
+
+private:
+    struct Queue {
+        std::mutex m {};
+        std::deque<size_t> q {};
+    };
+
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::mutex m_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    const Task *task_;
+    size_t generation_;
+    std::atomic<size_t> pending_;
+    std::exception_ptr error_; // the first exception of the tasks of run()
+    bool stop_;
+
+    void work(const size_t);
+    bool pop(const size_t, size_t&);
+};
+
+#endif
+
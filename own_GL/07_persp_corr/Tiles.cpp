@@ -0,0 +1,81 @@
+#include "Tiles.h"
+
+Tile_grid::Tile_grid(const int w, const int h, const int tile): w_{w}, h_{h},
+    tile_{std::max(tile, 1)}, nx_{(w + tile_ - 1) / tile_},
+    ny_{(h + tile_ - 1) / tile_}, bins_(nx_ * ny_) {
+}
+
+Raster_rect Tile_grid::rect(const int t) const {
+    const int x0 {t % nx_ * tile_}, y0 {t / nx_ * tile_};
+    return {x0, y0, std::min(x0 + tile_, w_) - 1, std::min(y0 + tile_, h_) - 1};
+}
+
+void Tile_grid::clear() {
+    for (auto &b: bins_)
+        b.clear();
+}
+
+void Tile_grid::bin(const int tri, const Raster_rect &bb) {
+    if (bb.empty())
+        return;
+    for (int ty = bb.y0 / tile_; ty <= bb.y1 / tile_; ++ty)
+        for (int tx = bb.x0 / tile_; tx <= bb.x1 / tile_; ++tx)
+            bins_[tx + ty * nx_].push_back(tri);
+}
+
+
+void bin_triangles(const std::vector<Mat<3, 4, double>> &pts, Tile_grid &grid,
+        std::vector<Tile_prim> &prims, Primitive_assembly *pa) {
+    PROF_SCOPE("binning");
+    const size_t nfaces {pts.size()};
+    prims.clear();
+    prims.reserve(nfaces);
+    Clip_tri tris[Primitive_assembly::max_tris];
+    PROF_COUNT(tris_submitted, nfaces);
+    for (size_t i {0}; i < nfaces; ++i) {
+        bool clipped {false};
+        int n {1};
+        if (pa)
+            n = pa->assemble(pts[i], tris, clipped);
+        else
+            tris[0].pts = pts[i];
+        PROF_COUNT(tris_culled, n == 0);
+        for (int k {0}; k < n; ++k) {
+            Mat<3, 2, double> pts2;
+            for (int j = 0; j < 3; ++j)
+                pts2[j] = tris[k].pts[j] / tris[k].pts[j][3];
+            grid.bin(prims.size(), bounding_box(pts2, grid.width(),
+                        grid.height()));
+            prims.push_back(Tile_prim{tris[k], i, clipped});
+        }
+    }
+}
+
+void position_stage(const Model &m, std::vector<Mat<3, 4, double>> &pts,
+        const Mat<4, 4, double> &Viewport, const Mat<4, 4, double> &Proj,
+        const Mat<4, 4, double> &ModelView, Thread_pool &pool) {
+    PROF_SCOPE("vertex");
+    const size_t nfaces {m.num_faces()};
+    const Mat<4, 4, double> MVP {Viewport * Proj * ModelView};
+    constexpr size_t chunk {1024};
+    pool.run((nfaces + chunk - 1) / chunk, [&](const size_t c) {
+        for (size_t i {c * chunk}; i < std::min(nfaces, (c + 1) * chunk); ++i)
+            for (int j {0}; j < 3; ++j)
+                pts[i][j] = MVP * resize<4>(m.vertex(i, j));
+    });
+}
+
+void position_stage(const Mesh &m, std::vector<Mat<3, 4, double>> &pts,
+        const Mat<4, 4, double> &Viewport, const Mat<4, 4, double> &Proj,
+        const Mat<4, 4, double> &ModelView, Thread_pool &pool) {
+    PROF_SCOPE("vertex");
+    Vertex_cache vc;
+    vc.transform(m, Viewport, Proj, ModelView, Vec<3, double>{}, pool);
+    const size_t nfaces {m.num_faces()};
+    constexpr size_t chunk {4096};
+    pool.run((nfaces + chunk - 1) / chunk, [&](const size_t c) {
+        for (size_t i {c * chunk}; i < std::min(nfaces, (c + 1) * chunk); ++i)
+            for (int j {0}; j < 3; ++j)
+                pts[i][j] = vc.position(i, j);
+    });
+}
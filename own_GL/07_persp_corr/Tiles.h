@@ -0,0 +1,195 @@
+/*
+ * Tile-binned rendering:
+ *      the screen is split into square tiles (64x64 pixels by default).
+ *      Binning stage: every projected triangle is put into the bins of all the
+ *      tiles its bounding box overlaps (keeping the order of submission).
+ *      Shading stage: the tiles are shaded in parallel by a Thread_pool. Each
+ *      task owns the pixels of its tile both in the z-buffer and in the image,
+ *      so no locks are needed, and within a tile the triangles are drawn in
+ *      the submission order, hence the output is bit-identical to the serial
+ *      loop over the faces
+ *      Vertex stage: for a compiled Mesh the batched Vertex_cache is used
+ *      Primitive assembly (optional): culling and clipping before binning
+ *      Depth-only pass (render_depth): the same stages without shaders and
+ *      image, for shadow maps and the z-prepass of a shading pass
+ *
+ * Examples:
+ *      Thread_pool pool {8}; // thread count knob
+ *      render_tiled(model, Tex_shader{}, Viewport, Proj, ModelView, L_dir,
+ *          img, tex, zbuf, pool); // instead of the loop over num_faces()
+ *      z_prepass(model, Viewport, Proj, ModelView, zbuf, w, h, pool);
+ *      render_tiled(...); // every visible pixel shaded once (see the cost
+ *          at z_prepass)
+ */
+
+#ifndef TILES_H
+#define TILES_H
+
+#include "Shader.h"
+#include "Thread_pool.h"
+#include <vector>
+
+class Tile_grid {
+public:
+    Tile_grid(const int, const int, const int = 64);
+
+    int width() const { return w_; }
+    int height() const { return h_; }
+    int tile_size() const { return tile_; }
+    int num_tiles() const { return nx_ * ny_; }
+    Raster_rect rect(const int) const;
+    const std::vector<int>& triangles(const int t) const { return bins_[t]; }
+
+    void clear();
+    // put the triangle index into the bins overlapped by the rectangle
+    void bin(const int, const Raster_rect&);
+
+private:
+    int w_;
+    int h_;
+    int tile_;
+    int nx_;
+    int ny_;
+    std::vector<std::vector<int>> bins_;
+};
+
+// vertex stage of a Model: every face corner goes through the shader, and
+// every face keeps its own copy of the shader varyings
+template <class Shader>
+void vertex_stage(const Model &m, std::vector<Shader> &shaders,
+        std::vector<Mat<3, 4, double>> &pts, const Mat<4, 4, double>
+        &Viewport, const Mat<4, 4, double> &Proj, const Mat<4, 4, double>
+        &ModelView, const Vec<3, double> &L_dir, Thread_pool &pool) {
+    PROF_SCOPE("vertex");
+    const size_t nfaces {m.num_faces()};
+    constexpr size_t chunk {1024};
+    pool.run((nfaces + chunk - 1) / chunk, [&](const size_t c) {
+        for (size_t i {c * chunk}; i < std::min(nfaces, (c + 1) * chunk); ++i)
+            for (int j {0}; j < 3; ++j)
+                pts[i][j] = shaders[i].vertex(m, Viewport, Proj, ModelView,
+                        L_dir, i, j);
+    });
+}
+
+// vertex stage of a compiled Mesh: the unique vertices are transformed once
+// in bulk, and the corners are gathered from the cache
+template <class Shader>
+void vertex_stage(const Mesh &m, std::vector<Shader> &shaders,
+        std::vector<Mat<3, 4, double>> &pts, const Mat<4, 4, double>
+        &Viewport, const Mat<4, 4, double> &Proj, const Mat<4, 4, double>
+        &ModelView, const Vec<3, double> &L_dir, Thread_pool &pool) {
+    PROF_SCOPE("vertex");
+    Vertex_cache vc;
+    vc.transform(m, Viewport, Proj, ModelView, L_dir, pool);
+    const size_t nfaces {m.num_faces()};
+    constexpr size_t chunk {4096};
+    pool.run((nfaces + chunk - 1) / chunk, [&](const size_t c) {
+        for (size_t i {c * chunk}; i < std::min(nfaces, (c + 1) * chunk); ++i)
+            for (int j {0}; j < 3; ++j)
+                pts[i][j] = shaders[i].vertex(vc, i, j);
+    });
+}
+
+// assembled triangle of the binning stage: its face and whether it is a
+// clipped part of it
+struct Tile_prim {
+    Clip_tri tri;
+    size_t face;
+    bool clipped;
+};
+
+// primitive assembly (if any) and binning stage: the triangles are put into
+// the bins of the grid in the submission order
+void bin_triangles(const std::vector<Mat<3, 4, double>>&, Tile_grid&,
+        std::vector<Tile_prim>&, Primitive_assembly*);
+
+// the geometry is either a Model or a compiled Mesh, the depth buffer is
+// either a std::vector<int> or a Depth_buffer; the tile size is rounded up to
+// a multiple of 8, so that every 8x8 depth block belongs to a single tile.
+// With a Primitive_assembly the triangles are culled and clipped before the
+// binning (serial stage, so a single instance is fine)
+template <class Shader, class Geom, class Zbuf>
+void render_tiled(const Geom &m, const Shader &proto, const Mat<4, 4, double>
+        &Viewport, const Mat<4, 4, double> &Proj, const Mat<4, 4, double>
+        &ModelView, const Vec<3, double> &L_dir, PPM_Image &I,
+        const PPM_Image &tex, Zbuf &zbuf, Thread_pool &pool,
+        const int tile = 64, Primitive_assembly *pa = nullptr) {
+    const size_t nfaces {m.num_faces()};
+    std::vector<Mat<3, 4, double>> pts(nfaces);
+    std::vector<Shader> shaders(nfaces, proto);
+    vertex_stage(m, shaders, pts, Viewport, Proj, ModelView, L_dir, pool);
+
+    std::vector<Tile_prim> prims;
+    Tile_grid grid {I.width(), I.height(), (std::max(tile, 1) + 7) & ~7};
+    bin_triangles(pts, grid, prims, pa);
+
+    // shading stage: one task per tile
+    pool.run(grid.num_tiles(), [&](const size_t t) {
+        PROF_SCOPE("tile");
+        const Raster_rect r {grid.rect(t)};
+        for (const int i: grid.triangles(t)) {
+            const Tile_prim &p = prims[i];
+            Shader shader {shaders[p.face]};
+            draw_clip_tri(p.tri, p.clipped, shader, I, tex, zbuf, r);
+        }
+    });
+}
+
+// vertex stage of the depth-only pass: the positions alone, computed as the
+// shaders compute them (the same values)
+void position_stage(const Model&, std::vector<Mat<3, 4, double>>&,
+        const Mat<4, 4, double>&, const Mat<4, 4, double>&,
+        const Mat<4, 4, double>&, Thread_pool&);
+void position_stage(const Mesh&, std::vector<Mat<3, 4, double>>&,
+        const Mat<4, 4, double>&, const Mat<4, 4, double>&,
+        const Mat<4, 4, double>&, Thread_pool&);
+
+// depth-only render_tiled into a w x h depth buffer (depth_triangle): no
+// shaders, no image. The stored depth is lowered by bias levels; without
+// exact the depth of an orthographic view is evaluated linearly
+template <class Geom, class Zbuf>
+void render_depth(const Geom &m, const Mat<4, 4, double> &Viewport,
+        const Mat<4, 4, double> &Proj, const Mat<4, 4, double> &ModelView,
+        Zbuf &zbuf, const int w, const int h, Thread_pool &pool,
+        const int tile = 64, Primitive_assembly *pa = nullptr,
+        const int bias = 0, const bool exact = true) {
+    std::vector<Mat<3, 4, double>> pts(m.num_faces());
+    position_stage(m, pts, Viewport, Proj, ModelView, pool);
+
+    std::vector<Tile_prim> prims;
+    Tile_grid grid {w, h, (std::max(tile, 1) + 7) & ~7};
+    bin_triangles(pts, grid, prims, pa);
+
+    auto &&depth = depth_ref(zbuf, w);
+    pool.run(grid.num_tiles(), [&](const size_t t) {
+        PROF_SCOPE("depth_tile");
+        const Raster_rect r {grid.rect(t)};
+        for (const int i: grid.triangles(t))
+            depth_triangle(prims[i].tri.pts, depth, w, h, r, bias,
+                    exact);
+    });
+}
+
+// z-prepass of a render_tiled with the same geometry, transforms, image size,
+// depth buffer and primitive assembly: the depth of the nearest fragment of
+// every pixel is stored one level lower, so the strict depth test of the
+// shading pass fails for all the hidden fragments and passes for the visible
+// one, which is shaded once (for shaders which never discard fragments). The
+// image is the same as without the prepass
+// The prepass is a second geometry pass (positions, binning, depth raster)
+// and pays off only when it saves more shading than it costs: many layers of
+// shaded fragments per pixel (scenes drawn back to front, dense depth
+// complexity) and an expensive fragment shader. With the hierarchical z-buffer
+// keeping the overdraw low it usually costs more than it saves (bench_shadow
+// and test_shadow report the times and the fragments shaded)
+template <class Geom, class Zbuf>
+void z_prepass(const Geom &m, const Mat<4, 4, double> &Viewport,
+        const Mat<4, 4, double> &Proj, const Mat<4, 4, double> &ModelView,
+        Zbuf &zbuf, const int w, const int h, Thread_pool &pool,
+        const int tile = 64, Primitive_assembly *pa = nullptr) {
+    PROF_SCOPE("z_prepass");
+    render_depth(m, Viewport, Proj, ModelView, zbuf, w, h, pool, tile, pa, 1);
+}
+
+#endif
+
@@ -4,6 +4,85 @@
 #include <fstream>
 #include <array>
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+// the compiler builtin behind C++20 std::is_constant_evaluated (gcc 9,
+// clang 9): the constexpr functions with a faster run-time version (SIMD
+// kernels, std::sqrt) choose the portable one in constant expressions
+#if defined(__has_builtin)
+#if __has_builtin(__builtin_is_constant_evaluated)
+#define VEC_CONSTANT_EVALUATED
+#endif
+#endif
+
+// SSE2 (x86-64 baseline) kernels for the 4-element float and double vectors
+// and matrices, AVX ones if the compiler targets it (-mavx); -DVEC_NO_SIMD
+// leaves only the generic loops. The kernels are not constexpr, so they need
+// the builtin to keep the products usable in constant expressions
+#if defined(__SSE2__) && !defined(VEC_NO_SIMD) && \
+    defined(VEC_CONSTANT_EVALUATED)
+#define VEC_SIMD
+#include <immintrin.h>
+#endif
+
+// true while the compiler evaluates a constant expression (always false
+// without the builtin: only the run-time versions are used then)
+constexpr bool constant_evaluated() {
+#ifdef VEC_CONSTANT_EVALUATED
+    return __builtin_is_constant_evaluated();
+#else
+    return false;
+#endif
+}
+
+/*
+ * square root usable in constant expressions: correctly rounded, like the
+ * IEEE 754 std::sqrt, so that a value folded at compile time has the bits
+ * it would have at run time. x = m * 2^e with an integer m (53 or 54 bits)
+ * and an even e, the integer square root of m * 2^52 (53 bits) is computed
+ * bit by bit and rounded to nearest with its remainder
+ */
+constexpr double const_sqrt(double x) {
+    if (x == 0 || x > std::numeric_limits<double>::max())
+        return x; // +-0, +inf
+    if (!(x > 0))
+        return std::numeric_limits<double>::quiet_NaN(); // negative, NaN
+    int e {0};
+    for (; x >= 0x1p53; ++e) x *= 0.5;
+    for (; x < 0x1p52; --e) x *= 2;
+    uint64_t m {uint64_t(x)};
+    if (e & 1) {
+        m <<= 1;
+        --e;
+    }
+    // pair p of bits of m * 2^52: 2p + 1 and 2p, zeros below the 52nd bit
+    uint64_t q {0}, r {0};
+    for (int p {52}; p >= 0; --p) {
+        r = r << 2 | (p >= 26 ? m >> (2 * p - 52) & 3 : 0);
+        const uint64_t t {q << 2 | 1};
+        q <<= 1;
+        if (r >= t) {
+            r -= t;
+            q |= 1;
+        }
+    }
+    if (r > q) // m * 2^52 > (q + 1/2)^2
+        ++q;
+    double y {double(q)};
+    for (e = (e - 52) / 2; e > 0; --e) y *= 2;
+    for (; e < 0; ++e) y *= 0.5;
+    return y;
+}
+
+// std::sqrt at run time, const_sqrt in constant expressions (a float is
+// rounded from the double root: the same as the float std::sqrt)
+template <class Num>
+constexpr auto vec_sqrt(const Num x) -> decltype(std::sqrt(x)) {
+    using Res = decltype(std::sqrt(x));
+    return constant_evaluated() ? Res(const_sqrt(x)) : std::sqrt(x);
+}
 
 /*
  * Class Vec:
@@ -11,58 +90,74 @@
  *      Num type hints that the type should be numeric
  *      Decided to use fixed size array because the Vec class is going to be
  *      used mainly for short (2 - 4 elements) arrays
+ *      Everything but the stream operators is constexpr (C++17: std::array
+ *      is constexpr there), so constant vectors and matrices are built at
+ *      compile time
+ *      4-element vectors of float and double are 16-byte aligned, so that
+ *      the SIMD kernels (end of the file, and of Mat.h) load whole SSE
+ *      registers (std::vector storage is only 16-byte aligned before C++17,
+ *      so the 32-byte AVX loads are the unaligned ones)
  */
+template <size_t N, class Num>
+struct vec_align {
+    static constexpr size_t value {alignof(std::array<Num, N>)};
+};
+template <>
+struct vec_align<4, float> { static constexpr size_t value {16}; };
+template <>
+struct vec_align<4, double> { static constexpr size_t value {16}; };
+
 template <size_t N, class Num>
 class Vec {
-    std::array<Num, N> A_;
+    alignas(vec_align<N, Num>::value) std::array<Num, N> A_;
 public:
     // ctors
-    Vec(const Num& = 0); // fill array with one value
+    constexpr Vec(const Num& = 0); // fill array with one value
     constexpr Vec(const std::array<Num, N>&); // init from std::array
-    Vec(const std::initializer_list<Num>&); // from initializer_list
+    constexpr Vec(const std::initializer_list<Num>&); // from initializer_list
     template <size_t M, class Comp>
-    Vec(const Vec<M, Comp>&); // templated copy ctor: e.g., double to int
+    constexpr Vec(const Vec<M, Comp>&); // templated copy ctor: double to int
     //Vec(Vec&&) = default; // some problems with move ctor
     template <size_t M, class Comp> // templated assignment operator
-    Vec& operator=(const Vec<M, Comp>&);
+    constexpr Vec& operator=(const Vec<M, Comp>&);
     ~Vec() = default;
 
     // templated compound arithemtic operators
     template <class Comp>
-    Vec& operator+=(const Comp&);
+    constexpr Vec& operator+=(const Comp&);
     template <class Comp>
-    Vec& operator+=(const Vec<N, Comp>&);
+    constexpr Vec& operator+=(const Vec<N, Comp>&);
     template <class Comp>
-    Vec& operator-=(const Comp&);
+    constexpr Vec& operator-=(const Comp&);
     template <class Comp>
-    Vec& operator-=(const Vec<N, Comp>&);
+    constexpr Vec& operator-=(const Vec<N, Comp>&);
     template <class Comp>
-    Vec& operator*=(const Comp&);
+    constexpr Vec& operator*=(const Comp&);
     template <class Comp>
-    Vec& operator/=(const Comp&);
+    constexpr Vec& operator/=(const Comp&);
 
     // iterators: using in loops (for (auto a: v))
     using iterator = typename std::array<Num, N>::iterator;
     using const_iterator = typename std::array<Num, N>::const_iterator;
-    iterator begin() { return A_.begin(); }
-    const_iterator begin() const { return A_.begin(); }
-    const_iterator cbegin() const { return A_.cbegin(); }
-    iterator end() { return A_.end(); }
-    const_iterator end() const { return A_.end(); }
-    const_iterator cend() const { return A_.cend(); }
+    constexpr iterator begin() { return A_.begin(); }
+    constexpr const_iterator begin() const { return A_.begin(); }
+    constexpr const_iterator cbegin() const { return A_.cbegin(); }
+    constexpr iterator end() { return A_.end(); }
+    constexpr const_iterator end() const { return A_.end(); }
+    constexpr const_iterator cend() const { return A_.cend(); }
 
     // index and range-check index operators
-    Num& operator[](const size_t i) { return A_[i]; }
-    const Num& operator[](const size_t i) const { return A_[i]; }
-    Num& at(const size_t i) { return A_.at(i); }
-    const Num& at(const size_t i) const { return A_.at(i); }
-
-    Num& x() { return A_[0]; }
-    const Num& x() const { return A_[0]; }
-    Num& y() { return A_[1]; }
-    const Num& y() const { return A_[1]; }
-    Num& z() { return A_[2]; }
-    const Num& z() const { return A_[2]; }
+    constexpr Num& operator[](const size_t i) { return A_[i]; }
+    constexpr const Num& operator[](const size_t i) const { return A_[i]; }
+    constexpr Num& at(const size_t i) { return A_.at(i); }
+    constexpr const Num& at(const size_t i) const { return A_.at(i); }
+
+    constexpr Num& x() { return A_[0]; }
+    constexpr const Num& x() const { return A_[0]; }
+    constexpr Num& y() { return A_[1]; }
+    constexpr const Num& y() const { return A_[1]; }
+    constexpr Num& z() { return A_[2]; }
+    constexpr const Num& z() const { return A_[2]; }
 
     // default value for w is 1, so assuming we use Vec for points
     //Num w() { return N > 3 ? A_[3] : N > 2 ? A_[2]; }
@@ -79,13 +174,13 @@ public:
     //const Num w() const {  return N > 3 ? A_[3] : N > 2 ? A_[2] : 1; }
 
     constexpr size_t size() const { return N; }
-    constexpr std::array<Num, N>& values() const { return A_; }
+    constexpr const std::array<Num, N>& values() const { return A_; }
 
     // methods concerning normalization
-    double norm() const { return std::sqrt((*this) * (*this)); }
+    constexpr double norm() const { return vec_sqrt((*this) * (*this)); }
     //Vec& normalize() { *this /= norm(); return *this; }
-    Vec& normalize() { return *this /= norm(); }
-    const Vec normalize() const { return *this / norm(); }
+    constexpr Vec& normalize() { return *this /= norm(); }
+    constexpr const Vec normalize() const { return *this / norm(); }
     //double norm() const;
     //Vec normalize();
     //const Vec normalize() const;
@@ -95,24 +190,26 @@ public:
  * ------------------ Vec ctors and operators ------------------
  */
 template <size_t N, class Num>
-Vec<N, Num>::Vec(const Num& val): A_() { A_.fill(val); }
+constexpr Vec<N, Num>::Vec(const Num& val): A_() {
+    for (auto &a: A_) a = val;
+}
 
 template <size_t N, class Num>
 constexpr Vec<N, Num>::Vec(const std::array<Num, N> &A): A_(A) { }
 
 template <size_t N, class Num>
-Vec<N, Num>::Vec(const std::initializer_list<Num> &IL): A_() {
+constexpr Vec<N, Num>::Vec(const std::initializer_list<Num> &IL): A_() {
     auto iter = std::begin(IL);
     for (size_t i {0}; i < std::min(N, IL.size()); ++i, ++iter) A_[i] = *iter;
 }
 
 template <size_t N, class Num> template <size_t M, class Comp>
-Vec<N, Num>::Vec(const Vec<M, Comp> &o): A_() {
+constexpr Vec<N, Num>::Vec(const Vec<M, Comp> &o): A_() {
     for (auto i = std::min(N, M); i--; A_[i] = o[i]) { }
 }
 
 template <size_t N, class Num> template <size_t M, class Comp>
-Vec<N, Num>& Vec<N, Num>::operator=(const Vec<M, Comp> &o) {
+constexpr Vec<N, Num>& Vec<N, Num>::operator=(const Vec<M, Comp> &o) {
     for (auto i = std::min(N, M); i--; A_[i] = o[i]) { }
     return *this;
 }
@@ -136,16 +233,18 @@ std::ostream& operator<<(std::ostream &os, const Vec<N, Num> &v) {
  * precision issues
 */
 template <size_t N, class Num, size_t M, class Comp>
-inline bool operator==(const Vec<N, Num> &v1, const Vec<M, Comp> &v2) {
+constexpr bool operator==(const Vec<N, Num> &v1, const Vec<M, Comp> &v2) {
     if (M != N) return false;
-    for (size_t i {0}; i < N; ++i)
-        if (std::abs(v1[i] - v2[i]) > 1E-14) return false;
+    for (size_t i {0}; i < N; ++i) {
+        const auto d = v1[i] - v2[i];
+        if ((d < 0 ? -d : d) > 1E-14) return false;
+    }
         //if (v1[i] != v2[i]) return false;
     return true;
 }
 
 template <size_t N, class Num, size_t M, class Comp>
-inline bool operator!=(const Vec<N, Num> &v1, const Vec<M, Comp> &v2) {
+constexpr bool operator!=(const Vec<N, Num> &v1, const Vec<M, Comp> &v2) {
     return !(v1 == v2);
 }
 
@@ -154,42 +253,42 @@ inline bool operator!=(const Vec<N, Num> &v1, const Vec<M, Comp> &v2) {
  */
 // sum assignment: add a value to a vector
 template <size_t N, class Num> template <class Comp>
-inline Vec<N, Num>& Vec<N, Num>::operator+=(const Comp &rhs) {
+constexpr Vec<N, Num>& Vec<N, Num>::operator+=(const Comp &rhs) {
     for (auto &a: A_) a += rhs;
     return *this;
 }
 
 // sum assignment: add a vector to a vector
 template <size_t N, class Num> template <class Comp>
-inline Vec<N, Num>& Vec<N, Num>::operator+=(const Vec<N, Comp> &rhs) {
+constexpr Vec<N, Num>& Vec<N, Num>::operator+=(const Vec<N, Comp> &rhs) {
     for (auto i = N; i--; A_[i] += rhs[i]) { }
     return *this;
 }
 
 // difference assignment: subtract a value from a vector
 template <size_t N, class Num> template <class Comp>
-inline Vec<N, Num>& Vec<N, Num>::operator-=(const Comp &rhs) {
+constexpr Vec<N, Num>& Vec<N, Num>::operator-=(const Comp &rhs) {
     for (auto &a: A_) a -= rhs;
     return *this;
 }
 
 // difference assignment: subtract a vector from a vector
 template <size_t N, class Num> template <class Comp>
-inline Vec<N, Num>& Vec<N, Num>::operator-=(const Vec<N, Comp> &rhs) {
+constexpr Vec<N, Num>& Vec<N, Num>::operator-=(const Vec<N, Comp> &rhs) {
     for (auto i = N; i--; A_[i] -= rhs[i]) { }
     return *this;
 }
 
 // multiply a vector by a value
 template <size_t N, class Num> template <class Comp>
-inline Vec<N, Num>& Vec<N, Num>::operator*=(const Comp &rhs) {
+constexpr Vec<N, Num>& Vec<N, Num>::operator*=(const Comp &rhs) {
     for (auto &a: A_) a *= rhs;
     return *this;
 }
 
 // divide a vector by a value
 template <size_t N, class Num> template <class Comp>
-inline Vec<N, Num>& Vec<N, Num>::operator/=(const Comp &rhs) {
+constexpr Vec<N, Num>& Vec<N, Num>::operator/=(const Comp &rhs) {
     for (auto &a: A_) a /= rhs;
     return *this;
 }
@@ -199,55 +298,55 @@ inline Vec<N, Num>& Vec<N, Num>::operator/=(const Comp &rhs) {
  */
 // sum of two vectors
 template <size_t N, class Num, class Comp>
-inline Vec<N, class std::common_type<Num, Comp>::type> operator+(
+constexpr Vec<N, typename std::common_type<Num, Comp>::type> operator+(
         const Vec<N, Num> &lhs, const Vec<N, Comp> &rhs) {
-    Vec<N, class std::common_type<Num, Comp>::type> res {lhs};
+    Vec<N, typename std::common_type<Num, Comp>::type> res {lhs};
     return res += rhs;
 }
 
 // add a value to a vector
 template <size_t N, class Num, class Comp>
-inline Vec<N, class std::common_type<Num, Comp>::type> operator+(
+constexpr Vec<N, typename std::common_type<Num, Comp>::type> operator+(
         const Vec<N, Num> &lhs, const Comp &rhs) {
-    Vec<N, class std::common_type<Num, Comp>::type> res {lhs};
+    Vec<N, typename std::common_type<Num, Comp>::type> res {lhs};
     return res += rhs;
 }
 
 // difference operation
 template <size_t N, class Num, class Comp>
-inline Vec<N, class std::common_type<Num, Comp>::type> operator-(
+constexpr Vec<N, typename std::common_type<Num, Comp>::type> operator-(
         const Vec<N, Num> &lhs, const Vec<N, Comp> &rhs) {
-    Vec<N, class std::common_type<Num, Comp>::type> res {lhs};
+    Vec<N, typename std::common_type<Num, Comp>::type> res {lhs};
     return res -= rhs;
 }
 
 // subtract a value from a vector
 template <size_t N, class Num, class Comp>
-inline Vec<N, class std::common_type<Num, Comp>::type> operator-(
+constexpr Vec<N, typename std::common_type<Num, Comp>::type> operator-(
         const Vec<N, Num> &lhs, const Comp &rhs) {
-    Vec<N, class std::common_type<Num, Comp>::type> res {lhs};
+    Vec<N, typename std::common_type<Num, Comp>::type> res {lhs};
     return res -= rhs;
 }
 
 // multiply a vector by a value
 template <size_t N, class Num, class Comp>
-inline Vec<N, class std::common_type<Num, Comp>::type> operator*(
+constexpr Vec<N, typename std::common_type<Num, Comp>::type> operator*(
         const Vec<N, Num> &lhs, const Comp &rhs) {
-    Vec<N, class std::common_type<Num, Comp>::type> res {lhs};
+    Vec<N, typename std::common_type<Num, Comp>::type> res {lhs};
     return res *= rhs;
 }
 
 // divide a vector by a value
 template <size_t N, class Num, class Comp>
-inline Vec<N, class std::common_type<Num, Comp>::type> operator/(
+constexpr Vec<N, typename std::common_type<Num, Comp>::type> operator/(
         const Vec<N, Num> &lhs, const Comp &rhs) {
-    Vec<N, class std::common_type<Num, Comp>::type> res {lhs};
+    Vec<N, typename std::common_type<Num, Comp>::type> res {lhs};
     return res /= rhs;
 }
 
 // dot product
 template <size_t N, class Num, class Comp>
-inline typename std::common_type<Num, Comp>::type operator*(
+constexpr typename std::common_type<Num, Comp>::type operator*(
         const Vec<N, Num> &lhs, const Vec<N, Comp> &rhs) {
     //return std::inner_product(std::begin(lhs), std::end(lhs), std::begin(rhs),
     //        0.0, std::plus<double>(), std::multiplies<double>());
@@ -257,7 +356,7 @@ inline typename std::common_type<Num, Comp>::type operator*(
 }
 
 template <size_t N, class Num, class Comp>
-inline typename std::common_type<Num, Comp>::type dot(
+constexpr typename std::common_type<Num, Comp>::type dot(
         const Vec<N, Num> &lhs, const Vec<N, Comp> &rhs) {
     //return std::inner_product(std::begin(lhs), std::end(lhs), std::begin(rhs),
     //        0.0, std::plus<double>(), std::multiplies<double>());
@@ -268,9 +367,9 @@ inline typename std::common_type<Num, Comp>::type dot(
 
 // cross product: we have it implemented only for 3-element vector
 template <class Num, class Comp>
-constexpr Vec<3, class std::common_type<Num, Comp>::type> operator^(
+constexpr Vec<3, typename std::common_type<Num, Comp>::type> operator^(
         const Vec<3, Num> &lhs, const Vec<3, Comp> &rhs) {
-    return std::array<class std::common_type<Num, Comp>::type, 3> {
+    return std::array<typename std::common_type<Num, Comp>::type, 3> {
         lhs[1] * rhs[2] - lhs[2] * rhs[1], // y * z - z * y
         lhs[2] * rhs[0] - lhs[0] * rhs[2], // z * x - x * z
         lhs[0] * rhs[1] - lhs[1] * rhs[0], // x * y - y * x
@@ -278,9 +377,9 @@ constexpr Vec<3, class std::common_type<Num, Comp>::type> operator^(
 }
 
 template <class Num, class Comp>
-constexpr Vec<3, class std::common_type<Num, Comp>::type> cross(
+constexpr Vec<3, typename std::common_type<Num, Comp>::type> cross(
         const Vec<3, Num> &lhs, const Vec<3, Comp> &rhs) {
-    return std::array<class std::common_type<Num, Comp>::type, 3> {
+    return std::array<typename std::common_type<Num, Comp>::type, 3> {
         lhs[1] * rhs[2] - lhs[2] * rhs[1], // y * z - z * y
         lhs[2] * rhs[0] - lhs[0] * rhs[2], // z * x - x * z
         lhs[0] * rhs[1] - lhs[1] * rhs[0], // x * y - y * x
@@ -291,7 +390,7 @@ constexpr Vec<3, class std::common_type<Num, Comp>::type> cross(
  * ------------------ Normalization stuff ------------------
  */
 template <size_t N, class Num>
-void normalize(Vec<N, Num> &v) {
+constexpr void normalize(Vec<N, Num> &v) {
     v /= v.norm();
 }
 
@@ -301,13 +400,74 @@ void normalize(Vec<N, Num> &v) {
  * trailing part of the vector
  */
 template <size_t M, size_t N, class Num>
-Vec<M, Num> resize(const Vec<N, Num> &v, const Num& fill = 1) {
+constexpr Vec<M, Num> resize(const Vec<N, Num> &v, const Num& fill = 1) {
     Vec<M, Num> res;
     for (size_t i = N; i < M; ++i)
         res[i] = fill;
-    for (size_t i = N; i--; res[i] = v[i]) { }
+    for (size_t i = std::min(M, N); i--; res[i] = v[i]) { }
     return res;
 }
 
+/*
+ * ------------------ SIMD kernels ------------------
+ * Non-template overloads for Vec<4, float> and Vec<4, double>: chosen over
+ * the templates for these exact types. The results are bit-identical to the
+ * generic loops: the products are computed in SIMD, the dot product is
+ * summed in the same order (0 + v3 + v2 + v1 + v0), and no multiply-add is
+ * fused (-std=c++17 turns the contraction off). In constant expressions the
+ * overloads call the generic templates
+ */
+#ifdef VEC_SIMD
+namespace simd {
+
+inline double dot(const Vec<4, double> &lhs, const Vec<4, double> &rhs) {
+    const __m128d lo {_mm_mul_pd(_mm_load_pd(&lhs[0]), _mm_load_pd(&rhs[0]))};
+    const __m128d hi {_mm_mul_pd(_mm_load_pd(&lhs[2]), _mm_load_pd(&rhs[2]))};
+    return 0.0 + _mm_cvtsd_f64(_mm_unpackhi_pd(hi, hi)) + _mm_cvtsd_f64(hi) +
+        _mm_cvtsd_f64(_mm_unpackhi_pd(lo, lo)) + _mm_cvtsd_f64(lo);
+}
+
+inline float dot(const Vec<4, float> &lhs, const Vec<4, float> &rhs) {
+    alignas(16) float p[4];
+    _mm_store_ps(p, _mm_mul_ps(_mm_load_ps(&lhs[0]), _mm_load_ps(&rhs[0])));
+    return 0.0f + p[3] + p[2] + p[1] + p[0];
+}
+
+// v / |v|: the division by the double norm of the generic operator/=
+inline void normalize(Vec<4, double> &v) {
+    const __m128d n {_mm_set1_pd(v.norm())};
+    _mm_store_pd(&v[0], _mm_div_pd(_mm_load_pd(&v[0]), n));
+    _mm_store_pd(&v[2], _mm_div_pd(_mm_load_pd(&v[2]), n));
+}
+
+} // namespace simd
+
+constexpr double operator*(const Vec<4, double> &lhs,
+        const Vec<4, double> &rhs) {
+    return constant_evaluated() ? operator*<4, double, double>(lhs, rhs) :
+        simd::dot(lhs, rhs);
+}
+
+constexpr double dot(const Vec<4, double> &lhs, const Vec<4, double> &rhs) {
+    return lhs * rhs;
+}
+
+constexpr float operator*(const Vec<4, float> &lhs, const Vec<4, float> &rhs) {
+    return constant_evaluated() ? operator*<4, float, float>(lhs, rhs) :
+        simd::dot(lhs, rhs);
+}
+
+constexpr float dot(const Vec<4, float> &lhs, const Vec<4, float> &rhs) {
+    return lhs * rhs;
+}
+
+constexpr void normalize(Vec<4, double> &v) {
+    if (constant_evaluated())
+        normalize<4, double>(v);
+    else
+        simd::normalize(v);
+}
+#endif
+
 #endif
 
@@ -0,0 +1,73 @@
+#include "Vertex_cache.h"
+#include "Thread_pool.h"
+#include "Profile.h"
+
+Vertex_cache::Vertex_cache(): mesh_{nullptr}, x_{}, y_{}, z_{}, w_{},
+    intensity_{} {
+}
+
+void Vertex_cache::transform(const Mesh &m, const Mat4d &Viewport,
+        const Mat4d &Proj, const Mat4d &ModelView, const Vec3d &L_dir) {
+    transform(m, Viewport, Proj, ModelView, L_dir, nullptr);
+}
+
+void Vertex_cache::transform(const Mesh &m, const Mat4d &Viewport,
+        const Mat4d &Proj, const Mat4d &ModelView, const Vec3d &L_dir,
+        Thread_pool &pool) {
+    transform(m, Viewport, Proj, ModelView, L_dir, &pool);
+}
+
+void Vertex_cache::transform(const Mesh &m, const Mat4d &Viewport,
+        const Mat4d &Proj, const Mat4d &ModelView, const Vec3d &L_dir,
+        Thread_pool *pool) {
+    PROF_SCOPE("vertex_cache");
+    mesh_ = &m;
+    const size_t n {m.num_vertices()};
+    x_.resize(n);
+    y_.resize(n);
+    z_.resize(n);
+    w_.resize(n);
+    intensity_.resize(n);
+
+    // the same product (and the same order) as in the vertex shaders
+    const Mat4d MVP {Viewport * Proj * ModelView};
+    constexpr size_t chunk {4096};
+    if (pool && n > chunk)
+        pool->run((n + chunk - 1) / chunk, [&](const size_t c) {
+            transform_range(MVP, L_dir, c * chunk,
+                    std::min(n, (c + 1) * chunk));
+        });
+    else
+        transform_range(MVP, L_dir, 0, n);
+}
+
+void Vertex_cache::transform_range(const Mat4d &M, const Vec3d &L,
+        const size_t first, const size_t last) {
+    // local copy: the loop below does not reload the matrix after the stores
+    // Mat * Vec sums the products from the last component down to the first
+    // one starting at zero: the w = 1 term of every row is a constant
+    double m[4][3], c[4];
+    for (int r {0}; r < 4; ++r) {
+        for (int k {0}; k < 3; ++k)
+            m[r][k] = M[r][k];
+        c[r] = 0.0 + M[r][3];
+    }
+    const double l2 {L[2]}, l1 {L[1]}, l0 {L[0]};
+    const float *px {mesh_->x().data()}, *py {mesh_->y().data()};
+    const float *pz {mesh_->z().data()};
+    const float *nx {mesh_->nx().data()}, *ny {mesh_->ny().data()};
+    const float *nz {mesh_->nz().data()};
+    double *ox {x_.data()}, *oy {y_.data()}, *oz {z_.data()};
+    double *ow {w_.data()}, *oi {intensity_.data()};
+    for (size_t i {first}; i < last; ++i) {
+        const double x {px[i]}, y {py[i]}, z {pz[i]};
+        ox[i] = c[0] + m[0][2] * z + m[0][1] * y + m[0][0] * x;
+        oy[i] = c[1] + m[1][2] * z + m[1][1] * y + m[1][0] * x;
+        oz[i] = c[2] + m[2][2] * z + m[2][1] * y + m[2][0] * x;
+        ow[i] = c[3] + m[3][2] * z + m[3][1] * y + m[3][0] * x;
+        const double d {0.0 + double(nz[i]) * l2 + double(ny[i]) * l1 +
+            double(nx[i]) * l0};
+        oi[i] = std::max(0.0, d);
+    }
+}
+
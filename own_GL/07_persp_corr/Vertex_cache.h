@@ -0,0 +1,79 @@
+/*
+ * Class Vertex_cache:
+ *      batched vertex stage for the compiled Mesh
+ *      The per-corner shaders compute Viewport * Proj * ModelView * vertex for
+ *      every corner of every face, i.e. two matrix products per corner, and a
+ *      vertex shared by several faces is transformed once per face. Here the
+ *      matrices are concatenated once per draw and the unique vertices of the
+ *      mesh are transformed in bulk (structure of arrays in, structure of
+ *      arrays out, optionally in parallel chunks), together with the diffuse
+ *      intensity of their normals. The shaders then pick the results up by
+ *      index (IShader::vertex(const Vertex_cache&, iface, ivert)).
+ *      The arithmetic is done in the same order as in Mat * Vec, so the
+ *      output is bit-identical to the per-corner vertex shaders
+ *
+ * Examples:
+ *      Vertex_cache vc;
+ *      vc.transform(mesh, Viewport, Proj, ModelView, L_dir, pool);
+ *      pts[j] = shader.vertex(vc, iface, j); // instead of vertex(mesh, ...)
+ */
+
+#ifndef VERTEX_CACHE_H
+#define VERTEX_CACHE_H
+
+#include "Mesh.h"
+#include "Mat.h"
+
+class Vertex_cache {
+public:
+    using Vec3d = Vec<3, double>;
+    using Vec4d = Vec<4, double>;
+    using Mat4d = Mat<4, 4, double>;
+
+    Vertex_cache();
+    Vertex_cache(const Vertex_cache&) = delete;
+    Vertex_cache& operator=(const Vertex_cache&) = delete;
+
+    ~Vertex_cache() = default;
+
+    // transform all the vertices of the mesh (the cache refers to the mesh
+    // afterwards, so the mesh has to outlive it)
+    void transform(const Mesh&, const Mat4d&, const Mat4d&, const Mat4d&,
+            const Vec3d&);
+    void transform(const Mesh&, const Mat4d&, const Mat4d&, const Mat4d&,
+            const Vec3d&, Thread_pool&);
+
+    const Mesh& mesh() const { return *mesh_; }
+    size_t size() const { return x_.size(); }
+
+    // transformed vertex and diffuse intensity of the vertex i
+    const Vec4d position(const uint32_t i) const {
+        return {x_[i], y_[i], z_[i], w_[i]};
+    }
+    double intensity(const uint32_t i) const { return intensity_[i]; }
+
+    // the same by the face corner
+    const Vec4d position(const int iface, const int ivert) const {
+        return position(mesh_->index(iface, ivert));
+    }
+    double intensity(const int iface, const int ivert) const {
+        return intensity(mesh_->index(iface, ivert));
+    }
+
+private:
+    void transform(const Mesh&, const Mat4d&, const Mat4d&, const Mat4d&,
+            const Vec3d&, Thread_pool*);
+    // transform the vertices [first, last)
+    void transform_range(const Mat4d&, const Vec3d&, const size_t,
+            const size_t);
+
+    const Mesh *mesh_;
+    aligned_vector<double> x_;
+    aligned_vector<double> y_;
+    aligned_vector<double> z_;
+    aligned_vector<double> w_;
+    aligned_vector<double> intensity_;
+};
+
+#endif
+
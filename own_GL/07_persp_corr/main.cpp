@@ -9,14 +9,81 @@
 #include "Vec.h"
 #include "Mat.h"
 #include "Shader.h"
+#include "Tiles.h"
+#include "Mesh.h"
+#include "Deferred.h"
+#include "Sequence.h"
+#include "Msaa.h"
+#include "Shadow.h"
 #include <iostream>
 #include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <random>
+#include <atomic>
+#include <stdexcept>
+#include <fstream>
+#include <sys/stat.h>
+#include <utime.h>
 
 using Vec3i = Vec<3, int>;
 using Vec3d = Vec<3, double>;
 using Vec4d = Vec<4, double>;
 using Mat4d = Mat<4, 4, double>;
 
+// the camera of the tests and the benchmarks: the head seen from Eye (by
+// default the view of test_proj) in the middle 3/4 of a w x h image
+struct Scene {
+    Vec3d L_dir, Eye, Center, Up;
+    Mat4d Viewport, ModelView, Proj;
+};
+
+constexpr Scene head_scene(const int w, const int h, const int d = 255,
+        const Vec3d &L_dir = Vec3d{1, 1, 1}.normalize(),
+        const Vec3d &Eye = Vec3d{1, 1, 3}) {
+    constexpr Vec3d Center {0, 0, 0}, Up {0, 1, 0};
+    return {L_dir, Eye, Center, Up, viewport(w >> 3, h >> 3, (w >> 2) * 3,
+        (h >> 2) * 3, d), lookat(Eye, Center, Up),
+        projection(-1.0 / (Eye - Center).norm())};
+}
+
+// the model view of the copy k of a layered scene: the head moved by k * dz
+// along the z axis of the eye
+Mat4d layer_view(const Scene &S, const int k, const double dz) {
+    Mat4d T {eye<4>()};
+    T[2][3] = dz * k;
+    return T * S.ModelView;
+}
+
+// the head drawn nlayers times (layer_view()): the screen coordinates and
+// the shader of every face, layer after layer
+void layered_scene(const Mesh &mesh, const Scene &S, const int nlayers,
+        const double dz, std::vector<Mat<3, 4, double>> &pts,
+        std::vector<Tex_shader> &shaders) {
+    const size_t nfaces {mesh.num_faces()};
+    pts.resize(nfaces * nlayers);
+    shaders.resize(nfaces * nlayers);
+    for (int k {0}; k < nlayers; ++k) {
+        Vertex_cache vc;
+        vc.transform(mesh, S.Viewport, S.Proj, layer_view(S, k, dz), S.L_dir);
+        for (size_t i {0}; i < nfaces; ++i)
+            for (int j {0}; j < 3; ++j)
+                pts[k * nfaces + i][j] = shaders[k * nfaces + i].vertex(vc,
+                        i, j);
+    }
+}
+
+// the images are the same pixel by pixel
+bool same_image(const PPM_Image &a, const PPM_Image &b) {
+    if (a.width() != b.width() || a.height() != b.height())
+        return false;
+    for (int y {0}; y < a.height(); ++y)
+        if (!std::equal(a.row(y), a.row(y) + a.width(), b.row(y)))
+            return false;
+    return true;
+}
+
 void test_proj() {
     const Model m {"../obj/african_head.obj"};
     const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
@@ -24,15 +91,7 @@ void test_proj() {
     constexpr int w {800}, h {800}, d {255};
     PPM_Image img {w, h};
 
-    Vec3d L_dir {1, 1, 1};
-    const Vec3d Eye {1, 1, 3}, Center {0, 0, 0}, Up {0, 1, 0};
-    const Mat4d Viewport {viewport(w >> 3, h >> 3, (w >> 2) * 3,
-            (h >> 2) * 3, d)};
-    const Mat4d ModelView {lookat(Eye, Center, Up)};
-    const Mat4d Proj {projection(-1.0 / (Eye - Center).norm())};
-
-    //L_dir = Proj * ModelView * resize<4>(L_dir);
-    L_dir = L_dir.normalize();
+    constexpr Scene S {head_scene(w, h, d)};
 
     std::vector<int> zbuf(w * h, 0);
     Tex_shader shader;
@@ -40,14 +99,1442 @@ void test_proj() {
     for (size_t i {0}; i < m.num_faces(); ++i) {
         Mat<3, 4, double> sc_coords;
         for (int j {0}; j < 3; ++j) {
-            sc_coords[j] = shader.vertex(m, Viewport, Proj, ModelView, L_dir,
-                    i, j);
+            sc_coords[j] = shader.vertex(m, S.Viewport, S.Proj, S.ModelView,
+                    S.L_dir, i, j);
         }
         triangle_shader(sc_coords, shader, img, tex, zbuf);
     }
     img.write_to("output.ppm");
 }
 
+// render the same scene serially and tile by tile in parallel: the images
+// have to be bit-identical
+void test_tiles(const size_t nthreads = 0, const int tile = 64) {
+    using namespace std::chrono;
+    const Model m {"../obj/african_head.obj"};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+
+    PPM_Image img {w, h};
+    std::vector<int> zbuf(w * h, 0);
+    auto t0 = steady_clock::now();
+    Tex_shader shader;
+    for (size_t i {0}; i < m.num_faces(); ++i) {
+        Mat<3, 4, double> sc_coords;
+        for (int j {0}; j < 3; ++j)
+            sc_coords[j] = shader.vertex(m, S.Viewport, S.Proj, S.ModelView,
+                    S.L_dir, i, j);
+        triangle_shader(sc_coords, shader, img, tex, zbuf);
+    }
+    const auto t_serial = duration<double, std::milli>(steady_clock::now() -
+            t0).count();
+
+    Thread_pool pool {nthreads};
+    PPM_Image img_tiled {w, h};
+    std::vector<int> zbuf_tiled(w * h, 0);
+    t0 = steady_clock::now();
+    render_tiled(m, Tex_shader{}, S.Viewport, S.Proj, S.ModelView, S.L_dir,
+            img_tiled, tex, zbuf_tiled, pool, tile);
+    const auto t_tiled = duration<double, std::milli>(steady_clock::now() -
+            t0).count();
+
+    const bool same {zbuf == zbuf_tiled && same_image(img, img_tiled)};
+    std::cout << "serial: " << t_serial << " ms, tiled (" << pool.num_threads()
+        << " threads, " << tile << "x" << tile << " tiles): " << t_tiled <<
+        " ms, images are " << (same ? "identical" : "DIFFERENT") << '\n';
+    img_tiled.write_to("output_tiled.ppm");
+}
+
+// an exception of a task reaches the caller of run() with and without the
+// workers, the other tasks still run and the pool is usable afterwards
+void test_pool_errors() {
+    bool ok {true};
+    for (const size_t nthreads: {size_t(1), size_t(4)}) {
+        Thread_pool pool {nthreads};
+        std::atomic<int> done {0};
+        bool thrown {false};
+        try {
+            pool.run(64, [&](const size_t i) {
+                if (i == 13)
+                    throw std::runtime_error("task 13");
+                ++done;
+            });
+        } catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        ok = ok && thrown && (nthreads == 1 ? done == 13 : done == 63);
+        done = 0;
+        pool.run(64, [&](const size_t) { ++done; });
+        ok = ok && done == 64;
+    }
+    std::cout << (ok ? "pool errors passed" : "pool errors FAILED") << '\n';
+}
+
+// a triangle sticking out of a narrow guard band under a strong perspective
+// (the w of the vertices 1, 4, 0.5): its clipped parts shade every pixel with
+// the varyings (here the barycentric coordinates as the color) of the whole
+// triangle rasterized without clipping
+void test_clip_varyings() {
+    struct Bar_shader {
+        bool fragment(const PPM_Image&, const Vec3d &bar, PPM_Color &C) {
+            C = PPM_Color(bar[0] * 255 + 0.5, bar[1] * 255 + 0.5,
+                    bar[2] * 255 + 0.5);
+            return false;
+        }
+    };
+    constexpr int w {400}, h {400};
+    const double ws[3] {1, 4, 0.5};
+    const double xy[3][2] {{50, 40}, {1500, 250}, {200, 390}};
+    Mat<3, 4, double> pts;
+    for (int i {0}; i < 3; ++i)
+        pts[i] = Vec4d{xy[i][0] * ws[i], xy[i][1] * ws[i], 100 * ws[i], ws[i]};
+    const PPM_Image tex {1, 1};
+    PPM_Image ref {w, h}, img {w, h};
+    std::vector<int> zref(w * h, 0), zbuf(w * h, 0);
+    Bar_shader shader;
+    triangle_shader(pts, shader, ref, tex, zref);
+    Primitive_assembly pa {w, h, Cull_mode::none, 16};
+    draw_triangle(pts, shader, img, tex, zbuf, pa);
+    // the edges ending at a clipped vertex may cover a few other pixels
+    int covered {0}, edge {0}, ndiff {0};
+    for (int y {0}; y < h; ++y)
+        for (int x {0}; x < w; ++x) {
+            const uint a {ref.row(y)[x]}, b {img.row(y)[x]};
+            covered += a != 0;
+            edge += (a != 0) != (b != 0);
+            if (a && b)
+                for (int sh {0}; sh < 24; sh += 8)
+                    ndiff += std::abs(int(a >> sh & 0xFF) -
+                            int(b >> sh & 0xFF)) > 1;
+        }
+    const bool ok {pa.stats().clipped == 1 && covered > 1000 &&
+        edge < h && ndiff == 0};
+    std::cout << covered << " pixels, " << edge << " on the edges, " <<
+        ndiff << " differ: " << (ok ? "clip varyings passed" :
+                "clip varyings FAILED") << '\n';
+}
+
+// the vertex indices of the faces: relative ones resolve to the vertices
+// before them, an index missing, past the vertices or relative past the start
+// of the list throws, serial or in chunks
+void test_obj_indices() {
+    const std::string fn {"index_test.obj"};
+    auto load = [&](const std::string &obj) {
+        std::ofstream {fn, std::ios_base::binary} << obj;
+        Thread_pool pool {2};
+        bool thrown {false};
+        for (const bool chunks: {false, true})
+            try {
+                const Model m {chunks ? Model {fn, pool} : Model {fn}};
+                if (m.num_faces() != 1 || m.face(0)[2] != 2)
+                    return -1;
+            } catch (const std::runtime_error&) {
+                thrown = true;
+            }
+        return int(thrown);
+    };
+    const std::string verts {"v 0 0 0\nv 1 0 0\nv 0 1 0\n"};
+    const bool ok {load(verts + "f 1 2 3\n") == 0 &&
+        load(verts + "f -3 -2 -1\n") == 0 && load(verts + "f 1 2 4\n") == 1 &&
+        load(verts + "f -4 -2 -1\n") == 1 && load(verts + "f 1 2 0\n") == 1 &&
+        load("f 1 2 3\n" + verts) == 0};
+    std::remove(fn.c_str());
+    std::cout << (ok ? "obj indices passed" : "obj indices FAILED") << '\n';
+}
+
+// the compiled mesh cache of a touched source: the first load hashes the
+// source and writes the cache again (a new inode) with the new time, the next
+// load maps it without hashing (the same inode)
+void test_mesh_cache() {
+    const std::string fn {"cache_test.obj"};
+    {
+        std::ifstream src {"../obj/african_head.obj", std::ios_base::binary};
+        std::ofstream dst {fn, std::ios_base::binary};
+        dst << src.rdbuf();
+    }
+    const std::string cfn {Mesh::cache_name(fn)};
+    auto inode = [&] {
+        struct stat st;
+        return stat(cfn.c_str(), &st) ? ino_t(0) : st.st_ino;
+    };
+    const Mesh first {Mesh::load(fn)};
+    const ino_t built {inode()};
+    struct stat st;
+    stat(fn.c_str(), &st);
+    const struct utimbuf later {st.st_atime, st.st_mtime + 10};
+    utime(fn.c_str(), &later);
+    const Mesh touched {Mesh::load(fn)};
+    const ino_t resaved {inode()};
+    const Mesh again {Mesh::load(fn)};
+    const bool ok {touched.mapped() && again.mapped() && built != resaved &&
+        inode() == resaved && again.memory() == first.memory() &&
+        !memcmp(again.x().data(), first.x().data(), first.memory())};
+    std::remove(cfn.c_str());
+    std::remove(fn.c_str());
+    std::cout << (ok ? "mesh cache passed" : "mesh cache FAILED") << '\n';
+}
+
+// compile the model into the indexed structure-of-arrays mesh and render it:
+// the image should be (almost: float positions) the same as for the model
+void test_mesh() {
+    const Model m {"../obj/african_head.obj"};
+    const Mesh mesh {m};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+    const size_t model_mem {(m.num_vertices() + m.num_normals() +
+            m.num_texvertices()) * sizeof(Vec3d) + m.num_faces() *
+        sizeof(Facet)};
+    std::cout << "model: " << m.num_vertices() << " vertices, " <<
+        m.num_faces() << " faces, " << model_mem << " bytes\n" <<
+        "mesh: " << mesh.num_vertices() << " unique vertices, " <<
+        mesh.num_faces() << " faces, " << mesh.memory() << " bytes\n";
+
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+
+    Thread_pool pool {};
+    PPM_Image img_model {w, h}, img_mesh {w, h};
+    std::vector<int> zbuf_model(w * h, 0), zbuf_mesh(w * h, 0);
+    render_tiled(m, Tex_shader{}, S.Viewport, S.Proj, S.ModelView, S.L_dir,
+            img_model, tex, zbuf_model, pool);
+    render_tiled(mesh, Tex_shader{}, S.Viewport, S.Proj, S.ModelView, S.L_dir,
+            img_mesh, tex, zbuf_mesh, pool);
+    int ndiff {0};
+    for (int y {0}; y < h; ++y)
+        for (int x {0}; x < w; ++x)
+            ndiff += img_model.row(y)[x] != img_mesh.row(y)[x];
+    std::cout << ndiff << " pixels differ from the model rendering\n";
+    img_mesh.write_to("output_mesh.ppm");
+}
+
+// OBJ loading throughput: old stream reader, mmap reader (serial) and mmap
+// reader with parallel chunks; the models have to be the same
+void bench_obj_load(const std::string &fn = "../obj/african_head.obj",
+        const int reps = 20) {
+    using namespace std::chrono;
+    std::ifstream ifs {fn, std::ios_base::binary | std::ios_base::ate};
+    const double mb = ifs.tellg() / 1048576.0;
+    Thread_pool pool {};
+    const Model ref {fn};
+    auto same_as_ref = [&ref](const Model &m) {
+        if (m.num_vertices() != ref.num_vertices() ||
+                m.num_faces() != ref.num_faces() ||
+                m.num_normals() != ref.num_normals() ||
+                m.num_texvertices() != ref.num_texvertices())
+            return false;
+        for (size_t i {0}; i < m.num_vertices(); ++i)
+            if (m.vertex(i) != ref.vertex(i)) return false;
+        for (size_t i {0}; i < m.num_faces(); ++i)
+            for (int j {0}; j < 3; ++j)
+                for (int k {0}; k < 3; ++k)
+                    if (m.facet(i)[j][k] != ref.facet(i)[j][k]) return false;
+        return true;
+    };
+    for (int mode {0}; mode < 3; ++mode) {
+        double t {0};
+        bool same {true};
+        for (int r {0}; r < reps; ++r) {
+            const auto t0 = steady_clock::now();
+            if (mode == 0) {
+                std::ifstream is {fn};
+                const Model m {is};
+                t += duration<double>(steady_clock::now() - t0).count();
+                same = same && same_as_ref(m);
+            } else {
+                const Model m = mode == 1 ? Model{fn} : Model{fn, pool};
+                t += duration<double>(steady_clock::now() - t0).count();
+                same = same && same_as_ref(m);
+            }
+        }
+        const char *name[] {"stream", "mmap", "mmap parallel"};
+        std::cout << name[mode] << ": " << mb * reps / t << " MB/s" <<
+            (same ? "" : " (the model differs)") << '\n';
+    }
+}
+
+// startup cost of the compiled mesh: parsing the OBJ and writing the cache
+// (first run) versus mapping the cache (later runs); the meshes have to be
+// the same
+void bench_mesh_cache(const std::string &fn = "../obj/african_head.obj",
+        const int reps = 20) {
+    using namespace std::chrono;
+    std::remove(Mesh::cache_name(fn).c_str());
+    auto t0 = steady_clock::now();
+    const Mesh ref {Mesh::load(fn)};
+    const double t_parse {duration<double>(steady_clock::now() - t0).count()};
+    double t_cache {0};
+    bool same {true};
+    for (int r {0}; r < reps; ++r) {
+        t0 = steady_clock::now();
+        const Mesh m {Mesh::load(fn)};
+        t_cache += duration<double>(steady_clock::now() - t0).count();
+        same = same && m.mapped() && m.memory() == ref.memory() &&
+            !memcmp(m.x().data(), ref.x().data(), ref.memory());
+    }
+    std::cout << "mesh parse + cache write: " << t_parse * 1e3 << " ms\n" <<
+        "mesh cache map: " << t_cache * 1e3 / reps << " ms" <<
+        (same ? "" : " (the mesh differs)") << '\n';
+}
+
+// vertex stage throughput (face corners per second) of the compiled mesh:
+// per-corner vertex shader versus the batched Vertex_cache (serial and with
+// the pool); the transformed corners have to be the same
+void bench_vertex(const int reps = 50) {
+    using namespace std::chrono;
+    const Mesh mesh {Mesh::load("../obj/african_head.obj")};
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+
+    const size_t nfaces {mesh.num_faces()};
+    std::vector<Mat<3, 4, double>> ref(nfaces), pts(nfaces);
+    std::vector<Tex_shader> shaders(nfaces);
+    Thread_pool pool {};
+    for (int mode {0}; mode < 3; ++mode) {
+        double t {0};
+        for (int r {0}; r < reps; ++r) {
+            const auto t0 = steady_clock::now();
+            if (mode == 0) {
+                for (size_t i {0}; i < nfaces; ++i)
+                    for (int j {0}; j < 3; ++j)
+                        ref[i][j] = shaders[i].vertex(mesh, S.Viewport, S.Proj,
+                                S.ModelView, S.L_dir, i, j);
+            } else {
+                Vertex_cache vc;
+                if (mode == 1)
+                    vc.transform(mesh, S.Viewport, S.Proj, S.ModelView,
+                            S.L_dir);
+                else
+                    vc.transform(mesh, S.Viewport, S.Proj, S.ModelView, S.L_dir,
+                            pool);
+                for (size_t i {0}; i < nfaces; ++i)
+                    for (int j {0}; j < 3; ++j)
+                        pts[i][j] = shaders[i].vertex(vc, i, j);
+            }
+            t += duration<double>(steady_clock::now() - t0).count();
+        }
+        bool same {true};
+        for (size_t i {0}; mode && i < nfaces; ++i)
+            for (int j {0}; j < 3; ++j)
+                for (int k {0}; k < 4; ++k) // exact, unlike Vec::operator==
+                    same = same && pts[i][j][k] == ref[i][j][k];
+        const char *name[] {"per corner", "batched", "batched parallel"};
+        std::cout << name[mode] << ": " << nfaces * 3 * reps / t * 1E-6 <<
+            " Mcorners/s" << (same ? "" : " (the corners differ)") << '\n';
+    }
+}
+
+// rasterization throughput of the african head scene for every raster path:
+// covered pixels (fragments) per second, checking the images are the same
+void bench_raster(const int reps = 20) {
+    using namespace std::chrono;
+    const Model m {"../obj/african_head.obj"};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+
+    // the vertex stage is done once: only the rasterization is measured
+    const size_t nfaces {m.num_faces()};
+    std::vector<Mat<3, 4, double>> pts(nfaces);
+    std::vector<Tex_shader> shaders(nfaces);
+    size_t nfrags {0};
+    for (size_t i {0}; i < nfaces; ++i) {
+        Mat<3, 2, double> pts2;
+        for (int j {0}; j < 3; ++j) {
+            pts[i][j] = shaders[i].vertex(m, S.Viewport, S.Proj, S.ModelView,
+                    S.L_dir, i, j);
+            pts2[j] = pts[i][j] / pts[i][j][3];
+        }
+        for_each_covered(Edge_tri{pts2[0], pts2[1], pts2[2]},
+                bounding_box(pts2, w, h),
+                [&](int, int, int, int) { ++nfrags; });
+    }
+
+    const Raster_path saved {raster_path()};
+    PPM_Image ref {};
+    for (const auto p: {Raster_path::baryc, Raster_path::scalar,
+            Raster_path::sse2, Raster_path::avx2}) {
+        if (!raster_path_supported(p))
+            continue;
+        set_raster_path(p);
+        PPM_Image img {w, h};
+        double t {0};
+        for (int r {0}; r < reps; ++r) {
+            img = PPM_Image{w, h};
+            std::vector<int> zbuf(w * h, 0);
+            const auto t0 = steady_clock::now();
+            for (size_t i {0}; i < nfaces; ++i)
+                triangle_shader(pts[i], shaders[i], img, tex, zbuf);
+            t += duration<double>(steady_clock::now() - t0).count();
+        }
+        if (p == Raster_path::baryc)
+            ref = img;
+        const bool same {same_image(img, ref)};
+        std::cout << raster_path_name(p) << ": " << nfrags * reps / t * 1E-6 <<
+            " Mpixels/s, " << t / reps * 1E3 << " ms per frame" <<
+            (same ? "" : " (image differs from baryc)") << '\n';
+    }
+    set_raster_path(saved);
+}
+
+// fragment throughput of the templated (inlined) and of the virtual (IShader
+// reference) triangle_shader route for the shader; the images are the same
+template <class Shader>
+void bench_dispatch(const std::string &name, const int reps = 20) {
+    using namespace std::chrono;
+    const Model m {"../obj/african_head.obj"};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+
+    const size_t nfaces {m.num_faces()};
+    std::vector<Mat<3, 4, double>> pts(nfaces);
+    std::vector<Shader> shaders(nfaces);
+    size_t nfrags {0};
+    for (size_t i {0}; i < nfaces; ++i) {
+        Mat<3, 2, double> pts2;
+        for (int j {0}; j < 3; ++j) {
+            pts[i][j] = shaders[i].vertex(m, S.Viewport, S.Proj, S.ModelView,
+                    S.L_dir, i, j);
+            pts2[j] = pts[i][j] / pts[i][j][3];
+        }
+        for_each_covered(Edge_tri{pts2[0], pts2[1], pts2[2]},
+                bounding_box(pts2, w, h),
+                [&](int, int, int, int) { ++nfrags; });
+    }
+
+    PPM_Image img[2] {{w, h}, {w, h}};
+    for (int virt {0}; virt < 2; ++virt) {
+        double t {0};
+        for (int r {0}; r < reps; ++r) {
+            img[virt] = PPM_Image{w, h};
+            std::vector<int> zbuf(w * h, 0);
+            const auto t0 = steady_clock::now();
+            for (size_t i {0}; i < nfaces; ++i)
+                if (virt)
+                    triangle_shader(pts[i], static_cast<IShader&>(shaders[i]),
+                            img[virt], tex, zbuf);
+                else
+                    triangle_shader(pts[i], shaders[i], img[virt], tex, zbuf);
+            t += duration<double>(steady_clock::now() - t0).count();
+        }
+        const bool same {same_image(img[virt], img[0])};
+        std::cout << name << (virt ? " virtual: " : " templated: ") <<
+            nfrags * reps / t * 1E-6 << " Mfragments/s" <<
+            (same ? "" : " (image differs)") << '\n';
+    }
+}
+
+// hierarchical z-buffer on a scene with heavy overdraw: the head is drawn
+// nlayers times, every copy a bit further from the camera (front to back);
+// plain z-buffer versus Depth_buffer (8 and 24 bits), serial and tiled. The
+// 8-bit Depth_buffer has to give the same image as the plain z-buffer
+void bench_hiz(const int nlayers = 8, const int reps = 5) {
+    using namespace std::chrono;
+    const Mesh mesh {Mesh::load("../obj/african_head.obj")};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+
+    std::vector<Mat<3, 4, double>> pts;
+    std::vector<Tex_shader> shaders;
+    layered_scene(mesh, S, nlayers, -0.1, pts, shaders);
+
+    PPM_Image ref {w, h};
+    double t {0};
+    for (int r {0}; r < reps; ++r) {
+        ref = PPM_Image{w, h};
+        std::vector<int> zbuf(w * h, 0);
+        const auto t0 = steady_clock::now();
+        for (size_t i {0}; i < pts.size(); ++i)
+            triangle_shader(pts[i], shaders[i], ref, tex, zbuf);
+        t += duration<double>(steady_clock::now() - t0).count();
+    }
+    std::cout << "plain z-buffer: " << t / reps * 1E3 << " ms per frame\n";
+
+    for (const int bits: {8, 24}) {
+        PPM_Image img {w, h};
+        Depth_buffer zbuf {w, h, bits, d};
+        t = 0;
+        for (int r {0}; r < reps; ++r) {
+            img = PPM_Image{w, h};
+            zbuf.clear();
+            const auto t0 = steady_clock::now();
+            for (size_t i {0}; i < pts.size(); ++i)
+                triangle_shader(pts[i], shaders[i], img, tex, zbuf);
+            t += duration<double>(steady_clock::now() - t0).count();
+        }
+        const Depth_stats st {zbuf.stats()};
+        const bool same {same_image(img, ref)};
+        std::cout << bits << "-bit hierarchical: " << t / reps * 1E3 <<
+            " ms per frame, " << st.tested << " fragments tested, " <<
+            st.shaded << " shaded, overdraw " << st.overdraw() << ", " <<
+            st.tri_rejected << " triangles and " << st.blk_rejected <<
+            " blocks rejected" << (bits == 8 && !same ?
+                    " (image differs from the plain z-buffer)" : "") << '\n';
+    }
+
+    // tiled rendering through the hierarchical z-buffer: the same image
+    Thread_pool pool {};
+    PPM_Image img {w, h};
+    Depth_buffer zbuf {w, h};
+    const auto t0 = steady_clock::now();
+    for (int k {0}; k < nlayers; ++k)
+        render_tiled(mesh, Tex_shader{}, S.Viewport, S.Proj,
+                layer_view(S, k, -0.1), S.L_dir, img, tex, zbuf, pool);
+    t = duration<double>(steady_clock::now() - t0).count();
+    const bool same {same_image(img, ref)};
+    std::cout << "tiled 8-bit hierarchical: " << t * 1E3 << " ms per frame" <<
+        (same ? "" : " (image differs from the plain z-buffer)") << '\n';
+}
+
+// primitive assembly: the head scene without and with back-face culling
+// (time, counters and the number of pixels which differ), then a close-up
+// with the eye inside the head bounding box, which needs near-plane clipping
+void bench_assembly(const int reps = 20) {
+    using namespace std::chrono;
+    const Mesh mesh {Mesh::load("../obj/african_head.obj")};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+    // the eye inside the bounding box of the head
+    constexpr Scene closeup {head_scene(w, h, d, S.L_dir,
+            Vec3d{0.1, 0.1, 0.35})};
+    auto print = [](const Assembly_stats &st) {
+        std::cout << st.triangles << " triangles, " << st.back_culled <<
+            " back-facing, " << st.frustum_culled << " outside, " <<
+            st.clipped << " clipped, " << st.emitted << " rasterized";
+    };
+
+    const size_t nfaces {mesh.num_faces()};
+    std::vector<Mat<3, 4, double>> pts(nfaces);
+    std::vector<Tex_shader> shaders(nfaces);
+    auto vertex_stage = [&](const Scene &V) {
+        Vertex_cache vc;
+        vc.transform(mesh, V.Viewport, V.Proj, V.ModelView, V.L_dir);
+        for (size_t i {0}; i < nfaces; ++i)
+            for (int j {0}; j < 3; ++j)
+                pts[i][j] = shaders[i].vertex(vc, i, j);
+    };
+
+    vertex_stage(S);
+    PPM_Image ref {w, h}, img {w, h};
+    Primitive_assembly pa {w, h};
+    double t[2] {0, 0};
+    for (int r {0}; r < reps; ++r) {
+        ref = PPM_Image{w, h};
+        img = PPM_Image{w, h};
+        std::vector<int> zref(w * h, 0), zbuf(w * h, 0);
+        auto t0 = steady_clock::now();
+        for (size_t i {0}; i < nfaces; ++i)
+            triangle_shader(pts[i], shaders[i], ref, tex, zref);
+        t[0] += duration<double>(steady_clock::now() - t0).count();
+        pa.reset_stats();
+        t0 = steady_clock::now();
+        for (size_t i {0}; i < nfaces; ++i)
+            draw_triangle(pts[i], shaders[i], img, tex, zbuf, pa);
+        t[1] += duration<double>(steady_clock::now() - t0).count();
+    }
+    int ndiff {0};
+    for (int y {0}; y < h; ++y)
+        for (int x {0}; x < w; ++x)
+            ndiff += img.row(y)[x] != ref.row(y)[x];
+    std::cout << "no assembly: " << t[0] / reps * 1E3 << " ms per frame\n" <<
+        "back-face culling: " << t[1] / reps * 1E3 << " ms per frame, ";
+    print(pa.stats());
+    std::cout << ", " << ndiff << " pixels differ\n";
+
+    vertex_stage(closeup);
+    img = PPM_Image{w, h};
+    std::vector<int> zbuf(w * h, 0);
+    pa.reset_stats();
+    for (size_t i {0}; i < nfaces; ++i)
+        draw_triangle(pts[i], shaders[i], img, tex, zbuf, pa);
+    std::cout << "close-up: ";
+    print(pa.stats());
+
+    // the same through the tiled renderer
+    Thread_pool pool {};
+    PPM_Image img_tiled {w, h};
+    std::vector<int> zbuf_tiled(w * h, 0);
+    render_tiled(mesh, Tex_shader{}, closeup.Viewport, closeup.Proj,
+            closeup.ModelView, closeup.L_dir, img_tiled, tex, zbuf_tiled,
+            pool, 64, &pa);
+    const bool same {same_image(img, img_tiled)};
+    std::cout << (same ? "" : " (tiled image differs)") << '\n';
+    img.write_to("closeup.ppm");
+}
+
+// deferred versus forward shading with heavy overdraw: nlayers copies of the
+// head drawn back to front (every copy nearer to the camera than the previous
+// one); the images have to be the same
+void bench_deferred(const int nlayers = 8, const int reps = 5) {
+    using namespace std::chrono;
+    const Mesh mesh {Mesh::load("../obj/african_head.obj")};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+
+    std::vector<Mat<3, 4, double>> pts;
+    std::vector<Tex_shader> shaders;
+    layered_scene(mesh, S, nlayers, 0.1, pts, shaders);
+
+    PPM_Image ref {w, h};
+    double t {0};
+    for (int r {0}; r < reps; ++r) {
+        ref = PPM_Image{w, h};
+        std::vector<int> zbuf(w * h, 0);
+        const auto t0 = steady_clock::now();
+        for (size_t i {0}; i < pts.size(); ++i)
+            triangle_shader(pts[i], shaders[i], ref, tex, zbuf);
+        t += duration<double>(steady_clock::now() - t0).count();
+    }
+    std::cout << "forward: " << t / reps * 1E3 << " ms per frame\n";
+
+    G_buffer gbuf {w, h};
+    std::vector<size_t> threads {1};
+    if (std::thread::hardware_concurrency() > 1)
+        threads.push_back(0);
+    for (const size_t nthreads: threads) {
+        Thread_pool pool {nthreads};
+        PPM_Image img {w, h};
+        t = 0;
+        for (int r {0}; r < reps; ++r) {
+            img = PPM_Image{w, h};
+            std::vector<int> zbuf(w * h, 0);
+            const auto t0 = steady_clock::now();
+            gbuf.rasterize(pts, zbuf, pool);
+            gbuf.shade(shaders, img, tex, pool);
+            t += duration<double>(steady_clock::now() - t0).count();
+        }
+        const bool same {same_image(img, ref)};
+        const Deferred_stats st {gbuf.stats()};
+        std::cout << "deferred (" << pool.num_threads() << " threads): " <<
+            t / reps * 1E3 << " ms per frame, " << st.fragments <<
+            " fragments, " << st.pixels << " pixels shaded, overdraw " <<
+            st.overdraw() << (same ? "" : " (image differs from forward)") <<
+            '\n';
+    }
+}
+
+// frames per second of a turntable with the frames written in the background:
+// with a single framebuffer the rendering waits for the encoding of the
+// previous frame, with more it waits only if the writer falls behind; without
+// a file prefix only the encoding is done
+void bench_sequence(const int nframes = 60) {
+    const Mesh mesh {Mesh::load("../obj/african_head.obj")};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+    constexpr Vec3d L_dir {Vec3d{1, 1, 1}.normalize()};
+    Thread_pool pool {};
+    const std::vector<Camera> path {orbit({0, 0, 0}, std::sqrt(10.0), 1,
+            nframes)};
+    struct Run {
+        size_t nbuffers;
+        const char *prefix;
+    };
+    for (const Run &r: {Run{1, ""}, Run{3, ""}, Run{1, "bench_"},
+            Run{3, "bench_"}}) {
+        std::cout << "sequence, " << r.nbuffers << " framebuffer(s)" <<
+            (*r.prefix ? ", written: " : ", encoded only: ") <<
+            render_sequence(mesh, Tex_shader{}, tex, path, L_dir, 800, 800,
+                    r.prefix, pool, r.nbuffers);
+    }
+}
+
+// Tex_shader counting its invocations
+struct Counted_tex_shader {
+    Tex_shader shader;
+    size_t *count;
+
+    bool fragment(const PPM_Image &tex, const Vec3d &bar, PPM_Color &C) {
+        ++*count;
+        return shader.fragment(tex, bar, C);
+    }
+};
+
+// the head of test_proj rendered at s times the resolution (with the
+// z-buffer of the same size) and box filtered down: s = 1 is the image
+// without anti-aliasing, s = 2 the 4x SSAA
+PPM_Image ssaa_head(const Model &m, const PPM_Image &tex, const int s,
+        size_t &frags) {
+    constexpr int w {800}, h {800}, d {255};
+    const int sw {w * s}, sh {h * s};
+    const Scene S {head_scene(sw, sh, d)};
+    PPM_Image big {sw, sh};
+    std::vector<int> zbuf(size_t(sw) * sh, 0);
+    Counted_tex_shader cs {Tex_shader{}, &frags};
+    for (size_t i {0}; i < m.num_faces(); ++i) {
+        Mat<3, 4, double> pts;
+        for (int j {0}; j < 3; ++j)
+            pts[j] = cs.shader.vertex(m, S.Viewport, S.Proj, S.ModelView,
+                    S.L_dir, i, j);
+        triangle_shader(pts, cs, big, tex, zbuf);
+    }
+    if (s == 1)
+        return big;
+    PPM_Image img {w, h};
+    const uint n = s * s;
+    for (int y {0}; y < h; ++y)
+        for (int x {0}; x < w; ++x) {
+            uint r {0}, g {0}, b {0};
+            for (int j {0}; j < s; ++j)
+                for (const uint c: Span<const uint>{big.row(y * s + j) +
+                        x * s, size_t(s)}) {
+                    r += c >> 16 & 0xff;
+                    g += c >> 8 & 0xff;
+                    b += c & 0xff;
+                }
+            img.row(y)[x] = (r + n / 2) / n << 16 | (g + n / 2) / n << 8 |
+                (b + n / 2) / n;
+        }
+    return img;
+}
+
+// the same with n-sample MSAA
+PPM_Image msaa_head(const Model &m, const PPM_Image &tex, Msaa_buffer &ms,
+        size_t &frags) {
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+    ms.clear();
+    Counted_tex_shader cs {Tex_shader{}, &frags};
+    for (size_t i {0}; i < m.num_faces(); ++i) {
+        Mat<3, 4, double> pts;
+        for (int j {0}; j < 3; ++j)
+            pts[j] = cs.shader.vertex(m, S.Viewport, S.Proj, S.ModelView,
+                    S.L_dir, i, j);
+        triangle_shader_msaa(pts, cs, tex, ms);
+    }
+    PPM_Image img {w, h};
+    ms.resolve(img);
+    return img;
+}
+
+// PSNR (dB) of the image against the reference
+double psnr(const PPM_Image &img, const PPM_Image &ref) {
+    double se {0};
+    for (int y {0}; y < ref.height(); ++y)
+        for (int x {0}; x < ref.width(); ++x)
+            for (int s {0}; s <= 16; s += 8) {
+                const int c {int(img.row(y)[x] >> s & 0xff) -
+                    int(ref.row(y)[x] >> s & 0xff)};
+                se += c * c;
+            }
+    const double mse {se / (3.0 * ref.width() * ref.height())};
+    return mse > 0 ? 10 * std::log10(255 * 255 / mse) : 99;
+}
+
+// MSAA 2x/4x/8x against the 4x SSAA and no anti-aliasing: frame time,
+// fragment shader invocations, memory of the buffers and the PSNR against a
+// 16x SSAA (4x4) reference
+void bench_msaa(const int reps = 5) {
+    using namespace std::chrono;
+    const Model m {"../obj/african_head.obj"};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+    constexpr int w {800}, h {800};
+    size_t frags {0};
+    const PPM_Image ref {ssaa_head(m, tex, 4, frags)};
+
+    auto report = [&](const std::string &name, const PPM_Image &img,
+            const double t, const size_t nfrags, const size_t bytes) {
+        std::cout << name << ": " << t / reps * 1E3 << " ms, " << nfrags /
+            reps << " fragments, " << bytes / 1024 << " KiB, PSNR " <<
+            psnr(img, ref) << " dB\n";
+    };
+    for (const int s: {1, 2}) {
+        PPM_Image img;
+        frags = 0;
+        const auto t0 = steady_clock::now();
+        for (int r {0}; r < reps; ++r)
+            img = ssaa_head(m, tex, s, frags);
+        const double t {duration<double>(steady_clock::now() - t0).count()};
+        // image and z-buffer at s times the resolution
+        report(s == 1 ? "no AA" : "SSAA 4x", img, t, frags,
+                size_t(w) * h * s * s * 2 * sizeof(uint));
+        if (s == 2)
+            img.write_to("ssaa4.ppm");
+    }
+    for (const int n: {2, 4, 8}) {
+        Msaa_buffer ms {w, h, n};
+        PPM_Image img;
+        frags = 0;
+        const auto t0 = steady_clock::now();
+        for (int r {0}; r < reps; ++r)
+            img = msaa_head(m, tex, ms, frags);
+        const double t {duration<double>(steady_clock::now() - t0).count()};
+        report("MSAA " + std::to_string(n) + "x", img, t, frags, ms.memory());
+        std::cout << "  " << ms.expanded() << " pixels with per-sample " <<
+            "colors (" << 100.0 * ms.expanded() / (w * h) << "%)\n";
+        if (n == 4)
+            img.write_to("msaa4.ppm");
+    }
+}
+
+// the depth-only pass against the full (textured) one from the light of a
+// 1024 shadow map: the raster loops alone (one thread, the triangles
+// transformed once) and the whole passes (vertex stage, binning, tiles);
+// then a frame with the shadow (the map and the shading pass) and a frame
+// with the z-prepass against the plain one
+void bench_shadow(const int reps = 10) {
+    using namespace std::chrono;
+    const Mesh mesh {Mesh::load("../obj/african_head.obj")};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d, Vec3d{1, 1, 0.5}.normalize())};
+    Thread_pool pool {};
+    Shadow_map sm {1024};
+    sm.look(S.L_dir);
+    const int n {sm.size()};
+
+    auto time = [&](auto f) {
+        const auto t0 = steady_clock::now();
+        for (int r {0}; r < reps; ++r)
+            f();
+        return duration<double>(steady_clock::now() - t0).count() / reps;
+    };
+    auto report = [](const char *name, const double full,
+            const double fast) {
+        std::cout << name << ": " << full * 1E3 << " ms -> " << fast * 1E3 <<
+            " ms (" << full / fast << "x)\n";
+    };
+
+    const size_t nfaces {mesh.num_faces()};
+    std::vector<Mat<3, 4, double>> pts(nfaces);
+    std::vector<Tex_shader> shaders(nfaces);
+    Vertex_cache vc;
+    vc.transform(mesh, sm.viewport(), projection(0), sm.modelview(), S.L_dir);
+    for (size_t i {0}; i < nfaces; ++i)
+        for (int j {0}; j < 3; ++j)
+            pts[i][j] = shaders[i].vertex(vc, i, j);
+    PPM_Image img {n, n};
+    Depth_buffer zbuf {n, n, 16};
+    const Raster_rect all {0, 0, n - 1, n - 1};
+    report("light view raster loops (textured -> depth only)", time([&] {
+        zbuf.clear();
+        for (size_t i {0}; i < nfaces; ++i)
+            triangle_shader(pts[i], shaders[i], img, tex, zbuf, all);
+    }), time([&] {
+        zbuf.clear();
+        for (size_t i {0}; i < nfaces; ++i)
+            depth_triangle(pts[i], zbuf, n, n, all, 0, false);
+    }));
+    report("light view passes (textured -> depth only)", time([&] {
+        zbuf.clear();
+        render_tiled(mesh, Tex_shader{}, sm.viewport(), projection(0),
+                sm.modelview(), S.L_dir, img, tex, zbuf, pool);
+    }), time([&] {
+        zbuf.clear();
+        render_depth(mesh, sm.viewport(), projection(0), sm.modelview(),
+                zbuf, n, n, pool, 64, nullptr, 0, false);
+    }));
+
+    PPM_Image frame {w, h};
+    Depth_buffer fz {w, h};
+    const double plain {time([&] {
+        fz.clear();
+        render_tiled(mesh, Tex_shader{}, S.Viewport, S.Proj, S.ModelView,
+                S.L_dir, frame, tex, fz, pool);
+    })};
+    const uint64_t shaded {fz.stats().shaded};
+    const double shadow {time([&] {
+        sm.render(mesh, S.L_dir, pool);
+        fz.clear();
+        render_tiled(mesh, Shadow_shader{sm}, S.Viewport, S.Proj, S.ModelView,
+                S.L_dir, frame, tex, fz, pool);
+    })};
+    std::cout << "frame: " << plain * 1E3 << " ms, with the shadow " <<
+        shadow * 1E3 << " ms\n";
+    const double pre {time([&] {
+        fz.clear();
+        z_prepass(mesh, S.Viewport, S.Proj, S.ModelView, fz, w, h, pool);
+        fz.reset_stats();
+        render_tiled(mesh, Tex_shader{}, S.Viewport, S.Proj, S.ModelView,
+                S.L_dir, frame, tex, fz, pool);
+    })};
+    std::cout << "z-prepass: " << plain * 1E3 << " ms -> " << pre * 1E3 <<
+        " ms, fragments shaded " << shaded << " -> " << fz.stats().shaded <<
+        '\n';
+    // the shadow map shader (PCF) costs more per fragment than the prepass
+    // per pixel
+    sm.render(mesh, S.L_dir, pool);
+    const Shadow_shader ss {sm};
+    report("z-prepass of the shadow shader", time([&] {
+        fz.clear();
+        render_tiled(mesh, ss, S.Viewport, S.Proj, S.ModelView, S.L_dir, frame,
+                tex, fz, pool);
+    }), time([&] {
+        fz.clear();
+        z_prepass(mesh, S.Viewport, S.Proj, S.ModelView, fz, w, h, pool);
+        render_tiled(mesh, ss, S.Viewport, S.Proj, S.ModelView, S.L_dir, frame,
+                tex, fz, pool);
+    }));
+}
+
+// vertex stage of the texture scenes: the head in every viewport, one shader
+// (copy of proto) per face
+template <class Shader>
+void tex_scene(const Model &m, const Shader &proto,
+        const std::vector<Mat4d> &viewports, const Mat4d &Proj,
+        const Mat4d &ModelView, const Vec3d &L_dir,
+        std::vector<Mat<3, 4, double>> &pts, std::vector<Shader> &shaders) {
+    pts.clear();
+    shaders.clear();
+    for (const Mat4d &Viewport: viewports)
+        for (size_t i {0}; i < m.num_faces(); ++i) {
+            shaders.push_back(proto);
+            Mat<3, 4, double> p;
+            for (int j {0}; j < 3; ++j)
+                p[j] = shaders.back().vertex(m, Viewport, Proj, ModelView,
+                        L_dir, i, j);
+            pts.push_back(p);
+        }
+}
+
+// time of reps passes of f(i), i < n
+template <class F>
+double time_loop(const size_t n, const int reps, F f) {
+    using namespace std::chrono;
+    const auto t0 = steady_clock::now();
+    for (int r {0}; r < reps; ++r)
+        for (size_t i {0}; i < n; ++i)
+            f(i);
+    return duration<double>(steady_clock::now() - t0).count();
+}
+
+// generic template versus SIMD overload of a Vec/Mat kernel: ns per call
+// and a bitwise comparison of the results
+template <class T, class Generic, class Simd>
+void bench_kernel(const char *name, const size_t n, const int reps,
+        Generic generic, Simd fast) {
+    std::vector<T> a(n), b(n);
+    const double tg {time_loop(n, reps, [&](const size_t i) {
+            a[i] = generic(i); })};
+    const double ts {time_loop(n, reps, [&](const size_t i) {
+            b[i] = fast(i); })};
+    const bool same {!std::memcmp(a.data(), b.data(), n * sizeof(T))};
+    std::cout << name << ": generic " << tg / (n * reps) * 1E9 << " ns, " <<
+#ifdef VEC_SIMD
+        "simd " <<
+#else
+        "no simd " <<
+#endif
+        ts / (n * reps) * 1E9 << " ns" << (same ? "" : " (results differ)") <<
+        '\n';
+}
+
+// the Vec/Mat kernels on random data: the generic templates are called
+// explicitly, the plain calls pick the SIMD overloads
+void bench_simd(const size_t n = 4096, const int reps = 200) {
+    using Vec4f = Vec<4, float>;
+    using Mat4f = Mat<4, 4, float>;
+    std::mt19937 gen {42};
+    std::uniform_real_distribution<double> dist {-1, 1};
+    std::vector<Vec4d> v(n), u(n);
+    std::vector<Vec4f> vf(n), uf(n);
+    std::vector<Vec3d> v3(n), u3(n);
+    std::vector<Mat4d> A(n), B(n);
+    std::vector<Mat4f> Af(n), Bf(n);
+    std::vector<Mat<3, 4, double>> P(n);
+    for (size_t i {0}; i < n; ++i) {
+        for (int j {0}; j < 4; ++j) {
+            v[i][j] = dist(gen);
+            u[i][j] = dist(gen);
+            vf[i][j] = dist(gen);
+            uf[i][j] = dist(gen);
+            for (int k {0}; k < 4; ++k) {
+                A[i][j][k] = dist(gen);
+                B[i][j][k] = dist(gen);
+                Af[i][j][k] = dist(gen);
+                Bf[i][j][k] = dist(gen);
+                if (j < 3)
+                    P[i][j][k] = dist(gen);
+            }
+        }
+        v3[i] = Vec3d{v[i][0], v[i][1], v[i][2]};
+        u3[i] = Vec3d{u[i][0], u[i][1], u[i][2]};
+    }
+
+    bench_kernel<Vec4d>("mat4d * vec4d", n, reps, [&](const size_t i) {
+        return operator*<4, 4, double, double>(A[i], v[i]);
+    }, [&](const size_t i) { return A[i] * v[i]; });
+    bench_kernel<Vec3d>("mat3x4d * vec4d", n, reps, [&](const size_t i) {
+        return operator*<3, 4, double, double>(P[i], v[i]);
+    }, [&](const size_t i) { return P[i] * v[i]; });
+    bench_kernel<Mat4d>("mat4d * mat4d", n, reps, [&](const size_t i) {
+        return operator*<4, 4, 4, double, double>(A[i], B[i]);
+    }, [&](const size_t i) { return A[i] * B[i]; });
+    bench_kernel<Vec4f>("mat4f * vec4f", n, reps, [&](const size_t i) {
+        return operator*<4, 4, float, float>(Af[i], vf[i]);
+    }, [&](const size_t i) { return Af[i] * vf[i]; });
+    bench_kernel<Mat4f>("mat4f * mat4f", n, reps, [&](const size_t i) {
+        return operator*<4, 4, 4, float, float>(Af[i], Bf[i]);
+    }, [&](const size_t i) { return Af[i] * Bf[i]; });
+    bench_kernel<double>("dot vec4d", n, reps, [&](const size_t i) {
+        return operator*<4, double, double>(v[i], u[i]);
+    }, [&](const size_t i) { return v[i] * u[i]; });
+    bench_kernel<float>("dot vec4f", n, reps, [&](const size_t i) {
+        return operator*<4, float, float>(vf[i], uf[i]);
+    }, [&](const size_t i) { return vf[i] * uf[i]; });
+    // the cross product has 3 elements and the float normalization needs
+    // the double division of the generic one: no SIMD versions, these
+    // would not be faster
+    bench_kernel<Vec3d>("cross vec3d", n, reps, [&](const size_t i) {
+        return v3[i] ^ u3[i];
+    }, [&](const size_t i) { return v3[i] ^ u3[i]; });
+    bench_kernel<Vec4d>("normalize vec4d", n, reps, [&](const size_t i) {
+        Vec4d a {v[i]};
+        normalize<4, double>(a);
+        return a;
+    }, [&](const size_t i) {
+        Vec4d a {v[i]};
+        normalize(a);
+        return a;
+    });
+}
+
+// shader recording the texture coordinates of the fragments it shades
+struct Uv_sample {
+    double u;
+    double v;
+    double lod;
+};
+
+class Uv_recorder {
+public:
+    Uv_recorder(const Mat<2, 3, double> &uv, const double lod,
+            std::vector<Uv_sample> &out): uv_(uv), lod_{lod}, out_(out) {
+    }
+
+    bool fragment(const PPM_Image&, const Vec3d &bar, PPM_Color&) {
+        const auto uv = uv_ * bar;
+        out_.push_back({uv.x(), uv.y(), lod_});
+        return false;
+    }
+
+private:
+    Mat<2, 3, double> uv_;
+    double lod_;
+    std::vector<Uv_sample> &out_;
+};
+
+// time of reps frames: draw(i, zbuf) draws triangle i of ntris into img
+template <class Draw>
+double time_frames(PPM_Image &img, const size_t ntris, const int reps,
+        Draw draw) {
+    using namespace std::chrono;
+    const int w {img.width()}, h {img.height()};
+    double t {0};
+    for (int r {0}; r < reps; ++r) {
+        img = PPM_Image{w, h};
+        std::vector<int> zbuf(w * h, 0);
+        const auto t0 = steady_clock::now();
+        for (size_t i {0}; i < ntris; ++i)
+            draw(i, zbuf);
+        t += duration<double>(steady_clock::now() - t0).count();
+    }
+    return t;
+}
+
+// time of reps texture lookups of the fragments: the colors are summed, so
+// that the compiler keeps them
+template <class Sample>
+double time_lookups(const std::vector<Uv_sample> &frags, const int reps,
+        uint &sum, Sample sample) {
+    using namespace std::chrono;
+    const auto t0 = steady_clock::now();
+    for (int r {0}; r < reps; ++r)
+        for (const Uv_sample &uv: frags)
+            sum += sample(uv);
+    return duration<double>(steady_clock::now() - t0).count();
+}
+
+// texture-bound fragment throughput: the point sample of the PPM_Image
+// (Tex_shader) versus the mipmapped Texture (Mip_shader) with every filter,
+// on the head at the usual size and on a grid of 100 minified heads (about
+// 8 texels per pixel). Whole frames are timed, then the texture lookups
+// alone: the uv (and LOD) of every shaded fragment, in the raster order, are
+// recorded and sampled again. The nearest filter without mipmaps has to give
+// the image of Tex_shader
+void bench_texture(const int reps = 10) {
+    using namespace std::chrono;
+    const Model m {"../obj/african_head.obj"};
+    const PPM_Image img_tex {"../obj/african_head_diffuse.ppm"};
+    auto t0 = steady_clock::now();
+    const Texture tex {img_tex};
+    std::cout << "texture: " << tex.levels() << " levels, " <<
+        tex.memory() / 1024 << " KiB, built in " <<
+        duration<double>(steady_clock::now() - t0).count() * 1E3 << " ms\n";
+
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+    std::vector<Mat4d> minified;
+    for (int gy {0}; gy < 10; ++gy)
+        for (int gx {0}; gx < 10; ++gx)
+            minified.push_back(viewport(gx * 80 + 8, gy * 80 + 8, 64, 64, d));
+    const std::vector<Mat4d> scenes[2] {{S.Viewport}, minified};
+
+    struct Filter {
+        const char *name;
+        Tex_filter f;
+        bool mipmaps;
+    };
+    const Filter filters[] {{"nearest, level 0", Tex_filter::nearest, false},
+        {"nearest", Tex_filter::nearest, true},
+        {"bilinear", Tex_filter::bilinear, true},
+        {"trilinear", Tex_filter::trilinear, true}};
+
+    for (int s {0}; s < 2; ++s) {
+        std::cout << (s ? "minified heads:\n" : "head:\n");
+        std::vector<Mat<3, 4, double>> pts;
+        std::vector<Tex_shader> tshaders;
+        tex_scene(m, Tex_shader{}, scenes[s], S.Proj, S.ModelView, S.L_dir,
+                pts, tshaders);
+        std::vector<Mip_shader> mshaders;
+        tex_scene(m, Mip_shader{tex}, scenes[s], S.Proj, S.ModelView,
+                S.L_dir, pts, mshaders);
+
+        // fragments shaded in a frame, with their uv and LOD
+        std::vector<Uv_sample> frags;
+        {
+            PPM_Image img {w, h};
+            std::vector<int> zbuf(w * h, 0);
+            for (size_t i {0}; i < pts.size(); ++i) {
+                const size_t f {i % m.num_faces()};
+                Mat<2, 3, double> uv;
+                for (int j {0}; j < 3; ++j)
+                    uv.fill_col(j, resize<2>(m.texvertex(f, j)));
+                Uv_recorder rec {uv, mshaders[i].lod(), frags};
+                triangle_shader(pts[i], rec, img, img_tex, zbuf);
+            }
+        }
+        const double nfrags = frags.size();
+        double lod {0};
+        for (const Uv_sample &f: frags)
+            lod += f.lod;
+        std::cout << "  " << frags.size() << " fragments, mean LOD " <<
+            lod / nfrags << '\n';
+
+        PPM_Image ref {w, h};
+        uint sum {0};
+        double t = time_frames(ref, pts.size(), reps,
+                [&](const size_t i, std::vector<int> &zbuf) {
+            triangle_shader(pts[i], tshaders[i], ref, img_tex, zbuf);
+        });
+        double tl = time_lookups(frags, reps, sum, [&](const Uv_sample &uv) {
+            return img_tex.color(uv.u * img_tex.width(),
+                    img_tex.height() * (1 - uv.v)).color();
+        });
+        std::cout << "  PPM_Image point sample: frames " <<
+            nfrags * reps / t * 1E-6 << " Mfragments/s, lookups " <<
+            nfrags * reps / tl * 1E-6 << " Msamples/s\n";
+
+        for (const Filter &f: filters) {
+            tex_scene(m, Mip_shader{tex, f.f, f.mipmaps}, scenes[s], S.Proj,
+                    S.ModelView, S.L_dir, pts, mshaders);
+            PPM_Image img {w, h};
+            t = time_frames(img, pts.size(), reps,
+                    [&](const size_t i, std::vector<int> &zbuf) {
+                triangle_shader(pts[i], mshaders[i], img, img_tex, zbuf);
+            });
+            tl = time_lookups(frags, reps, sum, [&](const Uv_sample &uv) {
+                return tex.sample(uv.u, uv.v, f.mipmaps ? uv.lod : 0,
+                        f.f).color();
+            });
+            const bool same {same_image(img, ref)};
+            std::cout << "  Texture " << f.name << ": frames " <<
+                nfrags * reps / t * 1E-6 << " Mfragments/s, lookups " <<
+                nfrags * reps / tl * 1E-6 << " Msamples/s" <<
+                (same ? " (same image)" : "") << '\n';
+            if (s && f.f == Tex_filter::trilinear)
+                img.write_to("minified.ppm");
+        }
+        if (!sum)
+            std::cout << "  (all the lookups are black)\n";
+    }
+}
+
+// the head of test_proj drawn with the shader of a precision policy
+template <class Shader>
+PPM_Image render_head(const Model &m, const PPM_Image &tex, double &t) {
+    using namespace std::chrono;
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+
+    PPM_Image img {w, h};
+    std::vector<int> zbuf(w * h, 0);
+    const auto t0 = steady_clock::now();
+    Shader shader;
+    for (size_t i {0}; i < m.num_faces(); ++i) {
+        Mat<3, 4, typename Shader::real> pts;
+        for (int j {0}; j < 3; ++j)
+            pts[j] = shader.vertex(m, S.Viewport, S.Proj, S.ModelView, S.L_dir,
+                    i, j);
+        triangle_shader(pts, shader, img, tex, zbuf);
+    }
+    t = duration<double>(steady_clock::now() - t0).count();
+    return img;
+}
+
+// the float and the 28.4 fixed-point pipelines against the double one: the
+// images may differ only by a little (the float depths break some ties
+// differently, the pixel centers of the sub-pixel rasterizer move the edges
+// and the texture lookups by half a pixel), and the sub-pixel triangles of a
+// mesh have to cover every pixel exactly once
+void test_precision() {
+    const Model m {"../obj/african_head.obj"};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+
+    double t;
+    const PPM_Image ref {render_head<Tex_shader>(m, tex, t)};
+    std::cout << "precision: " << Prec_double::name << " " << t * 1E3 <<
+        " ms\n";
+    // image, share of the pixels which may differ, least PSNR (dB)
+    struct Policy {
+        const char *name;
+        PPM_Image img;
+        double t, max_diff, min_psnr;
+    };
+    double tf, tx;
+    const Policy policies[] {
+        {Prec_float::name, render_head<Tex_shader_p<Prec_float>>(m, tex, tf),
+            tf, 0.001, 60},
+        {Prec_fixed::name, render_head<Tex_shader_p<Prec_fixed>>(m, tex, tx),
+            tx, 0.2, 35}};
+    const int w {ref.width()}, h {ref.height()};
+    for (const Policy &p: policies) {
+        size_t diff {0};
+        int max_ch {0};
+        double se {0};
+        for (int y {0}; y < h; ++y)
+            for (int x {0}; x < w; ++x) {
+                const uint a {ref.row(y)[x]}, b {p.img.row(y)[x]};
+                if (a == b)
+                    continue;
+                ++diff;
+                for (int s {0}; s <= 16; s += 8) {
+                    const int c {int(a >> s & 0xff) - int(b >> s & 0xff)};
+                    max_ch = std::max(max_ch, std::abs(c));
+                    se += c * c;
+                }
+            }
+        const double mse {se / (3.0 * w * h)};
+        const double psnr {mse > 0 ? 10 * std::log10(255 * 255 / mse) : 99};
+        const bool ok {diff <= p.max_diff * w * h && psnr >= p.min_psnr};
+        std::cout << "  " << p.name << ": " << p.t * 1E3 << " ms, " << diff <<
+            " pixels differ (" << 100.0 * diff / (w * h) <<
+            "%), max channel difference " << max_ch << ", PSNR " << psnr <<
+            " dB" << (ok ? "" : " (out of bounds)") << '\n';
+    }
+
+    // fill rule: a grid of cells (two triangles each) with jittered vertices,
+    // a lot of them exactly on pixel centers and on the pixel borders
+    constexpr int gw {64}, gh {64}, cell {4}, bits {Prec_fixed::sub_bits};
+    constexpr int unit {1 << bits}, n {gw / cell};
+    std::mt19937 gen {17};
+    std::uniform_int_distribution<int> jitter {-2, 2};
+    std::vector<Vec<2, int>> grid;
+    for (int j {0}; j <= n; ++j)
+        for (int i {0}; i <= n; ++i) {
+            const int jx {i > 0 && i < n ? jitter(gen) * unit / 4 : 0};
+            const int jy {j > 0 && j < n ? jitter(gen) * unit / 4 : 0};
+            grid.push_back({i * cell * unit + jx, j * cell * unit + jy});
+        }
+    std::vector<int> fixed(gw * gh, 0), whole(gw * gh, 0);
+    const Raster_rect r {0, 0, gw - 1, gh - 1};
+    for (int j {0}; j < n; ++j)
+        for (int i {0}; i < n; ++i) {
+            const Vec<2, int> &p00 = grid[j * (n + 1) + i],
+                  &p10 = grid[j * (n + 1) + i + 1],
+                  &p01 = grid[(j + 1) * (n + 1) + i],
+                  &p11 = grid[(j + 1) * (n + 1) + i + 1];
+            // the diagonal alternates, and so does the winding
+            const bool alt {((i + j) & 1) != 0};
+            const Vec<2, int> tris[2][3] {{p00, p10, alt ? p11 : p01},
+                {alt ? p00 : p10, p11, p01}};
+            for (const auto &tri: tris) {
+                const Edge_tri ft {tri[0], tri[1], tri[2], bits};
+                for_each_covered(ft, r, [&](const int x, const int y,
+                            const int, const int) { ++fixed[x + y * gw]; });
+                const Edge_tri wt {tri[0] / unit, tri[1] / unit, tri[2] / unit};
+                for_each_covered(wt, r, [&](const int x, const int y,
+                            const int, const int) { ++whole[x + y * gw]; });
+            }
+        }
+    const auto wrong = [](const std::vector<int> &c) {
+        return std::count_if(c.begin(), c.end(), [](const int k) {
+            return k != 1;
+        });
+    };
+    std::cout << "  fill rule: " << wrong(fixed) << " of " << gw * gh <<
+        " pixels not covered exactly once (" << wrong(whole) <<
+        " with whole pixels)\n";
+}
+
+// turntable of the head: the model and the texture are loaded once, the
+// frames are written by the background thread. First two cameras alternate
+// in a pool of two framebuffers: every frame has to be the image of its
+// camera (the one of test_proj for the first), whichever buffer it got
+void test_sequence(const int nframes = 72) {
+    const Model m {"../obj/african_head.obj"};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+    constexpr int w {800}, h {800};
+    constexpr Vec3d L_dir {Vec3d{1, 1, 1}.normalize()};
+    Thread_pool pool {};
+
+    double t;
+    const PPM_Image ref {render_head<Tex_shader>(m, tex, t)};
+    const Camera a {{1, 1, 3}, {0, 0, 0}, {0, 1, 0}},
+          b {{-2, 0.5, 2}, {0, 0, 0}, {0, 1, 0}};
+    const std::vector<Camera> path {a, b, a, b, a, b};
+    render_sequence(m, Tex_shader{}, tex, path, L_dir, w, h, "seq_", pool, 2);
+    const PPM_Image first {frame_name("seq_", 1)};
+    bool same {true};
+    for (size_t i {0}; i < path.size(); ++i) {
+        const PPM_Image img {frame_name("seq_", i)};
+        const PPM_Image &expected = i & 1 ? first : ref;
+        same = same && same_image(img, expected);
+    }
+    std::cout << "sequence: " << path.size() << " frames in 2 framebuffers " <<
+        (same ? "are the images of their cameras" : "DIFFER") << '\n';
+
+    std::cout << "turntable: " << render_sequence(m, Tex_shader{}, tex,
+            orbit({0, 0, 0}, std::sqrt(10.0), 1, nframes), L_dir, w, h,
+            "turn_", pool);
+}
+
+// the head lit from the side with the shadow of the PCF shadow map
+// (shadow.ppm, the map itself in shadow_map.ppm), and the z-prepass: the
+// image of the plain pass with every visible pixel shaded once
+void test_shadow() {
+    const Mesh mesh {Mesh::load("../obj/african_head.obj")};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d, Vec3d{1, 1, 0.5}.normalize())};
+    Thread_pool pool {};
+
+    Shadow_map sm {1024};
+    sm.render(mesh, S.L_dir, pool);
+    PPM_Image img {w, h};
+    Depth_buffer zbuf {w, h};
+    render_tiled(mesh, Shadow_shader{sm}, S.Viewport, S.Proj, S.ModelView,
+            S.L_dir, img, tex, zbuf, pool);
+    img.write_to("shadow.ppm");
+    const int n {sm.size()};
+    PPM_Image map {n, n};
+    for (int y {0}; y < n; ++y)
+        for (int x {0}; x < n; ++x)
+            map.set_color(x, n - 1 - y, sm.depth().depth8(x + size_t(y) * n));
+    map.write_to("shadow_map.ppm");
+
+    PPM_Image ref {w, h};
+    zbuf.clear();
+    render_tiled(mesh, Tex_shader{}, S.Viewport, S.Proj, S.ModelView, S.L_dir,
+            ref, tex, zbuf, pool);
+    const uint64_t shaded {zbuf.stats().shaded};
+    img.clear();
+    zbuf.clear();
+    z_prepass(mesh, S.Viewport, S.Proj, S.ModelView, zbuf, w, h, pool);
+    zbuf.reset_stats();
+    render_tiled(mesh, Tex_shader{}, S.Viewport, S.Proj, S.ModelView, S.L_dir,
+            img, tex, zbuf, pool);
+    const bool same {same_image(img, ref)};
+    const Depth_stats st {zbuf.stats()};
+    std::cout << "z-prepass: " << shaded << " -> " << st.shaded <<
+        " fragments shaded, " << st.visible << " visible pixels, " <<
+        (same ? "same image" : "image DIFFERS") << '\n';
+}
+
+// profiled run (make profile && ./profile): the head is loaded (the OBJ and
+// the mesh cache) and a few frames of a turntable are rendered by tiles, with
+// the primitive assembly and the hierarchical z-buffer, the last one written;
+// the stages and the counters are printed and dumped, the timeline is
+// written for a trace viewer (chrome://tracing, ui.perfetto.dev)
+void profile_frames(const int nframes = 8) {
+    prof_reset();
+    Thread_pool pool {};
+    const Model m {"../obj/african_head.obj", pool};
+    const Mesh mesh {Mesh::load("../obj/african_head.obj", pool)};
+    const PPM_Image tex {"../obj/african_head_diffuse.ppm"};
+
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+    PPM_Image img {w, h};
+    Depth_buffer zbuf {w, h};
+    Primitive_assembly pa {w, h};
+    for (const Camera &c: orbit({0, 0, 0}, std::sqrt(10.0), 1, nframes)) {
+        PROF_SCOPE("frame");
+        img.clear();
+        zbuf.clear();
+        render_tiled(mesh, Tex_shader{}, S.Viewport,
+                projection(-1.0 / (c.eye - c.center).norm()),
+                lookat(c.eye, c.center, c.up), S.L_dir, img, tex, zbuf, pool,
+                64, &pa);
+    }
+    img.write_to("profile.ppm");
+    std::cout << "model: " << m.num_faces() << " faces, " << nframes <<
+        " frames\n";
+    prof_print();
+    prof_write_json("profile.json");
+    prof_write_csv("profile.csv");
+    prof_write_trace("trace.json");
+}
+
+// the camera rig of the tests is evaluated by the compiler (the
+// static_asserts do not compile otherwise), and to the same bits as at run
+// time: the square roots and the transforms are compared with the ones built
+// from values the compiler cannot see
+void test_constexpr() {
+    constexpr int w {800}, h {800}, d {255};
+    constexpr Scene S {head_scene(w, h, d)};
+    constexpr Mat4d Z {S.Viewport * S.Proj * S.ModelView};
+
+    static_assert(const_sqrt(4) == 2 && const_sqrt(0x1p-1074) == 0x1p-537,
+            "const_sqrt");
+    static_assert(const_sqrt(2) == 1.4142135623730951, "const_sqrt");
+    static_assert(Vec3d{3, 0, 4}.norm() == 5, "norm");
+    static_assert(resize<2>(Vec3d{1, 2, 3}) == Vec<2, double>{1, 2},
+            "resize");
+    static_assert(S.Viewport[0][0] == 300 && S.Viewport[0][3] == 400 &&
+            S.Viewport[2][2] == 127.5, "viewport");
+    static_assert(S.Proj[3][2] == -1 / const_sqrt(11), "projection");
+    static_assert(S.ModelView[2][0] == 1 / const_sqrt(11) &&
+            S.ModelView[2][2] == 3 / const_sqrt(11), "lookat");
+    static_assert(S.ModelView * Vec4d{0, 0, 0, 1} == Vec4d{0, 0, 0, 1},
+            "lookat");
+    static_assert(eye<4>() * Z == Z && Z.transpose().transpose() == Z,
+            "multiply, transpose");
+    static_assert(det(S.Viewport) == 300 * 300 * 127.5, "det");
+    static_assert(inverse(S.Viewport) * S.Viewport == Mat4d{eye<4>()},
+            "inverse");
+    static_assert(inverse(Z) * Z == Mat4d{eye<4>()}, "inverse");
+
+    std::mt19937_64 gen {1};
+    std::uniform_real_distribution<double> dist {-300, 300};
+    int nsqrt {0}, ndiff {0};
+    for (; nsqrt < 1000000; ++nsqrt) {
+        const double x {std::exp2(dist(gen))};
+        const float xf {float(x)};
+        if (const_sqrt(x) != std::sqrt(x) ||
+                float(const_sqrt(xf)) != std::sqrt(xf))
+            ++ndiff;
+    }
+    // the same rig from volatile values: computed at run time
+    volatile double eye_z {3};
+    volatile int vp_w {(w >> 2) * 3};
+    const Vec3d Eye_rt {1, 1, eye_z};
+    const Mat4d Z_rt {viewport(w >> 3, h >> 3, vp_w, (h >> 2) * 3, d) *
+        projection(-1.0 / (Eye_rt - S.Center).norm()) *
+            lookat(Eye_rt, S.Center, S.Up)};
+    const bool same {std::memcmp(&Z, &Z_rt, sizeof(Mat4d)) == 0};
+    std::cout << "constexpr: " << ndiff << " of " << nsqrt <<
+        " square roots differ, the camera transform is " <<
+        (same ? "identical" : "DIFFERENT") << '\n';
+}
+
 void test_camera() {
     using namespace std;
     const Model m {"../obj/african_head.obj"};
@@ -55,14 +1542,13 @@ void test_camera() {
     vector<int> zbuf(w * h, 0);
     PPM_Image img {w, h};
 
-    const Vec3d light_dir {Vec3d{1, -1, 1}.normalize()}, Eye {1, 1, 3},
+    constexpr Vec3d light_dir {Vec3d{1, -1, 1}.normalize()}, Eye {1, 1, 3},
           center {0, 0, 0};
-    const Mat4d ModelView {lookat(Eye, center, Vec3d{0, 1, 0})};
-    const Mat4d VP {viewport(w >> 3, h >> 3, (w >> 2) * 3,
+    constexpr Mat4d ModelView {lookat(Eye, center, Vec3d{0, 1, 0})};
+    constexpr Mat4d VP {viewport(w >> 3, h >> 3, (w >> 2) * 3,
             (h >> 2) * 3, d)};
-    Mat4d Proj = eye<4>();
-    Proj[3][2] = -1.0 / (Eye - center).norm();
-    const Mat4d Z {VP * Proj * ModelView};
+    constexpr Mat4d Proj {projection(-1.0 / (Eye - center).norm())};
+    constexpr Mat4d Z {VP * Proj * ModelView};
     //cout << ModelView << Proj << VP << Z;
     //cout << mat_minor(Z, 0, 0) << '\n';
     for (size_t i {0}; i < m.num_faces(); ++i) {
@@ -85,16 +1571,45 @@ void test_camera() {
     img.write_to("gouraud.ppm");
 
     PPM_Image zbimg {w, h};
-    for (int i {0}; i < w; ++i)
-        for (int j {0}; j < h; ++j)
+    for (int j {0}; j < h; ++j)
+        for (int i {0}; i < w; ++i)
             zbimg.set_color(i, j, zbuf[i + j * w]);
     zbimg.write_to("zbuffer.ppm");
 }
 
 int main() {
 
+#if defined(PROFILE)
+    profile_frames();
+#elif defined(BENCH)
+    bench_obj_load();
+    bench_mesh_cache();
+    bench_vertex();
+    bench_raster();
+    bench_dispatch<Gouraud_shader>("gouraud");
+    bench_dispatch<Tex_shader>("texture");
+    bench_hiz();
+    bench_assembly();
+    bench_deferred();
+    bench_texture();
+    bench_sequence();
+    bench_msaa();
+    bench_shadow();
+    bench_simd();
+#else
     test_camera();
+    //test_constexpr();
+    //test_precision();
+    //test_sequence();
+    //test_shadow();
     //test_proj();
+    //test_tiles();
+    //test_pool_errors();
+    //test_clip_varyings();
+    //test_mesh();
+    //test_obj_indices();
+    //test_mesh_cache();
+#endif
 
     return 0;
 }